@@ -0,0 +1,675 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/*
+ * Benchmark suite of the CPU pipeline. A deterministic synthetic DNA pair
+ * is generated and the following components are measured:
+ *
+ *  - CPUBlockProcessor and SIMDBlockProcessor (cells/second);
+ *  - Buffer2 throughput between a producer and a consumer thread;
+ *  - SpecialRowFile and SpecialRowRAM write/read bandwidth;
+ *  - stage #1 with AbstractBlockAligner, with and without BlockPruningGenericN2;
+ *  - stage #4 with each one of the strategies.
+ *
+ * The pipeline cases run libmasa_entry_point in a child process and read
+ * the times from the statistics files of the work directory. The results
+ * are written to the standard output in JSON format; the progress and the
+ * output of the child processes go to the standard error and to log files.
+ *
+ * Usage: gcups_benchmark [options]
+ *   --length=N            length of the first sequence (default 20000).
+ *   --similarity=F        probability of keeping a base (default 0.90).
+ *   --indel-rate=F        probability of an insertion/deletion per base (default 0.01).
+ *   --repeats=F           approximate fraction of repeated bases (default 0.05).
+ *   --repeat-length=N     length of each repeated segment (default 200).
+ *   --seed=N              seed of the generator (default 1).
+ *   --repetitions=N       repetitions of the micro-benchmarks, the best one
+ *                         is reported (default 3).
+ *   --work-dir=DIR        directory of the temporary files (default: a new
+ *                         directory in /tmp, removed at the end).
+ *   --no-pipeline         skips the stage #1 and stage #4 cases.
+ *   --generate            only writes the sequences to the work directory.
+ *
+ * Build with "make gcups_benchmark".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+using namespace std;
+
+#include "../libmasa/libmasa.hpp"
+#include "../common/io/Buffer2.hpp"
+#include "../common/sra/SpecialRowFile.hpp"
+#include "../common/sra/SpecialRowRAM.hpp"
+
+/** Number of cells transferred in each Buffer2/SpecialRow call */
+#define CHUNK_CELLS		(4*1024)
+
+/** Capacity of the Buffer2 in cells */
+#define BUFFER2_CELLS	(64*1024)
+
+/** Number of special rows written in the SpecialRow cases */
+#define SPECIAL_ROWS	(16)
+
+/** Names of the stage #4 strategies, in the order of the Job constants */
+static const char* stage4_strategies[] = {"ORIGINAL_MM", "ORTHOGONAL", "OPTIMIZED", "SIMD", NULL};
+
+/**
+ * Parameters of the synthetic pair of sequences.
+ */
+struct synthetic_params_t {
+	int length;
+	double similarity;
+	double indel_rate;
+	double repeats;
+	int repeat_length;
+	unsigned long long seed;
+};
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/* xorshift64* generator, so the sequences do not depend on the libc rand() */
+static unsigned long long next_random(unsigned long long* state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+static double next_uniform(unsigned long long* state) {
+	return (next_random(state) >> 11) * (1.0/9007199254740992.0);
+}
+
+static char random_base(unsigned long long* state) {
+	return "ACGT"[next_random(state) >> 62];
+}
+
+/**
+ * Generates the pair of sequences. The first sequence is random, except
+ * for copies of earlier segments that account for the repeats fraction.
+ * The second one is derived from the first: each base is deleted or
+ * preceded by a random insertion with probability indel_rate, and
+ * replaced by a different base with probability (1-similarity).
+ */
+static void generate_pair(const synthetic_params_t& params, string& seq0, string& seq1) {
+	unsigned long long state = params.seed*0x9E3779B97F4A7C15ULL + 1;
+	double repeat_probability = params.repeats/params.repeat_length;
+
+	seq0.clear();
+	seq0.reserve(params.length);
+	while ((int)seq0.size() < params.length) {
+		int len = seq0.size();
+		if (len > params.repeat_length && next_uniform(&state) < repeat_probability) {
+			int start = next_random(&state) % (len - params.repeat_length);
+			for (int k = 0; k < params.repeat_length; k++) {
+				seq0.push_back(seq0[start+k]);
+			}
+		} else {
+			seq0.push_back(random_base(&state));
+		}
+	}
+	seq0.resize(params.length);
+
+	seq1.clear();
+	seq1.reserve(params.length + params.length/8);
+	for (int i = 0; i < params.length; i++) {
+		double u = next_uniform(&state);
+		if (u < params.indel_rate/2) {
+			continue;
+		} else if (u < params.indel_rate) {
+			seq1.push_back(random_base(&state));
+		}
+		if (next_uniform(&state) < params.similarity) {
+			seq1.push_back(seq0[i]);
+		} else {
+			int base = strchr("ACGT", seq0[i]) - "ACGT";
+			seq1.push_back("ACGT"[(base + 1 + next_random(&state)%3) % 4]);
+		}
+	}
+}
+
+static void write_fasta(const string& filename, const char* name, const string& seq) {
+	FILE* file = fopen(filename.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not create file: %s\n", filename.c_str());
+		exit(1);
+	}
+	fprintf(file, ">%s\n", name);
+	for (int i = 0; i < (int)seq.size(); i += 80) {
+		fprintf(file, "%s\n", seq.substr(i, 80).c_str());
+	}
+	fclose(file);
+}
+
+/**
+ * Computes the whole SW matrix with the given block processor, block by
+ * block in row-major order.
+ *
+ * @return the time in seconds.
+ */
+static double run_block_processor(AbstractBlockProcessor* processor, const string& seq0, const string& seq1,
+		int block_size, score_t* best) {
+	int m = seq0.size();
+	int n = seq1.size();
+	cell_t* row = (cell_t*)malloc(n*sizeof(cell_t));
+	cell_t* col = (cell_t*)malloc((block_size+1)*sizeof(cell_t));
+	for (int j = 0; j < n; j++) {
+		row[j].h = 0;
+		row[j].e = -INF;
+	}
+	processor->setSequences(seq0.data(), seq1.data(), m, n);
+
+	best->score = -INF;
+	double t0 = now();
+	for (int i0 = 0; i0 < m; i0 += block_size) {
+		int i1 = (i0 + block_size < m) ? i0 + block_size : m;
+		for (int k = 0; k <= i1-i0; k++) {
+			col[k].h = 0;
+			col[k].e = -INF;
+		}
+		for (int j0 = 0; j0 < n; j0 += block_size) {
+			int j1 = (j0 + block_size < n) ? j0 + block_size : n;
+			score_t score = processor->processBlock(row+j0, col, i0, j0, i1, j1, SMITH_WATERMAN);
+			if (score.score > best->score) {
+				*best = score;
+			}
+		}
+	}
+	double t1 = now();
+
+	processor->unsetSequences();
+	free(row);
+	free(col);
+	return t1-t0;
+}
+
+struct buffer2_args_t {
+	Buffer2* buffer;
+	long long cells;
+};
+
+static void* buffer2_producer(void* arg) {
+	buffer2_args_t* args = (buffer2_args_t*)arg;
+	cell_t chunk[CHUNK_CELLS];
+	for (int k = 0; k < CHUNK_CELLS; k++) {
+		chunk[k].h = k;
+		chunk[k].e = -k;
+	}
+	for (long long sent = 0; sent < args->cells; sent += CHUNK_CELLS) {
+		args->buffer->writeBuffer(chunk, CHUNK_CELLS);
+	}
+	return NULL;
+}
+
+/**
+ * Transfers the cells from a producer thread to the current thread.
+ *
+ * @return the time in seconds, or a negative value if the data is corrupted.
+ */
+static double run_buffer2(long long cells) {
+	Buffer2* buffer = new Buffer2(BUFFER2_CELLS);
+	buffer2_args_t args;
+	args.buffer = buffer;
+	args.cells = cells;
+
+	cell_t chunk[CHUNK_CELLS];
+	bool ok = true;
+	double t0 = now();
+	pthread_t thread;
+	pthread_create(&thread, NULL, buffer2_producer, &args);
+	for (long long received = 0; received < cells; received += CHUNK_CELLS) {
+		buffer->readBuffer(chunk, CHUNK_CELLS);
+		ok &= (chunk[CHUNK_CELLS-1].h == CHUNK_CELLS-1);
+	}
+	pthread_join(thread, NULL);
+	double t1 = now();
+
+	delete buffer;
+	return ok ? t1-t0 : -1;
+}
+
+/**
+ * Writes SPECIAL_ROWS rows with the given length and then reads them back
+ * in the reverse direction, as stage #2 does.
+ *
+ * @return false if the data read is different from the data written.
+ */
+static bool run_special_rows(bool ram, string* path, int length, double* write_time, double* read_time) {
+	SpecialRow* rows[SPECIAL_ROWS];
+	cell_t chunk[CHUNK_CELLS];
+	bool ok = true;
+
+	double t0 = now();
+	for (int r = 0; r < SPECIAL_ROWS; r++) {
+		if (ram) {
+			rows[r] = new SpecialRowRAM(r);
+		} else {
+			rows[r] = new SpecialRowFile(path, r);
+		}
+		rows[r]->open(false, length);
+		for (int pos = 0; pos < length; pos += CHUNK_CELLS) {
+			int len = (length-pos < CHUNK_CELLS) ? length-pos : CHUNK_CELLS;
+			for (int k = 0; k < len; k++) {
+				chunk[k].h = pos+k;
+				chunk[k].e = r;
+			}
+			rows[r]->write(chunk, len);
+		}
+		rows[r]->close();
+	}
+	double t1 = now();
+	for (int r = 0; r < SPECIAL_ROWS; r++) {
+		if (!ram) {
+			delete rows[r];
+			rows[r] = new SpecialRowFile(path, r);
+		}
+		rows[r]->open(true);
+		rows[r]->seek(length);
+		for (int pos = length; pos > 0; ) {
+			int len = rows[r]->read(chunk, CHUNK_CELLS);
+			pos -= len;
+			/* the cells are returned in the reverse order */
+			ok &= (chunk[0].h == pos+len-1 && chunk[len-1].h == pos && chunk[0].e == r);
+		}
+		rows[r]->close();
+	}
+	double t2 = now();
+	for (int r = 0; r < SPECIAL_ROWS; r++) {
+		rows[r]->truncateRow(0);
+		delete rows[r];
+	}
+
+	*write_time = t1-t0;
+	*read_time = t2-t1;
+	return ok;
+}
+
+/**
+ * Minimal block aligner that processes the whole grid with the given block
+ * processor, as the CUDAlign aligners do in the GPU. It can be cloned, so
+ * the stage #3 partitions are aligned concurrently.
+ */
+class BenchmarkAligner : public AbstractBlockAligner {
+public:
+	BenchmarkAligner(bool simd, BlockAlignerParameters* params = NULL)
+			: AbstractBlockAligner(createProcessor(simd), params) {
+		this->simd = simd;
+	}
+
+	virtual IAligner* clone() {
+		return new BenchmarkAligner(simd, (BlockAlignerParameters*)getParameters());
+	}
+private:
+	/** Uses the SIMDBlockProcessor instead of the CPUBlockProcessor */
+	bool simd;
+
+	static AbstractBlockProcessor* createProcessor(bool simd) {
+		if (simd) {
+			return new SIMDBlockProcessor();
+		} else {
+			return new CPUBlockProcessor();
+		}
+	}
+protected:
+	virtual void alignBlock(int bx, int by, int i0, int j0, int i1, int j1) {
+		cell_t firstColumnTail;
+		if (bx == 0) {
+			col[by][0] = getFirstColumnTail();
+			receiveFirstColumn(col[by]+1, i1-i0);
+			firstColumnTail = col[by][i1-i0];
+		}
+		if (by == 0) {
+			receiveFirstRow(row[bx], j1-j0);
+		}
+		processBlock(bx, by, i0, j0, i1, j1);
+		if (isSpecialRow(by)) {
+			if (bx == 0) dispatchRow(i1, &firstColumnTail, 1);
+			dispatchRow(i1, row[bx], j1-j0);
+		}
+		if (isSpecialColumn(bx)) {
+			if (by == 0) dispatchColumn(j1, col[by], i1-i0+1);
+			else dispatchColumn(j1, col[by]+1, i1-i0);
+		}
+	}
+};
+
+/**
+ * Executes libmasa_entry_point in a child process, so each case starts
+ * with a clean state. The output of the child goes to the log file.
+ *
+ * @return true if the child process finished successfully.
+ */
+static bool run_libmasa(bool simd, const char* log, int argc, const char** argv) {
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid == 0) {
+		if (freopen(log, "w", stdout) == NULL || dup2(fileno(stdout), fileno(stderr)) < 0) {
+			_exit(1);
+		}
+		optind = 1;
+		int ret = libmasa_entry_point(argc, (char**)argv, new BenchmarkAligner(simd));
+		fflush(stdout);
+		_exit(ret);
+	}
+	int status;
+	if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+		return false;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Reads the value that follows the given key in a statistics file.
+ *
+ * @return the value or a negative number if the key was not found.
+ */
+static double read_statistic(const string& filename, const char* key) {
+	FILE* file = fopen(filename.c_str(), "r");
+	if (file == NULL) {
+		return -1;
+	}
+	double value = -1;
+	char line[1024];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char* pos = strstr(line, key);
+		if (pos != NULL) {
+			value = atof(pos + strlen(key));
+		}
+	}
+	fclose(file);
+	return value;
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftw) {
+	return remove(path);
+}
+
+static void print_rate(const char* name, double value, bool last=false) {
+	printf("\"%s\": %.4f%s", name, value, last ? "" : ", ");
+}
+
+enum {
+	ARG_LENGTH = 1000,
+	ARG_SIMILARITY,
+	ARG_INDEL_RATE,
+	ARG_REPEATS,
+	ARG_REPEAT_LENGTH,
+	ARG_SEED,
+	ARG_REPETITIONS,
+	ARG_WORK_DIR,
+	ARG_NO_PIPELINE,
+	ARG_GENERATE
+};
+
+int main(int argc, char** argv) {
+	synthetic_params_t params;
+	params.length = 20000;
+	params.similarity = 0.90;
+	params.indel_rate = 0.01;
+	params.repeats = 0.05;
+	params.repeat_length = 200;
+	params.seed = 1;
+	int repetitions = 3;
+	string work_dir;
+	bool pipeline = true;
+	bool generate_only = false;
+
+	static struct option long_options[] = {
+		{"length",        required_argument, 0, ARG_LENGTH},
+		{"similarity",    required_argument, 0, ARG_SIMILARITY},
+		{"indel-rate",    required_argument, 0, ARG_INDEL_RATE},
+		{"repeats",       required_argument, 0, ARG_REPEATS},
+		{"repeat-length", required_argument, 0, ARG_REPEAT_LENGTH},
+		{"seed",          required_argument, 0, ARG_SEED},
+		{"repetitions",   required_argument, 0, ARG_REPETITIONS},
+		{"work-dir",      required_argument, 0, ARG_WORK_DIR},
+		{"no-pipeline",   no_argument,       0, ARG_NO_PIPELINE},
+		{"generate",      no_argument,       0, ARG_GENERATE},
+		{0, 0, 0, 0}
+	};
+	int c;
+	while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+		switch (c) {
+			case ARG_LENGTH:        params.length = atoi(optarg); break;
+			case ARG_SIMILARITY:    params.similarity = atof(optarg); break;
+			case ARG_INDEL_RATE:    params.indel_rate = atof(optarg); break;
+			case ARG_REPEATS:       params.repeats = atof(optarg); break;
+			case ARG_REPEAT_LENGTH: params.repeat_length = atoi(optarg); break;
+			case ARG_SEED:          params.seed = strtoull(optarg, NULL, 10); break;
+			case ARG_REPETITIONS:   repetitions = atoi(optarg); break;
+			case ARG_WORK_DIR:      work_dir = optarg; break;
+			case ARG_NO_PIPELINE:   pipeline = false; break;
+			case ARG_GENERATE:      generate_only = true; break;
+			default:
+				fprintf(stderr, "Unrecognized option. See the usage in %s.\n", __FILE__);
+				return 1;
+		}
+	}
+	if (params.length <= 0 || params.repeat_length <= 0 || repetitions <= 0) {
+		fprintf(stderr, "Invalid length or repetitions.\n");
+		return 1;
+	}
+
+	bool temporary_dir = work_dir.empty();
+	if (temporary_dir) {
+		char dir[] = "/tmp/gcups_benchmark.XXXXXX";
+		if (mkdtemp(dir) == NULL) {
+			perror("mkdtemp()");
+			return 1;
+		}
+		work_dir = dir;
+	} else {
+		mkdir(work_dir.c_str(), 0777);
+	}
+
+	string seq0;
+	string seq1;
+	generate_pair(params, seq0, seq1);
+	string fasta0 = work_dir + "/seq0.fasta";
+	string fasta1 = work_dir + "/seq1.fasta";
+	write_fasta(fasta0, "synthetic_0", seq0);
+	write_fasta(fasta1, "synthetic_1", seq1);
+	if (generate_only) {
+		fprintf(stderr, "Sequences written to %s and %s\n", fasta0.c_str(), fasta1.c_str());
+		return 0;
+	}
+
+	int errors = 0;
+	double cells = ((double)seq0.size())*seq1.size();
+
+	printf("{\n");
+	printf("  \"benchmark\": \"gcups_benchmark\",\n");
+	printf("  \"instruction_set\": \"%s\",\n",
+			SIMDBlockProcessor::getInstructionSetName(SIMDBlockProcessor::detectInstructionSet()));
+	printf("  \"sequences\": {\"length_0\": %d, \"length_1\": %d, \"similarity\": %.4f, \"indel_rate\": %.4f, "
+			"\"repeats\": %.4f, \"repeat_length\": %d, \"seed\": %llu},\n",
+			(int)seq0.size(), (int)seq1.size(), params.similarity, params.indel_rate,
+			params.repeats, params.repeat_length, params.seed);
+	printf("  \"repetitions\": %d,\n", repetitions);
+
+	/* Block processors */
+	fprintf(stderr, "Block processors...\n");
+	printf("  \"block_processors\": [\n");
+	score_t scores[2];
+	for (int p = 0; p < 2; p++) {
+		double best_time = 0;
+		for (int r = 0; r < repetitions; r++) {
+			AbstractBlockProcessor* processor;
+			if (p == 0) {
+				processor = new CPUBlockProcessor();
+			} else {
+				processor = new SIMDBlockProcessor();
+			}
+			double time = run_block_processor(processor, seq0, seq1, 1024, &scores[p]);
+			if (r == 0 || time < best_time) {
+				best_time = time;
+			}
+			delete processor;
+		}
+		printf("    {\"name\": \"%s\", ", p == 0 ? "CPUBlockProcessor" : "SIMDBlockProcessor");
+		printf("\"cells\": %.0f, ", cells);
+		print_rate("seconds", best_time);
+		print_rate("gcups", cells/best_time/1e9);
+		printf("\"score\": %d}%s\n", scores[p].score, p == 0 ? "," : "");
+	}
+	printf("  ],\n");
+	if (scores[0].score != scores[1].score) {
+		fprintf(stderr, "ERROR: different block processor scores: %d != %d\n", scores[0].score, scores[1].score);
+		errors++;
+	}
+
+	/* Buffer2 */
+	fprintf(stderr, "Buffer2...\n");
+	long long buffer_cells = 64LL*1024*1024;
+	double buffer_time = 0;
+	for (int r = 0; r < repetitions; r++) {
+		double time = run_buffer2(buffer_cells);
+		if (time < 0) {
+			fprintf(stderr, "ERROR: corrupted data in Buffer2\n");
+			errors++;
+		} else if (buffer_time == 0 || time < buffer_time) {
+			buffer_time = time;
+		}
+	}
+	printf("  \"buffer2\": {\"cells\": %lld, ", buffer_cells);
+	print_rate("seconds", buffer_time);
+	print_rate("mb_per_second", buffer_cells*sizeof(cell_t)/buffer_time/1e6, true);
+	printf("},\n");
+
+	/* Special rows */
+	fprintf(stderr, "Special rows...\n");
+	string rows_dir = work_dir + "/special_rows";
+	mkdir(rows_dir.c_str(), 0777);
+	int row_length = 1024*1024;
+	printf("  \"special_rows\": [\n");
+	for (int ram = 0; ram < 2; ram++) {
+		double write_time = 0;
+		double read_time = 0;
+		for (int r = 0; r < repetitions; r++) {
+			double w;
+			double rd;
+			if (!run_special_rows(ram, &rows_dir, row_length, &w, &rd)) {
+				fprintf(stderr, "ERROR: corrupted data in %s\n", ram ? "SpecialRowRAM" : "SpecialRowFile");
+				errors++;
+			}
+			if (r == 0 || w < write_time) write_time = w;
+			if (r == 0 || rd < read_time) read_time = rd;
+		}
+		double bytes = ((double)SPECIAL_ROWS)*row_length*sizeof(cell_t);
+		printf("    {\"name\": \"%s\", \"bytes\": %.0f, ", ram ? "SpecialRowRAM" : "SpecialRowFile", bytes);
+		print_rate("write_mb_per_second", bytes/write_time/1e6);
+		print_rate("read_mb_per_second", bytes/read_time/1e6, true);
+		printf("}%s\n", ram ? "" : ",");
+	}
+	printf("  ]");
+
+	if (pipeline) {
+		/* Stage 1: processors with and without block pruning */
+		printf(",\n  \"stage1\": [\n");
+		for (int p = 0; p < 4; p++) {
+			bool simd = p >= 2;
+			bool pruning = (p % 2) == 0;
+			const char* processor_name = simd ? "SIMDBlockProcessor" : "CPUBlockProcessor";
+			fprintf(stderr, "Stage 1 (%s, pruning: %d)...\n", processor_name, pruning);
+
+			char name[64];
+			sprintf(name, "stage1_%s_%s", simd ? "simd" : "cpu", pruning ? "pruning" : "no_pruning");
+			string dir = work_dir + "/" + name;
+			string log = dir + ".log";
+			const char* args[8];
+			int count = 0;
+			args[count++] = "gcups_benchmark";
+			args[count++] = "-d";
+			args[count++] = dir.c_str();
+			args[count++] = "--stage-1";
+			if (!pruning) {
+				args[count++] = "--no-block-pruning";
+			}
+			args[count++] = fasta0.c_str();
+			args[count++] = fasta1.c_str();
+			bool ok = run_libmasa(simd, log.c_str(), count, args);
+			double time = read_statistic(dir + "/statistics_01.00", "Total:")/1000.0;
+			if (!ok || time < 0) {
+				fprintf(stderr, "ERROR: stage 1 failed. See %s\n", log.c_str());
+				errors++;
+			}
+			printf("    {\"processor\": \"%s\", \"block_pruning\": %s, \"cells\": %.0f, ",
+					processor_name, pruning ? "true" : "false", cells);
+			print_rate("seconds", time);
+			print_rate("gcups", cells/time/1e9, true);
+			printf("}%s\n", p == 3 ? "" : ",");
+		}
+		printf("  ]");
+
+		/* Stage 4: the first run executes all the stages, so the next
+		 * runs only repeat the stage 4 with the remaining strategies */
+		printf(",\n  \"stage4\": [\n");
+		string dir = work_dir + "/pipeline";
+		for (int s = 0; stage4_strategies[s] != NULL; s++) {
+			fprintf(stderr, "Stage 4 (%s)...\n", stage4_strategies[s]);
+			string strategy = string("--stage-4-strategy=") + stage4_strategies[s];
+			string log = dir + "." + stage4_strategies[s] + ".log";
+			const char* args[8];
+			int count = 0;
+			args[count++] = "gcups_benchmark";
+			args[count++] = "-d";
+			args[count++] = dir.c_str();
+			args[count++] = strategy.c_str();
+			if (s > 0) {
+				args[count++] = "--stage-4";
+			}
+			args[count++] = fasta0.c_str();
+			args[count++] = fasta1.c_str();
+			bool ok = run_libmasa(true, log.c_str(), count, args);
+			double time = read_statistic(dir + "/statistics_04.00", "total:")/1000.0;
+			if (!ok || time < 0) {
+				fprintf(stderr, "ERROR: stage 4 failed. See %s\n", log.c_str());
+				errors++;
+			}
+			printf("    {\"strategy\": \"%s\", ", stage4_strategies[s]);
+			print_rate("seconds", time, true);
+			printf("}%s\n", stage4_strategies[s+1] == NULL ? "" : ",");
+		}
+		printf("  ]");
+	}
+
+	printf(",\n  \"errors\": %d\n}\n", errors);
+
+	if (temporary_dir) {
+		nftw(work_dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	}
+	return errors == 0 ? 0 : 1;
+}
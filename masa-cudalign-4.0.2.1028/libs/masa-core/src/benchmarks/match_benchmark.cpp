@@ -0,0 +1,168 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/*
+ * Micro-benchmark of the Myers-Miller matching procedure
+ * (AlignerUtils::matchColumn) and of the best cell search
+ * (AlignerUtils::findBestCell), compared with the original scalar loops.
+ *
+ * Usage: match_benchmark [cells] [repetitions]
+ *
+ * Build with "make match_benchmark".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../libmasa/libmasa.hpp"
+
+#define GAP_OPEN (3)
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/* Original scalar matching procedure, without the debug messages. */
+static match_result_t scalar_match(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty) {
+	match_result_t match_result;
+	match_result.found = false;
+	for (int k = 0; k < len; k++) {
+		int sum_match = base[k].h + buffer[k].h;
+		int sum_gap = base[k].e + buffer[k].e + gap_open_penalty;
+		if (sum_match == goalScore) {
+			match_result.found = true;
+			match_result.k = k;
+			match_result.score = base[k].h;
+			match_result.type = MATCH_ALIGNED;
+			break;
+		} else if (sum_gap == goalScore) {
+			match_result.found = true;
+			match_result.k = k;
+			match_result.score = base[k].e;
+			match_result.type = MATCH_GAPPED;
+			break;
+		} else if (sum_match > goalScore || sum_gap > goalScore) {
+			match_result.type = sum_match > goalScore ? MATCH_ERROR_1 : MATCH_ERROR_2;
+			break;
+		}
+	}
+	return match_result;
+}
+
+/* Original scalar best cell search. */
+static int scalar_best(const cell_t* buffer, int len) {
+	int best_score = -INF;
+	int best_id = 0;
+	for (int k = 0; k < len; k++) {
+		if (best_score < buffer[k].h) {
+			best_score = buffer[k].h;
+			best_id = k;
+		}
+	}
+	return best_id;
+}
+
+static bool same_result(const match_result_t& a, const match_result_t& b) {
+	if (a.found != b.found) return false;
+	if (!a.found) return true;
+	return a.k == b.k && a.score == b.score && a.type == b.type;
+}
+
+int main(int argc, char** argv) {
+	int len = (argc > 1) ? atoi(argv[1]) : 1024;
+	int reps = (argc > 2) ? atoi(argv[2]) : 20000;
+
+	cell_t* buffer = (cell_t*)malloc(len*sizeof(cell_t));
+	cell_t* base = (cell_t*)malloc(len*sizeof(cell_t));
+
+	/* all the sums stay below the goal, except at the planted position */
+	srand(1);
+	const int goal = 1000;
+	for (int k = 0; k < len; k++) {
+		buffer[k].h = rand() % 400;
+		buffer[k].e = rand() % 400;
+		base[k].h = rand() % 400;
+		base[k].e = rand() % 400;
+	}
+
+	printf("Instruction set: %s\n", SIMDBlockProcessor::getInstructionSetName(SIMDBlockProcessor::detectInstructionSet()));
+	printf("Cells: %d  Repetitions: %d\n\n", len, reps);
+	printf("%-16s %12s %12s %9s\n", "case", "scalar(ns)", "simd(ns)", "speedup");
+
+	int errors = 0;
+	const int positions[] = {-1, len/2, len-1};
+	const char* names[] = {"not found", "found at 1/2", "found at end"};
+	for (int p = 0; p < 3; p++) {
+		int pos = positions[p];
+		cell_t saved = base[pos < 0 ? 0 : pos];
+		if (pos >= 0) {
+			base[pos].h = goal - buffer[pos].h;
+		}
+
+		match_result_t r0 = scalar_match(buffer, base, len, goal, GAP_OPEN);
+		match_result_t r1 = AlignerUtils::matchColumn(buffer, base, len, goal, GAP_OPEN);
+		if (!same_result(r0, r1)) {
+			printf("ERROR: different results in case '%s'\n", names[p]);
+			errors++;
+		}
+
+		volatile int sink = 0;
+		double t0 = now();
+		for (int r = 0; r < reps; r++) {
+			sink += scalar_match(buffer, base, len, goal, GAP_OPEN).k;
+		}
+		double t1 = now();
+		for (int r = 0; r < reps; r++) {
+			sink += AlignerUtils::matchColumn(buffer, base, len, goal, GAP_OPEN).k;
+		}
+		double t2 = now();
+		printf("%-16s %12.1f %12.1f %8.2fx\n", names[p],
+				(t1-t0)*1e9/reps, (t2-t1)*1e9/reps, (t1-t0)/(t2-t1));
+
+		if (pos >= 0) {
+			base[pos] = saved;
+		}
+	}
+
+	if (scalar_best(buffer, len) != AlignerUtils::findBestCell(buffer, len)) {
+		printf("ERROR: different best cells\n");
+		errors++;
+	}
+	volatile int sink = 0;
+	double t0 = now();
+	for (int r = 0; r < reps; r++) {
+		sink += scalar_best(buffer, len);
+	}
+	double t1 = now();
+	for (int r = 0; r < reps; r++) {
+		sink += AlignerUtils::findBestCell(buffer, len);
+	}
+	double t2 = now();
+	printf("%-16s %12.1f %12.1f %8.2fx\n", "best cell",
+			(t1-t0)*1e9/reps, (t2-t1)*1e9/reps, (t1-t0)/(t2-t1));
+
+	free(buffer);
+	free(base);
+	return errors == 0 ? 0 : 1;
+}
@@ -52,6 +52,11 @@ AlignerManager::AlignerManager(IAligner* aligner) {
 
 	unsetSuperPartition();
 
+	this->region = NULL;
+	this->regionReversed = false;
+	this->xdrop = 0;
+	this->regionFile = NULL;
+
 	/*this->processLastCellFunction = NULL;
 	this->processLastColumnFunction = NULL;
 	this->processLastRowFunction = NULL;
@@ -59,6 +64,7 @@ AlignerManager::AlignerManager(IAligner* aligner) {
 
 	this->recurrenceType = SMITH_WATERMAN;
 	this->blockPruning = false;
+	this->alignerPool = NULL;
 	//this->firstColumnGapped = false;
 	//this->firstRowGapped = false;
 
@@ -79,6 +85,11 @@ AlignerManager::~AlignerManager() {
 		firstRowFile = NULL;
 	}
 
+	if (regionFile != NULL) {
+		fclose(regionFile);
+		regionFile = NULL;
+	}
+
 	if (this->baseColumn != NULL) {
 		free(this->baseColumn);
 		this->baseColumn = NULL;
@@ -174,7 +185,11 @@ void AlignerManager::setSequences(Sequence* seq0, Sequence* seq1, int i0, int j0
 	if (DEBUG) printf("AlignerManager::setSequences(%p, %p, %d, %d, %d, %d, %p)\n", seq0, seq1, i0, j0, i1, j1, stats);
 	seq0_offset = i0;
 	seq1_offset = j0;
-	aligner->setSequences(seq0->getData()+seq0_offset, seq1->getData()+seq1_offset, i1-i0, j1-j0);
+	regionReversed = (region != NULL && region->isReversed(seq0));
+	/* only the given ranges are decoded from the packed sequences */
+	const char* s0 = seq0_window.load(seq0, i0, i1) + i0;
+	const char* s1 = seq1_window.load(seq1, j0, j1) + j0;
+	aligner->setSequences(s0, s1, i1-i0, j1-j0);
 	if (stats != NULL) {
 		aligner->printStageStatistics(stats);
 	}
@@ -196,6 +211,13 @@ void AlignerManager::setBlockPruning(bool blockPruning) {
 	this->blockPruning = blockPruning;
 }
 
+/*
+ * @see definition on header file
+ */
+void AlignerManager::setAlignerPool(AlignerPool* alignerPool) {
+	this->alignerPool = alignerPool;
+}
+
 /*
  * @see definition on header file
  */
@@ -281,6 +303,33 @@ void AlignerManager::unsetSuperPartition() {
 	this->superPartition = Partition(-1,-1,-1,-1);
 }
 
+/*
+ * @see definition on header file
+ */
+void AlignerManager::setRegion(const AlignmentRegion* region) {
+	this->region = region;
+}
+
+/*
+ * @see definition on header file
+ */
+void AlignerManager::setXDrop(int xdrop, string filename) {
+	this->xdrop = xdrop;
+	if (regionFile != NULL) {
+		fclose(regionFile);
+		regionFile = NULL;
+	}
+	if (xdrop > 0) {
+		regionFile = fopen(filename.c_str(), "ab");
+		if (regionFile == NULL) {
+			fprintf(stderr, "Could not create region file: %s\n", filename.c_str());
+			exit(1);
+		}
+		/* the borders of the super-partition are always computed */
+		AlignmentRegion::writeOrigin(regionFile, superPartition.getI0(), superPartition.getJ0());
+	}
+}
+
 void AlignerManager::setLastRowDestination(CellsWriter* lastRowWriter) {
 	this->lastRowWriter = lastRowWriter;
 }
@@ -536,6 +585,58 @@ bool AlignerManager::mustPruneBlocks() {
 	return blockPruning;
 }
 
+/*
+ * @see definition on header file
+ */
+int AlignerManager::shareBestScore(int score) {
+	if (alignerPool == NULL) {
+		return score;
+	}
+	return alignerPool->shareBestScore(score);
+}
+
+/*
+ * @see definition on header file
+ */
+int AlignerManager::getRegionOverlap(int i0, int j0, int i1, int j1) {
+	if (region == NULL) {
+		return REGION_INSIDE;
+	}
+	return region->getOverlap(i0+seq0_offset, j0+seq1_offset,
+			i1+seq0_offset, j1+seq1_offset, regionReversed);
+}
+
+/*
+ * @see definition on header file
+ */
+void AlignerManager::getRegionMask(int i, int j0, int len, bool* mask) {
+	if (region == NULL) {
+		for (int k = 0; k < len; k++) {
+			mask[k] = true;
+		}
+		return;
+	}
+	/* cell (i,j) of the aligner is the vertex (i+1,j+1) of the partition */
+	region->getRowMask(i+1+seq0_offset, j0+1+seq1_offset, len, regionReversed, mask);
+}
+
+/*
+ * @see definition on header file
+ */
+int AlignerManager::getXDrop() {
+	return xdrop;
+}
+
+/*
+ * @see definition on header file
+ */
+void AlignerManager::dispatchComputedBlock(int i0, int j0, int i1, int j1) {
+	if (regionFile != NULL) {
+		AlignmentRegion::writeBlock(regionFile, i0+seq0_offset, j0+seq1_offset,
+				i1+seq0_offset, j1+seq1_offset);
+	}
+}
+
 /*
  * @see definition on header file
  */
@@ -548,11 +649,22 @@ int AlignerManager::getFirstColumnInitType() {
  */
 void AlignerManager::setPenalties(const int match, const int mismatch,
 		const int gapOpen, const int gapExtension) {
-	// TODO Not supported yet.
+	if (aligner->getCapabilities().variable_penalties != SUPPORTED) {
+		fprintf(stderr, "The aligner does not support variable penalties.\n");
+		exit(1);
+	}
 	this->match = match;
 	this->mismatch = mismatch;
 	this->gapOpen = gapOpen;
 	this->gapExtension = gapExtension;
+
+	score_params_t params;
+	params.match = match;
+	params.mismatch = mismatch;
+	params.gap_open = gapOpen;
+	params.gap_ext = gapExtension;
+	aligner->setScoreParameters(&params);
+	this->score_params = aligner->getScoreParameters();
 }
 
 /*
@@ -609,15 +721,8 @@ bool AlignerManager::isFoundCrosspoint() const {
 }
 
 int AlignerManager::findBestCell(const cell_t* buffer, int len) {
-	int best_score = -INF;
-	int best_id = 0;
-	for (int k = 0; k < len; k++) {
-		if (best_score < buffer[k].h) {
-			best_score = buffer[k].h;
-			best_id = k;
-		}
-		if (DEBUG) printf("bestCell: [%d]:%d/%d\n", k, buffer[k].h, best_score);
-	}
+	int best_id = AlignerUtils::findBestCell(buffer, len);
+	if (DEBUG) printf("bestCell: [%d]:%d\n", best_id, len > 0 ? buffer[best_id].h : -INF);
 	return best_id;
 }
 
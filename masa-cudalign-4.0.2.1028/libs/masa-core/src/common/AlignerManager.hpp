@@ -27,11 +27,13 @@
 //#include "buffer/Buffer.hpp"
 //#include "BlocksFile.hpp"
 #include "biology/Sequence.hpp"
+#include "biology/SequenceWindow.hpp"
 #include "io/CellsReader.hpp"
 #include "io/CellsWriter.hpp"
 #include "sra/SpecialRowsPartition.hpp"
 #include "BlocksFile.hpp"
 #include "BestScoreList.hpp"
+#include "AlignmentRegion.hpp"
 #include "Job.hpp"
 
 typedef void (*callback_f)(int i, int j, int len, cell_t* data);
@@ -108,6 +110,15 @@ public:
 	 */
 	void setBlockPruning(bool blockPruning);
 
+	/**
+	 * Defines the pool used to share the best score of the block pruning
+	 * with the other processes. It must only be set while aligning the
+	 * whole matrix (stage 1), since every process must prune the same matrix.
+	 *
+	 * @param alignerPool the pool of processes, or NULL to disable sharing.
+	 */
+	void setAlignerPool(AlignerPool* alignerPool);
+
 	/**
 	 * Defines the grid dimension of the grid, if
 	 * capabilities_t::dispatch_block_scores is SUPPORTED.
@@ -166,7 +177,9 @@ public:
 	void setSpecialRowInterval(const int specialRowInterval);
 
 	/**
-	 * Defines the variable penalty functions to be aligned.
+	 * Defines the variable penalty functions to be aligned. The penalties
+	 * are forwarded to the aligner (see IAligner::setScoreParameters), that
+	 * must support the aligner_capabilities_t::variable_penalties capability.
 	 *
 	 * @param match		Match score
 	 * @param mismatch	Mismatch score
@@ -190,6 +203,24 @@ public:
 	 */
 	void unsetSuperPartition();
 
+	/**
+	 * Restricts the alignment to the given region. The cells outside the
+	 * region are considered -INF (see IManager::getRegionOverlap()).
+	 *
+	 * @param region the region, or NULL for the whole matrix.
+	 */
+	void setRegion(const AlignmentRegion* region);
+
+	/**
+	 * Enables the X-drop in the aligner. The blocks computed by the aligner
+	 * are appended to the given region file, so the later stages can
+	 * restrict themselves to the same region.
+	 *
+	 * @param xdrop the X-drop threshold, or zero to disable it.
+	 * @param filename the region file.
+	 */
+	void setXDrop(int xdrop, string filename);
+
 	/* ********************* *
 	 *  Callback functions   *
 	 * ********************* */
@@ -255,6 +286,13 @@ public:
 	void dispatchColumn(int j, const cell_t* buffer, int len);
 	void dispatchRow(int i, const cell_t* buffer, int len);
 	void dispatchScore(score_t score, int bx=-1, int by=-1);
+	int shareBestScore(int score);
+
+	/* Region Methods */
+	int getRegionOverlap(int i0, int j0, int i1, int j1);
+	void getRegionMask(int i, int j0, int len, bool* mask);
+	int getXDrop();
+	void dispatchComputedBlock(int i0, int j0, int i1, int j1);
 
 	/* Must Methods */
 	bool mustContinue();
@@ -377,6 +415,9 @@ private:
 	/** true if block must be pruned */
 	int blockPruning;
 
+	/** Pool that shares the best score among processes (may be NULL) */
+	AlignerPool* alignerPool;
+
 	/** required recurrence type (SMITH_WATERMAN or NEEDLEMAN_WUNSCH) */
 	int recurrenceType;
 
@@ -418,12 +459,29 @@ private:
 	/** defines how many nucleotides were trimmed from the sequence 1 */
 	int seq1_offset;
 
+	/** decoded range of the sequence 0 that is passed to the aligner */
+	SequenceWindow seq0_window;
+	/** decoded range of the sequence 1 that is passed to the aligner */
+	SequenceWindow seq1_window;
+
 	/**
 	 * Partition that holds all sub-partitions. If there are no
 	 * sub-partition, this is the single partition being aligned.
 	 */
 	Partition superPartition;
 
+	/** region where the alignment may pass, or NULL for the whole matrix */
+	const AlignmentRegion* region;
+
+	/** true if the aligned matrix is reversed in relation to the region */
+	bool regionReversed;
+
+	/** X-drop threshold (zero if disabled) */
+	int xdrop;
+
+	/** file where the blocks computed with X-drop are stored */
+	FILE* regionFile;
+
 	/**
 	 * Stops the execution of the aligner. This makes the
 	 * mustContinue() method to return false.
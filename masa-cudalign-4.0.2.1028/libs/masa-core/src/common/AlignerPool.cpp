@@ -23,74 +23,94 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 
-AlignerPool::AlignerPool(string sharedPath) {
+#include "pool/FilePoolTransport.hpp"
+#include "pool/SharedMemoryPoolTransport.hpp"
+#include "pool/SocketPoolTransport.hpp"
+#include "Tracer.hpp"
+
+AlignerPool::AlignerPool(string sharedPath, int transportType) {
 	this->sharedPath = sharedPath;
-	this->crosspointIdSentCounter = 0;
-	this->crosspointIdRecvCounter = 0;
 	this->bestNodeScore.score = -INF;
 	this->bestNodeScore.i = -1;
 	this->bestNodeScore.j = -1;
+	this->sharedBestScore = NULL;
+	this->sharedBestScoreFailed = false;
+	this->registry = new FilePoolTransport(sharedPath);
+	switch (transportType) {
+		case POOL_TRANSPORT_SHM:
+			this->transport = new SharedMemoryPoolTransport(sharedPath);
+			break;
+		case POOL_TRANSPORT_SOCKET:
+			this->transport = new SocketPoolTransport(sharedPath);
+			break;
+		default:
+			this->transport = new FilePoolTransport(sharedPath);
+			break;
+	}
 }
 
 AlignerPool::~AlignerPool() {
-
+	if (sharedBestScore != NULL) {
+		munmap((void*)sharedBestScore, sizeof(int));
+		sharedBestScore = NULL;
+	}
+	delete transport;
+	delete registry;
 }
 
 void AlignerPool::waitId(int id) {
-	string filename = getMsgFile("stage1", id);
-	waitSignal(filename);
+	string mailbox = getMailbox("stage1", id);
+	int count = 0;
+	while (!transport->peek(mailbox)) {
+		if (count % 1000 == 0) {
+			printf("[%d] Waiting msg: %s\n", getpid(), mailbox.c_str());
+		}
+		usleep(10000);
+		count++;
+	}
 }
 
 void AlignerPool::dispatchScore(score_t score) {
-	string filename = getMsgFile("stage1", right);
-
-	FILE* file = fopen(filename.c_str(), "wt");
-	fprintf(file, "%d %d %d\n", score.i, score.j, score.score);
-	fclose(file);
-
-	sendSignal(filename);
-
+	TRACE_SPAN(TRACE_POOL, "dispatchScore");
+	char str[100];
+	sprintf(str, "%d %d %d\n", score.i, score.j, score.score);
+	transport->send(getMailbox("stage1", right), str);
 }
 
 score_t AlignerPool::receiveScore() {
+	TRACE_SPAN(TRACE_POOL, "receiveScore");
 	score_t score;
 
-	string filename = getMsgFile("stage1", left);
-	waitSignal(filename);
-
-	FILE* file = fopen(filename.c_str(), "rt");
-	fscanf(file, "%d %d %d\n", &score.i, &score.j, &score.score);
-	fclose(file);
+	string msg = transport->receive(getMailbox("stage1", left));
+	sscanf(msg.c_str(), "%d %d %d\n", &score.i, &score.j, &score.score);
 	return score;
 
 }
 
 void AlignerPool::dispatchCrosspoint(crosspoint_t crosspoint, int final) {
-	string filename = getMsgFile("stage2", left, crosspointIdSentCounter++);
-
-	FILE* file = fopen(filename.c_str(), "wt");
-	fprintf(file, "%d %d %d %d %d\n", crosspoint.i, crosspoint.j, crosspoint.score, crosspoint.type, final);
-	fclose(file);
-
-	sendSignal(filename);
+	TRACE_SPAN(TRACE_POOL, "dispatchCrosspoint");
+	char str[100];
+	sprintf(str, "%d %d %d %d %d\n", crosspoint.i, crosspoint.j, crosspoint.score, crosspoint.type, final);
+	transport->send(getMailbox("stage2", left), str);
 }
 
 crosspoint_t AlignerPool::receiveCrosspoint(int* final) {
+	TRACE_SPAN(TRACE_POOL, "receiveCrosspoint");
 	crosspoint_t c;
-	bool _final;
+	int _final;
 
-	string filename = getMsgFile("stage2", right, crosspointIdRecvCounter++);
-	waitSignal(filename);
-
-	while (peekSignal(getMsgFile("stage2", right, crosspointIdRecvCounter))) {
-		filename = getMsgFile("stage2", right, crosspointIdRecvCounter++);
+	/* only the most recent crosspoint is relevant */
+	string mailbox = getMailbox("stage2", right);
+	string msg = transport->receive(mailbox);
+	while (transport->poll(mailbox)) {
+		msg = transport->receive(mailbox);
 	}
 
-	FILE* file = fopen(filename.c_str(), "rt");
-	fscanf(file, "%d %d %d %d %d\n", &c.i, &c.j, &c.score, &c.type, &_final);
-	fclose(file);
+	sscanf(msg.c_str(), "%d %d %d %d %d\n", &c.i, &c.j, &c.score, &c.type, &_final);
 
 	if (final != NULL) {
 		*final = _final;
@@ -101,44 +121,101 @@ crosspoint_t AlignerPool::receiveCrosspoint(int* final) {
 
 
 void AlignerPool::dispatchCrosspointFile(CrosspointsFile* file) {
-	string filename = getMsgFile("stage4", left);
-
-	file->writeToFile(filename.c_str());
-	sendSignal(filename);
-
+	TRACE_SPAN(TRACE_POOL, "dispatchCrosspointFile");
+	string msg;
+	if (!file->empty()) {
+		msg.assign((const char*)&file->front(), file->size()*sizeof(crosspoint_t));
+	}
+	transport->send(getMailbox("stage4", left), msg);
 }
 
 CrosspointsFile* AlignerPool::receiveCrosspointFile() {
-	string filename = getMsgFile("stage4", right);
-	waitSignal(filename);
+	TRACE_SPAN(TRACE_POOL, "receiveCrosspointFile");
+	string mailbox = getMailbox("stage4", right);
+	string msg = transport->receive(mailbox);
 
-	CrosspointsFile* crosspoints = new CrosspointsFile(filename);
-	crosspoints->loadCrosspoints();
+	CrosspointsFile* crosspoints = new CrosspointsFile(sharedPath + "/" + mailbox);
+	const crosspoint_t* records = (const crosspoint_t*)msg.data();
+	crosspoints->assign(records, records + msg.size()/sizeof(crosspoint_t));
 
 	return crosspoints;
 }
 
+/**
+ * Publishes the best score found by this node and returns the best score
+ * published by any node. The score is kept in a file of the shared
+ * directory mapped in memory, so the nodes running in the same host
+ * (forked or split instances) see each other's scores immediately.
+ * If the file cannot be mapped, the scores are not shared.
+ *
+ * @param score the best score found by this node.
+ * @return the best score among all the nodes.
+ */
+int AlignerPool::shareBestScore(int score) {
+	if (sharedBestScore == NULL) {
+		if (sharedBestScoreFailed) {
+			return score;
+		}
+		openSharedBestScore();
+		if (sharedBestScore == NULL) {
+			return score;
+		}
+	}
+
+	/* the file is created with zeroes, so the values are stored relative to -INF */
+	int value = score + INF;
+	int current = *sharedBestScore;
+	while (current < value) {
+		int previous = __sync_val_compare_and_swap(sharedBestScore, current, value);
+		if (previous == current) {
+			current = value;
+		} else {
+			current = previous;
+		}
+	}
+	return current - INF;
+}
+
+void AlignerPool::openSharedBestScore() {
+	string filename = this->sharedPath + "/best_score";
+	int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd != -1 && ftruncate(fd, sizeof(int)) == 0) {
+		void* ptr = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (ptr != MAP_FAILED) {
+			sharedBestScore = (volatile int*)ptr;
+		}
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	if (sharedBestScore == NULL) {
+		fprintf(stderr, "Warning: could not share the best score through %s.\n", filename.c_str());
+		sharedBestScoreFailed = true;
+	}
+}
+
 void AlignerPool::registerNode(int id, int left, int right, string flushURL) {
-	string filename = getMsgFile("register", id);
 	this->left = left;
 	this->right = right;
 
 	printf("%d: %d,%d\n", id, left, right);
-	FILE* file = fopen(filename.c_str(), "wt");
-	fprintf(file, "%s\n", flushURL.c_str());
-	fclose(file);
+	registry->send(getMailbox("register", id), flushURL + "\n");
 
-	sendSignal(filename);
+	/* prepares the mailboxes received by this node */
+	if (left != -1) {
+		transport->listen(getMailbox("stage1", left));
+	}
+	if (right != -1) {
+		transport->listen(getMailbox("stage2", right));
+		transport->listen(getMailbox("stage4", right));
+	}
 }
 
 string AlignerPool::getLoadURL(int id) {
-	string filename = getMsgFile("register", id);
-	waitSignal(filename);
+	string msg = registry->receive(getMailbox("register", id));
 
-	FILE* file = fopen(filename.c_str(), "rt");
 	char url[200];
-	fscanf(file, "%s\n", url);
-	fclose(file);
+	sscanf(msg.c_str(), "%s\n", url);
 
 	return string(url);
 }
@@ -149,26 +226,10 @@ void AlignerPool::initialize() {
 
 }
 
-string AlignerPool::getMsgFile(string prefix, int id, int count) {
+string AlignerPool::getMailbox(string prefix, int id) {
 	char str[100];
-	if (count == -1) {
-		sprintf(str, ".%08X", id);
-	} else {
-		sprintf(str, ".%08X.%02d", id, count);
-	}
-	return this->sharedPath + "/" + prefix + string(str);
-}
-
-string AlignerPool::getSignalFile(string msgFile) {
-	return msgFile + ".signal";
-}
-
-void AlignerPool::sendSignal(string msgFile) {
-	string signalFile = getSignalFile(msgFile);
-	FILE* file = fopen(signalFile.c_str(), "wt");
-	fclose(file);
-	sync();
-	printf("[%d] Signal Sent: %s\n", getpid(), signalFile.c_str());
+	sprintf(str, ".%08X", id);
+	return prefix + string(str);
 }
 
 bool AlignerPool::isFirstNode() {
@@ -186,31 +247,3 @@ const score_t& AlignerPool::getBestNodeScore() const {
 void AlignerPool::setBestNodeScore(const score_t& bestNodeScore) {
 	this->bestNodeScore = bestNodeScore;
 }
-
-bool AlignerPool::peekSignal(string msgFile) {
-	string signalFile = getSignalFile(msgFile);
-	FILE* file = fopen(signalFile.c_str(), "rt");
-	bool signalOk = false;
-	if (file != NULL) {
-		signalOk = true;
-		fclose(file);
-	}
-	return signalOk;
-}
-
-void AlignerPool::waitSignal(string msgFile) {
-	int count = 0;
-	bool signalOk = false;
-	while (!signalOk) {
-		if (count % 1000 == 0) {
-			printf("[%d] Waiting Signal for msg: %s\n", getpid(), msgFile.c_str());
-		}
-		signalOk = peekSignal(msgFile);
-		if (!signalOk) {
-			usleep(10000);
-			count++;
-		}
-	}
-	printf("[%d] Signal Received for msg: %s\n", getpid(), msgFile.c_str());
-}
-
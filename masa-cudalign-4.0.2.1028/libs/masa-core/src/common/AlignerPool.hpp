@@ -27,10 +27,11 @@ using namespace std;
 
 #include "../libmasa/libmasaTypes.hpp"
 #include "CrosspointsFile.hpp"
+#include "pool/PoolTransport.hpp"
 
 class AlignerPool {
 public:
-	AlignerPool(string sharedPath);
+	AlignerPool(string sharedPath, int transportType=POOL_TRANSPORT_FILE);
 	virtual ~AlignerPool();
 
 	virtual void initialize();
@@ -49,6 +50,8 @@ public:
 	virtual void dispatchCrosspointFile(CrosspointsFile* file);
 	//virtual void dispatchSignal(int signal);
 
+	virtual int shareBestScore(int score);
+
 	virtual bool isFirstNode();
 	virtual bool isLastNode();
 	const score_t& getBestNodeScore() const;
@@ -58,15 +61,20 @@ private:
 	string sharedPath;
 	int right;
 	int left;
-	int crosspointIdSentCounter;
-	int crosspointIdRecvCounter;
 	score_t bestNodeScore;
 
-	string getMsgFile(string prefix, int id, int count=-1);
-	string getSignalFile(string msgFile);
-	void sendSignal(string msgFile);
-	void waitSignal(string msgFile);
-	bool peekSignal(string msgFile);
+	/** Delivers the messages exchanged with the other nodes */
+	PoolTransport* transport;
+	/** Keeps the registration of the nodes, that may be read by any node */
+	PoolTransport* registry;
+
+	/** Best score shared by all the nodes (relative to -INF), mapped from a file */
+	volatile int* sharedBestScore;
+	/** true if the shared best score could not be mapped */
+	bool sharedBestScoreFailed;
+
+	string getMailbox(string prefix, int id);
+	void openSharedBestScore();
 };
 
 #endif /* ALIGNERPOOL_HPP_ */
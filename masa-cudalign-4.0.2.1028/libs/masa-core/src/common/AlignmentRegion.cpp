@@ -0,0 +1,324 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "AlignmentRegion.hpp"
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "../libmasa/libmasa.hpp"
+
+/** floor(a/b) for b > 0 */
+static long long floorDiv(long long a, long long b) {
+	return a >= 0 ? a/b : -((-a + b - 1)/b);
+}
+
+/** ceil(a/b) for b > 0 */
+static long long ceilDiv(long long a, long long b) {
+	return -floorDiv(-a, b);
+}
+
+AlignmentRegion::AlignmentRegion(const Sequence* seq0, const Sequence* seq1) {
+	this->n = seq0->getInfo()->getSize();
+	this->m = seq1->getInfo()->getSize();
+	this->info0 = seq0->getInfo();
+	this->band = -1;
+	this->bandLimit = 0;
+	this->hasBlocks = false;
+}
+
+AlignmentRegion::~AlignmentRegion() {
+}
+
+void AlignmentRegion::setBand(int band) {
+	this->band = band;
+	/* |J*n - I*m| is the distance from the diagonal scaled by max(n,m) */
+	this->bandLimit = ((long long)band) * (n > m ? n : m);
+}
+
+int AlignmentRegion::getBand() const {
+	return band;
+}
+
+void AlignmentRegion::loadBlocks(string filename) {
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not open region file: %s\n", filename.c_str());
+		exit(1);
+	}
+
+	/* closed rectangles of vertices: {rowStart, colStart, rowEnd, colEnd} */
+	vector<int> rects;
+	int rec[4];
+	while (fread(rec, sizeof(int), 4, file) == 4) {
+		if (rec[2] == -1) {
+			/* first row and first column of the super-partition */
+			int r[8] = {rec[0], rec[1], rec[0], (int)m,
+					rec[0], rec[1], (int)n, rec[1]};
+			rects.insert(rects.end(), r, r+8);
+		} else {
+			int r[4] = {rec[0]+1, rec[1]+1, rec[2], rec[3]};
+			rects.insert(rects.end(), r, r+4);
+		}
+	}
+	fclose(file);
+
+	buildSlabs(rects, false, rowSlabStart, rowSlabColumns);
+	buildSlabs(rects, true, colSlabStart, colSlabRows);
+	hasBlocks = true;
+	fprintf(stderr, "Region: %d blocks in %d slabs loaded from %s\n",
+			(int)(rects.size()/4), (int)rowSlabColumns.size(), filename.c_str());
+}
+
+bool AlignmentRegion::isReversed(const Sequence* seq0) const {
+	return seq0->getInfo() != info0;
+}
+
+int AlignmentRegion::getOverlap(int I0, int J0, int I1, int J1, bool reversed) const {
+	int r0, c0, r1, c1; // closed rectangle
+	int ir0, ic0, ir1, ic1; // interior rectangle
+	if (reversed) {
+		r0 = n-J1; r1 = n-J0;
+		c0 = m-I1; c1 = m-I0;
+		ir0 = r0; ir1 = r1-1;
+		ic0 = c0; ic1 = c1-1;
+	} else {
+		r0 = I0; r1 = I1;
+		c0 = J0; c1 = J1;
+		ir0 = r0+1; ir1 = r1;
+		ic0 = c0+1; ic1 = c1;
+	}
+	if (!bandIntersects(ir0, ic0, ir1, ic1) || !blocksIntersect(ir0, ic0, ir1, ic1)) {
+		return REGION_OUTSIDE;
+	}
+	if (bandCovers(r0, c0, r1, c1) && blocksCover(r0, c0, r1, c1)) {
+		return REGION_INSIDE;
+	}
+	return REGION_PARTIAL;
+}
+
+void AlignmentRegion::getRowMask(int I, int J0, int len, bool reversed, bool* mask) const {
+	for (int k = 0; k < len; k++) {
+		mask[k] = false;
+	}
+	long long lo;
+	long long hi;
+	long long first;
+	int step;
+	const vector< pair<int,int> >* intervals = NULL;
+	if (!reversed) {
+		/* a forward row: the columns J0..J0+len-1 of row I */
+		lo = J0;
+		hi = J0 + len - 1;
+		first = J0;
+		step = 1;
+		if (band >= 0) {
+			lo = max(lo, ceilDiv(I*m - bandLimit, n));
+			hi = min(hi, floorDiv(I*m + bandLimit, n));
+		}
+		if (hasBlocks) {
+			int s = findSlab(rowSlabStart, I);
+			if (s == -1) return;
+			intervals = &rowSlabColumns[s];
+		}
+	} else {
+		/* a reversed row is the forward column m-I, with decreasing rows */
+		long long J = m - I;
+		lo = n - J0 - len + 1;
+		hi = n - J0;
+		first = n - J0;
+		step = -1;
+		if (band >= 0) {
+			lo = max(lo, ceilDiv(J*n - bandLimit, m));
+			hi = min(hi, floorDiv(J*n + bandLimit, m));
+		}
+		if (hasBlocks) {
+			int s = findSlab(colSlabStart, J);
+			if (s == -1) return;
+			intervals = &colSlabRows[s];
+		}
+	}
+	if (intervals == NULL) {
+		vector< pair<int,int> > all(1, make_pair((int)lo, (int)hi));
+		fillMask(all, lo, hi, first, step, mask);
+	} else {
+		fillMask(*intervals, lo, hi, first, step, mask);
+	}
+}
+
+void AlignmentRegion::writeOrigin(FILE* file, int I0, int J0) {
+	int rec[4] = {I0, J0, -1, -1};
+	fwrite(rec, sizeof(int), 4, file);
+}
+
+void AlignmentRegion::writeBlock(FILE* file, int I0, int J0, int I1, int J1) {
+	int rec[4] = {I0, J0, I1, J1};
+	fwrite(rec, sizeof(int), 4, file);
+}
+
+bool AlignmentRegion::isInsideBand(long long I, long long J) const {
+	if (band < 0) return true;
+	long long d = J*n - I*m;
+	return d >= -bandLimit && d <= bandLimit;
+}
+
+bool AlignmentRegion::isInside(int I, int J) const {
+	if (!isInsideBand(I, J)) return false;
+	if (!hasBlocks) return true;
+	int s = findSlab(rowSlabStart, I);
+	if (s == -1) return false;
+	const vector< pair<int,int> >& cols = rowSlabColumns[s];
+	/* the first interval that ends at or after J */
+	int lo = 0;
+	int hi = cols.size();
+	while (lo < hi) {
+		int mid = (lo+hi)/2;
+		if (cols[mid].second < J) {
+			lo = mid+1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < (int)cols.size() && cols[lo].first <= J;
+}
+
+/**
+ * Splits the given rectangles in slabs of rows (or columns, if transposed)
+ * and merges the overlapping or adjacent intervals of each slab.
+ */
+void AlignmentRegion::buildSlabs(const vector<int>& rects, bool transposed,
+		vector<int>& slabStart, vector< vector< pair<int,int> > >& slabIntervals) {
+	const int a0 = transposed ? 1 : 0; // start of the slab dimension
+	const int b0 = transposed ? 0 : 1; // start of the interval dimension
+
+	slabStart.clear();
+	for (size_t k = 0; k < rects.size(); k += 4) {
+		slabStart.push_back(rects[k+a0]);
+		slabStart.push_back(rects[k+a0+2]+1);
+	}
+	sort(slabStart.begin(), slabStart.end());
+	slabStart.erase(unique(slabStart.begin(), slabStart.end()), slabStart.end());
+
+	slabIntervals.clear();
+	if (slabStart.size() > 1) {
+		slabIntervals.resize(slabStart.size()-1);
+	}
+	for (size_t k = 0; k < rects.size(); k += 4) {
+		int s0 = lower_bound(slabStart.begin(), slabStart.end(), rects[k+a0]) - slabStart.begin();
+		int s1 = lower_bound(slabStart.begin(), slabStart.end(), rects[k+a0+2]+1) - slabStart.begin();
+		for (int s = s0; s < s1; s++) {
+			slabIntervals[s].push_back(make_pair(rects[k+b0], rects[k+b0+2]));
+		}
+	}
+
+	for (size_t s = 0; s < slabIntervals.size(); s++) {
+		vector< pair<int,int> >& intervals = slabIntervals[s];
+		sort(intervals.begin(), intervals.end());
+		size_t last = 0;
+		for (size_t k = 1; k < intervals.size(); k++) {
+			if (intervals[k].first <= intervals[last].second + 1) {
+				intervals[last].second = max(intervals[last].second, intervals[k].second);
+			} else {
+				intervals[++last] = intervals[k];
+			}
+		}
+		if (!intervals.empty()) {
+			intervals.resize(last+1);
+		}
+	}
+}
+
+/**
+ * @return the slab that contains the given position, or -1 if there is
+ * 		no such slab.
+ */
+int AlignmentRegion::findSlab(const vector<int>& slabStart, int pos) {
+	int s = upper_bound(slabStart.begin(), slabStart.end(), pos) - slabStart.begin() - 1;
+	if (s < 0 || s >= (int)slabStart.size()-1) return -1;
+	return s;
+}
+
+/**
+ * Sets mask[step*(p-first)] for every position p of the intervals
+ * inside [lo,hi].
+ */
+void AlignmentRegion::fillMask(const vector< pair<int,int> >& intervals,
+		long long lo, long long hi, long long first, int step, bool* mask) {
+	for (size_t k = 0; k < intervals.size(); k++) {
+		long long a = max(lo, (long long)intervals[k].first);
+		long long b = min(hi, (long long)intervals[k].second);
+		for (long long p = a; p <= b; p++) {
+			mask[step*(p-first)] = true;
+		}
+	}
+}
+
+/*
+ * The J*n-I*m values of the vertices of a rectangle step by n or m, so a
+ * rectangle whose value range overlaps the band contains a vertex of the
+ * band for any band of at least one cell.
+ */
+bool AlignmentRegion::bandIntersects(int I0, int J0, int I1, int J1) const {
+	if (band < 0) return true;
+	long long lo = J0*n - I1*m;
+	long long hi = J1*n - I0*m;
+	return hi >= -bandLimit && lo <= bandLimit;
+}
+
+bool AlignmentRegion::bandCovers(int I0, int J0, int I1, int J1) const {
+	if (band < 0) return true;
+	long long lo = J0*n - I1*m;
+	long long hi = J1*n - I0*m;
+	return lo >= -bandLimit && hi <= bandLimit;
+}
+
+bool AlignmentRegion::blocksIntersect(int I0, int J0, int I1, int J1) const {
+	if (!hasBlocks) return true;
+	int s0 = upper_bound(rowSlabStart.begin(), rowSlabStart.end(), I0) - rowSlabStart.begin() - 1;
+	if (s0 < 0) s0 = 0;
+	for (int s = s0; s < (int)rowSlabColumns.size() && rowSlabStart[s] <= I1; s++) {
+		if (rowSlabStart[s+1] <= I0) continue;
+		const vector< pair<int,int> >& cols = rowSlabColumns[s];
+		for (size_t k = 0; k < cols.size(); k++) {
+			if (cols[k].first <= J1 && J0 <= cols[k].second) return true;
+		}
+	}
+	return false;
+}
+
+bool AlignmentRegion::blocksCover(int I0, int J0, int I1, int J1) const {
+	if (!hasBlocks) return true;
+	int s0 = findSlab(rowSlabStart, I0);
+	if (s0 == -1) return false;
+	for (int s = s0; rowSlabStart[s] <= I1; s++) {
+		if (s >= (int)rowSlabColumns.size()) return false;
+		const vector< pair<int,int> >& cols = rowSlabColumns[s];
+		bool covered = false;
+		for (size_t k = 0; k < cols.size(); k++) {
+			if (cols[k].first <= J0 && J1 <= cols[k].second) {
+				covered = true;
+				break;
+			}
+		}
+		if (!covered) return false;
+	}
+	return true;
+}
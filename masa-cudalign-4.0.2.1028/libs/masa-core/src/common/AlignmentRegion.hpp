@@ -0,0 +1,159 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef ALIGNMENTREGION_HPP_
+#define ALIGNMENTREGION_HPP_
+
+#include <stdio.h>
+#include <vector>
+#include <utility>
+using namespace std;
+
+#include "biology/Sequence.hpp"
+
+/**
+ * @brief Region of the DP matrix where the alignment may pass.
+ *
+ * The region is given by the --band and --xdrop parameters. The cells
+ * outside the region are considered -INF, so every stage must use exactly
+ * the same region, otherwise the crosspoints would not be found.
+ *
+ * The region is defined in the vertex coordinates of the forward matrix,
+ * i.e., vertex (I,J) is the cell after I residues of sequence 0 and J
+ * residues of sequence 1. The reversed stages swap and reverse both
+ * sequences, so their vertex (I',J') is the forward vertex (n-J',m-I'),
+ * where n and m are the sizes of sequences 0 and 1.
+ *
+ * <ul>
+ *  <li>band: vertices whose distance to the diagonal from (0,0) to
+ *  	(n,m) is, at most, W cells. It is computed on the fly and it is
+ *  	symmetric for the forward and the reversed matrices.
+ *  <li>blocks: set of rectangles computed by the X-drop in stage 1 and
+ *  	loaded from the region file in the later stages. Each record of the
+ *  	file has four integers {I0,J0,I1,J1} representing the vertices
+ *  	(I0,I1]x(J0,J1]. The {I0,J0,-1,-1} record represents the first row
+ *  	and column of the super-partition with origin at (I0,J0).
+ * </ul>
+ *
+ * A vertex is inside the region if it is inside both the band and the
+ * blocks, when they are defined.
+ */
+class AlignmentRegion {
+public:
+	/**
+	 * Creates an unrestricted region.
+	 *
+	 * @param seq0 the forward sequence 0 (vertical).
+	 * @param seq1 the forward sequence 1 (horizontal).
+	 */
+	AlignmentRegion(const Sequence* seq0, const Sequence* seq1);
+	virtual ~AlignmentRegion();
+
+	/**
+	 * Restricts the region to a band around the main diagonal.
+	 *
+	 * @param band the maximum distance (in cells) from the diagonal, or -1
+	 * 		to disable the band.
+	 */
+	void setBand(int band);
+	int getBand() const;
+
+	/**
+	 * Restricts the region to the blocks stored in the given region file.
+	 *
+	 * @param filename the region file written by stage 1.
+	 */
+	void loadBlocks(string filename);
+
+	/**
+	 * Tells whether the given sequence is the sequence 0 of a matrix that
+	 * is reversed in relation to the forward matrix.
+	 *
+	 * @param seq0 the vertical sequence of the aligned matrix.
+	 * @return true if the matrix is reversed.
+	 */
+	bool isReversed(const Sequence* seq0) const;
+
+	/**
+	 * Classifies the closed rectangle of vertices [I0,I1]x[J0,J1] against
+	 * the region.
+	 *
+	 * @return REGION_OUTSIDE if no vertex of (I0,I1]x(J0,J1] is inside the
+	 * 		region, REGION_INSIDE if all the vertices of [I0,I1]x[J0,J1] are
+	 * 		inside the region, or REGION_PARTIAL otherwise.
+	 */
+	int getOverlap(int I0, int J0, int I1, int J1, bool reversed) const;
+
+	/**
+	 * @return true if the vertex (I,J) of the forward matrix is inside
+	 * 		the region.
+	 */
+	bool isInside(int I, int J) const;
+
+	/**
+	 * Tells which vertices (I,J0+k), for 0<=k<len, are inside the region.
+	 */
+	void getRowMask(int I, int J0, int len, bool reversed, bool* mask) const;
+
+	static void writeOrigin(FILE* file, int I0, int J0);
+	static void writeBlock(FILE* file, int I0, int J0, int I1, int J1);
+
+private:
+	/** size of the forward sequence 0 */
+	long long n;
+	/** size of the forward sequence 1 */
+	long long m;
+	/** the information of sequence 0, used to identify reversed matrices */
+	const SequenceInfo* info0;
+
+	/** maximum distance from the diagonal, or -1 if there is no band */
+	int band;
+	/** band limit in the J*n-I*m scale */
+	long long bandLimit;
+
+	/** true if the blocks were loaded */
+	bool hasBlocks;
+	/**
+	 * The rows of the blocks are split in slabs. Slab k contains
+	 * the rows [rowSlabStart[k], rowSlabStart[k+1]).
+	 */
+	vector<int> rowSlabStart;
+	/** merged closed intervals of columns inside each row slab */
+	vector< vector< pair<int,int> > > rowSlabColumns;
+	/** the same slabs for the columns, used by the reversed matrices */
+	vector<int> colSlabStart;
+	/** merged closed intervals of rows inside each column slab */
+	vector< vector< pair<int,int> > > colSlabRows;
+
+	bool isInsideBand(long long I, long long J) const;
+	bool bandIntersects(int I0, int J0, int I1, int J1) const;
+	bool bandCovers(int I0, int J0, int I1, int J1) const;
+	bool blocksIntersect(int I0, int J0, int I1, int J1) const;
+	bool blocksCover(int I0, int J0, int I1, int J1) const;
+
+	static void buildSlabs(const vector<int>& rects, bool transposed,
+			vector<int>& slabStart, vector< vector< pair<int,int> > >& slabIntervals);
+	static int findSlab(const vector<int>& slabStart, int pos);
+	static void fillMask(const vector< pair<int,int> >& intervals,
+			long long lo, long long hi, long long first, int step, bool* mask);
+};
+
+#endif /* ALIGNMENTREGION_HPP_ */
@@ -26,6 +26,9 @@
 
 #define DEBUG (0)
 
+/* Minimum list size to look for derived scores in the neighbor buckets first */
+#define BEST_SCORE_MIN_INDEXED	(32)
+
 
 /*#define MY_MUTEX_INIT
 #define MY_MUTEX_DESTROY
@@ -47,16 +50,45 @@ BestScoreList::BestScoreList(int limit, int min_score, int seq0_len, int seq1_le
 	this->seq0_len = seq0_len;
 	this->seq1_len = seq1_len;
 	this->score_params = score_params;
+	this->mergedBestScore = -INF;
+
+	/* about 64x64 buckets, with at least 1024x1024 cells each */
+	int max_len = seq0_len > seq1_len ? seq0_len : seq1_len;
+	this->bucketShift = 10;
+	while ((max_len >> bucketShift) > 64) {
+		bucketShift++;
+	}
+	this->bucketsI = (seq0_len >> bucketShift) + 1;
+	this->bucketsJ = (seq1_len >> bucketShift) + 1;
+	this->buckets = new vector<score_t>[bucketsI*bucketsJ];
 
 	MY_MUTEX_INIT
+	pthread_key_create(&stagingKey, NULL);
 }
 
 BestScoreList::~BestScoreList() {
+	pthread_key_delete(stagingKey);
+	for (size_t k=0; k<stagingBuffers.size(); k++) {
+		pthread_mutex_destroy(&stagingBuffers[k]->mutex);
+		delete stagingBuffers[k];
+	}
+	delete[] buckets;
 	MY_MUTEX_DESTROY
 }
 
+/**
+ * Merges the scores of all the staging buffers in the list.
+ */
+void BestScoreList::flush() {
+	MY_MUTEX_LOCK
+	for (size_t k=0; k<stagingBuffers.size(); k++) {
+		mergeStaging(stagingBuffers[k]);
+	}
+	MY_MUTEX_UNLOCK
+}
 
-score_t BestScoreList::getBestScore() const {
+score_t BestScoreList::getBestScore() {
+	flush();
 	set<score_t>::iterator it=begin();
 	if (it == end()) {
 		score_t null_score;
@@ -121,9 +153,144 @@ bool BestScoreList::isAllowed(const score_t best, const score_t score) {
 }
 
 void BestScoreList::add(int i, int j, int score) {
-	MY_MUTEX_LOCK
-	_add(i,j,score);
-	MY_MUTEX_UNLOCK
+	if (score < min_score) return;
+	score_t reg;
+	reg.score = score;
+	reg.i = i;
+	reg.j = j;
+
+	/* The best score never decreases, so a score that is not allowed now
+	 * will never be allowed. */
+	score_t best;
+	best.score = mergedBestScore;
+	if (best.score > -INF && !isAllowed(best, reg)) return;
+
+	best_score_staging_t* staging = getStaging();
+	pthread_mutex_lock(&staging->mutex);
+	staging->scores[staging->count++] = reg;
+	bool full = (staging->count == BEST_SCORE_STAGING_SIZE);
+	pthread_mutex_unlock(&staging->mutex);
+
+	if (full) {
+		MY_MUTEX_LOCK
+		mergeStaging(staging);
+		MY_MUTEX_UNLOCK
+	}
+}
+
+/**
+ * @return the staging buffer of the current thread.
+ */
+best_score_staging_t* BestScoreList::getStaging() {
+	best_score_staging_t* staging = (best_score_staging_t*)pthread_getspecific(stagingKey);
+	if (staging == NULL) {
+		staging = new best_score_staging_t;
+		pthread_mutex_init(&staging->mutex, NULL);
+		staging->count = 0;
+		MY_MUTEX_LOCK
+		stagingBuffers.push_back(staging);
+		MY_MUTEX_UNLOCK
+		pthread_setspecific(stagingKey, staging);
+	}
+	return staging;
+}
+
+/**
+ * Merges the scores of a staging buffer in the list, in the same order they
+ * were added. The list mutex must be held by the caller.
+ */
+void BestScoreList::mergeStaging(best_score_staging_t* staging) {
+	score_t scores[BEST_SCORE_STAGING_SIZE];
+	pthread_mutex_lock(&staging->mutex);
+	int count = staging->count;
+	for (int k=0; k<count; k++) {
+		scores[k] = staging->scores[k];
+	}
+	staging->count = 0;
+	pthread_mutex_unlock(&staging->mutex);
+
+	for (int k=0; k<count; k++) {
+		_add(scores[k].i, scores[k].j, scores[k].score);
+	}
+	if (size() > 0) {
+		mergedBestScore = begin()->score;
+	}
+}
+
+/**
+ * @return the bucket (bi,bj) or NULL if it is outside the grid.
+ */
+vector<score_t>* BestScoreList::getBucket(int bi, int bj) const {
+	if (bi < 0 || bj < 0 || bi >= bucketsI || bj >= bucketsJ) {
+		return NULL;
+	}
+	return &buckets[bi*bucketsJ + bj];
+}
+
+void BestScoreList::insertScore(const score_t score) {
+	insert(score);
+	vector<score_t>* bucket = getBucket(score.i >> bucketShift, score.j >> bucketShift);
+	if (bucket != NULL) {
+		bucket->push_back(score);
+	}
+}
+
+void BestScoreList::eraseScore(set<score_t,classcomp>::iterator it) {
+	vector<score_t>* bucket = getBucket(it->i >> bucketShift, it->j >> bucketShift);
+	if (bucket != NULL) {
+		for (size_t k=0; k<bucket->size(); k++) {
+			if ((*bucket)[k].i == it->i && (*bucket)[k].j == it->j) {
+				(*bucket)[k] = bucket->back();
+				bucket->pop_back();
+				break;
+			}
+		}
+	}
+	erase(it);
+}
+
+/**
+ * Checks if the score is derived from any score of the list. The best
+ * score and the scores in the neighbor buckets are the most likely to
+ * derive it, so they are checked before the rest of the list.
+ */
+bool BestScoreList::isDerivedFromList(const score_t reg) {
+	if (size() < BEST_SCORE_MIN_INDEXED) {
+		for (set<score_t>::iterator it=begin() ; it != end(); it++ ) {
+			if (isDerived(*it, reg)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	if (isDerived(*begin(), reg)) {
+		return true;
+	}
+	int bi = reg.i >> bucketShift;
+	int bj = reg.j >> bucketShift;
+	for (int di=-1; di<=1; di++) {
+		for (int dj=-1; dj<=1; dj++) {
+			const vector<score_t>* bucket = getBucket(bi+di, bj+dj);
+			if (bucket == NULL) continue;
+			for (size_t k=0; k<bucket->size(); k++) {
+				if (isDerived((*bucket)[k], reg)) {
+					return true;
+				}
+			}
+		}
+	}
+	for (set<score_t>::iterator it=++begin() ; it != end(); it++ ) {
+		int ii = it->i >> bucketShift;
+		int jj = it->j >> bucketShift;
+		if (abs(ii - bi) <= 1 && abs(jj - bj) <= 1 && getBucket(ii, jj) != NULL) {
+			continue; // already checked
+		}
+		if (isDerived(*it, reg)) {
+			//printf("HEY NOT: (%d,%d,%d) -> (%d,%d,%d)\n", reg.y, reg.x, reg.z, it->y, it->x, it->z);
+			return true;
+		}
+	}
+	return false;
 }
 
 void BestScoreList::_add(int i, int j, int score) {
@@ -151,14 +318,7 @@ void BestScoreList::_add(int i, int j, int score) {
 		return;
 	}
 
-	bool derived = false;
-	for (set<score_t>::iterator it=begin() ; it != end(); it++ ) {
-		if (isDerived(*it, reg)) {
-			derived = true;
-			//printf("HEY NOT: (%d,%d,%d) -> (%d,%d,%d)\n", reg.y, reg.x, reg.z, it->y, it->x, it->z);
-			break;
-		}
-	}
+	bool derived = isDerivedFromList(reg);
 
 	if (!derived) {
 		set<score_t>::iterator it=begin();
@@ -166,7 +326,7 @@ void BestScoreList::_add(int i, int j, int score) {
 			if (isDerived(reg, *it) || !isAllowed(reg, *it)) {
 				set<score_t>::iterator toErase = it;
 				it++;
-				erase(toErase);
+				eraseScore(toErase);
 				//printf("HEY ERASE: (%d,%d,%d) -> (%d,%d,%d)\n", reg.y, reg.x, reg.z, it->y, it->x, it->z);
 			} else {
 				it++;
@@ -174,11 +334,11 @@ void BestScoreList::_add(int i, int j, int score) {
 		}
 
 
-		insert(reg);
+		insertScore(reg);
 		if (size() > limit) {
 			set<score_t>::iterator it=end();
 			it--;
-			erase(it);
+			eraseScore(it);
 		}
 		if (DEBUG) {
 			int c = 1;
@@ -23,6 +23,7 @@
 #define BESTSCORELIST_H_
 #include <pthread.h>
 #include <set>
+#include <vector>
 using namespace std;
 
 #include "../libmasa/libmasa.hpp"
@@ -38,12 +39,33 @@ struct classcomp {
 };
 
 
+/** Number of scores kept by each thread before they are merged in the list */
+#define BEST_SCORE_STAGING_SIZE	(64)
+
+/**
+ * Scores added by a single thread that were not merged in the list yet.
+ */
+typedef struct {
+	pthread_mutex_t mutex;
+	int count;
+	score_t scores[BEST_SCORE_STAGING_SIZE];
+} best_score_staging_t;
+
+/**
+ * Sorted list of the best scores that are not derived from each other.
+ *
+ * The add() method may be called concurrently. Each thread keeps its new
+ * scores in a private staging buffer, which is merged in the list when it
+ * is full or when the list is read (flush(), getBestScore()). Note that the
+ * set iterators only see the merged scores.
+ */
 class BestScoreList : public std::set<score_t,classcomp> {
 public:
 	BestScoreList(int limit, int min_score, int seq0_len, int seq1_len, const score_params_t* score_params);
 	virtual ~BestScoreList();
 	void add(int i, int j, int score);
-	score_t getBestScore() const;
+	void flush();
+	score_t getBestScore();
 private:
 	int limit;
 	int min_score;
@@ -54,9 +76,30 @@ private:
 	//set<int3,classcomp> bestScores;
 	pthread_mutex_t mutex;
 
+	/** Key of the staging buffer of each thread */
+	pthread_key_t stagingKey;
+	/** All the staging buffers, owned by this list */
+	vector<best_score_staging_t*> stagingBuffers;
+	/** Best merged score, read without locks. It never decreases. */
+	volatile int mergedBestScore;
+
+	/** Spatial index of the scores in the list: a grid of buckets */
+	vector<score_t>* buckets;
+	/** log2 of the bucket size */
+	int bucketShift;
+	/** Number of buckets in each dimension */
+	int bucketsI;
+	int bucketsJ;
+
 	bool isDerived(const score_t best, const score_t score);
 	bool isAllowed(const score_t best, const score_t score);
+	bool isDerivedFromList(const score_t score);
 	void _add(int i, int j, int score);
+	void insertScore(const score_t score);
+	void eraseScore(set<score_t,classcomp>::iterator it);
+	vector<score_t>* getBucket(int bi, int bj) const;
+	best_score_staging_t* getStaging();
+	void mergeStaging(best_score_staging_t* staging);
 };
 
 #endif /* BESTSCORELIST_H_ */
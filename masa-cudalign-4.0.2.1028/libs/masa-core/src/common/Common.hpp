@@ -29,6 +29,7 @@
 #include "CrosspointsFile.hpp"
 #include "Timer.hpp"
 #include "RecurrentTimer.hpp"
+#include "Tracer.hpp"
 #include "Status.hpp"
 #include "BestScoreList.hpp"
 #include "BlocksFile.hpp"
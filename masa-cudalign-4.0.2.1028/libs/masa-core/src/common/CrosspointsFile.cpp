@@ -23,7 +23,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <algorithm>
+
+#include "Tracer.hpp"
 using namespace std;
 
 CrosspointsFile::CrosspointsFile(string filename) {
@@ -31,6 +37,7 @@ CrosspointsFile::CrosspointsFile(string filename) {
     this->tmpFilename = filename + ".tmp";
     this->autoSave = false;
     this->file = NULL;
+    this->written = 0;
 }
 
 CrosspointsFile::~CrosspointsFile() {
@@ -38,13 +45,87 @@ CrosspointsFile::~CrosspointsFile() {
 }
 
 void CrosspointsFile::loadCrosspoints() {
-    FILE * file = fopen(filename.c_str(), "r");
-    if (file == NULL) {
+	TRACE_SPAN(TRACE_IO, "load crosspoints");
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
     	this->clear();
         printf("NO CROSSPOINTS: %s\n", filename.c_str());
     	return;
     }
 
+    if (loadBinary(fd)) {
+    	::close(fd);
+    } else {
+    	FILE* file = fdopen(fd, "r");
+    	loadText(file);
+    	fclose(file);
+    }
+
+	printf("LOAD CROSSPOINTS: count %d\n", this->size());
+    /*if (this->front().i < this->back().i || this->front().j < this->back().j) {
+        std::reverse(this->begin(),this->end());
+    }*/
+}
+
+/**
+ * Loads the crosspoints from a binary file. The records are mapped in memory
+ * and copied at once, without any parsing.
+ *
+ * @param fd the descriptor of the opened file.
+ * @return false if the file is not in the binary format.
+ */
+bool CrosspointsFile::loadBinary(int fd) {
+	crosspoints_header_t header;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		return false;
+	}
+	if (memcmp(header.magic, CROSSPOINTS_MAGIC, sizeof(header.magic)) != 0) {
+		return false;
+	}
+	if (header.version != CROSSPOINTS_VERSION || header.record_size != sizeof(crosspoint_t)) {
+		fprintf(stderr, "Incompatible crosspoints file: %s (version %d, record size %d)\n",
+				filename.c_str(), header.version, header.record_size);
+		exit(1);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "Error reading crosspoints file: %s\n", filename.c_str());
+		exit(1);
+	}
+	long long available = (st.st_size - sizeof(header)) / sizeof(crosspoint_t);
+	long long count = header.count;
+	if (count == 0) {
+		/* file not closed: trust the records already flushed */
+		count = available;
+	} else if (count > available) {
+		fprintf(stderr, "Truncated crosspoints file: %s (%lld of %lld)\n",
+				filename.c_str(), available, count);
+		count = available;
+	}
+
+	this->clear();
+	if (count == 0) {
+		return true;
+	}
+
+	void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "Error mapping crosspoints file: %s\n", filename.c_str());
+		exit(1);
+	}
+	const crosspoint_t* records = (const crosspoint_t*)((const char*)ptr + sizeof(header));
+	this->assign(records, records + count);
+	munmap(ptr, st.st_size);
+	return true;
+}
+
+/**
+ * Loads the crosspoints from a file in the legacy text format.
+ *
+ * @param file the opened file.
+ */
+void CrosspointsFile::loadText(FILE* file) {
     char line[500];
     int started = 0;
     while (fgets(line, sizeof(line), file) != NULL) {
@@ -60,12 +141,6 @@ void CrosspointsFile::loadCrosspoints() {
             this->clear();
         }
     }
-    fclose(file);
-
-	printf("LOAD CROSSPOINTS: count %d\n", this->size());
-    /*if (this->front().i < this->back().i || this->front().j < this->back().j) {
-        std::reverse(this->begin(),this->end());
-    }*/
 }
 
 int CrosspointsFile::getLargestPartitionSize(int* max_i, int* max_j) {
@@ -97,7 +172,31 @@ void CrosspointsFile::setAutoSave() {
 }
 
 void CrosspointsFile::writeToFile(string filename) {
+	TRACE_SPAN(TRACE_IO, "write crosspoints");
 	FILE* file = fopen(filename.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening crosspoints file: %s\n", filename.c_str());
+		exit(1);
+	}
+	writeHeader(file, this->size());
+	if (!this->empty()) {
+		fwrite(&this->front(), sizeof(crosspoint_t), this->size(), file);
+	}
+    fclose(file);
+}
+
+/**
+ * Writes the crosspoints in the legacy text format, with one line
+ * "type,i,j,score" for each crosspoint between START and END markers.
+ *
+ * @param filename the name of the exported file.
+ */
+void CrosspointsFile::exportText(string filename) {
+	FILE* file = fopen(filename.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening crosspoints file: %s\n", filename.c_str());
+		exit(1);
+	}
 	fprintf(file, "START\n");
 	for (int i=0; i < this->size(); i++) {
 		crosspoint_t c = at(i);
@@ -107,6 +206,16 @@ void CrosspointsFile::writeToFile(string filename) {
     fclose(file);
 }
 
+void CrosspointsFile::writeHeader(FILE* file, long long count) {
+	crosspoints_header_t header;
+	memset(&header, 0, sizeof(header));
+	strncpy(header.magic, CROSSPOINTS_MAGIC, sizeof(header.magic));
+	header.version = CROSSPOINTS_VERSION;
+	header.record_size = sizeof(crosspoint_t);
+	header.count = count;
+	fwrite(&header, sizeof(header), 1, file);
+}
+
 void CrosspointsFile::open() {
     file = fopen(tmpFilename.c_str(), "w");
 	if (file == NULL) {
@@ -114,14 +223,17 @@ void CrosspointsFile::open() {
 		exit(1);
 	}
     fprintf(stderr, "START\n");
-    fprintf(file, "START\n");
+    writeHeader(file, 0);
+    written = 0;
 }
 
 void CrosspointsFile::close() {
     if (file != NULL) {
         fprintf(stderr, "END\n");
-        fprintf(file, "END\n");
 
+        /* the final count marks the file as closed */
+        fseek(file, 0, SEEK_SET);
+        writeHeader(file, written);
         fclose(file);
         file = NULL;
 
@@ -143,17 +255,19 @@ void CrosspointsFile::write(crosspoint_t crosspoint) {
 		fprintf(stderr, "Crosspoints File not opened.\n");
 		exit(1);
 	}
-    fprintf(file, "%d,%d,%d,%d\n", crosspoint.type, crosspoint.i, crosspoint.j, crosspoint.score);
+    fwrite(&crosspoint, sizeof(crosspoint_t), 1, file);
+    written++;
     fprintf(stderr, "%d,%d,%d,%d\n", crosspoint.type, crosspoint.i, crosspoint.j, crosspoint.score);
     push_back(crosspoint);
     fflush(file);
 }
 
 void CrosspointsFile::save() {
+	TRACE_SPAN(TRACE_IO, "write crosspoints");
 	open();
-	for (iterator it=begin() ; it != end(); it++ ) {
-	    fprintf(file, "%d,%d,%d,%d\n", it->type, it->i, it->j, it->score);
-	    //fprintf(stderr, "%d,%d,%d,%d\n", it->type, it->i, it->j, it->score);
+	if (!this->empty()) {
+		fwrite(&this->front(), sizeof(crosspoint_t), this->size(), file);
+		written = this->size();
 	}
 	close();
 }
@@ -29,6 +29,36 @@ using namespace std;
 
 #include "Crosspoint.hpp"
 
+/** Magic string identifying the binary crosspoints files. */
+#define CROSSPOINTS_MAGIC		"MASACRP"
+/** Version of the binary crosspoints format. */
+#define CROSSPOINTS_VERSION		(1)
+
+/** @brief Header of the binary crosspoints files.
+ *
+ * The binary file is composed by this header followed by a raw array
+ * of crosspoint_t records, so it can be mapped in memory and loaded
+ * without parsing. While the file is being appended, the count field
+ * is zero and the number of records is given by the file size.
+ */
+typedef struct {
+	/** CROSSPOINTS_MAGIC, including the null terminator. */
+	char magic[8];
+	/** CROSSPOINTS_VERSION. */
+	int version;
+	/** sizeof(crosspoint_t), used to reject files from incompatible builds. */
+	int record_size;
+	/** Number of records, or zero if the file was not closed. */
+	long long count;
+} crosspoints_header_t;
+
+/** @brief List of crosspoints persisted in a file.
+ *
+ * The crosspoints are stored in a binary format (see crosspoints_header_t).
+ * Files in the legacy text format (lines "type,i,j,score" between START and
+ * END markers) are still accepted by loadCrosspoints() and may be produced
+ * with exportText() (see the --export-crosspoints parameter).
+ */
 class CrosspointsFile : public std::vector<crosspoint_t> {
     public:
         CrosspointsFile ( string filename );
@@ -42,6 +72,7 @@ class CrosspointsFile : public std::vector<crosspoint_t> {
         void close();
 
         void writeToFile( string filename );
+        void exportText( string filename );
 
         void save();
 
@@ -51,8 +82,13 @@ class CrosspointsFile : public std::vector<crosspoint_t> {
         string tmpFilename;
         FILE* file;
         bool autoSave;
+        /** Number of records appended to the opened file. */
+        long long written;
 
         void open();
+        void writeHeader(FILE* file, long long count);
+        bool loadBinary(int fd);
+        void loadText(FILE* file);
 };
 
 #endif	/* _CROSSPOINTSFILE_HPP */
@@ -27,6 +27,7 @@ using namespace std;
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <algorithm>
 #include <sys/stat.h>
 #include <errno.h>
@@ -34,12 +35,20 @@ using namespace std;
 #include <wordexp.h>
 #include "Properties.hpp"
 #include "SpecialRowWriter.hpp"
+#include "sra/SpecialRowFlusher.hpp"
+#include "sra/SpecialRowCompressed.hpp"
 #include "exceptions/exceptions.hpp"
+#include "../libmasa/parameters/BlockAlignerParameters.hpp"
 
 #define DEBUG (0)
 
 #define SRA_DECAY (1.0f)
 
+/**
+ * Fraction of the ram limit used by the buffers queued for the disk.
+ */
+#define SRA_FLUSHER_RAM_FRACTION (16)
+
 Job::Job(int sequencesCount) {
     this->alignment_params = new AlignmentParams();
     this->alignment = NULL;
@@ -50,7 +59,11 @@ Job::Job(int sequencesCount) {
     this->flushIntervals = NULL;
     this->maxFlushDeep = 20;
     this->pool_wait_id = -1;
+    this->pool_transport = POOL_TRANSPORT_FILE;
     this->bufferLimit = 0;
+    this->compress_special_rows = false;
+    this->direct_io = false;
+    this->batch = false;
 }
 
 Job::~Job() {
@@ -59,12 +72,23 @@ Job::~Job() {
 	clearSpecialRowsAreas();
 }
 
-int Job::initialize() {
+/**
+ * Initializes the work directory and the flush intervals of the job.
+ *
+ * @param initializeAligner if false, the aligner is not initialized, since
+ * 		it was already initialized by a previous job of the same process
+ * 		(see createBatchJob).
+ * @return 1 if the job was initialized, 0 if the work directory belongs to
+ * 		other sequences.
+ */
+int Job::initialize(bool initializeAligner) {
     initializeWorkPath();
 	SequenceInfo* seq0 = alignment_params->getSequence(0)->getInfo();
 	SequenceInfo* seq1 = alignment_params->getSequence(1)->getInfo();
 
 	calculateFlushIntervals(maxFlushDeep, getSRALimit(), seq0->getSize(), seq1->getSize());
+	SpecialRowFlusher::setBufferLimit(ram_limit/SRA_FLUSHER_RAM_FRACTION);
+	SpecialRowFlusher::setDirectIO(direct_io);
 
     Properties prop;
     if (prop.initialize(this->info_filename.c_str())) {
@@ -97,7 +121,9 @@ int Job::initialize() {
     cout << this->special_rows_path << endl;
 
     // TODO poderia ficar fora da class Job?
-	aligner->initialize();
+    if (initializeAligner) {
+    	aligner->initialize();
+    }
 
     if (getAlignerPool() != NULL) {
 		int j0 = getAlignmentParams()->getSequence(1)->getTrimStart()-1;
@@ -115,12 +141,61 @@ int Job::initialize() {
     return 1; // TODO remover quando for retornar excecao
 }
 
+/**
+ * Creates the job of one pair of a batch execution (see --batch). The new
+ * job shares the parameters, the aligner and the configs of this job, but
+ * it has no sequences and its work directory (and its special rows
+ * directory, if customized) is the subdirectory <name> of this job's one.
+ *
+ * @param name the name of the pair.
+ * @return the new job, which must be deleted by the caller.
+ */
+Job* Job::createBatchJob(string name) const {
+	Job* job = new Job(sequences.size());
+
+	AlignmentParams* params = job->getAlignmentParams();
+	params->setAlignmentMethod(alignment_params->getAlignmentMethod());
+	params->setAffineGapPenalties(alignment_params->getGapOpen(), alignment_params->getGapExtension());
+	params->setMatchMismatchScores(alignment_params->getMatch(), alignment_params->getMismatch());
+
+	job->alignment_start = alignment_start;
+	job->alignment_end = alignment_end;
+	job->max_alignments = max_alignments;
+	job->ram_limit = ram_limit;
+	job->disk_limit = disk_limit;
+	job->compress_special_rows = compress_special_rows;
+	job->direct_io = direct_io;
+	job->block_pruning = block_pruning;
+	job->band = band;
+	job->xdrop = xdrop;
+	job->dump_blocks = dump_blocks;
+	job->flush_column_url = flush_column_url;
+	job->load_column_url = load_column_url;
+	job->predicted_traceback = predicted_traceback;
+	job->stage4_maximum_partition_size = stage4_maximum_partition_size;
+	job->stage4_strategy = stage4_strategy;
+	job->stage6_output_format = stage6_output_format;
+	job->aligner = aligner;
+	job->configs = configs;
+	job->peer_listen_port = peer_listen_port;
+	job->peer_connect = peer_connect;
+	job->pool_transport = pool_transport;
+	job->bufferLimit = bufferLimit;
+	job->batch = true;
+
+	job->work_path = work_path + "/" + name;
+	if (special_rows_path.length() > 0) {
+		job->special_rows_path = special_rows_path + "/" + name;
+	}
+	return job;
+}
+
 void Job::initializeWorkPath() {
     if (this->pool_shared_path.length() == 0) {
     	this->pool_shared_path = work_path + "/shared";
     }
 
-    if (aligner->getParameters()->getForkId() != NOT_FORKED_INSTANCE) {
+    if (aligner->getParameters()->getForkId() != NOT_FORKED_INSTANCE && !batch) {
         createPath(this->work_path);
 
         char suffix[20];
@@ -221,13 +296,67 @@ void Job::clearSpecialRowsArea(SpecialRowsArea** area) {
 AlignerPool* Job::getAlignerPool() {
 	if (alignerPool == NULL) {
 		if (flush_column_url.length() > 0 || load_column_url.length() > 0) {
-			alignerPool = new AlignerPool(pool_shared_path);
+			alignerPool = new AlignerPool(pool_shared_path, pool_transport);
 			alignerPool->initialize();
 		}
 	}
 	return alignerPool;
 }
 
+/**
+ * Returns the aligner of a worker thread. Worker 0 uses the main aligner,
+ * while the other workers use clones that are created on demand and are
+ * kept until the end of the process.
+ *
+ * @param worker the worker id.
+ * @return the aligner or NULL if the aligner cannot be cloned.
+ */
+IAligner* Job::getWorkerAligner(int worker) {
+	if (worker == 0) {
+		return aligner;
+	}
+	while ((int)workerAligners.size() < worker) {
+		IAligner* clone = aligner->clone();
+		if (clone == NULL) {
+			return NULL;
+		}
+		if (aligner->getCapabilities().variable_penalties == SUPPORTED) {
+			clone->setScoreParameters(aligner->getScoreParameters());
+		}
+		clone->initialize();
+		workerAligners.push_back(clone);
+	}
+	return workerAligners[worker-1];
+}
+
+/**
+ * Returns the number of threads used by the stages that process many
+ * partitions concurrently. The --threads parameter of block aligners is
+ * used if it was given. Otherwise, forked instances (including the workers
+ * of a batch execution) use a single thread, since each process already
+ * receives its own CPU, and other instances use one thread per CPU.
+ *
+ * @return the number of threads.
+ */
+int Job::getThreadCount() const {
+	BlockAlignerParameters* blockParams = dynamic_cast<BlockAlignerParameters*>(aligner->getParameters());
+	if (blockParams != NULL && blockParams->getThreadCount() > 0) {
+		return blockParams->getThreadCount();
+	}
+	if (aligner->getParameters()->getForkId() != NOT_FORKED_INSTANCE) {
+		return 1;
+	}
+	int numCPU = sysconf( _SC_NPROCESSORS_ONLN );
+	return numCPU > 0 ? numCPU : 1;
+}
+
+void Job::finalizeWorkerAligners() {
+	for (size_t i=0; i<workerAligners.size(); i++) {
+		workerAligners[i]->finalize();
+	}
+	workerAligners.clear();
+}
+
 void Job::calculateFlushIntervals(int max_deep, long long limit, int seq0_len, int seq1_len) {
 	if (flushIntervals != NULL) {
 		delete flushIntervals;
@@ -277,7 +406,7 @@ SpecialRowsArea* Job::getSpecialRowsArea(int stage, int id, int deep) {
     SpecialRowsArea* area = specialRowsAreas[name];
     if (area == NULL) {
     	createPath(name);
-    	long long disk = disk_limit;
+    	long long disk = getDiskCapacity();
     	if (stage == STAGE_2) {
     		disk = (disk + ram_limit)/SRA_DECAY - ram_limit;
     	} else if (stage == STAGE_3) {
@@ -290,6 +419,10 @@ SpecialRowsArea* Job::getSpecialRowsArea(int stage, int id, int deep) {
     	}
     	printf(" Job::getSpecialRowsArea(%d, %d, %d) -> %d/%d\n", stage, id, deep, ram_limit, disk);
     	area = new SpecialRowsArea(name, ram_limit, disk, aligner->getScoreParameters());
+    	area->setCompressedRows(compress_special_rows);
+    	if (compress_special_rows && disk_limit > 0) {
+    		area->setDiskBudget(disk/SpecialRowCompressed::EXPECTED_RATIO);
+    	}
     	specialRowsAreas[name] = area;
     } else {
     	//area->reload();
@@ -303,6 +436,34 @@ string Job::getAlignmentBinaryFile(int id) {
 	return str;
 }
 
+/**
+ * @return the file where stage 1 stores the blocks computed with --xdrop.
+ */
+string Job::getRegionFile() {
+	return work_path + "/region.xdrop";
+}
+
+/**
+ * Creates the region given by the --band and --xdrop parameters. Stage 1
+ * only restricts the band, since it is the stage that runs the X-drop. The
+ * later stages also restrict the region to the blocks computed in stage 1.
+ *
+ * @param stage the current stage.
+ * @return the region, or NULL if the whole matrix must be aligned.
+ */
+AlignmentRegion* Job::createAlignmentRegion(int stage) {
+	if (band < 0 && (xdrop <= 0 || stage == STAGE_1)) {
+		return NULL;
+	}
+	AlignmentRegion* region = new AlignmentRegion(alignment_params->getSequence(0),
+			alignment_params->getSequence(1));
+	region->setBand(band);
+	if (xdrop > 0 && stage != STAGE_1) {
+		region->loadBlocks(getRegionFile());
+	}
+	return region;
+}
+
 string Job::getAlignmentTextFile(int id) {
     char str[500];
     sprintf(str, "%s/alignment.%02d.txt", work_path.c_str(), id);
@@ -352,14 +513,27 @@ FILE* Job::fopenStatistics(int stage, int id) {
 }
 
 long long Job::getSRALimit() {
-	if (disk_limit <= 0 && ram_limit <= 0) {
+	long long disk_capacity = getDiskCapacity();
+	if (disk_capacity <= 0 && ram_limit <= 0) {
 		return 0;
-	} else if (disk_limit <= 0) {
+	} else if (disk_capacity <= 0) {
 		return ram_limit;
 	} else if (ram_limit <= 0) {
-		return disk_limit;
+		return disk_capacity;
 	} else {
-		return disk_limit + ram_limit;
+		return disk_capacity + ram_limit;
+	}
+}
+
+/**
+ * Returns the amount of uncompressed special rows data that fits in the
+ * disk limit.
+ */
+long long Job::getDiskCapacity() {
+	if (compress_special_rows && disk_limit > 0) {
+		return disk_limit*SpecialRowCompressed::EXPECTED_RATIO;
+	} else {
+		return disk_limit;
 	}
 }
 
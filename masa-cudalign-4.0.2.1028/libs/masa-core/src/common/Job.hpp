@@ -36,6 +36,7 @@ using namespace std;
 #include "sra/SpecialRowsArea.hpp"
 #include "configs/Configs.hpp"
 #include "AlignerPool.hpp"
+#include "AlignmentRegion.hpp"
 
 #define STAGE_1   (1)
 #define STAGE_2   (2)
@@ -57,6 +58,7 @@ using namespace std;
 #define STAGE_4_STRATEGY_ORIGINAL_MM		0
 #define STAGE_4_STRATEGY_ORTHOGONAL		1
 #define STAGE_4_STRATEGY_OPTIMIZED		2
+#define STAGE_4_STRATEGY_SIMD			3
 
 
 class Job {
@@ -70,7 +72,11 @@ public:
 	int max_alignments;
 	long long ram_limit;
 	long long disk_limit;
+	bool compress_special_rows;
+	bool direct_io;
 	bool block_pruning;
+	int band;
+	int xdrop;
 	bool dump_blocks;
 	string flush_column_url;
 	string load_column_url;
@@ -88,6 +94,7 @@ public:
 
 	int peer_listen_port;
 	string peer_connect;
+	int pool_transport;
 
 	/* Statistics */
 
@@ -103,7 +110,8 @@ public:
 	void setSpecialRowsPath(string specialRowsPath);
 	void setSharedPath(string sharedPath);
 	string getWorkPath();
-	int initialize();
+	int initialize(bool initializeAligner = true);
+	Job* createBatchJob(string name) const;
 
 	FILE* fopenStatistics(int stage, int id);
 
@@ -118,13 +126,19 @@ public:
 	string getCrosspointFile(int stage, int id, int deep = -1);
 	string getAlignmentBinaryFile(int id);
 	string getAlignmentTextFile(int id);
+	string getRegionFile();
+	AlignmentRegion* createAlignmentRegion(int stage);
 
 	SpecialRowsArea* getSpecialRowsArea(int stage, int id, int deep = -1);
 	void clearSpecialRowsArea(SpecialRowsArea** area);
 
 	long long getSRALimit();
+	long long getDiskCapacity();
 	long long getFlushInterval(int step);
 	AlignerPool* getAlignerPool();
+	IAligner* getWorkerAligner(int worker);
+	void finalizeWorkerAligners();
+	int getThreadCount() const;
 	int getPoolWaitId() const;
 	void setPoolWaitId(int id);
 	int getBufferLimit() const;
@@ -147,8 +161,12 @@ private:
 	string pool_shared_path;
 	int pool_wait_id;
 	int bufferLimit;
+	/* The job is one of the pairs of a batch execution (see createBatchJob) */
+	bool batch;
 
 	map<string, SpecialRowsArea*> specialRowsAreas;
+	/* Clones of the aligner used by the worker threads (worker > 0) */
+	vector<IAligner*> workerAligners;
 
 	string getSpecialRowsPath(int stage, int id, int deep = -1);
 	void createPath(string path);
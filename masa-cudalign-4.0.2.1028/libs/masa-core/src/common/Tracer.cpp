@@ -0,0 +1,274 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "Tracer.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/** Number of events in each chunk of the per-thread buffers */
+#define TRACE_CHUNK_EVENTS	(4096)
+
+/** Maximum number of chunks per thread. Newer events are dropped. */
+#define TRACE_MAX_CHUNKS	(256)
+
+/**
+ * Chunk of events of a single thread. The count is only incremented after
+ * the event is stored, so the writer never sees incomplete events.
+ */
+struct trace_chunk_t {
+	trace_event_t events[TRACE_CHUNK_EVENTS];
+	volatile int count;
+	trace_chunk_t* volatile next;
+};
+
+/**
+ * Events recorded by a single thread.
+ */
+struct trace_buffer_t {
+	int tid;
+	const char* threadName;
+	int chunks;
+	long long dropped;
+	trace_chunk_t* first;
+	trace_chunk_t* last;
+	trace_buffer_t* next;
+};
+
+/** Buffer of the current thread */
+static __thread trace_buffer_t* localBuffer = NULL;
+
+bool Tracer::enabled = false;
+string Tracer::filename;
+int Tracer::pid = 0;
+long long Tracer::origin = 0;
+trace_buffer_t* volatile Tracer::buffers = NULL;
+volatile int Tracer::nextTid = 0;
+
+/**
+ * Starts recording the events. The file is written when the process exits.
+ *
+ * @param filename the name of the trace-event JSON file.
+ */
+void Tracer::open(string filename) {
+	if (enabled) {
+		return;
+	}
+	Tracer::filename = filename;
+	Tracer::pid = getpid();
+	Tracer::origin = 0;
+	Tracer::origin = now();
+	atexit(exitHandler);
+	pthread_atfork(NULL, NULL, forkHandler);
+	enabled = true;
+}
+
+/**
+ * Stops recording and writes the trace file. The forked instances append
+ * their pid to the file name.
+ */
+void Tracer::close() {
+	if (!enabled) {
+		return;
+	}
+	enabled = false;
+
+	string name = filename;
+	if (getpid() != pid) {
+		char str[32];
+		sprintf(str, ".%d", getpid());
+		name += str;
+	}
+	FILE* file = fopen(name.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not create trace file: %s\n", name.c_str());
+		return;
+	}
+	write(file);
+	fclose(file);
+}
+
+/**
+ * @return the current time in microseconds since Tracer::open.
+ */
+long long Tracer::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000LL + ts.tv_nsec/1000 - origin;
+}
+
+/**
+ * Records a span that finishes now.
+ *
+ * @param category one of the TRACE_* categories.
+ * @param name the string literal that names the span.
+ * @param start the start of the span, as returned by Tracer::now().
+ * @param arg an optional argument of the span.
+ */
+void Tracer::span(const char* category, const char* name, long long start, long long arg) {
+	if (!enabled) return;
+	record('X', category, name, start, now()-start, arg);
+}
+
+/**
+ * Records the current value of a counter.
+ *
+ * @param category one of the TRACE_* categories.
+ * @param name the string literal that names the counter.
+ * @param value the value of the counter.
+ */
+void Tracer::counter(const char* category, const char* name, long long value) {
+	if (!enabled) return;
+	record('C', category, name, now(), value, 0);
+}
+
+/**
+ * Records an instant event.
+ *
+ * @param category one of the TRACE_* categories.
+ * @param name the string literal that names the event.
+ * @param arg an optional argument of the event.
+ */
+void Tracer::instant(const char* category, const char* name, long long arg) {
+	if (!enabled) return;
+	record('i', category, name, now(), 0, arg);
+}
+
+/**
+ * Names the current thread in the timeline.
+ *
+ * @param name a string literal with the thread name.
+ */
+void Tracer::setThreadName(const char* name) {
+	if (!enabled) return;
+	getBuffer()->threadName = name;
+}
+
+/**
+ * Returns the buffer of the current thread, creating it in the first call.
+ * The new buffer is pushed into the global list with compare-and-swap.
+ */
+trace_buffer_t* Tracer::getBuffer() {
+	if (localBuffer == NULL) {
+		trace_buffer_t* buffer = new trace_buffer_t();
+		buffer->tid = __sync_fetch_and_add(&nextTid, 1);
+		buffer->threadName = NULL;
+		buffer->chunks = 1;
+		buffer->dropped = 0;
+		buffer->first = new trace_chunk_t();
+		buffer->first->count = 0;
+		buffer->first->next = NULL;
+		buffer->last = buffer->first;
+		do {
+			buffer->next = buffers;
+		} while (!__sync_bool_compare_and_swap(&buffers, buffer->next, buffer));
+		localBuffer = buffer;
+	}
+	return localBuffer;
+}
+
+void Tracer::record(char phase, const char* category, const char* name, long long ts, long long value, long long arg) {
+	trace_buffer_t* buffer = getBuffer();
+	trace_chunk_t* chunk = buffer->last;
+	if (chunk->count == TRACE_CHUNK_EVENTS) {
+		if (buffer->chunks == TRACE_MAX_CHUNKS) {
+			buffer->dropped++;
+			return;
+		}
+		trace_chunk_t* next = new trace_chunk_t();
+		next->count = 0;
+		next->next = NULL;
+		__sync_synchronize();
+		chunk->next = next;
+		buffer->last = next;
+		buffer->chunks++;
+		chunk = next;
+	}
+	trace_event_t* event = &chunk->events[chunk->count];
+	event->phase = phase;
+	event->category = category;
+	event->name = name;
+	event->ts = ts;
+	event->value = value;
+	event->arg = arg;
+	__sync_synchronize();
+	chunk->count++;
+}
+
+/**
+ * Writes the events of all the threads in the trace-event JSON format.
+ */
+void Tracer::write(FILE* file) {
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, "
+			"\"args\": {\"name\": \"masa %d\"}}", getpid(), getpid());
+	for (trace_buffer_t* buffer = buffers; buffer != NULL; buffer = buffer->next) {
+		if (buffer->threadName != NULL) {
+			fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+					"\"args\": {\"name\": \"%s\"}}", getpid(), buffer->tid, buffer->threadName);
+		}
+		if (buffer->dropped > 0) {
+			fprintf(stderr, "Trace: %lld events dropped in thread %d.\n", buffer->dropped, buffer->tid);
+		}
+		for (trace_chunk_t* chunk = buffer->first; chunk != NULL; chunk = chunk->next) {
+			int count = chunk->count;
+			for (int k = 0; k < count; k++) {
+				const trace_event_t* e = &chunk->events[k];
+				fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %lld, \"pid\": %d, \"tid\": %d",
+						e->name, e->category, e->phase, e->ts, getpid(), buffer->tid);
+				if (e->phase == 'X') {
+					fprintf(file, ", \"dur\": %lld, \"args\": {\"arg\": %lld}}", e->value, e->arg);
+				} else if (e->phase == 'C') {
+					fprintf(file, ", \"args\": {\"value\": %lld}}", e->value);
+				} else {
+					fprintf(file, ", \"s\": \"t\", \"args\": {\"arg\": %lld}}", e->arg);
+				}
+			}
+		}
+	}
+	fprintf(file, "\n]}\n");
+}
+
+void Tracer::exitHandler() {
+	close();
+}
+
+/**
+ * Discards the events inherited by a forked child, which only keeps the
+ * thread that called fork().
+ */
+void Tracer::forkHandler() {
+	for (trace_buffer_t* buffer = buffers; buffer != NULL; buffer = buffer->next) {
+		trace_chunk_t* chunk = buffer->first->next;
+		while (chunk != NULL) {
+			trace_chunk_t* next = chunk->next;
+			delete chunk;
+			chunk = next;
+		}
+		buffer->first->count = 0;
+		buffer->first->next = NULL;
+		buffer->last = buffer->first;
+		buffer->chunks = 1;
+		buffer->dropped = 0;
+	}
+}
@@ -0,0 +1,148 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef _TRACER_HPP
+#define	_TRACER_HPP
+
+#include <stdio.h>
+#include <string>
+using namespace std;
+
+/*
+ * Categories of the trace events.
+ */
+#define TRACE_STAGE		"stage"
+#define TRACE_ALIGNER	"aligner"
+#define TRACE_SRA		"special_rows"
+#define TRACE_BUFFER	"buffer"
+#define TRACE_STAGE4	"stage4"
+#define TRACE_POOL		"pool"
+#define TRACE_IO		"io"
+
+/**
+ * Records a span from the declaration until the end of the current scope.
+ */
+#define TRACE_SPAN(category, name)	TraceSpan _trace_span(category, name)
+
+/**
+ * Event recorded in the per-thread buffers. The name and the category
+ * must be string literals, since only the pointers are kept.
+ */
+struct trace_event_t {
+	/** name of the event */
+	const char* name;
+	/** category of the event */
+	const char* category;
+	/** start of the event in microseconds since Tracer::open */
+	long long ts;
+	/** duration in microseconds (spans) or the value (counters) */
+	long long value;
+	/** optional argument of the span, such as a size or a coordinate */
+	long long arg;
+	/** 'X' for spans, 'C' for counters and 'i' for instant events */
+	char phase;
+};
+
+struct trace_buffer_t;
+
+/**
+ * @brief Low overhead timeline of the execution, exported in the
+ * Chrome trace-event JSON format (chrome://tracing or Perfetto).
+ *
+ * Each thread appends its events to its own buffer without locks; the
+ * buffers are only linked in a global list (with compare-and-swap) when a
+ * thread records its first event. The file is written when the process
+ * exits, so the forked instances write their own files, suffixed with
+ * their pid. While the tracer is not opened, each trace point costs a
+ * single test.
+ */
+class Tracer {
+public:
+	static void open(string filename);
+	static void close();
+
+	/**
+	 * @return true if the events are being recorded.
+	 */
+	static inline bool isEnabled() {
+		return enabled;
+	}
+
+	static long long now();
+	static void span(const char* category, const char* name, long long start, long long arg=0);
+	static void counter(const char* category, const char* name, long long value);
+	static void instant(const char* category, const char* name, long long arg=0);
+	static void setThreadName(const char* name);
+
+private:
+	static bool enabled;
+	static string filename;
+	static int pid;
+	static long long origin;
+	static trace_buffer_t* volatile buffers;
+	static volatile int nextTid;
+
+	static trace_buffer_t* getBuffer();
+	static void record(char phase, const char* category, const char* name, long long ts, long long value, long long arg);
+	static void write(FILE* file);
+	static void exitHandler();
+	static void forkHandler();
+};
+
+/**
+ * @brief Span recorded between the constructor and the destructor.
+ */
+class TraceSpan {
+public:
+	/**
+	 * Starts the span.
+	 * @param category one of the TRACE_* categories.
+	 * @param name the string literal that names the span.
+	 */
+	inline TraceSpan(const char* category, const char* name) {
+		this->category = category;
+		this->name = name;
+		this->arg = 0;
+		this->start = Tracer::isEnabled() ? Tracer::now() : -1;
+	}
+
+	/**
+	 * Defines the argument exported with the span.
+	 * @param arg the argument value.
+	 */
+	inline void setArg(long long arg) {
+		this->arg = arg;
+	}
+
+	inline ~TraceSpan() {
+		if (start >= 0) {
+			Tracer::span(category, name, start, arg);
+		}
+	}
+
+private:
+	const char* category;
+	const char* name;
+	long long start;
+	long long arg;
+};
+
+#endif	/* _TRACER_HPP */
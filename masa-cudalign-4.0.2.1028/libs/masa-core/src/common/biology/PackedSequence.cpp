@@ -0,0 +1,170 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "PackedSequence.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+/** Characters of the 2-bit codes */
+static const char BASES[4] = {'A', 'C', 'G', 'T'};
+
+/** Decoded characters of each byte of codes, 4 bases per entry */
+static uint32_t decode_table[256];
+static bool decode_table_ready = false;
+
+static void init_decode_table() {
+	if (decode_table_ready) {
+		return;
+	}
+	for (int i=0; i<256; i++) {
+		char str[4];
+		for (int k=0; k<4; k++) {
+			str[k] = BASES[(i >> (2*k)) & 3];
+		}
+		memcpy(&decode_table[i], str, 4);
+	}
+	__sync_synchronize();
+	decode_table_ready = true;
+}
+
+static inline int encode(char c) {
+	switch (c) {
+		case 'A': return 0;
+		case 'C': return 1;
+		case 'G': return 2;
+		case 'T': return 3;
+		default: return -1;
+	}
+}
+
+static inline char complement(char c) {
+	switch (c) {
+		case 'A': return 'T';
+		case 'C': return 'G';
+		case 'G': return 'C';
+		case 'T': return 'A';
+		case 'a': return 't';
+		case 'c': return 'g';
+		case 'g': return 'c';
+		case 't': return 'a';
+		default: return c;
+	}
+}
+
+static bool run_before(const packed_run_t& run, int pos) {
+	return run.start + run.len <= pos;
+}
+
+/**
+ * Packs the sequence.
+ *
+ * @param data the characters of the sequence.
+ * @param size the number of characters.
+ */
+PackedSequence::PackedSequence(const char* data, int size) {
+	init_decode_table();
+	this->size = size;
+	this->codes = (unsigned char*)calloc((size + 3)/4 + 1, 1);
+	for (int i=0; i<size; i++) {
+		int code = encode(data[i]);
+		if (code >= 0) {
+			codes[i >> 2] |= code << (2*(i & 3));
+		} else if (!runs.empty() && runs.back().c == data[i]
+				&& runs.back().start + runs.back().len == i) {
+			runs.back().len++;
+		} else {
+			packed_run_t run;
+			run.start = i;
+			run.len = 1;
+			run.c = data[i];
+			runs.push_back(run);
+		}
+	}
+}
+
+PackedSequence::~PackedSequence() {
+	free(codes);
+	codes = NULL;
+}
+
+/**
+ * Decodes a range of the sequence.
+ *
+ * @param out the buffer that receives len characters.
+ * @param start the first position (0-based) of the range, counted in the
+ * 		reverse strand if reverse is true.
+ * @param len the number of characters.
+ * @param reverse decodes the reversed sequence.
+ * @param complement decodes the complement of the sequence.
+ */
+void PackedSequence::decode(char* out, int start, int len, bool reverse, bool complement) const {
+	if (reverse) {
+		decodeForward(out, size - start - len, len);
+		std::reverse(out, out + len);
+	} else {
+		decodeForward(out, start, len);
+	}
+	if (complement) {
+		for (int i=0; i<len; i++) {
+			out[i] = ::complement(out[i]);
+		}
+	}
+}
+
+void PackedSequence::decodeForward(char* out, int start, int len) const {
+	int i = start;
+	int end = start + len;
+	/* unaligned head */
+	for (; i < end && (i & 3) != 0; i++) {
+		*out++ = BASES[(codes[i >> 2] >> (2*(i & 3))) & 3];
+	}
+	/* 4 bases per byte */
+	for (; i + 4 <= end; i += 4) {
+		memcpy(out, &decode_table[codes[i >> 2]], 4);
+		out += 4;
+	}
+	for (; i < end; i++) {
+		*out++ = BASES[(codes[i >> 2] >> (2*(i & 3))) & 3];
+	}
+	out -= len;
+
+	/* overwrites the other characters */
+	vector<packed_run_t>::const_iterator it = std::lower_bound(runs.begin(), runs.end(), start, run_before);
+	for (; it != runs.end() && it->start < end; it++) {
+		int r0 = std::max(it->start, start);
+		int r1 = std::min(it->start + it->len, end);
+		memset(out + (r0 - start), it->c, r1 - r0);
+	}
+}
+
+int PackedSequence::getSize() const {
+	return size;
+}
+
+/**
+ * @return the number of bytes used to store the sequence.
+ */
+long long PackedSequence::getMemorySize() const {
+	return (size + 3)/4 + 1 + runs.size()*sizeof(packed_run_t);
+}
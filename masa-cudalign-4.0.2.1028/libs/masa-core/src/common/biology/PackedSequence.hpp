@@ -0,0 +1,68 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef PACKEDSEQUENCE_HPP_
+#define PACKEDSEQUENCE_HPP_
+
+#include <vector>
+using namespace std;
+
+/** @brief Run of equal characters that cannot be represented with 2 bits. */
+typedef struct {
+	/** Position of the first character (0-based) */
+	int start;
+	/** Number of characters */
+	int len;
+	/** The character */
+	char c;
+} packed_run_t;
+
+/** @brief Sequence of nucleotides stored with 2 bits per base.
+ *
+ * The bases A, C, G and T are stored in 2 bits each (4 bases per byte).
+ * Any other character (e.g. 'N', 'n' or other IUPAC codes) is kept in a
+ * sorted list of runs, which is usually very short for real genomes.
+ *
+ * Ranges of the sequence are decoded on demand, optionally as the reverse,
+ * complement or reverse-complement strand, so these strands need not be
+ * stored.
+ */
+class PackedSequence {
+public:
+	PackedSequence(const char* data, int size);
+	virtual ~PackedSequence();
+
+	void decode(char* out, int start, int len, bool reverse=false, bool complement=false) const;
+	int getSize() const;
+	long long getMemorySize() const;
+
+private:
+	/** Number of bases */
+	int size;
+	/** 2-bit codes, 4 bases per byte */
+	unsigned char* codes;
+	/** Characters that are not A, C, G or T */
+	vector<packed_run_t> runs;
+
+	void decodeForward(char* out, int start, int len) const;
+};
+
+#endif /* PACKEDSEQUENCE_HPP_ */
@@ -43,6 +43,7 @@ Sequence::Sequence( SequenceInfo* info, SequenceModifiers* modifiers ) {
 	if (this->data != NULL) {
 		this->info->setDescription(this->data->getDescription());
 		this->info->setSize(this->data->getOriginalSize());
+		this->info->setHash(this->data->getHash());
 		this->len = this->data->getSize();
 	} else {
 		this->len = 0;
@@ -177,6 +178,27 @@ const char* Sequence::getData(bool reverse) const {
 	}
 }
 
+/**
+ * Decodes a range of the data, without materializing the whole strand.
+ *
+ * @param out the buffer that receives len characters.
+ * @param start the first position (0-based) of the range, in the same
+ * 		coordinates of getData(reverse).
+ * @param len the number of characters.
+ * @param reverse see getData.
+ */
+void Sequence::decode(char* out, int start, int len, bool reverse) const {
+	this->data->decode(out, start, len, reverseData ^ reverse);
+}
+
+/**
+ * Returns the number of characters of the data, which is the length of
+ * the array returned by getData (regardless of the trimming).
+ */
+int Sequence::getDataSize() const {
+	return this->data->getSize();
+}
+
 const char* Sequence::getForwardData() const {
 	return this->data->getForwardData();
 }
@@ -63,6 +63,8 @@ public:
 	void setInfo(SequenceInfo* info);
 	SequenceModifiers* getModifiers() const;
 	const char* getData(bool reverse = false) const;
+	void decode(char* out, int start, int len, bool reverse = false) const;
+	int getDataSize() const;
 	const char* getForwardData() const;
 	const char* getReverseData() const;
 	//char getPaddingChar() const;
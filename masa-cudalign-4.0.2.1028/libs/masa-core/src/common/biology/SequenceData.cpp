@@ -23,11 +23,44 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <string>
 using namespace std;
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "Constants.hpp"
 #include "SequenceModifiers.hpp"
+#include "../Tracer.hpp"
+
+string SequenceData::cacheDirectory = "";
+
+/**
+ * Returns true for the characters stripped from the fasta data.
+ */
+static inline bool is_blank(unsigned char c) {
+	return c == '\n' || c == '\r' || c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/**
+ * FNV-1a hash, used to name the cache files.
+ */
+static unsigned long long fnv1a(const void* data, size_t len, unsigned long long hash=14695981039346656037ULL) {
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i=0; i<len; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
 
 /*SequenceData::SequenceData(char* data, int size, SequenceModifiers* modifiers) {
 	this->modifiers = modifiers;
@@ -39,6 +72,10 @@ using namespace std;
 
 SequenceData::SequenceData(string filename, SequenceModifiers* modifiers) {
 	this->modifiers = modifiers;
+	this->packed = NULL;
+	this->forwardData = NULL;
+	this->reverseData = NULL;
+	pthread_mutex_init(&mutex, NULL);
 	loadFile(filename);
 	if (this->modifiers->getTrimStart() == 0) {
 		this->modifiers->setTrimStart(1);
@@ -49,78 +86,295 @@ SequenceData::SequenceData(string filename, SequenceModifiers* modifiers) {
 }
 
 SequenceData::~SequenceData() {
+	delete packed;
+	packed = NULL;
 	free(forwardData);
 	forwardData = NULL;
 	free(reverseData);
 	reverseData = NULL;
+	pthread_mutex_destroy(&mutex);
 }
 
-char* SequenceData::createReverseData(char* forwardData, int size) {
-	char* reverseData = (char*) (malloc(size + 1));
-	for (int i = 0; i < size; i++) {
-		reverseData[size - 1 - i] = forwardData[i];
-	}
-	reverseData[size] = '\0';
-	return reverseData;
+/**
+ * Decodes the whole sequence in one of the strands.
+ */
+char* SequenceData::createData(bool reverse) const {
+	char* data = (char*) (malloc(size + 1));
+	decode(data, 0, size, reverse);
+	data[size] = '\0';
+	return data;
 }
 
 void SequenceData::loadFile(string filename) {
-    FILE* file = fopen(filename.c_str(), "rt");
-    if (file == NULL) {
+	TRACE_SPAN(TRACE_IO, "load fasta");
+	int fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) != 0) {
 		fprintf(stderr, "Error opening fasta file: %s\n", filename.c_str());
 		exit(1);
-    }
+	}
 
-    fseek(file, 0L, SEEK_END);
-    long fileSize = ftell(file);
-    rewind(file);
+	/* the hash identifies this version of the file, independently of its name */
+	char str[100];
+	sprintf(str, "%llu|%llu|%lld|%lld", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+			(long long)st.st_size, (long long)st.st_mtime);
+	sprintf(str, "%016llx", fnv1a(str, strlen(str)));
+	this->hash = str;
 
-    char line[500];
-    fgets(line, sizeof(line), file);
-    description = line;
+	/* the plain data is only kept until it is packed */
+	char* data = NULL;
+	if (cacheDirectory.length() > 0 && loadCache(getCacheFile(), &data)) {
+		close(fd);
+		this->packed = new PackedSequence(data, this->size);
+		free(data);
+		return;
+	}
 
-    this->forwardData = (char*)(malloc(fileSize+1));
+	const char* buf = NULL;
+	if (st.st_size > 0) {
+		buf = (const char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			fprintf(stderr, "Error mapping fasta file: %s\n", filename.c_str());
+			exit(1);
+		}
+		madvise((void*)buf, st.st_size, MADV_SEQUENTIAL);
+	}
+	data = parseFasta(buf, st.st_size);
+	if (buf != NULL) {
+		munmap((void*)buf, st.st_size);
+	}
+	close(fd);
+
+	if (cacheDirectory.length() > 0) {
+		saveCache(getCacheFile(), data);
+	}
+	this->packed = new PackedSequence(data, this->size);
+	free(data);
+}
+
+/**
+ * Extracts the description and the residues of the fasta data. The first
+ * line is the description; the header lines of the next records are
+ * skipped and their residues are concatenated. Blanks are stripped and the
+ * residues are converted to upper case and marked as 'n' according to the
+ * modifiers. The complement is not applied here, since it is a view of the
+ * packed data (see decode).
+ *
+ * @param buf the contents of the fasta file.
+ * @param len the size of the file.
+ * @return the residues, allocated with malloc.
+ */
+char* SequenceData::parseFasta(const char* buf, long long len) {
+	const char* end = buf + len;
+	const char* p = buf;
 
+	/* the description keeps at most 499 characters, including the line break */
+	const char* nl = (len > 0) ? (const char*)memchr(p, '\n', len) : NULL;
+	const char* lineEnd = (nl == NULL) ? end : nl+1;
+	description = string(p, (lineEnd - p < 499) ? lineEnd - p : 499);
+	p = lineEnd;
 
-	char complement_map[256];
+	char residue_map[256];
 	for (int i=0; i<256; i++) {
-		complement_map[i] = toupper(i);
+		residue_map[i] = toupper(i);
+	}
+	bool clearN = modifiers->isClearN();
+	if (clearN) {
+		residue_map['N'] = residue_map['n'] = 'n'; // lower case
+	}
+
+	/* 16 extra bytes for the vector stores */
+	char* data = (char*)(malloc((end - p) + 16 + 1));
+	char* out = data;
+	bool lineStart = true;
+
+	while (p < end) {
+#ifdef __SSE2__
+		if (p + 16 <= end) {
+			/* converts 16 characters and finds the first one that needs attention */
+			__m128i v = _mm_loadu_si128((const __m128i*)p);
+			__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a'-1)),
+					_mm_cmplt_epi8(v, _mm_set1_epi8('z'+1)));
+			__m128i r = _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+			if (clearN) {
+				r = _mm_xor_si128(r, _mm_and_si128(_mm_cmpeq_epi8(r, _mm_set1_epi8('N')),
+						_mm_set1_epi8('N'^'n')));
+			}
+			/* blanks, '>' and non-ASCII characters are handled one by one */
+			__m128i special = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8('!')),
+					_mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+			int mask = _mm_movemask_epi8(special);
+			_mm_storeu_si128((__m128i*)out, r);
+			if (mask == 0) {
+				out += 16;
+				p += 16;
+				lineStart = false;
+				continue;
+			}
+			int k = __builtin_ctz(mask);
+			if (k > 0) {
+				out += k;
+				p += k;
+				lineStart = false;
+			}
+		}
+#endif
+		unsigned char c = *p;
+		if (c == '>' && lineStart) {
+			/* header of another record */
+			nl = (const char*)memchr(p, '\n', end - p);
+			p = (nl == NULL) ? end : nl+1;
+			continue;
+		}
+		p++;
+		if (is_blank(c)) {
+			lineStart = (c == '\n');
+			continue;
+		}
+		*out++ = residue_map[c];
+		lineStart = false;
+	}
+
+	this->size = out - data;
+	this->originalSize = this->size;
+    data[this->size] = '\0';
+    return (char*)realloc(data, this->size+1);
+}
+
+/**
+ * Loads the data from the cache.
+ *
+ * @param filename the cache file.
+ * @param data receives the residues, allocated with malloc.
+ * @return false if the file does not exist or is invalid.
+ */
+bool SequenceData::loadCache(string filename, char** data) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	sequence_cache_header_t header;
+	struct stat st;
+	bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header)
+			&& memcmp(header.magic, SEQUENCE_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.version == SEQUENCE_CACHE_VERSION
+			&& fstat(fd, &st) == 0
+			&& st.st_size == (off_t)(sizeof(header) + header.descriptionLen + header.size);
+	if (!valid) {
+		fprintf(stderr, "Ignoring invalid sequence cache: %s\n", filename.c_str());
+		close(fd);
+		return false;
 	}
-	if (modifiers->isComplement()) {
-		complement_map['A'] = complement_map['a'] = 'T';
-		complement_map['T'] = complement_map['t'] = 'A';
-		complement_map['C'] = complement_map['c'] = 'G';
-		complement_map['G'] = complement_map['g'] = 'C';
+
+	const char* buf = (const char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED) {
+		return false;
 	}
-	if (modifiers->isClearN()) {
-		complement_map['N'] = complement_map['n'] = 'n'; // lower case
+	const char* content = buf + sizeof(header);
+	description = string(content, header.descriptionLen);
+	this->size = header.size;
+	this->originalSize = header.originalSize;
+	*data = (char*)malloc(this->size + 1);
+	memcpy(*data, content + header.descriptionLen, this->size);
+	(*data)[this->size] = '\0';
+	munmap((void*)buf, st.st_size);
+
+	fprintf(stderr, "Loaded sequence cache: %s\n", filename.c_str());
+	return true;
+}
+
+/**
+ * Saves the data in the cache. The file is written with a temporary name,
+ * so concurrent processes never read an incomplete file.
+ *
+ * @param filename the cache file.
+ * @param data the residues.
+ */
+void SequenceData::saveCache(string filename, const char* data) {
+	mkdir(cacheDirectory.c_str(), 0774);
+
+	char suffix[30];
+	sprintf(suffix, ".%d.tmp", getpid());
+	string tmpFilename = filename + suffix;
+	FILE* file = fopen(tmpFilename.c_str(), "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Warning: could not write sequence cache: %s\n", filename.c_str());
+		return;
 	}
 
-	this->size = 0;
-	this->originalSize = 0;
-    int i;
-    while ((i=fgetc(file)) != EOF) {
-        if (i == '\r' || i == '\n' || i == ' ') continue;
-        this->originalSize++;
-		//if (modifiers->isClearN() && ((char)i == 'N' || (char)i == 'n')) continue;
-		this->forwardData[this->size] = complement_map[(char)i];
-		this->size++;
-    }
-    this->forwardData[this->size] = '\0';
-    this->forwardData = (char*)realloc(this->forwardData, this->size+1);
-    this->reverseData = createReverseData(this->forwardData, this->size);
+	sequence_cache_header_t header;
+	memset(&header, 0, sizeof(header));
+	strncpy(header.magic, SEQUENCE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = SEQUENCE_CACHE_VERSION;
+	header.descriptionLen = description.size();
+	header.size = this->size;
+	header.originalSize = this->originalSize;
 
-    fclose(file);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(description.data(), 1, description.size(), file) == description.size()
+			&& fwrite(data, 1, this->size, file) == (size_t)this->size;
+	ok = (fclose(file) == 0) && ok;
+	if (!ok || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+		fprintf(stderr, "Warning: could not write sequence cache: %s\n", filename.c_str());
+		unlink(tmpFilename.c_str());
+	}
 }
 
+/**
+ * The cache file is named after the hash of the fasta file and the
+ * modifiers that change the stored data.
+ */
+string SequenceData::getCacheFile() const {
+	char str[50];
+	sprintf(str, "/%s.%d.seq", hash.c_str(), modifiers->isClearN());
+	return cacheDirectory + str;
+}
+
+/**
+ * Returns the plain characters of the sequence. They are decoded from the
+ * packed data in the first call, so the algorithms that only need some
+ * ranges should use decode() instead.
+ */
 char* SequenceData::getForwardData() const {
+	if (forwardData == NULL) {
+		pthread_mutex_lock(&mutex);
+		if (forwardData == NULL) {
+			forwardData = createData(false);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
 	return forwardData;
 }
 
+/**
+ * Returns the plain characters of the reversed sequence, decoding them
+ * in the first call (see getForwardData).
+ */
 char* SequenceData::getReverseData() const {
+	if (reverseData == NULL) {
+		pthread_mutex_lock(&mutex);
+		if (reverseData == NULL) {
+			reverseData = createData(true);
+		}
+		pthread_mutex_unlock(&mutex);
+	}
 	return reverseData;
 }
 
+/**
+ * Decodes a range of the sequence, applying the complement modifier.
+ *
+ * @param out the buffer that receives len characters.
+ * @param start the first position (0-based) of the range, counted in the
+ * 		reversed sequence if reverse is true.
+ * @param len the number of characters.
+ * @param reverse decodes the reversed sequence.
+ */
+void SequenceData::decode(char* out, int start, int len, bool reverse) const {
+	packed->decode(out, start, len, reverse, modifiers->isComplement());
+}
+
 int SequenceData::getSize() const {
 	return size;
 }
@@ -134,3 +388,20 @@ int SequenceData::getOriginalSize() const {
 	return originalSize;
 }
 
+/**
+ * Returns the hash that identifies the version of the fasta file. It is
+ * computed from the device, inode, size and modification time of the
+ * file, so it does not require reading the file.
+ */
+string SequenceData::getHash() const {
+	return hash;
+}
+
+/**
+ * Defines the directory of the sequence cache.
+ *
+ * @param directory the directory, or empty to disable the cache.
+ */
+void SequenceData::setCacheDirectory(string directory) {
+	cacheDirectory = directory;
+}
@@ -23,10 +23,52 @@
 #define SEQUENCEDATA_HPP_
 
 #include <string>
+#include <pthread.h>
 using namespace std;
 
 #include "SequenceModifiers.hpp"
+#include "PackedSequence.hpp"
 
+/** Magic string identifying the sequence cache files. */
+#define SEQUENCE_CACHE_MAGIC	"MASASEQ"
+/** Version of the sequence cache format. */
+#define SEQUENCE_CACHE_VERSION	(1)
+
+/** @brief Header of the sequence cache files.
+ *
+ * The header is followed by the description and by the parsed residues,
+ * before the complement modifier is applied.
+ */
+typedef struct {
+	/** SEQUENCE_CACHE_MAGIC, including the null terminator. */
+	char magic[8];
+	/** SEQUENCE_CACHE_VERSION. */
+	int version;
+	/** Length of the description in bytes. */
+	int descriptionLen;
+	/** Number of characters of the sequence. */
+	long long size;
+	/** Number of characters read from the fasta file. */
+	long long originalSize;
+} sequence_cache_header_t;
+
+/** @brief Residues of a sequence loaded from a fasta file.
+ *
+ * The fasta file is mapped in memory and the line breaks and blanks
+ * are stripped 16 characters at a time. Files with many records are
+ * concatenated, skipping the header lines of the records after the
+ * first one.
+ *
+ * If a cache directory is defined (see setCacheDirectory), the parsed
+ * data is also saved in a binary file named after the hash of the fasta
+ * file and the modifiers, so the next executions (or the other parts of
+ * a split execution) load it without parsing.
+ *
+ * The residues are kept packed with 2 bits per base (see PackedSequence).
+ * The reverse and complement strands are views over the same packed data,
+ * decoded on demand by decode(). getForwardData() and getReverseData()
+ * decode the whole strand in the first call and keep it in memory.
+ */
 class SequenceData {
 public:
 	//SequenceData(char* data, int size, SequenceModifiers* modifiers);
@@ -35,18 +77,37 @@ public:
 	string getDescription() const;
 	char* getForwardData() const;
 	char* getReverseData() const;
+	void decode(char* out, int start, int len, bool reverse=false) const;
 	int getSize() const;
 	int getOriginalSize() const;
+	string getHash() const;
+
+	static void setCacheDirectory(string directory);
 
 private:
+	/** Directory of the sequence cache, or empty to disable the cache */
+	static string cacheDirectory;
+
 	void loadFile(string filename);
-	char* createReverseData(char* forwardData, int size);
+	char* parseFasta(const char* buf, long long len);
+	bool loadCache(string filename, char** data);
+	void saveCache(string filename, const char* data);
+	string getCacheFile() const;
+	char* createData(bool reverse) const;
 	SequenceModifiers* modifiers;
 	string description;
-	char* forwardData;
-	char* reverseData;
+	/** Residues packed with 2 bits per base */
+	PackedSequence* packed;
+	/** Forward strand, decoded in the first call of getForwardData */
+	mutable char* forwardData;
+	/** Reverse strand, decoded in the first call of getReverseData */
+	mutable char* reverseData;
+	/** Protects the lazy decoding of forwardData and reverseData */
+	mutable pthread_mutex_t mutex;
 	int size;
 	int originalSize;
+	/** Identifies the version of the fasta file (see getHash) */
+	string hash;
 };
 
 #endif /* SEQUENCEDATA_HPP_ */
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "SequenceWindow.hpp"
+#include "Sequence.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** Zeroed characters after the end of the window, for the kernels that read ahead */
+#define WINDOW_PADDING (16)
+
+SequenceWindow::SequenceWindow() {
+	this->sequence = NULL;
+	this->reverse = false;
+	this->start = 0;
+	this->end = 0;
+	this->buffer = NULL;
+	this->capacity = 0;
+}
+
+SequenceWindow::~SequenceWindow() {
+	free(buffer);
+	buffer = NULL;
+}
+
+/**
+ * Decodes a range of the sequence. Positions outside the sequence are
+ * filled with '\0', like the terminator of the plain data.
+ *
+ * @param sequence the sequence.
+ * @param start the first position (0-based) of the range.
+ * @param end the last position (exclusive) of the range.
+ * @param reverse if true, the range is decoded from the opposite strand
+ * 		(see Sequence::getData).
+ * @return a pointer p such that p[k] is the character in position k, for
+ * 		start <= k < end. The pointer is valid until the next call.
+ */
+const char* SequenceWindow::load(const Sequence* sequence, int start, int end, bool reverse) {
+	/* the sequence itself may be reversed between the calls */
+	bool strand = sequence->isReversed() ^ reverse;
+	if (sequence == this->sequence && strand == this->reverse
+			&& start >= this->start && end <= this->end && buffer != NULL) {
+		return buffer - this->start;
+	}
+
+	int len = end - start;
+	if (len + WINDOW_PADDING > capacity) {
+		capacity = len + WINDOW_PADDING;
+		free(buffer);
+		buffer = (char*)malloc(capacity);
+	}
+	memset(buffer, 0, len + WINDOW_PADDING);
+
+	int size = sequence->getDataSize();
+	int d0 = (start < 0) ? 0 : start;
+	int d1 = (end > size) ? size : end;
+	if (d1 > d0) {
+		sequence->decode(buffer + (d0 - start), d0, d1 - d0, reverse);
+	}
+
+	this->sequence = sequence;
+	this->reverse = strand;
+	this->start = start;
+	this->end = end;
+	return buffer - start;
+}
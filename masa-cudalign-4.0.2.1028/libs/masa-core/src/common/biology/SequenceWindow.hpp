@@ -0,0 +1,56 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef SEQUENCEWINDOW_HPP_
+#define SEQUENCEWINDOW_HPP_
+
+class Sequence;
+
+/** @brief Decoded range of a Sequence.
+ *
+ * The sequences are kept packed in memory (see PackedSequence), so the
+ * algorithms that need plain characters decode only the range they are
+ * working on. The window keeps its buffer and the last decoded range,
+ * so loading a range contained in the previous one costs nothing.
+ */
+class SequenceWindow {
+public:
+	SequenceWindow();
+	virtual ~SequenceWindow();
+
+	const char* load(const Sequence* sequence, int start, int end, bool reverse=false);
+
+private:
+	/** Sequence of the decoded range */
+	const Sequence* sequence;
+	/** Strand of the decoded range (true for the reversed data) */
+	bool reverse;
+	/** First decoded position */
+	int start;
+	/** Last decoded position (exclusive) */
+	int end;
+	/** Decoded characters */
+	char* buffer;
+	/** Size of the buffer */
+	int capacity;
+};
+
+#endif /* SEQUENCEWINDOW_HPP_ */
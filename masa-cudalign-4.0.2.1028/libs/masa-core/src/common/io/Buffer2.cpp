@@ -29,12 +29,22 @@
 //#include <sys/time.h>
 
 #include "../Timer.hpp"
+#include "../Tracer.hpp"
 #include <time.h>
 #include <unistd.h>
 #include "BufferLogger.hpp"
 
 #define DEBUG (0)
 
+/** Number of polls before a waiting thread parks in its condition variable */
+#define SPIN_COUNT	(2000)
+
+#if defined(__i386__) || defined(__x86_64__)
+	#define CPU_RELAX()	__builtin_ia32_pause()
+#else
+	#define CPU_RELAX()	__sync_synchronize()
+#endif
+
 Buffer2::Buffer2(int buffer_max) {
     this->buffer_max = buffer_max;
     buffer_size = buffer_max+5;
@@ -43,26 +53,22 @@ Buffer2::Buffer2(int buffer_max) {
     buffer = (cell_t*)malloc(buffer_size*sizeof(cell_t));
     destroyed = false;
 	isLogging = false;
+	readersWaiting = 0;
+	writersWaiting = 0;
     
     pthread_mutex_init(&mutex, NULL);
     pthread_cond_init(&notFullCond, NULL);
     pthread_cond_init(&notEmptyCond, NULL);
-    pthread_cond_init(&emptyCond, NULL);
     pthread_cond_init(&loggerCond, NULL);
 
-	stats.bufferUsage = 0;
-	stats.totalReadBytes = 0;
-	stats.blockingReadTime = 0;
-	stats.totalWriteBytes = 0;
-	stats.blockingWriteTime = 0;
+	totalReadBytes = 0;
+	blockingReadTime = 0;
+	totalWriteBytes = 0;
+	blockingWriteTime = 0;
 
 	tempBlockingReadTime = -1;
 	tempBlockingWriteTime = -1;
-
-    /*mutex = PTHREAD_MUTEX_INITIALIZER;
-    notFullCond = PTHREAD_COND_INITIALIZER;
-    notEmptyCond = PTHREAD_COND_INITIALIZER;
-    emptyCond = PTHREAD_COND_INITIALIZER;*/
+	traceUsageTime = 0;
 }
 
 Buffer2::~Buffer2() {
@@ -72,14 +78,13 @@ Buffer2::~Buffer2() {
 
 void Buffer2::destroy() {
 	fprintf(stderr, "Buffer2::destroy()...\n");
-    pthread_mutex_lock(&mutex);
-
     destroyed = true;
-    pthread_cond_signal(&notFullCond);
-    pthread_cond_signal(&notEmptyCond);
-    pthread_cond_signal(&emptyCond);
-    pthread_cond_signal(&loggerCond);
+    __sync_synchronize();
 
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&notFullCond);
+    pthread_cond_broadcast(&notEmptyCond);
+    pthread_cond_signal(&loggerCond);
     pthread_mutex_unlock(&mutex);
 
     if (isLogging) {
@@ -94,60 +99,115 @@ bool Buffer2::isDestroyed() {
 }
 
 void Buffer2::waitEmptyBuffer() {
-    pthread_mutex_lock(&mutex);
-	while (sizeUsed() > 0 && !destroyed) {
+	if (sizeUsed() > 0 && !destroyed) {
 		fprintf (stderr, "Waiting empty buffer: %d\n", sizeUsed());
-        pthread_cond_wait (&emptyCond, &mutex);		
+		waitAvailable(buffer_max);
 	}
-    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Wakes up the threads parked in the given condition variable, if any.
+ * The caller must have published its position before calling this method.
+ */
+void Buffer2::wakeUp(volatile int* waiting, pthread_cond_t* cond) {
+	/* Orders the position update before the load of the waiting counter.
+	 * The parked thread does the opposite, so at least one of them
+	 * sees the other. */
+	__sync_synchronize();
+	if (*waiting > 0) {
+		pthread_mutex_lock(&mutex);
+		pthread_cond_broadcast(cond);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+/**
+ * Waits until the buffer holds at least minUsed cells.
+ * @return false if the buffer was destroyed while waiting.
+ */
+bool Buffer2::waitUsed(int minUsed) {
+	for (int i = 0; i < SPIN_COUNT; i++) {
+		if (sizeUsed() >= minUsed) return true;
+		if (destroyed) return false;
+		CPU_RELAX();
+	}
+	pthread_mutex_lock(&mutex);
+	__sync_fetch_and_add(&readersWaiting, 1);
+	while (sizeUsed() < minUsed && !destroyed) {
+		pthread_cond_wait(&notEmptyCond, &mutex);
+	}
+	__sync_fetch_and_sub(&readersWaiting, 1);
+	pthread_mutex_unlock(&mutex);
+	return sizeUsed() >= minUsed;
+}
+
+/**
+ * Waits until the buffer has at least minAvailable free cells.
+ * @return false if the buffer was destroyed while waiting.
+ */
+bool Buffer2::waitAvailable(int minAvailable) {
+	for (int i = 0; i < SPIN_COUNT; i++) {
+		if (sizeAvailable() >= minAvailable) return true;
+		if (destroyed) return false;
+		CPU_RELAX();
+	}
+	pthread_mutex_lock(&mutex);
+	__sync_fetch_and_add(&writersWaiting, 1);
+	while (sizeAvailable() < minAvailable && !destroyed) {
+		pthread_cond_wait(&notFullCond, &mutex);
+	}
+	__sync_fetch_and_sub(&writersWaiting, 1);
+	pthread_mutex_unlock(&mutex);
+	return sizeAvailable() >= minAvailable;
 }
 
 int Buffer2::circularLoad(cell_t* dst, int len) {
-    
-    if (buffer_start+len < buffer_size) {
-        memcpy(dst, buffer+buffer_start, len*sizeof(cell_t));
-        buffer_start += len;
+	int start = buffer_start;
+	/* the cells must be read only after the producer position was read */
+	__sync_synchronize();
+    if (start+len < buffer_size) {
+        memcpy(dst, buffer+start, len*sizeof(cell_t));
+        start += len;
     } else {
-    	memcpy(dst, buffer+buffer_start, (buffer_size-buffer_start)*sizeof(cell_t));
-    	memcpy(dst+(buffer_size-buffer_start), buffer, (len-(buffer_size-buffer_start))*sizeof(cell_t));
-        buffer_start = len-(buffer_size-buffer_start);
+    	memcpy(dst, buffer+start, (buffer_size-start)*sizeof(cell_t));
+    	memcpy(dst+(buffer_size-start), buffer, (len-(buffer_size-start))*sizeof(cell_t));
+        start = len-(buffer_size-start);
     }
-    if (sizeUsed() > 0) {
-        pthread_cond_signal(&notFullCond);
-    } else {
-        pthread_cond_signal(&emptyCond);
-	}
+    /* the cells must be read before the space is released to the producer */
+    __sync_synchronize();
+    buffer_start = start;
+    wakeUp(&writersWaiting, &notFullCond);
     return len;
 }
 
 int Buffer2::circularSkip(int len) {
-
-    if (buffer_start+len < buffer_size) {
-        buffer_start += len;
+	int start = buffer_start;
+    if (start+len < buffer_size) {
+        start += len;
     } else {
-        buffer_start = len-(buffer_size-buffer_start);
+        start = len-(buffer_size-start);
     }
-    if (sizeUsed() > 0) {
-        pthread_cond_signal(&notFullCond);
-    } else {
-        pthread_cond_signal(&emptyCond);
-	}
+    __sync_synchronize();
+    buffer_start = start;
+    wakeUp(&writersWaiting, &notFullCond);
     return len;
 }
 
 
 int Buffer2::circularStore(const cell_t* src, int len) {
-    if (buffer_end+len < buffer_size) {
-        memcpy(buffer+buffer_end, src, len*sizeof(cell_t));
-        buffer_end += len;
+	int end = buffer_end;
+    if (end+len < buffer_size) {
+        memcpy(buffer+end, src, len*sizeof(cell_t));
+        end += len;
     } else {
-        memcpy(buffer+buffer_end, src, (buffer_size-buffer_end)*sizeof(cell_t));
-        memcpy(buffer, src+(buffer_size-buffer_end), (len - (buffer_size-buffer_end))*sizeof(cell_t));
-        buffer_end = len - (buffer_size-buffer_end);
-    }
-    if (sizeUsed() > 0) {
-        pthread_cond_signal(&notEmptyCond);
+        memcpy(buffer+end, src, (buffer_size-end)*sizeof(cell_t));
+        memcpy(buffer, src+(buffer_size-end), (len - (buffer_size-end))*sizeof(cell_t));
+        end = len - (buffer_size-end);
     }
+    /* the cells must be visible before they are published to the consumer */
+    __sync_synchronize();
+    buffer_end = end;
+    wakeUp(&readersWaiting, &notEmptyCond);
     return len;
 }
 
@@ -156,45 +216,57 @@ int Buffer2::sizeAvailable() {
 }
 
 int Buffer2::sizeUsed() {
-    if (buffer_end >= buffer_start) {
-        return buffer_end - buffer_start;
+	int start = buffer_start;
+	int end = buffer_end;
+    if (end >= start) {
+        return end - start;
     } else {
-        return buffer_end - buffer_start + buffer_size;
+        return end - start + buffer_size;
     }
 }
 
 int Buffer2::readBuffer(cell_t* data, int nmemb)
 {
-	pthread_mutex_lock(&mutex);
 	if (DEBUG) printf("Buffer2::readBuffer(%d) - buf: %d\n", nmemb, sizeUsed());
     int size_total = nmemb;
     int size_left = size_total;
-    while ((sizeUsed() < size_left) && !destroyed) {
+    while (size_left > 0 && !destroyed) {
+    	int used = sizeUsed();
+    	if (used == 0) {
+            float t0 = Timer::getGlobalTime();
+            tempBlockingReadTime = t0;
+            long long trace_t0 = Tracer::isEnabled() ? Tracer::now() : -1;
+            bool ok = waitUsed(1);
+            if (trace_t0 >= 0) {
+            	Tracer::span(TRACE_BUFFER, "Buffer2 read blocked", trace_t0);
+            }
+            tempBlockingReadTime = -1;
+            float t1 = Timer::getGlobalTime();
+            blockingReadTime += (t1-t0);
+            if (!ok) break;
+            used = sizeUsed();
+    	}
+    	int len = (used < size_left) ? used : size_left;
     	if (data == NULL) {
-    		size_left -= circularSkip(sizeUsed());
+    		size_left -= circularSkip(len);
     	} else {
-    		size_left -= circularLoad(data+(size_total-size_left), sizeUsed());
+    		size_left -= circularLoad(data+(size_total-size_left), len);
     	}
-        float t0 = Timer::getGlobalTime();
-        tempBlockingReadTime = t0;
-        pthread_cond_wait (&notEmptyCond, &mutex);
-        tempBlockingReadTime = -1;
-        float t1 = Timer::getGlobalTime();
-        stats.blockingReadTime += (t1-t0);
     }
-    if (!destroyed) {
-    	if (data == NULL) {
-    		size_left -= circularSkip(size_left);
-    	} else {
-    		size_left -= circularLoad(data+(size_total-size_left), size_left);
+    if (Tracer::isEnabled()) {
+    	/* at most one sample per millisecond */
+    	long long t = Tracer::now();
+    	if (t - traceUsageTime >= 1000) {
+    		traceUsageTime = t;
+    		Tracer::counter(TRACE_BUFFER, "Buffer2 usage", sizeUsed());
     	}
     }
-    stats.bufferUsage = sizeUsed();
-    if (stats.totalReadBytes == 0/* && inputBuffer*/) {
+    if (totalReadBytes == 0/* && inputBuffer*/) {
+        pthread_mutex_lock(&mutex);
     	pthread_cond_signal(&loggerCond);
+        pthread_mutex_unlock(&mutex);
     }
-    stats.totalReadBytes += (size_total-size_left);
-    pthread_mutex_unlock(&mutex);
+    totalReadBytes += (size_total-size_left);
     
     if (size_left != 0) fprintf(stderr, "readBuffer: diff len: %d %d\n", size_total-size_left, size_total);
     
@@ -203,28 +275,34 @@ int Buffer2::readBuffer(cell_t* data, int nmemb)
 
 int Buffer2::writeBuffer(const cell_t* data, int nmemb)
 {
-    pthread_mutex_lock(&mutex);
 	if (DEBUG) printf("Buffer2::writeBuffer(%d) - buf: %d\n", nmemb, sizeUsed());
     int size_total = nmemb;
     int size_left = size_total;
-    while ((sizeAvailable() < size_left) && !destroyed) {
-        size_left -= circularStore(data+(size_total-size_left), sizeAvailable());
-        float t0 = Timer::getGlobalTime();
-        tempBlockingWriteTime = t0;
-        pthread_cond_wait (&notFullCond, &mutex);
-        tempBlockingWriteTime = -1;
-        float t1 = Timer::getGlobalTime();
-        stats.blockingWriteTime += (t1-t0);
-    }
-    if (!destroyed) {
-        size_left -= circularStore(data+(size_total-size_left), size_left);
+    while (size_left > 0 && !destroyed) {
+    	int available = sizeAvailable();
+    	if (available == 0) {
+            float t0 = Timer::getGlobalTime();
+            tempBlockingWriteTime = t0;
+            long long trace_t0 = Tracer::isEnabled() ? Tracer::now() : -1;
+            bool ok = waitAvailable(1);
+            if (trace_t0 >= 0) {
+            	Tracer::span(TRACE_BUFFER, "Buffer2 write blocked", trace_t0);
+            }
+            tempBlockingWriteTime = -1;
+            float t1 = Timer::getGlobalTime();
+            blockingWriteTime += (t1-t0);
+            if (!ok) break;
+            available = sizeAvailable();
+    	}
+    	int len = (available < size_left) ? available : size_left;
+        size_left -= circularStore(data+(size_total-size_left), len);
     }
-    stats.bufferUsage = sizeUsed();
-    if (stats.totalWriteBytes == 0/* && !inputBuffer*/) {
+    if (totalWriteBytes == 0/* && !inputBuffer*/) {
+        pthread_mutex_lock(&mutex);
     	pthread_cond_signal(&loggerCond);
+        pthread_mutex_unlock(&mutex);
     }
-    stats.totalWriteBytes += (size_total-size_left);
-    pthread_mutex_unlock(&mutex);
+    totalWriteBytes += (size_total-size_left);
     if (size_left != 0) fprintf(stderr, "writeBuffer: diff len: %d %d\n", size_total-size_left, size_total);
 
     return size_total-size_left;
@@ -241,17 +319,26 @@ int Buffer2::getCapacity() {
 }
 
 buffer2_statistics_t Buffer2::getStatistics() {
-	buffer2_statistics_t stats = this->stats;
+	/* each field is only written by the producer or by the consumer, in
+	 * their own cache lines, and is read here without locks */
+	buffer2_statistics_t stats;
 	stats.time = Timer::getGlobalTime();
-
-    pthread_mutex_lock(&mutex);
-	if (tempBlockingReadTime != -1) {
-		stats.blockingReadTime += stats.time - tempBlockingReadTime;
+	stats.bufferUsage = sizeUsed();
+	stats.totalReadBytes = totalReadBytes;
+	stats.blockingReadTime = blockingReadTime;
+	stats.totalWriteBytes = totalWriteBytes;
+	stats.blockingWriteTime = blockingWriteTime;
+
+	/* the temporary times are written by the producer and consumer without
+	 * locks, so they are read only once */
+	float readTime = tempBlockingReadTime;
+	float writeTime = tempBlockingWriteTime;
+	if (readTime != -1) {
+		stats.blockingReadTime += stats.time - readTime;
 	}
-	if (tempBlockingWriteTime != -1) {
-		stats.blockingWriteTime += stats.time - tempBlockingWriteTime;
+	if (writeTime != -1) {
+		stats.blockingWriteTime += stats.time - writeTime;
 	}
-    pthread_mutex_unlock(&mutex);
 
 	return stats;
 }
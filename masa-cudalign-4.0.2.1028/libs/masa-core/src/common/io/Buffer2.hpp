@@ -52,6 +52,20 @@ struct buffer2_statistics_t {
 
 
 
+/** Size of a cache line, used to keep the producer and consumer data apart */
+#define BUFFER2_CACHE_LINE	(64)
+
+/**
+ * @brief Circular buffer of cells between one producer thread and one
+ * consumer thread.
+ *
+ * The buffer is lock-free: the producer only writes the end position and
+ * the consumer only writes the start position, each one in its own cache
+ * line. A thread that must wait spins for a while and then parks in a
+ * condition variable; the other thread only takes the mutex to wake it up
+ * when it is parked. The readBuffer() method must only be called by the
+ * consumer, and the writeBuffer() method only by the producer.
+ */
 class Buffer2 {
 public:
 	Buffer2(int bufferMax);
@@ -86,25 +100,46 @@ public:
     void setLogFile(string logFile, float interval);
 
 	private:
-		buffer2_statistics_t stats;
-
-        float tempBlockingWriteTime;
-        float tempBlockingReadTime;
-
+		/* Shared data, not modified after the construction */
+		cell_t* buffer;
+		int buffer_size;
+		int buffer_max;
 
+		char padding0[BUFFER2_CACHE_LINE];
+
+		/* Consumer data */
+		/** Position of the next cell to be read. Only written by the consumer */
+		volatile int buffer_start;
+		/** Number of parked consumers */
+		volatile int readersWaiting;
+		volatile float tempBlockingReadTime;
+		/** Statistics: bytes read and time blocked by the consumer */
+		int totalReadBytes;
+		float blockingReadTime;
+		/** Time of the last usage sample recorded in the trace */
+		long long traceUsageTime;
+
+		char padding1[BUFFER2_CACHE_LINE];
+
+		/* Producer data */
+		/** Position of the next cell to be written. Only written by the producer */
+		volatile int buffer_end;
+		/** Number of parked producers (or threads waiting for an empty buffer) */
+		volatile int writersWaiting;
+		volatile float tempBlockingWriteTime;
+		/** Statistics: bytes written and time blocked by the producer */
+		int totalWriteBytes;
+		float blockingWriteTime;
+
+		char padding2[BUFFER2_CACHE_LINE];
+
+		volatile bool destroyed;
+
+		/* Only used to park the threads */
 		pthread_mutex_t mutex;
 		pthread_cond_t notFullCond;
 		pthread_cond_t notEmptyCond;
-		pthread_cond_t emptyCond;
 		pthread_cond_t loggerCond;
-		
-		bool destroyed;
-		
-		cell_t* buffer;
-		int buffer_size;
-		int buffer_start;
-		int buffer_end;
-		int buffer_max;
 
         pthread_t loggerThread;
         string logFile;
@@ -116,6 +151,9 @@ public:
 		int circularStore(const cell_t* src, int len);
 		int sizeUsed();
 		int sizeAvailable();
+		bool waitUsed(int minUsed);
+		bool waitAvailable(int minAvailable);
+		void wakeUp(volatile int* waiting, pthread_cond_t* cond);
 
         static void* staticLogThread(void *arg);
 
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "FilePoolTransport.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+FilePoolTransport::FilePoolTransport(string sharedPath) {
+	this->sharedPath = sharedPath;
+}
+
+FilePoolTransport::~FilePoolTransport() {
+
+}
+
+void FilePoolTransport::send(const string& mailbox, const string& message) {
+	string filename = getMsgFile(mailbox, sentCount[mailbox]++);
+
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening message file: %s\n", filename.c_str());
+		exit(1);
+	}
+	fwrite(message.data(), 1, message.size(), file);
+	fclose(file);
+
+	sendSignal(filename);
+}
+
+string FilePoolTransport::receive(const string& mailbox) {
+	string filename = getMsgFile(mailbox, receivedCount[mailbox]++);
+	waitSignal(filename);
+
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening message file: %s\n", filename.c_str());
+		exit(1);
+	}
+	string message;
+	char buffer[4096];
+	size_t len;
+	while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		message.append(buffer, len);
+	}
+	fclose(file);
+	return message;
+}
+
+bool FilePoolTransport::poll(const string& mailbox) {
+	return peekSignal(getMsgFile(mailbox, receivedCount[mailbox]));
+}
+
+bool FilePoolTransport::peek(const string& mailbox) {
+	return peekSignal(getMsgFile(mailbox, 0));
+}
+
+string FilePoolTransport::getMsgFile(const string& mailbox, int count) {
+	char str[20];
+	sprintf(str, ".%02d", count);
+	return this->sharedPath + "/" + mailbox + string(str);
+}
+
+string FilePoolTransport::getSignalFile(const string& msgFile) {
+	return msgFile + ".signal";
+}
+
+void FilePoolTransport::sendSignal(const string& msgFile) {
+	string signalFile = getSignalFile(msgFile);
+	FILE* file = fopen(signalFile.c_str(), "wt");
+	fclose(file);
+	sync();
+	printf("[%d] Signal Sent: %s\n", getpid(), signalFile.c_str());
+}
+
+void FilePoolTransport::waitSignal(const string& msgFile) {
+	int count = 0;
+	bool signalOk = false;
+	while (!signalOk) {
+		if (count % 1000 == 0) {
+			printf("[%d] Waiting Signal for msg: %s\n", getpid(), msgFile.c_str());
+		}
+		signalOk = peekSignal(msgFile);
+		if (!signalOk) {
+			usleep(10000);
+			count++;
+		}
+	}
+	printf("[%d] Signal Received for msg: %s\n", getpid(), msgFile.c_str());
+}
+
+bool FilePoolTransport::peekSignal(const string& msgFile) {
+	string signalFile = getSignalFile(msgFile);
+	FILE* file = fopen(signalFile.c_str(), "rt");
+	bool signalOk = false;
+	if (file != NULL) {
+		signalOk = true;
+		fclose(file);
+	}
+	return signalOk;
+}
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef FILEPOOLTRANSPORT_HPP_
+#define FILEPOOLTRANSPORT_HPP_
+
+#include "PoolTransport.hpp"
+
+#include <map>
+
+/** @brief Pool transport that stores each message in a file.
+ *
+ * Each message is written into a file of the shared directory and
+ * a companion ".signal" file is created when the message is complete.
+ * The receiver polls for the signal file. This transport is slower
+ * than the others, but it works with shared directories mounted
+ * through the network (e.g. NFS).
+ */
+class FilePoolTransport : public PoolTransport {
+public:
+	FilePoolTransport(string sharedPath);
+	virtual ~FilePoolTransport();
+
+	virtual void send(const string& mailbox, const string& message);
+	virtual string receive(const string& mailbox);
+	virtual bool poll(const string& mailbox);
+	virtual bool peek(const string& mailbox);
+
+private:
+	string sharedPath;
+	/** Number of messages sent to each mailbox by this node */
+	map<string, int> sentCount;
+	/** Number of messages received from each mailbox by this node */
+	map<string, int> receivedCount;
+
+	string getMsgFile(const string& mailbox, int count);
+	string getSignalFile(const string& msgFile);
+	void sendSignal(const string& msgFile);
+	void waitSignal(const string& msgFile);
+	bool peekSignal(const string& msgFile);
+};
+
+#endif /* FILEPOOLTRANSPORT_HPP_ */
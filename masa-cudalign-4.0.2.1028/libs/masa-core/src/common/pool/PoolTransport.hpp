@@ -0,0 +1,95 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef POOLTRANSPORT_HPP_
+#define POOLTRANSPORT_HPP_
+
+#include <string>
+using namespace std;
+
+/** Messages are exchanged through files in the shared directory. */
+#define POOL_TRANSPORT_FILE		(0)
+/** Messages are exchanged through a shared memory area. */
+#define POOL_TRANSPORT_SHM		(1)
+/** Messages are exchanged through Unix-domain sockets. */
+#define POOL_TRANSPORT_SOCKET	(2)
+
+/** @brief Delivers the messages exchanged by the nodes of an AlignerPool.
+ *
+ * Messages are sent to mailboxes, identified by names such as
+ * "stage1.0000C350". Each mailbox has a single receiver, which
+ * gets the messages in the same order they were sent. Besides the
+ * receiver, any node may peek whether a mailbox has already received
+ * some message.
+ *
+ * Every transport keeps its data inside the shared directory of the
+ * pool, so the nodes only need to agree on this directory.
+ */
+class PoolTransport {
+public:
+	virtual ~PoolTransport() {};
+
+	/**
+	 * Declares that this node is the receiver of a mailbox, so the
+	 * transport may prepare it before any message arrives.
+	 *
+	 * @param mailbox the name of the mailbox.
+	 */
+	virtual void listen(const string& mailbox) {};
+
+	/**
+	 * Sends a message to a mailbox. This method does not wait for
+	 * the receiver.
+	 *
+	 * @param mailbox the name of the mailbox.
+	 * @param message the content of the message (may hold binary data).
+	 */
+	virtual void send(const string& mailbox, const string& message) = 0;
+
+	/**
+	 * Waits for the next message of a mailbox.
+	 *
+	 * @param mailbox the name of the mailbox.
+	 * @return the content of the message.
+	 */
+	virtual string receive(const string& mailbox) = 0;
+
+	/**
+	 * Verifies, without waiting, if the next message of a mailbox
+	 * was already sent.
+	 *
+	 * @param mailbox the name of the mailbox.
+	 * @return true if a call to receive() would not block.
+	 */
+	virtual bool poll(const string& mailbox) = 0;
+
+	/**
+	 * Verifies if a mailbox has received any message. Differently from
+	 * poll(), this method may be called by nodes that are not the receiver
+	 * of the mailbox.
+	 *
+	 * @param mailbox the name of the mailbox.
+	 * @return true if at least one message was sent to the mailbox.
+	 */
+	virtual bool peek(const string& mailbox) = 0;
+};
+
+#endif /* POOLTRANSPORT_HPP_ */
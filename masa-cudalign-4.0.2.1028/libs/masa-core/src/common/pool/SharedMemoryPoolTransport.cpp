@@ -0,0 +1,241 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "SharedMemoryPoolTransport.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#define DEBUG (0)
+
+/**
+ * Sleeps while *addr is equal to value. The sleep is limited to one
+ * second, so the callers must verify their condition again.
+ */
+static void futex_wait(volatile int* addr, int value) {
+#ifdef __linux__
+	struct timespec timeout;
+	timeout.tv_sec = 1;
+	timeout.tv_nsec = 0;
+	syscall(SYS_futex, (int*)addr, FUTEX_WAIT, value, &timeout, NULL, 0);
+#else
+	usleep(1000);
+#endif
+}
+
+/**
+ * Awakes all the processes sleeping on addr.
+ */
+static void futex_wake(volatile int* addr) {
+#ifdef __linux__
+	syscall(SYS_futex, (int*)addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+SharedMemoryPoolTransport::SharedMemoryPoolTransport(string sharedPath) {
+	this->sharedPath = sharedPath;
+	this->header = NULL;
+	this->heap = NULL;
+	open();
+}
+
+SharedMemoryPoolTransport::~SharedMemoryPoolTransport() {
+	if (header != NULL) {
+		munmap(header, sizeof(shm_pool_header_t) + SHM_POOL_HEAP_SIZE);
+		header = NULL;
+		heap = NULL;
+	}
+}
+
+/**
+ * Maps the shared memory file, creating and initializing it if this is
+ * the first node. The initialization is serialized with a file lock.
+ */
+void SharedMemoryPoolTransport::open() {
+	string filename = sharedPath + "/pool.shm";
+	size_t size = sizeof(shm_pool_header_t) + SHM_POOL_HEAP_SIZE;
+
+	int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Error opening shared memory file: %s\n", filename.c_str());
+		exit(1);
+	}
+	flock(fd, LOCK_EX);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, size) != 0)) {
+		fprintf(stderr, "Error resizing shared memory file: %s\n", filename.c_str());
+		exit(1);
+	}
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "Error mapping shared memory file: %s\n", filename.c_str());
+		exit(1);
+	}
+	header = (shm_pool_header_t*)ptr;
+	heap = ((char*)ptr) + sizeof(shm_pool_header_t);
+	if (header->magic != SHM_POOL_MAGIC) {
+		/* a new file is filled with zeroes */
+		header->magic = SHM_POOL_MAGIC;
+	}
+
+	flock(fd, LOCK_UN);
+	::close(fd);
+}
+
+void SharedMemoryPoolTransport::lock() {
+	while (__sync_lock_test_and_set(&header->lock, 1)) {
+		sched_yield();
+	}
+}
+
+void SharedMemoryPoolTransport::unlock() {
+	__sync_lock_release(&header->lock);
+}
+
+void SharedMemoryPoolTransport::send(const string& mailbox, const string& message) {
+	if (mailbox.size() >= SHM_POOL_MAILBOX_SIZE) {
+		fprintf(stderr, "Mailbox name too long: %s\n", mailbox.c_str());
+		exit(1);
+	}
+
+	lock();
+	if (header->slotsUsed == SHM_POOL_SLOTS) {
+		unlock();
+		fprintf(stderr, "No free slots in the shared memory transport. "
+				"Use the file transport instead.\n");
+		exit(1);
+	}
+	int index = 0;
+	for (int i=0; i<header->slotsUsed; i++) {
+		if (strcmp(header->slots[i].mailbox, mailbox.c_str()) == 0) {
+			index++;
+		}
+	}
+	shm_pool_slot_t* slot = &header->slots[header->slotsUsed++];
+	strcpy(slot->mailbox, mailbox.c_str());
+	slot->index = index;
+	slot->size = message.size();
+	if (header->heapUsed + message.size() <= SHM_POOL_HEAP_SIZE) {
+		slot->offset = header->heapUsed;
+		header->heapUsed += message.size();
+	} else {
+		slot->offset = -1;
+	}
+	unlock();
+
+	if (slot->offset >= 0) {
+		memcpy(heap + slot->offset, message.data(), message.size());
+	} else {
+		string filename = getSpillFile(mailbox, index);
+		FILE* file = fopen(filename.c_str(), "wb");
+		if (file == NULL) {
+			fprintf(stderr, "Error opening message file: %s\n", filename.c_str());
+			exit(1);
+		}
+		fwrite(message.data(), 1, message.size(), file);
+		fclose(file);
+	}
+
+	__sync_synchronize();
+	slot->ready = 1;
+	__sync_fetch_and_add(&header->sequence, 1);
+	futex_wake(&header->sequence);
+	if (DEBUG) printf("[%d] Message Sent: %s.%02d (%d bytes)\n", getpid(), mailbox.c_str(), index, slot->size);
+}
+
+string SharedMemoryPoolTransport::receive(const string& mailbox) {
+	int index = receivedCount[mailbox]++;
+	const shm_pool_slot_t* slot;
+	while (true) {
+		int sequence = header->sequence;
+		slot = findSlot(mailbox, index);
+		if (slot != NULL) {
+			break;
+		}
+		futex_wait(&header->sequence, sequence);
+	}
+	__sync_synchronize();
+
+	if (DEBUG) printf("[%d] Message Received: %s.%02d (%d bytes)\n", getpid(), mailbox.c_str(), index, slot->size);
+	if (slot->offset >= 0) {
+		return string(heap + slot->offset, slot->size);
+	}
+
+	string filename = getSpillFile(mailbox, index);
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Error opening message file: %s\n", filename.c_str());
+		exit(1);
+	}
+	string message(slot->size, '\0');
+	if (slot->size > 0 && fread(&message[0], 1, slot->size, file) != (size_t)slot->size) {
+		fprintf(stderr, "Error reading message file: %s\n", filename.c_str());
+		exit(1);
+	}
+	fclose(file);
+	return message;
+}
+
+bool SharedMemoryPoolTransport::poll(const string& mailbox) {
+	return findSlot(mailbox, receivedCount[mailbox]) != NULL;
+}
+
+bool SharedMemoryPoolTransport::peek(const string& mailbox) {
+	return findSlot(mailbox, 0) != NULL;
+}
+
+/**
+ * Finds a complete message. The slots are only read after their ready
+ * flag is set, so this method does not need the lock.
+ *
+ * @return the slot of the message, or NULL if it was not sent yet.
+ */
+const shm_pool_slot_t* SharedMemoryPoolTransport::findSlot(const string& mailbox, int index) {
+	int count = header->slotsUsed;
+	for (int i=0; i<count; i++) {
+		const shm_pool_slot_t* slot = &header->slots[i];
+		if (slot->ready && slot->index == index && strcmp(slot->mailbox, mailbox.c_str()) == 0) {
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+string SharedMemoryPoolTransport::getSpillFile(const string& mailbox, int index) {
+	char str[20];
+	sprintf(str, ".%02d", index);
+	return this->sharedPath + "/" + mailbox + string(str);
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef SHAREDMEMORYPOOLTRANSPORT_HPP_
+#define SHAREDMEMORYPOOLTRANSPORT_HPP_
+
+#include "PoolTransport.hpp"
+
+#include <map>
+
+/** Identifies an initialized shared memory area ("MPOL"). */
+#define SHM_POOL_MAGIC			(0x4D504F4C)
+/** Maximum number of messages kept in the shared memory area. */
+#define SHM_POOL_SLOTS			(1024)
+/** Maximum length of the mailbox names, including the null terminator. */
+#define SHM_POOL_MAILBOX_SIZE	(40)
+/** Size of the area that stores the content of the messages. */
+#define SHM_POOL_HEAP_SIZE		(64*1024*1024)
+
+/** @brief Descriptor of a message in the shared memory area. */
+typedef struct {
+	/** Name of the mailbox */
+	char mailbox[SHM_POOL_MAILBOX_SIZE];
+	/** Order of the message in its mailbox */
+	int index;
+	/** Size of the message in bytes */
+	int size;
+	/** Offset of the message in the heap, or -1 if it was spilled to a file */
+	long long offset;
+	/** Set when the message is complete */
+	volatile int ready;
+} shm_pool_slot_t;
+
+/** @brief Header of the shared memory area. */
+typedef struct {
+	/** SHM_POOL_MAGIC after the area is initialized */
+	int magic;
+	/** Spin lock that protects the allocation of slots and heap */
+	volatile int lock;
+	/** Incremented for each message; the receivers wait on it (futex) */
+	volatile int sequence;
+	/** Number of allocated slots */
+	volatile int slotsUsed;
+	/** Number of allocated bytes of the heap */
+	long long heapUsed;
+	/** Descriptors of the messages */
+	shm_pool_slot_t slots[SHM_POOL_SLOTS];
+} shm_pool_header_t;
+
+/** @brief Pool transport that exchanges messages through shared memory.
+ *
+ * The messages are kept in a file of the shared directory mapped in
+ * memory by every node, so a message is visible to the other processes
+ * as soon as it is copied. The receivers sleep on a futex that is
+ * awakened by each new message, avoiding the polling of the file
+ * transport. Messages larger than the free heap are spilled to files.
+ *
+ * All the nodes must run in the same host.
+ */
+class SharedMemoryPoolTransport : public PoolTransport {
+public:
+	SharedMemoryPoolTransport(string sharedPath);
+	virtual ~SharedMemoryPoolTransport();
+
+	virtual void send(const string& mailbox, const string& message);
+	virtual string receive(const string& mailbox);
+	virtual bool poll(const string& mailbox);
+	virtual bool peek(const string& mailbox);
+
+private:
+	string sharedPath;
+	/** The mapped area */
+	shm_pool_header_t* header;
+	/** Content of the messages, following the header */
+	char* heap;
+	/** Number of messages received from each mailbox by this node */
+	map<string, int> receivedCount;
+
+	void open();
+	void lock();
+	void unlock();
+	const shm_pool_slot_t* findSlot(const string& mailbox, int index);
+	string getSpillFile(const string& mailbox, int index);
+};
+
+#endif /* SHAREDMEMORYPOOLTRANSPORT_HPP_ */
@@ -0,0 +1,270 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "SocketPoolTransport.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define DEBUG (0)
+
+/**
+ * Writes the whole buffer to the socket. Broken connections are reported
+ * by the return value instead of SIGPIPE.
+ */
+static bool write_all(int fd, const void* buf, size_t len) {
+	size_t pos = 0;
+	while (pos < len) {
+		ssize_t ret = ::send(fd, ((const char*)buf) + pos, len - pos, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			if (ret == -1 && errno == EINTR) continue;
+			return false;
+		}
+		pos += ret;
+	}
+	return true;
+}
+
+/**
+ * Reads exactly len bytes from the socket.
+ */
+static bool read_all(int fd, void* buf, size_t len) {
+	size_t pos = 0;
+	while (pos < len) {
+		ssize_t ret = recv(fd, ((char*)buf) + pos, len - pos, 0);
+		if (ret <= 0) {
+			if (ret == -1 && errno == EINTR) continue;
+			return false;
+		}
+		pos += ret;
+	}
+	return true;
+}
+
+SocketPoolTransport::SocketPoolTransport(string sharedPath) {
+	this->sharedPath = sharedPath;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+SocketPoolTransport::~SocketPoolTransport() {
+	for (map<string, socket_pool_mailbox_t*>::iterator it = mailboxes.begin(); it != mailboxes.end(); it++) {
+		socket_pool_mailbox_t* mailbox = it->second;
+		/* wakes the accept() call of the mailbox thread */
+		shutdown(mailbox->socketfd, SHUT_RDWR);
+		pthread_join(mailbox->thread, NULL);
+		close(mailbox->socketfd);
+		unlink(mailbox->path.c_str());
+		delete mailbox;
+	}
+	mailboxes.clear();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void SocketPoolTransport::listen(const string& name) {
+	if (mailboxes.count(name) > 0) {
+		return;
+	}
+
+	socket_pool_mailbox_t* mailbox = new socket_pool_mailbox_t();
+	mailbox->transport = this;
+	mailbox->path = getSocketFile(name);
+	mailbox->count = 0;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, mailbox->path.c_str());
+
+	mailbox->socketfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (mailbox->socketfd == -1) {
+		fprintf(stderr, "ERROR creating socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	/* removes the socket left by a previous execution */
+	unlink(mailbox->path.c_str());
+	if (bind(mailbox->socketfd, (struct sockaddr*)&addr, sizeof(addr)) == -1
+			|| ::listen(mailbox->socketfd, 16) == -1) {
+		fprintf(stderr, "ERROR listening on socket %s: %s\n", mailbox->path.c_str(), strerror(errno));
+		exit(1);
+	}
+
+	mailboxes[name] = mailbox;
+	pthread_create(&mailbox->thread, NULL, acceptThread, mailbox);
+	if (DEBUG) printf("[%d] Listening mailbox: %s\n", getpid(), mailbox->path.c_str());
+}
+
+void SocketPoolTransport::send(const string& mailbox, const string& message) {
+	int fd = connectMailbox(mailbox, true);
+
+	int request[2];
+	request[0] = SOCKET_POOL_SEND;
+	request[1] = message.size();
+	int ack;
+	if (!write_all(fd, request, sizeof(request))
+			|| !write_all(fd, message.data(), message.size())
+			|| !read_all(fd, &ack, sizeof(ack))) {
+		fprintf(stderr, "ERROR sending message to mailbox %s\n", mailbox.c_str());
+		exit(1);
+	}
+	close(fd);
+	if (DEBUG) printf("[%d] Message Sent: %s (%d bytes)\n", getpid(), mailbox.c_str(), (int)message.size());
+}
+
+string SocketPoolTransport::receive(const string& name) {
+	listen(name);
+	socket_pool_mailbox_t* mailbox = mailboxes[name];
+
+	pthread_mutex_lock(&mutex);
+	while (mailbox->messages.empty()) {
+		pthread_cond_wait(&cond, &mutex);
+	}
+	string message = mailbox->messages.front();
+	mailbox->messages.pop_front();
+	pthread_mutex_unlock(&mutex);
+
+	if (DEBUG) printf("[%d] Message Received: %s (%d bytes)\n", getpid(), name.c_str(), (int)message.size());
+	return message;
+}
+
+bool SocketPoolTransport::poll(const string& name) {
+	listen(name);
+	socket_pool_mailbox_t* mailbox = mailboxes[name];
+
+	pthread_mutex_lock(&mutex);
+	bool available = !mailbox->messages.empty();
+	pthread_mutex_unlock(&mutex);
+	return available;
+}
+
+bool SocketPoolTransport::peek(const string& name) {
+	if (mailboxes.count(name) > 0) {
+		pthread_mutex_lock(&mutex);
+		int count = mailboxes[name]->count;
+		pthread_mutex_unlock(&mutex);
+		return count > 0;
+	}
+
+	int fd = connectMailbox(name, false);
+	if (fd == -1) {
+		return false;
+	}
+	int request[2];
+	request[0] = SOCKET_POOL_PEEK;
+	request[1] = 0;
+	int count = 0;
+	if (!write_all(fd, request, sizeof(request)) || !read_all(fd, &count, sizeof(count))) {
+		count = 0;
+	}
+	close(fd);
+	return count > 0;
+}
+
+string SocketPoolTransport::getSocketFile(const string& mailbox) {
+	string path = this->sharedPath + "/" + mailbox + ".sock";
+	if (path.size() >= sizeof(((struct sockaddr_un*)NULL)->sun_path)) {
+		fprintf(stderr, "Socket path too long: %s. Use a shorter --shared-dir.\n", path.c_str());
+		exit(1);
+	}
+	return path;
+}
+
+/**
+ * Connects to the socket of a mailbox.
+ *
+ * @param mailbox the name of the mailbox.
+ * @param wait if true, retries until the receiver starts listening.
+ * @return the connected socket, or -1 if the receiver is not listening
+ * 		and wait is false.
+ */
+int SocketPoolTransport::connectMailbox(const string& mailbox, bool wait) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, getSocketFile(mailbox).c_str());
+
+	int retries = 0;
+	while (true) {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1) {
+			fprintf(stderr, "ERROR creating socket: %s\n", strerror(errno));
+			exit(1);
+		}
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+			return fd;
+		}
+		close(fd);
+		if (!wait) {
+			return -1;
+		}
+		if (retries % 1000 == 0) {
+			printf("[%d] Waiting receiver of mailbox: %s\n", getpid(), mailbox.c_str());
+		}
+		retries++;
+		usleep(10000);
+	}
+}
+
+void SocketPoolTransport::acceptMessages(socket_pool_mailbox_t* mailbox) {
+	while (true) {
+		int fd = accept(mailbox->socketfd, NULL, NULL);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			/* the socket was shut down */
+			break;
+		}
+
+		int request[2];
+		if (read_all(fd, request, sizeof(request))) {
+			if (request[0] == SOCKET_POOL_SEND) {
+				string message(request[1], '\0');
+				if (request[1] == 0 || read_all(fd, &message[0], request[1])) {
+					pthread_mutex_lock(&mutex);
+					mailbox->messages.push_back(message);
+					mailbox->count++;
+					pthread_cond_broadcast(&cond);
+					pthread_mutex_unlock(&mutex);
+
+					int ack = 1;
+					write_all(fd, &ack, sizeof(ack));
+				}
+			} else if (request[0] == SOCKET_POOL_PEEK) {
+				pthread_mutex_lock(&mutex);
+				int count = mailbox->count;
+				pthread_mutex_unlock(&mutex);
+				write_all(fd, &count, sizeof(count));
+			}
+		}
+		close(fd);
+	}
+}
+
+void* SocketPoolTransport::acceptThread(void* arg) {
+	socket_pool_mailbox_t* mailbox = (socket_pool_mailbox_t*)arg;
+	mailbox->transport->acceptMessages(mailbox);
+	return NULL;
+}
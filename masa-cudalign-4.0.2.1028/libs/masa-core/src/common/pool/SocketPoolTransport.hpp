@@ -0,0 +1,92 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef SOCKETPOOLTRANSPORT_HPP_
+#define SOCKETPOOLTRANSPORT_HPP_
+
+#include "PoolTransport.hpp"
+
+#include <pthread.h>
+#include <map>
+#include <deque>
+
+/** Request that appends a message to the mailbox. */
+#define SOCKET_POOL_SEND	(1)
+/** Request that returns the number of messages received by the mailbox. */
+#define SOCKET_POOL_PEEK	(2)
+
+class SocketPoolTransport;
+
+/** @brief A mailbox received by this node. */
+typedef struct {
+	/** The transport that owns the mailbox */
+	SocketPoolTransport* transport;
+	/** Listening socket */
+	int socketfd;
+	/** Path of the socket in the shared directory */
+	string path;
+	/** Thread that accepts the connections of the senders */
+	pthread_t thread;
+	/** Messages not received yet */
+	deque<string> messages;
+	/** Number of messages that arrived since the creation of the mailbox */
+	int count;
+} socket_pool_mailbox_t;
+
+/** @brief Pool transport that exchanges messages through Unix-domain sockets.
+ *
+ * The receiver of each mailbox listens on a socket of the shared
+ * directory and keeps the incoming messages in memory. The senders
+ * connect to this socket for each message, waiting for the receiver
+ * only if it has not started listening yet.
+ *
+ * The mailboxes only exist while their receivers are alive, so peek()
+ * returns false for the mailboxes of nodes that have already finished.
+ * All the nodes must run in the same host.
+ */
+class SocketPoolTransport : public PoolTransport {
+public:
+	SocketPoolTransport(string sharedPath);
+	virtual ~SocketPoolTransport();
+
+	virtual void listen(const string& mailbox);
+	virtual void send(const string& mailbox, const string& message);
+	virtual string receive(const string& mailbox);
+	virtual bool poll(const string& mailbox);
+	virtual bool peek(const string& mailbox);
+
+private:
+	string sharedPath;
+	/** Mailboxes received by this node */
+	map<string, socket_pool_mailbox_t*> mailboxes;
+	/** Protects the messages of all the mailboxes */
+	pthread_mutex_t mutex;
+	/** Signals the arrival of a message */
+	pthread_cond_t cond;
+
+	string getSocketFile(const string& mailbox);
+	int connectMailbox(const string& mailbox, bool wait);
+	void acceptMessages(socket_pool_mailbox_t* mailbox);
+
+	static void* acceptThread(void* arg);
+};
+
+#endif /* SOCKETPOOLTRANSPORT_HPP_ */
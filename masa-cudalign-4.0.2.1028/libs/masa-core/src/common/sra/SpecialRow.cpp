@@ -86,6 +86,13 @@ void SpecialRow::seek(int offset) {
 	this->offset = offset;
 }
 
+/*
+ * @see description on header file
+ */
+void SpecialRow::prefetch(int offset, int len) {
+	// nothing to prefetch
+}
+
 /*
  * @see description on header file
  */
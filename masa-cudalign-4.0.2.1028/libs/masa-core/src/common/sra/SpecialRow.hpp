@@ -121,6 +121,17 @@ public:
 	 */
 	virtual void truncateRow(int size) = 0;
 
+	/**
+	 * Loads in advance a range of the row that will be read soon. This
+	 * method may be called from a background thread while the row is being
+	 * used by other thread, so it must not change the state of the object.
+	 * The default implementation does nothing.
+	 *
+	 * @param offset the end (exclusive) of the range to be loaded.
+	 * @param len the number of cells before the offset to be loaded.
+	 */
+	virtual void prefetch(int offset, int len);
+
 protected:
 
 	/**
@@ -0,0 +1,451 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#include "SpecialRowCompressed.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Tracer.hpp"
+
+#define DEBUG (0)
+
+/** Identifies the footer of a compressed special row */
+#define COMPRESSED_ROW_MAGIC	(0x5A525753)
+
+/** Size of the footer: cells count, block size, blocks count and magic */
+#define FOOTER_SIZE		(4*sizeof(int))
+
+/** Suffix of the compressed rows */
+#define COMPRESSED_SUFFIX	".z"
+
+/** Number of 64-bit words in the header of each block */
+#define BLOCK_HEADER_WORDS	(2)
+
+/**
+ * Maps a signed difference to an unsigned value, so small negative
+ * differences also have few significant bits.
+ */
+static inline unsigned long long zigzag(long long v) {
+	return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static inline long long unzigzag(unsigned long long v) {
+	return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static inline int bitWidth(unsigned long long v) {
+	return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+static inline void putBits(unsigned long long* out, long long pos, unsigned long long v, int bits) {
+	int w = pos >> 6;
+	int o = pos & 63;
+	out[w] |= v << o;
+	if (o + bits > 64) {
+		out[w+1] |= v >> (64 - o);
+	}
+}
+
+static inline unsigned long long getBits(const unsigned long long* in, long long pos, int bits) {
+	int w = pos >> 6;
+	int o = pos & 63;
+	unsigned long long v = in[w] >> o;
+	if (o + bits > 64) {
+		v |= in[w+1] << (64 - o);
+	}
+	return bits == 64 ? v : v & ((1ULL << bits) - 1);
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowCompressed::SpecialRowCompressed(string* path, string filename)
+		: SpecialRowFile(path, filename) {
+	this->writing = false;
+	this->block = NULL;
+	this->blockCount = 0;
+	this->decodedBlock = -1;
+	this->cellsCount = 0;
+	this->fileSize = 0;
+
+	int id = -1;
+	if (filename.length() == 8 + 2 && filename.compare(8, 2, COMPRESSED_SUFFIX) == 0) {
+		sscanf(filename.c_str(), "%X", &id);
+	} else if (filename.length() == 8 + 2 + 4 && filename.compare(8, 6, COMPRESSED_SUFFIX ".tmp") == 0) {
+		string fullFile = ((*path) + "/" + filename);
+		remove(fullFile.c_str());
+	}
+	setId(id);
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowCompressed::SpecialRowCompressed(string* path, int id)
+		: SpecialRowFile(path, id) {
+	this->writing = false;
+	this->block = NULL;
+	this->blockCount = 0;
+	this->decodedBlock = -1;
+	this->cellsCount = 0;
+	this->fileSize = 0;
+	this->filename += COMPRESSED_SUFFIX;
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowCompressed::~SpecialRowCompressed() {
+	close();
+}
+
+/*
+ * @see description on header file
+ */
+long long SpecialRowCompressed::getFileSize() const {
+	return fileSize;
+}
+
+/*
+ * @see description on header file
+ */
+bool SpecialRowCompressed::isCompressedFilename(const string filename) {
+	if (filename.length() == 8 + 2) {
+		return filename.compare(8, 2, COMPRESSED_SUFFIX) == 0;
+	} else if (filename.length() == 8 + 2 + 4) {
+		return filename.compare(8, 6, COMPRESSED_SUFFIX ".tmp") == 0;
+	} else {
+		return false;
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowCompressed::initialize(bool readOnly, int length) {
+	string filename = getFullFilename(!readOnly);
+	file = fopen(filename.c_str(), readOnly ? "rb" : "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not %s special row: %s\n", readOnly?"open":"create",
+				filename.c_str());
+		perror("fopen()");
+		exit(1);
+	}
+	writing = !readOnly;
+	block = (cell_t*)malloc(BLOCK_CELLS*sizeof(cell_t));
+	blockCount = 0;
+	decodedBlock = -1;
+	cellsCount = 0;
+	index.clear();
+	if (readOnly && !readIndex(file, index, &cellsCount)) {
+		fprintf(stderr, "Invalid compressed special row: %s\n", filename.c_str());
+		exit(1);
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowCompressed::close() {
+	if (file != NULL) {
+		if (writing) {
+			flushBlock();
+			index.push_back(ftello(file));
+			writeIndex(file, index, cellsCount);
+			fileSize = ftello(file);
+		}
+		fclose(file);
+		file = NULL;
+		if (writing) {
+			string filenameTmp = getFullFilename(true);
+			string filenameDef = getFullFilename(false);
+			rename(filenameTmp.c_str(), filenameDef.c_str());
+		}
+	}
+	if (block != NULL) {
+		free(block);
+		block = NULL;
+	}
+	index.clear();
+	encoded.clear();
+	decodedBlock = -1;
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowCompressed::truncateRow(int size) {
+	string filenameDef = getFullFilename(false);
+	if (size == 0) {
+		remove(filenameDef.c_str());
+		return;
+	}
+	FILE* f = fopen(filenameDef.c_str(), "r+b");
+	if (f == NULL) {
+		return;
+	}
+	vector<long long> fileIndex;
+	int count;
+	if (readIndex(f, fileIndex, &count) && size < count) {
+		// The last block is kept whole; the cells count hides the extra cells.
+		int blocks = (size + BLOCK_CELLS - 1)/BLOCK_CELLS;
+		fileIndex.resize(blocks+1);
+		fseeko(f, fileIndex.back(), SEEK_SET);
+		writeIndex(f, fileIndex, size);
+		fflush(f);
+		if (ftruncate(fileno(f), ftello(f)) != 0) {
+			perror("ftruncate()");
+		}
+	}
+	fclose(f);
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowCompressed::prefetch(int offset, int len) {
+	string filename = getFullFilename(false);
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd != -1) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		::close(fd);
+	}
+}
+
+/*
+ * @see description on header file
+ */
+int SpecialRowCompressed::write(const cell_t* buf, int offset, int len) {
+	int pos = 0;
+	while (pos < len) {
+		int n = BLOCK_CELLS - blockCount;
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		memcpy(block + blockCount, buf + pos, n*sizeof(cell_t));
+		blockCount += n;
+		pos += n;
+		if (blockCount == BLOCK_CELLS) {
+			flushBlock();
+		}
+	}
+	return len;
+}
+
+/*
+ * @see description on header file
+ */
+int SpecialRowCompressed::read(cell_t* buf, int offset, int len) {
+	if (DEBUG) printf("SpecialRowCompressed::read(%p, %d, %d): %s\n", buf, offset, len, filename.c_str());
+	if (offset + len > cellsCount) {
+		len = cellsCount - offset;
+	}
+	int pos = 0;
+	while (pos < len) {
+		int b = (offset + pos) / BLOCK_CELLS;
+		int start = (offset + pos) % BLOCK_CELLS;
+		if (!decodeBlock(b)) {
+			return pos;
+		}
+		int n = BLOCK_CELLS - start;
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		memcpy(buf + pos, block + start, n*sizeof(cell_t));
+		pos += n;
+	}
+	return pos;
+}
+
+void SpecialRowCompressed::flushBlock() {
+	if (blockCount == 0) {
+		return;
+	}
+	TRACE_SPAN(TRACE_IO, "SpecialRowCompressed write");
+	index.push_back(ftello(file));
+	size_t words = encodeBlock(block, blockCount, encoded);
+	if (fwrite(&encoded[0], sizeof(unsigned long long), words, file) != words) {
+		perror("SpecialRowCompressed::flushBlock");
+		exit(1);
+	}
+	cellsCount += blockCount;
+	blockCount = 0;
+}
+
+bool SpecialRowCompressed::decodeBlock(int b) {
+	if (b == decodedBlock) {
+		return true;
+	}
+	if (b < 0 || (size_t)b + 1 >= index.size()) {
+		return false;
+	}
+	TRACE_SPAN(TRACE_IO, "SpecialRowCompressed read");
+	size_t words = (index[b+1] - index[b])/sizeof(unsigned long long);
+	encoded.resize(words);
+	fseeko(file, index[b], SEEK_SET);
+	if (fread(&encoded[0], sizeof(unsigned long long), words, file) != words) {
+		return false;
+	}
+	decodeBlock(&encoded[0], block, BLOCK_CELLS);
+	decodedBlock = b;
+	return true;
+}
+
+/**
+ * Encodes the cells in the following 64-bit words: the first cell, the
+ * bit widths and the number of cells, followed by the H and the F
+ * zigzag differences packed with the given widths.
+ *
+ * @return the number of words of the encoded block.
+ */
+int SpecialRowCompressed::encodeBlock(const cell_t* cells, int count, vector<unsigned long long>& out) {
+	unsigned long long maxH = 0;
+	unsigned long long maxF = 0;
+	for (int k = 1; k < count; k++) {
+		maxH |= zigzag((long long)cells[k].h - cells[k-1].h);
+		maxF |= zigzag((long long)cells[k].f - cells[k-1].f);
+	}
+	int bitsH = bitWidth(maxH);
+	int bitsF = bitWidth(maxF);
+	long long bits = (long long)(count-1)*(bitsH + bitsF);
+	int words = BLOCK_HEADER_WORDS + (bits + 63)/64;
+
+	out.assign(words, 0);
+	out[0] = (unsigned int)cells[0].h | ((unsigned long long)(unsigned int)cells[0].f << 32);
+	out[1] = bitsH | (bitsF << 8) | ((unsigned long long)count << 16);
+	unsigned long long* data = &out[BLOCK_HEADER_WORDS];
+	long long pos = 0;
+	if (bitsH > 0) {
+		for (int k = 1; k < count; k++, pos += bitsH) {
+			putBits(data, pos, zigzag((long long)cells[k].h - cells[k-1].h), bitsH);
+		}
+	}
+	if (bitsF > 0) {
+		for (int k = 1; k < count; k++, pos += bitsF) {
+			putBits(data, pos, zigzag((long long)cells[k].f - cells[k-1].f), bitsF);
+		}
+	}
+	return words;
+}
+
+/**
+ * Decodes a block encoded by encodeBlock.
+ * @param max the capacity of the cells vector.
+ */
+void SpecialRowCompressed::decodeBlock(const unsigned long long* in, cell_t* cells, int max) {
+	int bitsH = in[1] & 0xFF;
+	int bitsF = (in[1] >> 8) & 0xFF;
+	int count = (int)(in[1] >> 16);
+	if (count > max) {
+		count = max;
+	}
+	const unsigned long long* data = in + BLOCK_HEADER_WORDS;
+	long long pos = 0;
+
+	cells[0].h = (int)(in[0] & 0xFFFFFFFFULL);
+	cells[0].f = (int)(in[0] >> 32);
+	for (int k = 1; k < count; k++) {
+		long long d = 0;
+		if (bitsH > 0) {
+			d = unzigzag(getBits(data, pos, bitsH));
+			pos += bitsH;
+		}
+		cells[k].h = (int)(cells[k-1].h + d);
+	}
+	for (int k = 1; k < count; k++) {
+		long long d = 0;
+		if (bitsF > 0) {
+			d = unzigzag(getBits(data, pos, bitsF));
+			pos += bitsF;
+		}
+		cells[k].f = (int)(cells[k-1].f + d);
+	}
+}
+
+bool SpecialRowCompressed::readIndex(FILE* file, vector<long long>& index, int* cellsCount) {
+	int footer[4];
+	if (fseeko(file, -(off_t)FOOTER_SIZE, SEEK_END) != 0
+			|| fread(footer, sizeof(int), 4, file) != 4) {
+		return false;
+	}
+	int blocks = footer[2];
+	if ((unsigned int)footer[3] != COMPRESSED_ROW_MAGIC || footer[1] != BLOCK_CELLS || blocks < 0) {
+		return false;
+	}
+	index.resize(blocks+1);
+	if (fseeko(file, -(off_t)(FOOTER_SIZE + (blocks+1)*sizeof(long long)), SEEK_END) != 0
+			|| fread(&index[0], sizeof(long long), blocks+1, file) != (size_t)blocks+1) {
+		return false;
+	}
+	*cellsCount = footer[0];
+	return true;
+}
+
+void SpecialRowCompressed::writeIndex(FILE* file, const vector<long long>& index, int cellsCount) {
+	int footer[4];
+	footer[0] = cellsCount;
+	footer[1] = BLOCK_CELLS;
+	footer[2] = index.size()-1;
+	footer[3] = COMPRESSED_ROW_MAGIC;
+	fwrite(&index[0], sizeof(long long), index.size(), file);
+	fwrite(footer, sizeof(int), 4, file);
+}
+
+/*
+ * @see description on header file
+ */
+bool SpecialRowCompressed::decompress(const string compressedFile, const string plainFile) {
+	FILE* in = fopen(compressedFile.c_str(), "rb");
+	if (in == NULL) {
+		return false;
+	}
+	FILE* out = fopen(plainFile.c_str(), "wb");
+	if (out == NULL) {
+		fclose(in);
+		return false;
+	}
+	vector<long long> fileIndex;
+	vector<unsigned long long> words;
+	cell_t* cells = (cell_t*)malloc(BLOCK_CELLS*sizeof(cell_t));
+	int count = 0;
+	bool ok = readIndex(in, fileIndex, &count);
+	for (size_t b = 0; ok && b + 1 < fileIndex.size() && count > 0; b++) {
+		words.resize((fileIndex[b+1] - fileIndex[b])/sizeof(unsigned long long));
+		fseeko(in, fileIndex[b], SEEK_SET);
+		ok = (fread(&words[0], sizeof(unsigned long long), words.size(), in) == words.size());
+		if (ok) {
+			decodeBlock(&words[0], cells, BLOCK_CELLS);
+			int n = count < BLOCK_CELLS ? count : BLOCK_CELLS;
+			ok = (fwrite(cells, sizeof(cell_t), n, out) == (size_t)n);
+			count -= n;
+		}
+	}
+	free(cells);
+	fclose(out);
+	fclose(in);
+	return ok;
+}
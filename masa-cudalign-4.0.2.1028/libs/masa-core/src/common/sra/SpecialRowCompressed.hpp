@@ -0,0 +1,164 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#ifndef SPECIALROWCOMPRESSED_HPP_
+#define SPECIALROWCOMPRESSED_HPP_
+
+#include "SpecialRowFile.hpp"
+
+#include <vector>
+using namespace std;
+
+/** @brief Class that stores a compressed Special Row in the disk.
+ *
+ * The cells are grouped in blocks of SpecialRowCompressed::BLOCK_CELLS cells.
+ * Inside each block, the H and F values are stored as the difference to
+ * the previous cell, zigzag encoded and bit-packed with the smallest width
+ * that fits all the differences of the block. Since adjacent cells differ
+ * by small bounded amounts, most blocks use a few bits per value instead of
+ * the 64 bits of a cell_t.
+ *
+ * The file is written sequentially and finished by an index with the
+ * offset of each block, so the blocks may be decoded in any order. The
+ * files have the ".z" suffix, so they can coexist with the uncompressed rows.
+ */
+class SpecialRowCompressed : public SpecialRowFile {
+public:
+	/**
+	 * @see SpecialRowFile::SpecialRowFile(string*, string)
+	 */
+	SpecialRowCompressed(string* path, string filename);
+
+	/**
+	 * @see SpecialRowFile::SpecialRowFile(string*, int)
+	 */
+	SpecialRowCompressed(string* path, int id);
+
+	/**
+	 * Closes the file.
+	 */
+	virtual ~SpecialRowCompressed();
+
+	/**
+	 * Closes the file. In write mode, the pending block and the index are
+	 * stored before closing.
+	 */
+	virtual void close();
+
+	/**
+	 * Truncates the file, keeping only the blocks containing the first
+	 * size cells.
+	 *
+	 * @param size the number of cells to keep in the file.
+	 */
+	virtual void truncateRow(int size);
+
+	/**
+	 * Asks the kernel to load the whole (small) compressed file.
+	 */
+	virtual void prefetch(int offset, int len);
+
+	/**
+	 * Returns the number of bytes of the file, including the index. It is
+	 * only known after the row is written and closed.
+	 */
+	long long getFileSize() const;
+
+	/**
+	 * Returns true if the filename is a compressed special row (or
+	 * a temporary one).
+	 */
+	static bool isCompressedFilename(const string filename);
+
+	/**
+	 * Decompresses a special row file into an uncompressed file.
+	 *
+	 * @param compressedFile the full name of the compressed file.
+	 * @param plainFile the full name of the file to be created.
+	 * @return true if the file was successfully decompressed.
+	 */
+	static bool decompress(const string compressedFile, const string plainFile);
+
+	/** Number of cells in each compressed block */
+	static const int BLOCK_CELLS = 4096;
+
+	/**
+	 * Expected compression ratio, used to convert the disk limit into the
+	 * number of uncompressed bytes that can be stored. The measured ratios
+	 * were about 3.4 on average and 2.7 in the worst rows, but they depend
+	 * on the sequences, so the bytes really written are also checked
+	 * against the disk limit (see SpecialRowsPartition::setDiskBudget).
+	 */
+	static const int EXPECTED_RATIO = 2;
+
+private:
+	/** Indicates if the file was opened for writing */
+	bool writing;
+
+	/** Cells of the block being written or the last block decoded */
+	cell_t* block;
+
+	/** Number of cells in the block being written */
+	int blockCount;
+
+	/** Index of the decoded block, or -1 */
+	int decodedBlock;
+
+	/** Offsets of the blocks in the file, and the end of the last block */
+	vector<long long> index;
+
+	/** Number of cells in the row */
+	int cellsCount;
+
+	/** Size of the file written by the last close() */
+	long long fileSize;
+
+	/** Temporary buffer for the encoded blocks */
+	vector<unsigned long long> encoded;
+
+	/**
+	 * Opens the file for read or write mode.
+	 * @param readOnly true if it must be opened for read mode, false otherwise.
+	 * @param length the initial size of the file (ignored).
+	 */
+	virtual void initialize(bool readOnly, int length);
+
+	/*
+	 * @see description in superclass header.
+	 */
+	virtual int write(const cell_t* buf, int offset, int len);
+
+	/*
+	 * @see description in superclass header.
+	 */
+	virtual int read(cell_t* buf, int offset, int len);
+
+	void flushBlock();
+	bool decodeBlock(int b);
+
+	static bool readIndex(FILE* file, vector<long long>& index, int* cellsCount);
+	static void writeIndex(FILE* file, const vector<long long>& index, int cellsCount);
+	static int encodeBlock(const cell_t* cells, int count, vector<unsigned long long>& out);
+	static void decodeBlock(const unsigned long long* in, cell_t* cells, int count);
+};
+
+#endif /* SPECIALROWCOMPRESSED_HPP_ */
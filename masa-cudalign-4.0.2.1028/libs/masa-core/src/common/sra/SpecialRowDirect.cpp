@@ -0,0 +1,198 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#include "SpecialRowDirect.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUG (0)
+
+/** Granularity of the O_DIRECT writes */
+#define DIRECT_BLOCK_SIZE	(4096)
+
+/*
+ * @see description on header file
+ */
+SpecialRowDirect::SpecialRowDirect(string* path, int id)
+		: SpecialRowMMap(path, id) {
+	this->flusher = NULL;
+	this->writing = false;
+	this->buffer = NULL;
+	this->bufferStart = 0;
+	this->bufferCount = 0;
+	this->cellsCount = 0;
+	this->writeFd = -1;
+	this->direct = false;
+	this->pending = 0;
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowDirect::~SpecialRowDirect() {
+	close();
+	if (flusher != NULL) {
+		flusher->wait(this);
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::initialize(bool readOnly, int length) {
+	if (readOnly) {
+		if (flusher != NULL) {
+			flusher->wait(this);
+		}
+		SpecialRowMMap::initialize(readOnly, length);
+	} else {
+		flusher = SpecialRowFlusher::getInstance();
+		writing = true;
+		buffer = NULL;
+		bufferCount = 0;
+		cellsCount = 0;
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::close() {
+	if (writing) {
+		if (buffer != NULL) {
+			flusher->submit(this, buffer, bufferStart, bufferCount);
+			buffer = NULL;
+		}
+		flusher->commit(this);
+		writing = false;
+	} else {
+		SpecialRowMMap::close();
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::truncateRow(int size) {
+	if (flusher != NULL) {
+		flusher->wait(this);
+	}
+	SpecialRowMMap::truncateRow(size);
+}
+
+/*
+ * @see description on header file
+ */
+int SpecialRowDirect::write(const cell_t* buf, int offset, int len) {
+	int pos = 0;
+	while (pos < len) {
+		if (buffer == NULL) {
+			buffer = flusher->getBuffer();
+			bufferStart = offset + pos;
+			bufferCount = 0;
+		}
+		int n = SpecialRowFlusher::BUFFER_CELLS - bufferCount;
+		if (n > len - pos) {
+			n = len - pos;
+		}
+		memcpy(buffer + bufferCount, buf + pos, n*sizeof(cell_t));
+		bufferCount += n;
+		pos += n;
+		if (bufferCount == SpecialRowFlusher::BUFFER_CELLS) {
+			flusher->submit(this, buffer, bufferStart, bufferCount);
+			buffer = NULL;
+		}
+	}
+	cellsCount = offset + len;
+	return len;
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::openFile() {
+	string filename = getFullFilename(true);
+	direct = SpecialRowFlusher::isDirectIO();
+	writeFd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0664);
+	if (writeFd == -1 && direct && errno == EINVAL) {
+		// The file system does not support O_DIRECT.
+		direct = false;
+		writeFd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	}
+	if (writeFd == -1) {
+		fprintf(stderr, "Could not create special row: %s\n", filename.c_str());
+		perror("open()");
+		exit(1);
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::writeBuffer(cell_t* buffer, int offset, int len) {
+	if (writeFd == -1) {
+		openFile();
+	}
+	size_t size = len*sizeof(cell_t);
+	if (direct && size % DIRECT_BLOCK_SIZE != 0) {
+		// O_DIRECT only writes whole blocks; the padding is truncated on commit.
+		size_t padded = (size/DIRECT_BLOCK_SIZE + 1)*DIRECT_BLOCK_SIZE;
+		memset((char*)buffer + size, 0, padded - size);
+		size = padded;
+	}
+	off_t position = (off_t)offset*sizeof(cell_t);
+	size_t done = 0;
+	while (done < size) {
+		ssize_t ret = pwrite(writeFd, (char*)buffer + done, size - done, position + done);
+		if (ret <= 0) {
+			if (ret == -1 && errno == EINTR) continue;
+			fprintf(stderr, "Could not write special row: %s\n", getFullFilename(true).c_str());
+			perror("pwrite()");
+			exit(1);
+		}
+		done += ret;
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowDirect::commitFile() {
+	if (writeFd == -1) {
+		openFile();
+	}
+	if (ftruncate(writeFd, (off_t)cellsCount*sizeof(cell_t)) != 0) {
+		perror("ftruncate()");
+	}
+	::close(writeFd);
+	writeFd = -1;
+	string filenameTmp = getFullFilename(true);
+	string filenameDef = getFullFilename(false);
+	rename(filenameTmp.c_str(), filenameDef.c_str());
+	if (DEBUG) printf("Committed %s (%d cells%s)\n", filenameDef.c_str(), cellsCount, direct ? ", O_DIRECT" : "");
+}
@@ -0,0 +1,120 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#ifndef SPECIALROWDIRECT_HPP_
+#define SPECIALROWDIRECT_HPP_
+
+#include "SpecialRowMMap.hpp"
+#include "SpecialRowFlusher.hpp"
+
+/** @brief Class that writes an Special Row in background.
+ *
+ * The cells are copied into the aligned buffers of the SpecialRowFlusher,
+ * whose thread writes them in the temporary file (with O_DIRECT, if
+ * enabled) and renames the file when the row is closed, as the other
+ * SpecialRowFile classes do. Since the last buffer is padded for O_DIRECT,
+ * the file is truncated to the exact length before renaming.
+ *
+ * The files are the same of the SpecialRowFile, and they are read through
+ * a memory mapping (see SpecialRowMMap) after all the writes finish.
+ */
+class SpecialRowDirect : public SpecialRowMMap {
+public:
+	/**
+	 * @see SpecialRowFile::SpecialRowFile(string*, int)
+	 */
+	SpecialRowDirect(string* path, int id);
+
+	/**
+	 * Waits for the pending writes.
+	 */
+	virtual ~SpecialRowDirect();
+
+	/**
+	 * In write mode, queues the last buffer and the commit of the file,
+	 * returning immediately. In read mode, unmaps the file.
+	 */
+	virtual void close();
+
+	/**
+	 * Waits for the pending writes and truncates the file.
+	 * @see SpecialRowFile::truncateRow
+	 */
+	virtual void truncateRow(int size);
+
+private:
+	friend class SpecialRowFlusher;
+
+	SpecialRowFlusher* flusher;
+
+	/** Indicates if the row is opened for writing */
+	bool writing;
+
+	/** Buffer being filled, or NULL */
+	cell_t* buffer;
+
+	/** Offset of the first cell of the buffer in the row */
+	int bufferStart;
+
+	/** Number of cells in the buffer */
+	int bufferCount;
+
+	/** Number of cells written in the row */
+	int cellsCount;
+
+	/** Descriptor of the temporary file, only used by the flusher thread */
+	int writeFd;
+
+	/** The file was opened with O_DIRECT */
+	bool direct;
+
+	/** Number of requests queued in the flusher (guarded by the flusher) */
+	int pending;
+
+	/**
+	 * Opens the row for read or write mode. In read mode, the pending
+	 * writes are waited before mapping the file.
+	 */
+	virtual void initialize(bool readOnly, int length);
+
+	/*
+	 * @see description in superclass header.
+	 */
+	virtual int write(const cell_t* buf, int offset, int len);
+
+	/**
+	 * Writes a buffer in the file. Called by the flusher thread.
+	 */
+	void writeBuffer(cell_t* buffer, int offset, int len);
+
+	/**
+	 * Truncates, closes and renames the file. Called by the flusher thread.
+	 */
+	void commitFile();
+
+	/**
+	 * Creates the temporary file. Called by the flusher thread.
+	 */
+	void openFile();
+};
+
+#endif /* SPECIALROWDIRECT_HPP_ */
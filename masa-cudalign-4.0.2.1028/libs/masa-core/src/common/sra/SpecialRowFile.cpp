@@ -26,6 +26,8 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 
+#include "../Tracer.hpp"
+
 #define DEBUG (0)
 
 /*
@@ -123,6 +125,8 @@ void SpecialRowFile::truncateRow(int size) {
  * @see description on header file
  */
 int SpecialRowFile::write(const cell_t* buf, int offset, int len) {
+	TraceSpan span(TRACE_IO, "SpecialRowFile write");
+	span.setArg(len*sizeof(cell_t));
 	return fwrite(buf, sizeof(cell_t), len, file);
 }
 
@@ -131,6 +135,8 @@ int SpecialRowFile::write(const cell_t* buf, int offset, int len) {
  */
 int SpecialRowFile::read(cell_t* buf, int offset, int len) {
 	if (DEBUG) printf("SpecialRowFile::read(%p, %d, %d): %s\n", buf, offset, len, filename.c_str());
+	TraceSpan span(TRACE_IO, "SpecialRowFile read");
+	span.setArg(len*sizeof(cell_t));
 	fseek(file, offset*sizeof(cell_t), SEEK_SET);
 	int pos = 0;
 	while (pos<len) {
@@ -71,7 +71,7 @@ public:
 	 */
 	virtual void truncateRow(int size);
 
-private:
+protected:
 	/** Dynamic path name of the partition. */
 	string* path; // this string changes when the partition changes its name.
 
@@ -0,0 +1,201 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#include "SpecialRowFlusher.hpp"
+#include "SpecialRowDirect.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../Tracer.hpp"
+
+#define DEBUG (0)
+
+/** Alignment of the buffers, required by O_DIRECT */
+#define BUFFER_ALIGNMENT	(4096)
+
+/** Bounds of the memory used by the queued buffers */
+#define MIN_BUFFER_LIMIT	(4*1024*1024LL)
+#define MAX_BUFFER_LIMIT	(64*1024*1024LL)
+
+SpecialRowFlusher* SpecialRowFlusher::instance = NULL;
+pthread_mutex_t SpecialRowFlusher::instanceMutex = PTHREAD_MUTEX_INITIALIZER;
+int SpecialRowFlusher::bufferLimit = MIN_BUFFER_LIMIT/(BUFFER_CELLS*sizeof(cell_t));
+bool SpecialRowFlusher::directIO = false;
+
+SpecialRowFlusher::SpecialRowFlusher() {
+	this->queuedBuffers = 0;
+	this->submitted = 0;
+	this->processed = 0;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+	int rc = pthread_create(&thread, NULL, staticThread, (void*)this);
+	if (rc) {
+		fprintf(stderr, "SpecialRowFlusher: pthread_create() error %d\n", rc);
+		exit(1);
+	}
+}
+
+SpecialRowFlusher* SpecialRowFlusher::getInstance() {
+	pthread_mutex_lock(&instanceMutex);
+	if (instance == NULL) {
+		instance = new SpecialRowFlusher();
+	}
+	pthread_mutex_unlock(&instanceMutex);
+	return instance;
+}
+
+void SpecialRowFlusher::setBufferLimit(long long limit) {
+	if (limit < MIN_BUFFER_LIMIT) {
+		limit = MIN_BUFFER_LIMIT;
+	} else if (limit > MAX_BUFFER_LIMIT) {
+		limit = MAX_BUFFER_LIMIT;
+	}
+	bufferLimit = limit/(BUFFER_CELLS*sizeof(cell_t));
+}
+
+void SpecialRowFlusher::setDirectIO(bool directIO) {
+	SpecialRowFlusher::directIO = directIO;
+}
+
+bool SpecialRowFlusher::isDirectIO() {
+	return directIO;
+}
+
+void SpecialRowFlusher::drain() {
+	pthread_mutex_lock(&instanceMutex);
+	SpecialRowFlusher* flusher = instance;
+	pthread_mutex_unlock(&instanceMutex);
+	if (flusher == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&flusher->mutex);
+	long long ticket = flusher->submitted;
+	while (flusher->processed < ticket) {
+		pthread_cond_wait(&flusher->cond, &flusher->mutex);
+	}
+	pthread_mutex_unlock(&flusher->mutex);
+}
+
+cell_t* SpecialRowFlusher::getBuffer() {
+	cell_t* buffer = NULL;
+	pthread_mutex_lock(&mutex);
+	if (!freeBuffers.empty()) {
+		buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+	pthread_mutex_unlock(&mutex);
+	if (buffer == NULL) {
+		// The buffers being filled are not limited, since each one
+		// belongs to a row that is still receiving cells.
+		if (posix_memalign((void**)&buffer, BUFFER_ALIGNMENT, BUFFER_CELLS*sizeof(cell_t))) {
+			fprintf(stderr, "SpecialRowFlusher: could not allocate a buffer.\n");
+			exit(1);
+		}
+	}
+	return buffer;
+}
+
+void SpecialRowFlusher::releaseBuffer(cell_t* buffer) {
+	pthread_mutex_lock(&mutex);
+	freeBuffers.push_back(buffer);
+	pthread_mutex_unlock(&mutex);
+}
+
+void SpecialRowFlusher::submit(SpecialRowDirect* row, cell_t* buffer, int offset, int len) {
+	enqueue(row, buffer, offset, len);
+}
+
+void SpecialRowFlusher::commit(SpecialRowDirect* row) {
+	enqueue(row, NULL, 0, 0);
+}
+
+void SpecialRowFlusher::enqueue(SpecialRowDirect* row, cell_t* buffer, int offset, int len) {
+	pthread_mutex_lock(&mutex);
+	if (buffer != NULL) {
+		if (queuedBuffers >= bufferLimit) {
+			TRACE_SPAN(TRACE_SRA, "special row backpressure");
+			while (queuedBuffers >= bufferLimit) {
+				pthread_cond_wait(&cond, &mutex);
+			}
+		}
+		queuedBuffers++;
+	}
+	request_t request;
+	request.row = row;
+	request.buffer = buffer;
+	request.offset = offset;
+	request.len = len;
+	queue.push_back(request);
+	row->pending++;
+	submitted++;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void SpecialRowFlusher::wait(SpecialRowDirect* row) {
+	pthread_mutex_lock(&mutex);
+	while (row->pending > 0) {
+		pthread_cond_wait(&cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void* SpecialRowFlusher::staticThread(void* arg) {
+	SpecialRowFlusher* flusher = (SpecialRowFlusher*)arg;
+	Tracer::setThreadName("special row flusher");
+	flusher->flushLoop();
+	return NULL;
+}
+
+void SpecialRowFlusher::flushLoop() {
+	pthread_mutex_lock(&mutex);
+	while (1) {
+		if (queue.empty()) {
+			pthread_cond_wait(&cond, &mutex);
+			continue;
+		}
+		request_t request = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		if (request.buffer != NULL) {
+			if (DEBUG) printf("Flushing row %08X [%d..%d)\n", request.row->getId(), request.offset, request.offset+request.len);
+			TraceSpan span(TRACE_IO, "special row flush");
+			span.setArg(request.len*sizeof(cell_t));
+			request.row->writeBuffer(request.buffer, request.offset, request.len);
+		} else {
+			TRACE_SPAN(TRACE_IO, "special row commit");
+			request.row->commitFile();
+		}
+
+		pthread_mutex_lock(&mutex);
+		if (request.buffer != NULL) {
+			freeBuffers.push_back(request.buffer);
+			queuedBuffers--;
+		}
+		request.row->pending--;
+		processed++;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#ifndef SPECIALROWFLUSHER_HPP_
+#define SPECIALROWFLUSHER_HPP_
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+using namespace std;
+
+#include "../../libmasa/libmasa.hpp"
+
+class SpecialRowDirect;
+
+/** @brief Background thread that writes the special rows to the disk.
+ *
+ * The SpecialRowDirect rows copy the cells dispatched by the aligner into
+ * aligned buffers of SpecialRowFlusher::BUFFER_CELLS cells, and this thread
+ * writes the full buffers and commits the finished rows (renaming their
+ * temporary files), so the aligner never waits for the disk unless the
+ * writes fall behind. In that case, the number of queued buffers is bounded
+ * (see setBufferLimit) and the aligner waits for a free slot.
+ *
+ * The requests are processed in order by a single thread, shared by all the
+ * rows of the process.
+ */
+class SpecialRowFlusher {
+public:
+	/** Number of cells of each buffer (1MB) */
+	static const int BUFFER_CELLS = 1024*1024/sizeof(cell_t);
+
+	/**
+	 * Returns the flusher of the process, creating it in the first call.
+	 */
+	static SpecialRowFlusher* getInstance();
+
+	/**
+	 * Defines the amount of memory used by the queued buffers. The limit
+	 * is bounded to the range [4MB..64MB].
+	 *
+	 * @param limit the limit in bytes.
+	 */
+	static void setBufferLimit(long long limit);
+
+	/**
+	 * Defines if the rows must be written with O_DIRECT, bypassing the page
+	 * cache. File systems that do not support O_DIRECT fall back to the
+	 * buffered writes.
+	 */
+	static void setDirectIO(bool directIO);
+
+	/**
+	 * Returns true if the rows must be written with O_DIRECT.
+	 */
+	static bool isDirectIO();
+
+	/**
+	 * Waits until all the requests submitted before this call are processed.
+	 * It must be called before listing a directory with special rows, since
+	 * the rows being committed still have temporary names.
+	 */
+	static void drain();
+
+	/**
+	 * Returns a buffer of BUFFER_CELLS cells, aligned for O_DIRECT.
+	 */
+	cell_t* getBuffer();
+
+	/**
+	 * Returns a buffer that was not submitted.
+	 */
+	void releaseBuffer(cell_t* buffer);
+
+	/**
+	 * Queues a buffer to be written in the row file. If the queue is full,
+	 * the caller waits until the oldest buffer is written (backpressure).
+	 * The buffer is released after it is written.
+	 *
+	 * @param row the row that owns the buffer.
+	 * @param buffer the buffer with the cells.
+	 * @param offset the offset (in cells) of the buffer in the row.
+	 * @param len the number of cells in the buffer.
+	 */
+	void submit(SpecialRowDirect* row, cell_t* buffer, int offset, int len);
+
+	/**
+	 * Queues the commit of the row, executed after all its buffers are
+	 * written.
+	 *
+	 * @param row the finished row.
+	 */
+	void commit(SpecialRowDirect* row);
+
+	/**
+	 * Waits until all the requests of the row are processed.
+	 */
+	void wait(SpecialRowDirect* row);
+
+private:
+	/** A queued write (or commit, if buffer is NULL) */
+	typedef struct {
+		SpecialRowDirect* row;
+		cell_t* buffer;
+		int offset;
+		int len;
+	} request_t;
+
+	static SpecialRowFlusher* instance;
+	static pthread_mutex_t instanceMutex;
+	static int bufferLimit;
+	static bool directIO;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	deque<request_t> queue;
+	/** Number of queued buffers */
+	int queuedBuffers;
+	/** Buffers available for reuse */
+	vector<cell_t*> freeBuffers;
+	/** Number of requests submitted and processed */
+	long long submitted;
+	long long processed;
+
+	/* The flusher lives until the end of the process */
+	SpecialRowFlusher();
+
+	void enqueue(SpecialRowDirect* row, cell_t* buffer, int offset, int len);
+	static void* staticThread(void* arg);
+	void flushLoop();
+};
+
+#endif /* SPECIALROWFLUSHER_HPP_ */
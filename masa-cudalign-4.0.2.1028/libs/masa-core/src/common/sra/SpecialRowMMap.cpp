@@ -0,0 +1,222 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#include "SpecialRowMMap.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Tracer.hpp"
+
+#define DEBUG (0)
+
+/** Number of cells requested in advance during the backward reading */
+#define ADVISE_CELLS	(64*1024)
+
+/**
+ * Returns the address of the page containing the given address.
+ */
+static void* pageStart(const void* ptr) {
+	static long pageSize = sysconf(_SC_PAGESIZE);
+	return (void*)((unsigned long)ptr & ~(unsigned long)(pageSize-1));
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowMMap::SpecialRowMMap(string* path, string filename)
+		: SpecialRowFile(path, filename) {
+	this->fd = -1;
+	this->map = NULL;
+	this->mapLength = 0;
+	this->adviseOffset = 0;
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowMMap::SpecialRowMMap(string* path, int id)
+		: SpecialRowFile(path, id) {
+	this->fd = -1;
+	this->map = NULL;
+	this->mapLength = 0;
+	this->adviseOffset = 0;
+}
+
+/*
+ * @see description on header file
+ */
+SpecialRowMMap::~SpecialRowMMap() {
+	close();
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowMMap::initialize(bool readOnly, int length) {
+	string filename = getFullFilename(!readOnly);
+	fd = ::open(filename.c_str(), readOnly ? O_RDONLY : (O_RDWR | O_CREAT | O_TRUNC), 0664);
+	if (fd == -1) {
+		fprintf(stderr, "Could not %s special row: %s\n", readOnly?"open":"create",
+				filename.c_str());
+		perror("open()");
+		exit(1);
+	}
+	if (readOnly) {
+		struct stat st;
+		fstat(fd, &st);
+		mapLength = st.st_size/sizeof(cell_t);
+	} else {
+		mapLength = length;
+		if (ftruncate(fd, length*sizeof(cell_t)) != 0) {
+			perror("ftruncate()");
+			mapLength = 0;
+		}
+	}
+	map = NULL;
+	if (mapLength > 0) {
+		void* ptr = mmap(NULL, mapLength*sizeof(cell_t),
+				readOnly ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+		if (ptr == MAP_FAILED) {
+			perror("mmap()");
+			mapLength = 0;
+		} else {
+			map = (cell_t*)ptr;
+			// Rows are written forward and read backwards, where the
+			// kernel read-ahead only loads pages that will not be used.
+			madvise(map, mapLength*sizeof(cell_t), readOnly ? MADV_RANDOM : MADV_SEQUENTIAL);
+		}
+	}
+	adviseOffset = mapLength;
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowMMap::close() {
+	if (fd != -1) {
+		if (map != NULL) {
+			munmap(map, mapLength*sizeof(cell_t));
+			map = NULL;
+		}
+		mapLength = 0;
+		::close(fd);
+		fd = -1;
+		string filenameTmp = getFullFilename(true);
+		string filenameDef = getFullFilename(false);
+		rename(filenameTmp.c_str(), filenameDef.c_str());
+	}
+}
+
+/*
+ * @see description on header file
+ */
+int SpecialRowMMap::write(const cell_t* buf, int offset, int len) {
+	if (offset+len > mapLength) {
+		// beyond the initial length, the file grows without the mapping.
+		return pwrite(fd, buf, len*sizeof(cell_t), (off_t)offset*sizeof(cell_t))/sizeof(cell_t);
+	}
+	memcpy(map+offset, buf, len*sizeof(cell_t));
+	return len;
+}
+
+/*
+ * @see description on header file
+ */
+int SpecialRowMMap::read(cell_t* buf, int offset, int len) {
+	if (DEBUG) printf("SpecialRowMMap::read(%p, %d, %d): %s\n", buf, offset, len, filename.c_str());
+	if (offset >= mapLength) {
+		return 0;
+	}
+	if (offset+len > mapLength) {
+		len = mapLength-offset;
+	}
+	TraceSpan span(TRACE_IO, "SpecialRowMMap read");
+	span.setArg(len*sizeof(cell_t));
+	adviseBackwards(offset);
+	memcpy(buf, map+offset, len*sizeof(cell_t));
+	return len;
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowMMap::adviseBackwards(int offset) {
+	// Keeps at least ADVISE_CELLS requested before the reading position.
+	if (adviseOffset <= 0 || offset - adviseOffset >= ADVISE_CELLS/2) {
+		return;
+	}
+	int start = offset - ADVISE_CELLS;
+	if (start < 0) {
+		start = 0;
+	}
+	if (start < adviseOffset) {
+		void* ptr = pageStart(map+start);
+		madvise(ptr, (char*)(map+adviseOffset) - (char*)ptr, MADV_WILLNEED);
+		adviseOffset = start;
+	}
+}
+
+/*
+ * @see description on header file
+ */
+void SpecialRowMMap::prefetch(int offset, int len) {
+	string filename = getFullFilename(false);
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	int length = st.st_size/sizeof(cell_t);
+	if (offset > length) {
+		offset = length;
+	}
+	int start = offset - len;
+	if (start < 0) {
+		start = 0;
+	}
+	if (start < offset) {
+		void* ptr = mmap(NULL, length*sizeof(cell_t), PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr != MAP_FAILED) {
+			const cell_t* cells = (const cell_t*)ptr;
+			char* first = (char*)pageStart(cells+start);
+			char* last = (char*)(cells+offset);
+			madvise(first, last-first, MADV_WILLNEED);
+
+			// Touches the pages in the reading order, so this thread
+			// (instead of the aligner) waits for the disk.
+			long pageSize = sysconf(_SC_PAGESIZE);
+			volatile char sum = 0;
+			for (char* p = (char*)pageStart(last-1); p >= first; p -= pageSize) {
+				sum += *p;
+			}
+			munmap(ptr, length*sizeof(cell_t));
+		}
+	}
+	::close(fd);
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#ifndef SPECIALROWMMAP_HPP_
+#define SPECIALROWMMAP_HPP_
+
+#include "SpecialRowFile.hpp"
+
+/** @brief Class that reads and stores an Special Row in a memory-mapped file.
+ *
+ * The files are the same used by the SpecialRowFile class, but the cells
+ * are accessed through a memory mapping. Since the rows are read backwards
+ * in the traceback, the kernel read-ahead is disabled for read-only rows
+ * and the region preceding each read is requested in advance with
+ * madvise(MADV_WILLNEED).
+ */
+class SpecialRowMMap : public SpecialRowFile {
+public:
+	/**
+	 * @see SpecialRowFile::SpecialRowFile(string*, string)
+	 */
+	SpecialRowMMap(string* path, string filename);
+
+	/**
+	 * @see SpecialRowFile::SpecialRowFile(string*, int)
+	 */
+	SpecialRowMMap(string* path, int id);
+
+	/**
+	 * Unmaps the file.
+	 */
+	virtual ~SpecialRowMMap();
+
+	/**
+	 * Unmaps and closes the file.
+	 */
+	virtual void close();
+
+	/**
+	 * Maps the given range of the (closed) row file and touches its pages,
+	 * so they are loaded in the page cache before the row is opened.
+	 *
+	 * @param offset the end (exclusive) of the range to be loaded.
+	 * @param len the number of cells before the offset to be loaded.
+	 */
+	virtual void prefetch(int offset, int len);
+
+protected:
+	/**
+	 * Opens and maps the file for read or write mode.
+	 * @param readOnly true if it must be opened for read mode, false otherwise.
+	 * @param length the initial size of the file.
+	 */
+	virtual void initialize(bool readOnly, int length);
+
+	/*
+	 * @see description in superclass header.
+	 */
+	virtual int write(const cell_t* buf, int offset, int len);
+
+	/*
+	 * @see description in superclass header.
+	 */
+	virtual int read(cell_t* buf, int offset, int len);
+
+private:
+	/** Opened file descriptor */
+	int fd;
+
+	/** Mapped cells of the file */
+	cell_t* map;
+
+	/** Number of cells mapped */
+	int mapLength;
+
+	/** Lowest offset already requested with madvise(MADV_WILLNEED) */
+	int adviseOffset;
+
+	/**
+	 * Requests the cells preceding the given offset, in reverse order.
+	 * @param offset the position that will be read.
+	 */
+	void adviseBackwards(int offset);
+};
+
+#endif /* SPECIALROWMMAP_HPP_ */
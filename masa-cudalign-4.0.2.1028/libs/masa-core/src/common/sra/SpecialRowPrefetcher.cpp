@@ -0,0 +1,117 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#include "SpecialRowPrefetcher.hpp"
+
+#include <stdio.h>
+
+#include "../Tracer.hpp"
+
+#define DEBUG (0)
+
+SpecialRowPrefetcher::SpecialRowPrefetcher() {
+	this->started = false;
+	this->stopped = false;
+	this->running = false;
+	this->row = NULL;
+	this->offset = 0;
+	this->len = 0;
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+SpecialRowPrefetcher::~SpecialRowPrefetcher() {
+	pthread_mutex_lock(&mutex);
+	stopped = true;
+	row = NULL;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	if (started) {
+		pthread_join(thread, NULL);
+	}
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+void SpecialRowPrefetcher::prefetch(SpecialRow* row, int offset, int len) {
+	pthread_mutex_lock(&mutex);
+	if (!started) {
+		// The thread is only created when the first row is requested.
+		int rc = pthread_create(&thread, NULL, staticThread, (void*)this);
+		if (rc) {
+			fprintf(stderr, "SpecialRowPrefetcher: pthread_create() error %d. Prefetching disabled.\n", rc);
+			stopped = true;
+		}
+		started = (rc == 0);
+	}
+	if (!stopped) {
+		this->row = row;
+		this->offset = offset;
+		this->len = len;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void SpecialRowPrefetcher::cancel() {
+	pthread_mutex_lock(&mutex);
+	row = NULL;
+	while (running) {
+		pthread_cond_wait(&cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void* SpecialRowPrefetcher::staticThread(void* arg) {
+	SpecialRowPrefetcher* prefetcher = (SpecialRowPrefetcher*)arg;
+	Tracer::setThreadName("special row prefetcher");
+	prefetcher->prefetchLoop();
+	return NULL;
+}
+
+void SpecialRowPrefetcher::prefetchLoop() {
+	pthread_mutex_lock(&mutex);
+	while (!stopped) {
+		if (row == NULL) {
+			pthread_cond_wait(&cond, &mutex);
+			continue;
+		}
+		SpecialRow* current = row;
+		int currentOffset = offset;
+		int currentLen = len;
+		row = NULL;
+		running = true;
+		pthread_mutex_unlock(&mutex);
+
+		if (DEBUG) printf("Prefetching row %08X [%d..%d)\n", current->getId(), currentOffset-currentLen, currentOffset);
+		long long trace_t0 = Tracer::isEnabled() ? Tracer::now() : -1;
+		current->prefetch(currentOffset, currentLen);
+		if (trace_t0 >= 0) {
+			Tracer::span(TRACE_IO, "special row prefetch", trace_t0, currentLen);
+		}
+
+		pthread_mutex_lock(&mutex);
+		running = false;
+		pthread_cond_broadcast(&cond);
+	}
+	pthread_mutex_unlock(&mutex);
+}
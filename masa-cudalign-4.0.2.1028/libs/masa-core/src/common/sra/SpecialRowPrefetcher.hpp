@@ -0,0 +1,79 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+#ifndef SPECIALROWPREFETCHER_HPP_
+#define SPECIALROWPREFETCHER_HPP_
+
+#include <pthread.h>
+
+#include "SpecialRow.hpp"
+
+/** @brief Background thread that loads special rows in advance.
+ *
+ * During the traceback (stages 2 and 3), the special rows are read
+ * backwards, one after another. While the aligner is processing the
+ * current row, this thread calls SpecialRow::prefetch for the row that
+ * will probably be read next. Only the most recent request is kept.
+ */
+class SpecialRowPrefetcher {
+public:
+	SpecialRowPrefetcher();
+
+	/**
+	 * Stops the background thread.
+	 */
+	virtual ~SpecialRowPrefetcher();
+
+	/**
+	 * Requests a range of a row to be loaded in background. Any pending
+	 * request is replaced.
+	 *
+	 * @param row the row to be loaded.
+	 * @param offset the end (exclusive) of the range to be loaded.
+	 * @param len the number of cells before the offset to be loaded.
+	 */
+	void prefetch(SpecialRow* row, int offset, int len);
+
+	/**
+	 * Discards the pending request and waits for the running one, so
+	 * the rows may be safely deleted.
+	 */
+	void cancel();
+
+private:
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool started;
+	bool stopped;
+	bool running;
+
+	/** Pending request */
+	SpecialRow* row;
+	int offset;
+	int len;
+
+	static void* staticThread(void* arg);
+	void prefetchLoop();
+};
+
+#endif /* SPECIALROWPREFETCHER_HPP_ */
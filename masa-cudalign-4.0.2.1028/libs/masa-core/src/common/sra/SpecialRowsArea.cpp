@@ -43,6 +43,9 @@ SpecialRowsArea::SpecialRowsArea(string directory, long long ram_limit, long lon
 	this->partitions.clear();
 	this->rowsCount = 0;
 	this->score_params = score_params;
+	this->compressedRows = false;
+	this->diskBudget = 0;
+	this->diskUsed = 0;
 	this->persistentPartitions = true;//(ram_limit+disk_limit) > 0; // FIXME or TODO
 }
 
@@ -57,6 +60,8 @@ SpecialRowsPartition* SpecialRowsArea::createPartition(int i0, int j0, int i1, i
 	string path = getPartitionPath(i0, j0, i1, j1);
 	SpecialRowsPartition* partition = new SpecialRowsPartition(path, i0, j0, i1, j1, false, score_params);
 	partition->setRamProportion(ram_limit, disk_limit);
+	partition->setCompressedRows(compressedRows);
+	partition->setDiskBudget(diskBudget, &diskUsed);
 
 	partitions[path] = partition;
 	return partition;
@@ -113,6 +118,19 @@ void SpecialRowsArea::setPersistentPartitions(bool persistent) {
 	this->persistentPartitions = persistent;
 }
 
+void SpecialRowsArea::setCompressedRows(bool compressedRows) {
+	this->compressedRows = compressedRows;
+}
+
+/**
+ * Limits the real number of bytes written by the compressed rows, since
+ * the disk_limit given in the constructor is an estimate of the number of
+ * uncompressed bytes.
+ */
+void SpecialRowsArea::setDiskBudget(long long diskBudget) {
+	this->diskBudget = diskBudget;
+}
+
 SpecialRowsPartition* SpecialRowsArea::openPartition(int i, int j) {
 	DIR *dir = NULL;
 	//printf("Opening Dir: %s\n", path.c_str());
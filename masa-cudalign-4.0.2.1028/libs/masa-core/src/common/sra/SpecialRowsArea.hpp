@@ -46,12 +46,19 @@ public:
 	int getPartitionsCount() const;
 	const string& getDirectory() const;
 	void setPersistentPartitions(bool persistent);
+	void setCompressedRows(bool compressedRows);
+	void setDiskBudget(long long diskBudget);
 
 	vector<SpecialRowsPartition*> getSortedPartitions();
 
 private:
 
 	bool persistentPartitions;
+	bool compressedRows;
+	/** Maximum number of bytes of the compressed rows, or 0 for no limit */
+	long long diskBudget;
+	/** Bytes used by the compressed rows of all the partitions */
+	long long diskUsed;
 	string directory;
 	long long disk_limit;
 	long long ram_limit;
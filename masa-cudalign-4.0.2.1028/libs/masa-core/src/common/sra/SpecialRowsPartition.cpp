@@ -20,7 +20,10 @@
  ******************************************************************************/
 
 #include "SpecialRowsPartition.hpp"
-#include "SpecialRowFile.hpp"
+#include "SpecialRowMMap.hpp"
+#include "SpecialRowDirect.hpp"
+#include "SpecialRowCompressed.hpp"
+#include "SpecialRowPrefetcher.hpp"
 #include "SpecialRowRAM.hpp"
 #include "FirstRow.hpp"
 #include "../io/FileCellsWriter.hpp"
@@ -28,6 +31,7 @@
 #include "../io/InitialCellsReader.hpp"
 #include "../io/TeeCellsReader.hpp"
 #include "../io/FileStream.hpp"
+#include "../Tracer.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,6 +49,9 @@ using namespace std;
 
 #define def2str(x) #x
 
+/** Minimum number of cells of the next special row loaded in background */
+#define PREFETCH_MIN_CELLS	(64*1024)
+
 SpecialRowsPartition::SpecialRowsPartition(string _path, int _i0, int _j0, int _i1, int _j1, bool _readOnly, const score_params_t* score_params)
         : path(_path), i0(_i0), j0(_j0), i1(_i1), j1(_j1), readOnly(_readOnly) {
 
@@ -56,6 +63,11 @@ SpecialRowsPartition::SpecialRowsPartition(string _path, int _i0, int _j0, int _
 	this->lastRowId = 0;
 	this->lastRowFilename = "";
 	this->firstColumnWriter = NULL;
+	this->prefetcher = NULL;
+	this->compressedRows = false;
+	this->diskBudget = 0;
+	this->diskUsed = NULL;
+	this->lastCompressedSize = 0;
 	this->score_params = score_params;
 
     rowsVector.push_back(&firstRow);
@@ -85,6 +97,10 @@ SpecialRowsPartition::SpecialRowsPartition(string _path, int _i0, int _j0, int _
 }
 
 SpecialRowsPartition::~SpecialRowsPartition() {
+	if (prefetcher != NULL) {
+		delete prefetcher;
+		prefetcher = NULL;
+	}
     if (readingRow != NULL) {
     	readingRow->close();
     }
@@ -202,6 +218,9 @@ int SpecialRowsPartition::getReadingRow() {
 
 void SpecialRowsPartition::truncate(int max_i, int max_j) {
     if (DEBUG) printf("Flush: %08X,%08X\n", max_i, max_j);
+    if (prefetcher != NULL) {
+    	prefetcher->cancel();
+    }
 	for (vector<SpecialRow*>::iterator it = rowsVector.begin(); it != rowsVector.end(); ) {
 		SpecialRow* row = (*it);
         if ((row->getId() + i0) >= max_i && row != &firstRow) {
@@ -228,6 +247,8 @@ void SpecialRowsPartition::truncate(int max_i, int max_j) {
         }
     }
     rowsMap.clear();
+    skippedRows.clear();
+    diskReservations.clear();
     i1 = max_i;
     j1 = max_j;
     lastRowId = rowsVector.back()->getId();
@@ -273,6 +294,22 @@ void SpecialRowsPartition::changePath(string new_path) {
 	path = new_path;
 }
 
+void SpecialRowsPartition::setCompressedRows(bool compressedRows) {
+	this->compressedRows = compressedRows;
+}
+
+/**
+ * Limits the bytes of the compressed rows in disk. The counter is shared by
+ * all the partitions of the same area, so it is updated atomically.
+ *
+ * @param budget maximum number of bytes, or 0 for no limit.
+ * @param used counter of the bytes used by the compressed rows.
+ */
+void SpecialRowsPartition::setDiskBudget(const long long budget, long long* used) {
+	this->diskBudget = budget;
+	this->diskUsed = used;
+}
+
 void SpecialRowsPartition::setRamProportion(const long long ram, const long long disk) {
 	this->ramProportion = ram;
 	this->diskProportion = disk;
@@ -313,14 +350,51 @@ CellsWriter* SpecialRowsPartition::getLastRowWriter() {
 	return lastRowWriter;
 }
 
+/**
+ * Reserves the disk budget for a new compressed row. Many rows may be
+ * written at the same time, so the reservation is done before the real size
+ * is known, using the size of the last row written by this partition or the
+ * expected compression ratio.
+ *
+ * @return the number of reserved bytes, or -1 if the budget is exhausted.
+ */
+long long SpecialRowsPartition::reserveDiskBytes() {
+	if (diskUsed == NULL || diskBudget <= 0) {
+		return 0;
+	}
+	long long bytes = lastCompressedSize;
+	if (bytes == 0) {
+		bytes = (j1-j0+1)*(long long)sizeof(cell_t)/SpecialRowCompressed::EXPECTED_RATIO;
+	}
+	if (__sync_add_and_fetch(diskUsed, bytes) > diskBudget) {
+		__sync_fetch_and_sub(diskUsed, bytes);
+		return -1;
+	}
+	return bytes;
+}
+
 SpecialRow* SpecialRowsPartition::getSpecialRow(int i) {
+	if (skippedRows.find(i) != skippedRows.end()) {
+		return NULL;
+	}
 	SpecialRow* row = NULL;
 	row = rowsMap[i];
 	if (row == NULL && persistent) {
 		// Alternate the creation of rows in disk and in ram.
 		if ((diskProportion !=0 && ramProportion==0) || ramCount*diskProportion > ramProportion*diskCount) {
-			row = new SpecialRowFile(&path, i);
 			diskCount++;
+			if (compressedRows) {
+				long long reserved = reserveDiskBytes();
+				if (reserved < 0) {
+					rowsMap.erase(i);
+					skippedRows[i] = 0;
+					return NULL;
+				}
+				diskReservations[i] = reserved;
+				row = new SpecialRowCompressed(&path, i);
+			} else {
+				row = new SpecialRowDirect(&path, i);
+			}
 		} else {
 			row = new SpecialRowRAM(i);
 			ramCount++;
@@ -340,11 +414,40 @@ int SpecialRowsPartition::write(int i, const cell_t* buf, int len) {
 	if (!persistent) {
 		return 0;
 	}
+	TraceSpan span(TRACE_SRA, "special row write");
+	span.setArg(i);
 	SpecialRow* row = getSpecialRow(i-i0);
+	if (row == NULL) {
+		// The disk budget is exhausted, so this row is not stored and the
+		// traceback uses the neighbour special rows instead.
+		int& written = skippedRows[i-i0];
+		written += len;
+		if (written >= (j1-j0)+1) {
+			skippedRows.erase(i-i0);
+		}
+		return len;
+	}
 	int ret = row->write(buf, len);
 	if (row->getOffset() >= (j1-j0)+1) {
+		TRACE_SPAN(TRACE_SRA, "special row flush");
 		row->close();
 		rowsMap.erase(i-i0);
+		SpecialRowCompressed* compressed = dynamic_cast<SpecialRowCompressed*>(row);
+		if (compressed != NULL && diskUsed != NULL && diskBudget > 0) {
+			// Replaces the reservation by the real size of the file.
+			lastCompressedSize = compressed->getFileSize();
+			long long used = __sync_add_and_fetch(diskUsed,
+					lastCompressedSize - diskReservations[i-i0]);
+			diskReservations.erase(i-i0);
+			if (used > diskBudget) {
+				// The row was compressed worse than expected and it
+				// does not fit in the disk budget.
+				__sync_fetch_and_sub(diskUsed, lastCompressedSize);
+				row->truncateRow(0);
+				delete row;
+				return ret;
+			}
+		}
 		rowsVector.push_back(row);
 		lastRowId = row->getId();
 	}
@@ -364,6 +467,8 @@ void SpecialRowsPartition::updateLargestInterval() {
 
 void SpecialRowsPartition::readDirectory() {
 	// This method insert new rows to the vectors.
+	// The rows still being written in background have temporary names.
+	SpecialRowFlusher::drain();
     DIR *dir = NULL;
     //printf("Opening Dir: %s\n", path.c_str());
     dir = opendir (path.c_str());
@@ -383,7 +488,12 @@ void SpecialRowsPartition::readDirectory() {
         	firstRow.setCellsReader(firstRowReader);
         	continue;
         }
-		SpecialRow* row = new SpecialRowFile(&path, string(dp->d_name));
+		SpecialRow* row;
+		if (SpecialRowCompressed::isCompressedFilename(string(dp->d_name))) {
+			row = new SpecialRowCompressed(&path, string(dp->d_name));
+		} else {
+			row = new SpecialRowMMap(&path, string(dp->d_name));
+		}
 		if (row->getId() < 0) {
 			delete row;
 		} else {
@@ -443,6 +553,18 @@ SpecialRow* SpecialRowsPartition::nextSpecialRow(int i, int j, int min_dist) {
 	int readingRowOffset = abs(j-j0)+1;
 	readingRow->seek(readingRowOffset);
 
+	// The next row in the traceback order is loaded while this one is used.
+	if (readingRowId > 0) {
+		if (prefetcher == NULL) {
+			prefetcher = new SpecialRowPrefetcher();
+		}
+		int len = 2*largestInterval;
+		if (len < PREFETCH_MIN_CELLS) {
+			len = PREFETCH_MIN_CELLS;
+		}
+		prefetcher->prefetch(rowsVector[readingRowId-1], readingRowOffset, len);
+	}
+
     return readingRow;
 }
 
@@ -455,7 +577,19 @@ int SpecialRowsPartition::continueFromLastRow() {
 	firstColumnReader->read(NULL, lastRowId);
 	// TODO o first row source precisa considerar a linha onde ele se encontra (i.e. primeira celula possui valor != 0)
 	// TODO Lembrando que eu retirei o primeiro dispatch cell.
-	setFirstRowReader(new FileCellsReader(lastRowFilename.c_str()));
+	size_t slash = lastRowFilename.rfind('/');
+	if (SpecialRowCompressed::isCompressedFilename(lastRowFilename.substr(slash+1))) {
+		// The row is decompressed into a temporary file, removed after opening.
+		string plainFilename = lastRowFilename + ".raw";
+		if (!SpecialRowCompressed::decompress(lastRowFilename, plainFilename)) {
+			fprintf(stderr, "Could not decompress special row (%s).\n", lastRowFilename.c_str());
+			exit(1);
+		}
+		setFirstRowReader(new FileCellsReader(plainFilename.c_str()));
+		remove(plainFilename.c_str());
+	} else {
+		setFirstRowReader(new FileCellsReader(lastRowFilename.c_str()));
+	}
 	printf("Continuing partition from row %d (%s)\n",
 			lastRowId + i0, lastRowFilename.c_str());
 	return lastRowId + i0;
@@ -32,6 +32,7 @@ using namespace std;
 
 #include "../../libmasa/libmasa.hpp"
 #include "FirstRow.hpp"
+#include "SpecialRowPrefetcher.hpp"
 #include "../io/CellsWriter.hpp"
 #include "../io/SeekableCellsReader.hpp"
 
@@ -46,6 +47,8 @@ public:
 	void deleteRows();
 
 	void setRamProportion(const long long ram, const long long disk);
+	void setCompressedRows(bool compressedRows);
+	void setDiskBudget(const long long budget, long long* used);
 
 //	void setFirstRow(const score_params_t* score_params, bool firstRowGapped);
 	void setFirstColumnReader(SeekableCellsReader* reader);
@@ -96,7 +99,19 @@ private:
     long long ramProportion;
     long long diskProportion;
     int ramCount;
+    /** The rows stored in disk are compressed */
+    bool compressedRows;
     int diskCount;
+    /** Maximum number of bytes of the compressed rows, or 0 for no limit */
+    long long diskBudget;
+    /** Bytes used by the compressed rows, shared by the area's partitions */
+    long long* diskUsed;
+    /** Size of the last compressed row written by this partition */
+    long long lastCompressedSize;
+    /** Bytes of the disk budget reserved by the rows being written */
+    map<int, long long> diskReservations;
+    /** Disk rows not stored due to the disk budget, with the written cells */
+    map<int, int> skippedRows;
     const score_params_t* score_params;
 
     bool readOnly;
@@ -110,6 +125,8 @@ private:
     string lastRowFilename;
     //int readingRowOffset;
     SpecialRow* readingRow;
+    /** Loads the next row to be read during the traceback */
+    SpecialRowPrefetcher* prefetcher;
     FirstRow firstRow;
     CellsWriter* firstColumnWriter;
     CellsWriter* firstRowWriter;
@@ -123,6 +140,7 @@ private:
 
     void readDirectory();
     SpecialRow* getSpecialRow(int i);
+    long long reserveDiskBytes();
     void setBorderReader(char prefix, SeekableCellsReader* &reader, CellsWriter* &writer);
     bool loadBorderReader(char prefix, string file, SeekableCellsReader* &reader);
 
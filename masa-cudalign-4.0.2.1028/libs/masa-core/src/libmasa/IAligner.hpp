@@ -88,7 +88,8 @@
  *    length supplied by IAligner::setSequences(). The
  *    calls to the IAligner::alignPartition() method are done serially,
  *    but inside this method the Aligner should used parallelism in order
- *    to speedup computation. See the IAligner::alignPartition() documentation
+ *    to speedup computation. Independent partitions may also be aligned
+ *    concurrently by clones of the Aligner (see IAligner::clone()). See the IAligner::alignPartition() documentation
  *    in order to understand how to compute a partition.
  *
  *    3.3. <b>%Sequence Deallocation</b>: After each stage, the MASA-Core calls
@@ -214,6 +215,18 @@ public:
 		 */
 		virtual const score_params_t* getScoreParameters() = 0;
 
+		/**
+		 * Defines the match/mismatch parameters and the gap penalties to be
+		 * used by this IAligner. This method is only called if the
+		 * aligner_capabilities_t::variable_penalties capability is
+		 * supported, and it is called before the IAligner::initialize()
+		 * method. After this call, the IAligner::getScoreParameters() must
+		 * return the new values.
+		 *
+		 * @param score_params the new score parameters.
+		 */
+		virtual void setScoreParameters(const score_params_t* score_params) = 0;
+
 		/**
 		 * Initializes the Aligner before the execution of the alignment
 		 * procedure. The IManager associated with this IAligner may only
@@ -316,6 +329,24 @@ public:
 		 */
 		virtual const Grid* getGrid() const = 0;
 
+		/**
+		 * Creates a new instance of this aligner, with the same parameters,
+		 * that may be executed concurrently with this one. The MASA-Core
+		 * uses these instances to align independent partitions in parallel
+		 * (e.g., in stage 3). Each clone follows the same life cycle of
+		 * the original aligner: the MASA-Core calls setScoreParameters()
+		 * (if variable penalties are supported) and initialize() before
+		 * its first use, and finalize() at the end of the process.
+		 *
+		 * Aligners that cannot have more than one instance per process
+		 * (e.g., if they own a single device) must return NULL, which is
+		 * the default implementation. In this case, the partitions are
+		 * aligned serially by the original aligner.
+		 *
+		 * @return a new aligner or NULL if the aligner cannot be cloned.
+		 */
+		virtual IAligner* clone() { return NULL; };
+
 	/* Statistic functions */
 
 		/**
@@ -57,6 +57,17 @@
 /** Partition starts with vertical gap */
 #define START_TYPE_GAP_V	(2)
 
+/* Overlap of a block with the alignment region (--band and --xdrop) */
+
+/** No cell of the block is inside the region */
+#define REGION_OUTSIDE		(0)
+
+/** Some cells of the block are inside the region */
+#define REGION_PARTIAL		(1)
+
+/** All the cells of the block and of its borders are inside the region */
+#define REGION_INSIDE		(2)
+
 
 /** @brief Interface that manages the MASA extension execution.
  *
@@ -270,6 +281,66 @@ public:
 	 */
 	virtual void dispatchScore(score_t score, int bx=-1, int by=-1) = 0;
 
+	/**
+	 * Exchanges the best score used by the block pruning with the other
+	 * processes that align the same matrix (forked or split executions).
+	 * Every process only publishes scores that it has really found, so the
+	 * returned score may safely be used to prune blocks.
+	 *
+	 * @param score the best score known by the aligner.
+	 * @return the best score known among all the processes (at least
+	 * 		<tt>score</tt>).
+	 */
+	virtual int shareBestScore(int score) = 0;
+
+	/* "REGION" METHODS */
+
+	/**
+	 * Classifies a block against the region of the matrix where the
+	 * alignment may pass (see the --band and --xdrop parameters). The cells
+	 * outside the region must be considered -INF, so the aligner may skip
+	 * the blocks outside the region.
+	 *
+	 * @param i0 first row of the block.
+	 * @param j0 first column of the block.
+	 * @param i1 last row of the block (exclusive).
+	 * @param j1 last column of the block (exclusive).
+	 * @return REGION_OUTSIDE if no cell of the block is inside the region,
+	 * 		REGION_INSIDE if all the cells of the block and the cells of its
+	 * 		top row/left column borders are inside the region, or
+	 * 		REGION_PARTIAL otherwise.
+	 */
+	virtual int getRegionOverlap(int i0, int j0, int i1, int j1) = 0;
+
+	/**
+	 * Tells which cells of a row segment are inside the alignment region.
+	 *
+	 * @param i the row (-1 is the border row above the first row).
+	 * @param j0 the first column of the segment (-1 is the border column).
+	 * @param len the number of cells of the segment.
+	 * @param[out] mask mask[k] is set to true if cell (i,j0+k) is inside
+	 * 		the region.
+	 */
+	virtual void getRegionMask(int i, int j0, int len, bool* mask) = 0;
+
+	/**
+	 * @return the X-drop threshold. A block whose borders are all lower than
+	 * 		the best score minus this threshold may be skipped. Zero disables
+	 * 		the X-drop.
+	 */
+	virtual int getXDrop() = 0;
+
+	/**
+	 * Notifies that a block was computed while the X-drop was enabled. The
+	 * later stages only compute the cells of these blocks.
+	 *
+	 * @param i0 first row of the block.
+	 * @param j0 first column of the block.
+	 * @param i1 last row of the block (exclusive).
+	 * @param j1 last column of the block (exclusive).
+	 */
+	virtual void dispatchComputedBlock(int i0, int j0, int i1, int j1) = 0;
+
 	/* "MUST" METHODS */
 
 	/**
@@ -97,6 +97,15 @@ const int* AbstractAligner::getForkWeights() {
 	return forkWeights;
 }
 
+/**
+ * Empty implementation for aligners with constant penalties. Aligners that
+ * support the variable_penalties capability must override this method.
+ *
+ * @see IAligner::setScoreParameters()
+ */
+void AbstractAligner::setScoreParameters(const score_params_t* score_params) {
+}
+
 /**
  * Creates a new grid using the given partition coordinates. If there is
  * a previously created grid, it is deleted and overwritten.
@@ -263,6 +272,46 @@ void AbstractAligner::dispatchScore(score_t score, int bx, int by) {
 	this->manager->dispatchScore(score, bx, by);
 }
 
+/** Delegates to IManager::shareBestScore()
+ * @copydoc IManager::shareBestScore
+ * @see IManager::shareBestScore()
+ */
+int AbstractAligner::shareBestScore(int score) {
+	return this->manager->shareBestScore(score);
+}
+
+/** Delegates to IManager::getRegionOverlap()
+ * @copydoc IManager::getRegionOverlap
+ * @see IManager::getRegionOverlap()
+ */
+int AbstractAligner::getRegionOverlap(int i0, int j0, int i1, int j1) {
+	return this->manager->getRegionOverlap(i0, j0, i1, j1);
+}
+
+/** Delegates to IManager::getRegionMask()
+ * @copydoc IManager::getRegionMask
+ * @see IManager::getRegionMask()
+ */
+void AbstractAligner::getRegionMask(int i, int j0, int len, bool* mask) {
+	this->manager->getRegionMask(i, j0, len, mask);
+}
+
+/** Delegates to IManager::getXDrop()
+ * @copydoc IManager::getXDrop
+ * @see IManager::getXDrop()
+ */
+int AbstractAligner::getXDrop() {
+	return this->manager->getXDrop();
+}
+
+/** Delegates to IManager::dispatchComputedBlock()
+ * @copydoc IManager::dispatchComputedBlock
+ * @see IManager::dispatchComputedBlock()
+ */
+void AbstractAligner::dispatchComputedBlock(int i0, int j0, int i1, int j1) {
+	this->manager->dispatchComputedBlock(i0, j0, i1, j1);
+}
+
 /** Delegates to IManager::mustContinue()
  * @copydoc IManager::mustContinue
  * @see IManager::mustContinue()
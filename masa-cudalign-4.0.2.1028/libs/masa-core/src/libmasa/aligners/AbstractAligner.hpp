@@ -72,6 +72,7 @@ public:
 
 	virtual void setManager(IManager* manager);
 	virtual const int* getForkWeights();
+	virtual void setScoreParameters(const score_params_t* score_params);
 	virtual match_result_t matchLastColumn(const cell_t* buffer, const cell_t* base, int len, int goalScore);
 
 protected:
@@ -97,6 +98,12 @@ protected:
 	void dispatchColumn(int j, const cell_t* buffer, int len);
 	void dispatchRow(int i, const cell_t* buffer, int len);
 	void dispatchScore(score_t score, int bx=-1, int by=-1);
+	int shareBestScore(int score);
+
+	int getRegionOverlap(int i0, int j0, int i1, int j1);
+	void getRegionMask(int i, int j0, int len, bool* mask);
+	int getXDrop();
+	void dispatchComputedBlock(int i0, int j0, int i1, int j1);
 
 	bool mustContinue();
 	bool mustDispatchLastCell();
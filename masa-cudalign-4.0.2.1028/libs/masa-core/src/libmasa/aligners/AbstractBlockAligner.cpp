@@ -26,7 +26,9 @@
 #include <unistd.h>
 
 #include "config.h"
-#include "../processors/CPUBlockProcessor.hpp"
+#include "../processors/SIMDBlockProcessor.hpp"
+#include "../utils/BlockAutotuner.hpp"
+#include "../../common/Tracer.hpp"
 
 /**
  * Set to (1) in order to print debug information in the stdout. This
@@ -34,6 +36,12 @@
  */
 #define DEBUG (0)
 
+/**
+ * Size of the tiles of the blocks crossing the border of the region given
+ * by --band or --xdrop (see AbstractBlockAligner::processPartialBlock).
+ */
+#define PARTIAL_TILE_SIZE	(128)
+
 /*
  * The score constants
  */
@@ -76,6 +84,7 @@ AbstractBlockAligner::AbstractBlockAligner(AbstractBlockProcessor* blockProcesso
 	 */
 	col = NULL;
 	row = NULL;
+	xdropBest = NULL;
 
 	/*
 	 *  defines the constant parameters to be returned in the
@@ -95,12 +104,19 @@ AbstractBlockAligner::AbstractBlockAligner(AbstractBlockProcessor* blockProcesso
 		this->params = params;
 	}
 	if (blockProcessor == NULL) {
-		this->blockProcessor = new CPUBlockProcessor();
+		this->blockProcessor = new SIMDBlockProcessor();
 	} else {
 		this->blockProcessor = blockProcessor;
 	}
+	this->blockProcessor->setScoreParameters(&score_params);
 	this->blockPruner = new BlockPruningGenericN2();
 
+	/* the scheduler threads are only created in scheduleBlocks (after --fork) */
+	this->scheduler = NULL;
+	/* the autotuner is only created in configureGrid (after the arguments) */
+	this->autotuner = NULL;
+	pthread_mutex_init(&mutex, NULL);
+
 	/*
 	 * Must be called to enable --fork parameter. This will allow
 	 * 2 process for each CPU. Each process will receive the same
@@ -117,13 +133,21 @@ AbstractBlockAligner::AbstractBlockAligner(AbstractBlockProcessor* blockProcesso
  * AbstractBlockAligner destructor.
  */
 AbstractBlockAligner::~AbstractBlockAligner() {
+	if (scheduler != NULL) {
+		delete scheduler;
+		scheduler = NULL;
+	}
+	if (autotuner != NULL) {
+		delete autotuner;
+		autotuner = NULL;
+	}
+	pthread_mutex_destroy(&mutex);
 }
 
 /*
  * This method defines which capabilities are implemented by this aligner.
- * The dispatch_special_column and variable_penalties capabilities are
- * not used yet by the MASA framework. The block_pruning and dispatch_last_cell
- * capabilities are not supported yet by this example aligner.
+ * The dispatch_special_column capability is not used yet by the MASA
+ * framework. The dispatch_last_cell capability is not supported yet.
  */
 aligner_capabilities_t AbstractBlockAligner::getCapabilities() {
 	aligner_capabilities_t capabilities;
@@ -142,7 +166,7 @@ aligner_capabilities_t AbstractBlockAligner::getCapabilities() {
 	capabilities.dispatch_block_scores		= SUPPORTED;
 	capabilities.dispatch_scores			= SUPPORTED;
 	capabilities.process_partition 			= SUPPORTED;
-	capabilities.variable_penalties 		= NOT_SUPPORTED;
+	capabilities.variable_penalties 		= SUPPORTED;
 	capabilities.fork_processes				= SUPPORTED;
 
 	capabilities.maximum_seq0_len	= 0;
@@ -158,6 +182,15 @@ const score_params_t* AbstractBlockAligner::getScoreParameters() {
 	return &score_params;
 }
 
+/*
+ * Replaces the match/mismatch scores and the gap penalties. The block
+ * processor chooses its kernel accordingly.
+ */
+void AbstractBlockAligner::setScoreParameters(const score_params_t* score_params) {
+	this->score_params = *score_params;
+	blockProcessor->setScoreParameters(&this->score_params);
+}
+
 /*
  * See MicParameters and AbstractAlignerParameters classes.
  */
@@ -201,6 +234,17 @@ Grid* AbstractBlockAligner::configureGrid(Partition partition) {
 
 	grid->setMinBlockSize(MIN_BLOCK_SIZE, MIN_BLOCK_SIZE);
 
+	/* Block dimensions chosen by the autotuner (--autotune) */
+	int tunedHeight = 0;
+	int tunedWidth = 0;
+	if (!mustDispatchLastColumn() && params->getAutotuneFile().length() > 0) {
+		if (autotuner == NULL) {
+			autotuner = new BlockAutotuner(params->getAutotuneFile());
+		}
+		autotuner->getBlockSize(partition, blockProcessor, getScheduler(),
+				getRecurrenceType(), &tunedHeight, &tunedWidth);
+	}
+
 	/* Block/Grid height */
 	if (params->getBlockHeight() > 0) {
 		grid->setBlockHeight(params->getBlockHeight());
@@ -209,7 +253,7 @@ Grid* AbstractBlockAligner::configureGrid(Partition partition) {
 	} else {
 		// Automatic configuration
 		if (!mustDispatchLastColumn()) {
-			int height = preferredBlockSize;
+			int height = tunedHeight > 0 ? tunedHeight : preferredBlockSize;
 			if (grid->getHeight() / height < preferredGridSize) {
 				height = grid->getHeight() / preferredGridSize;
 			}
@@ -227,7 +271,7 @@ Grid* AbstractBlockAligner::configureGrid(Partition partition) {
 	} else {
 		// Automatic configuration
 		if (!mustDispatchLastColumn()) {
-			int width = preferredBlockSize;
+			int width = tunedWidth > 0 ? tunedWidth : preferredBlockSize;
 			if (grid->getWidth() / width < preferredGridSize) {
 				width = grid->getWidth() / preferredGridSize;
 			}
@@ -327,6 +371,56 @@ void AbstractBlockAligner::alignPartition(Partition partition) {
 }
 
 
+/**
+ * Executes all the blocks of the grid with a WavefrontScheduler. The pool of
+ * threads is created in the first call and reused for all the partitions.
+ *
+ * @param grid_width width of the grid in blocks.
+ * @param grid_height height of the grid in blocks.
+ */
+void AbstractBlockAligner::scheduleBlocks(int grid_width, int grid_height) {
+	getScheduler()->execute(grid_width, grid_height, staticAlignBlock, (void*)this);
+}
+
+/**
+ * Returns the WavefrontScheduler of the default scheduleBlocks implementation,
+ * creating its pool of threads in the first call.
+ *
+ * @return the scheduler.
+ */
+WavefrontScheduler* AbstractBlockAligner::getScheduler() {
+	if (scheduler == NULL) {
+		scheduler = new WavefrontScheduler(getThreadCount());
+	}
+	return scheduler;
+}
+
+/**
+ * Function called by the WavefrontScheduler for each block.
+ */
+void AbstractBlockAligner::staticAlignBlock(void* arg, int bx, int by) {
+	AbstractBlockAligner* aligner = (AbstractBlockAligner*)arg;
+	aligner->alignBlock(bx, by);
+}
+
+/**
+ * Returns the number of threads used by the default scheduler. If it was
+ * not defined in the command line, one thread per CPU is used, except when
+ * the aligner is forked, since each process already receives its own CPU.
+ *
+ * @return the number of threads.
+ */
+int AbstractBlockAligner::getThreadCount() const {
+	if (params->getThreadCount() > 0) {
+		return params->getThreadCount();
+	}
+	if (params->getForkId() != NOT_FORKED_INSTANCE) {
+		return 1;
+	}
+	int numCPU = sysconf( _SC_NPROCESSORS_ONLN );
+	return numCPU > 0 ? numCPU : 1;
+}
+
 /**
  * This method aligns block (bx,by). This method calls the
  * AbstractBlockAligner::alignBlock(int,int,int,int,int,int)
@@ -351,6 +445,11 @@ void AbstractBlockAligner::alignBlock(int bx, int by) {
  * This method calls AbstractBlockProcessor::processBlock(int,int,int,int,int,int,int)
  * to execute the recurrence relation for a block.
  *
+ * The blocks outside the region given by the --band parameter, or below
+ * the --xdrop threshold, are not processed: their last row and column
+ * are filled with -INF. The blocks crossing the region border are
+ * processed row by row, only on the cells inside the region.
+ *
  * @param bx horizontal block coordinate
  * @param by vertical block coordinate
  * @param i0 vertical first row of the block
@@ -360,7 +459,25 @@ void AbstractBlockAligner::alignBlock(int bx, int by) {
  * @param true if the block was processed or false if it was pruned.
  */
 bool AbstractBlockAligner::processBlock(int bx, int by, int i0, int j0, int i1,	int j1) {
-	if (!isBlockPruned(bx, by)) {
+	pthread_mutex_lock(&mutex);
+	bool pruned = isBlockPruned(bx, by);
+	pthread_mutex_unlock(&mutex);
+
+	if (getXDrop() > 0) {
+		int left = (bx > 0) ? xdropBest[bx-1][by] : -INF;
+		int top = (by > 0) ? xdropBest[bx][by-1] : -INF;
+		xdropBest[bx][by] = (left > top) ? left : top;
+	}
+
+	int overlap = REGION_INSIDE;
+	if (!pruned) {
+		overlap = getRegionOverlap(i0, j0, i1, j1);
+		if (overlap != REGION_OUTSIDE && isBlockDropped(bx, by, i0, j0, i1, j1)) {
+			overlap = REGION_OUTSIDE;
+		}
+	}
+
+	if (!pruned && overlap != REGION_OUTSIDE) {
 		/* the block was not pruned */
 		if (DEBUG) printf(">>>AbstractBlockAligner::processBlock(%d, %d, %d, %d, %d, %d)\n", bx, by, i0, j0, i1, j1);
 
@@ -370,33 +487,242 @@ bool AbstractBlockAligner::processBlock(int bx, int by, int i0, int j0, int i1,
 		PROFILING_TIME(t0);
 
 		/* processes the block */
-		grid_scores[bx][by] = blockProcessor->processBlock(row[bx], col[by], i0, j0, i1, j1, getRecurrenceType());
+		long long trace_t0 = Tracer::isEnabled() ? Tracer::now() : -1;
+		if (overlap == REGION_PARTIAL) {
+			grid_scores[bx][by] = processPartialBlock(bx, by, i0, j0, i1, j1);
+		} else {
+			grid_scores[bx][by] = blockProcessor->processBlock(row[bx], col[by], i0, j0, i1, j1, getRecurrenceType());
+		}
+		if (trace_t0 >= 0) {
+			Tracer::span(TRACE_ALIGNER, "block", trace_t0, ((long long)(i1-i0))*(j1-j0));
+		}
 
 		PROFILING_TIME(t1);
 		PROFILING_PRINT(bx, by, grid_scores[bx][by].score, 1, t1-t0);
 
 		/* Updates the block pruning status */
+		pthread_mutex_lock(&mutex);
 		pruningUpdate(bx, by, grid_scores[bx][by].score);
-
 		increaseBlockStat(false);
+		if (getXDrop() > 0) {
+			if (xdropBest[bx][by] < grid_scores[bx][by].score) {
+				xdropBest[bx][by] = grid_scores[bx][by].score;
+			}
+			dispatchComputedBlock(i0, j0, i1, j1);
+		}
+		pthread_mutex_unlock(&mutex);
 
 		/* Dispatch the best score found in block (bx,by) */
 		//dispatchScore(grid_scores[bx][by], bx, by);
 		return true;
-	} else {
+	} else if (pruned) {
 		/* the block was pruned */
+		if (getXDrop() > 0) {
+			/* the later stages do not prune, so they compute this block */
+			pthread_mutex_lock(&mutex);
+			dispatchComputedBlock(i0, j0, i1, j1);
+			pthread_mutex_unlock(&mutex);
+		}
 		ignoreBlock(bx, by);
 		return false;
+	} else {
+		/* the block is outside the region */
+		clearBlock(bx, by, i0, j0, i1, j1);
+		ignoreBlock(bx, by);
+		return false;
+	}
+
+}
+
+/**
+ * Verifies if the X-drop is enabled and all the cells of the first row
+ * and first column of the block are lower than the best score minus the
+ * --xdrop threshold. The best score is taken from the blocks above and to
+ * the left of block (bx,by), so the result is deterministic.
+ *
+ * @return true if the block must not be processed.
+ */
+bool AbstractBlockAligner::isBlockDropped(int bx, int by, int i0, int j0, int i1, int j1) {
+	int xdrop = getXDrop();
+	if (xdrop <= 0) {
+		return false;
 	}
+	int max = -INF;
+	for (int k = 0; k < j1-j0; k++) {
+		if (max < row[bx][k].h) max = row[bx][k].h;
+	}
+	for (int k = 0; k <= i1-i0; k++) {
+		if (max < col[by][k].h) max = col[by][k].h;
+	}
+	return max < xdropBest[bx][by] - xdrop;
+}
 
+/**
+ * Fills the output row and column of a block (or tile) outside the region
+ * with -INF, keeping the corner cell in col[0] as the block processors do.
+ */
+static void clear_cells(cell_t* row, cell_t* col, const int w, const int h) {
+	const cell_t corner = row[w-1];
+	for (int k = 0; k < w; k++) {
+		row[k].h = -INF;
+		row[k].f = -INF;
+	}
+	for (int k = 1; k <= h; k++) {
+		col[k].h = -INF;
+		col[k].e = -INF;
+	}
+	col[0] = corner;
+}
+
+/**
+ * Fills the last row and last column of a block outside the region with
+ * -INF, as if the block had been processed.
+ */
+void AbstractBlockAligner::clearBlock(int bx, int by, int i0, int j0, int i1, int j1) {
+	clear_cells(row[bx], col[by], j1-j0, i1-i0);
+}
+
+/**
+ * Processes a block that crosses the border of the region. The block is
+ * split in tiles of PARTIAL_TILE_SIZE cells, so the tiles inside the region
+ * are still processed by the block processor and only the tiles crossing
+ * the border are processed cell by cell (see processMaskedTile).
+ *
+ * @return the best score of the cells inside the region.
+ */
+score_t AbstractBlockAligner::processPartialBlock(int bx, int by, int i0, int j0, int i1, int j1) {
+	cell_t* r = row[bx];
+	cell_t* c = col[by];
+
+	score_t best;
+	best.score = -INF;
+	best.i = -1;
+	best.j = -1;
+
+	cell_t* tile_col = new cell_t[PARTIAL_TILE_SIZE+1];
+	bool* mask = new bool[PARTIAL_TILE_SIZE+1];
+
+	const cell_t corner = r[j1-j0-1];
+	cell_t diag = c[0];
+	for (int ti0 = i0; ti0 < i1; ti0 += PARTIAL_TILE_SIZE) {
+		const int ti1 = (ti0 + PARTIAL_TILE_SIZE < i1) ? ti0 + PARTIAL_TILE_SIZE : i1;
+
+		/* the tiles of this strip share the column, as the blocks of the grid */
+		tile_col[0] = diag;
+		for (int k = 1; k <= ti1-ti0; k++) {
+			tile_col[k] = c[ti0-i0+k];
+		}
+		diag = tile_col[ti1-ti0];
+
+		for (int tj0 = j0; tj0 < j1; tj0 += PARTIAL_TILE_SIZE) {
+			const int tj1 = (tj0 + PARTIAL_TILE_SIZE < j1) ? tj0 + PARTIAL_TILE_SIZE : j1;
+			cell_t* tile_row = r + (tj0-j0);
+
+			score_t score;
+			score.score = -INF;
+			int overlap = getRegionOverlap(ti0, tj0, ti1, tj1);
+			if (overlap == REGION_INSIDE) {
+				score = blockProcessor->processBlock(tile_row, tile_col, ti0, tj0, ti1, tj1, getRecurrenceType());
+			} else if (overlap == REGION_PARTIAL) {
+				score = processMaskedTile(tile_row, tile_col, ti0, tj0, ti1, tj1, mask);
+			} else {
+				clear_cells(tile_row, tile_col, tj1-tj0, ti1-ti0);
+			}
+			if (best.score < score.score) {
+				best = score;
+			}
+		}
+
+		for (int k = 1; k <= ti1-ti0; k++) {
+			c[ti0-i0+k] = tile_col[k];
+		}
+	}
+	c[0] = corner;
+
+	delete[] mask;
+	delete[] tile_col;
+	return best;
+}
+
+/**
+ * Processes a tile that crosses the border of the region. Each row is
+ * split in runs of cells inside the region and each run is processed
+ * as a block of height 1. The cells outside the region are set to -INF.
+ *
+ * @param row the input/output row of the tile (see AbstractBlockProcessor).
+ * @param col the input/output column of the tile.
+ * @param mask buffer with, at least, j1-j0+1 positions.
+ * @return the best score of the cells inside the region.
+ */
+score_t AbstractBlockAligner::processMaskedTile(cell_t* row, cell_t* col, int i0, int j0, int i1, int j1, bool* mask) {
+	const int w = j1-j0;
+	const int h = i1-i0;
+	cell_t neg;
+	neg.h = -INF;
+	neg.f = -INF;
+
+	score_t best;
+	best.score = -INF;
+	best.i = -1;
+	best.j = -1;
+
+	/* masks the input row, including the diagonal cell. mask[0] is the
+	 * cell of the previous column and mask[1+k] is row[k] */
+	getRegionMask(i0-1, j0-1, w+1, mask);
+	if (!mask[0]) col[0] = neg;
+	for (int k = 0; k < w; k++) {
+		if (!mask[1+k]) row[k] = neg;
+	}
+	const cell_t corner = row[w-1];
+	cell_t diag = col[0];
+
+	for (int i = 0; i < h; i++) {
+		getRegionMask(i0+i, j0-1, w+1, mask);
+		const cell_t left = mask[0] ? col[i+1] : neg;
+		cell_t right = neg;
+
+		int a = 0;
+		while (a < w) {
+			if (!mask[1+a]) {
+				a++;
+				continue;
+			}
+			int b = a;
+			while (b < w && mask[1+b]) b++;
+
+			/* the run [a,b) of row i, with its diagonal and left cells */
+			cell_t run_col[2];
+			run_col[0] = (a == 0) ? diag : row[a-1];
+			run_col[1] = (a == 0) ? left : neg;
+			score_t score = blockProcessor->processBlock(row+a, run_col,
+					i0+i, j0+a, i0+i+1, j0+b, getRecurrenceType());
+			if (best.score < score.score) {
+				best = score;
+			}
+			if (b == w) {
+				right = run_col[1];
+			}
+			a = b;
+		}
+		for (int k = 0; k < w; k++) {
+			if (!mask[1+k]) row[k] = neg;
+		}
+		diag = left;
+		col[i+1] = right;
+	}
+	col[0] = corner;
+
+	return best;
 }
 
 /*
  * Profiles this block as "pruned"
  */
 void AbstractBlockAligner::ignoreBlock(int bx, int by) {
+	pthread_mutex_lock(&mutex);
 	PROFILING_PRINT(bx, by, 0, 0, 0);
 	increaseBlockStat(true);
+	pthread_mutex_unlock(&mutex);
 }
 
 /*
@@ -484,6 +810,7 @@ void AbstractBlockAligner::printInitialStatistics(FILE* file) {
 			params->getBlockWidth() ? "Block" : "Grid",
 			params->getBlockWidth() ? params->getBlockWidth() : params->getGridWidth());
 	fprintf(file, " ForkID: %d\n", params->getForkId());
+	fprintf(file, " Threads: %d\n", getThreadCount());
 }
 
 /**
@@ -565,6 +892,11 @@ void AbstractBlockAligner::allocateStructures() {
 			grid_scores[j][i].score = -INF;
 		}
 	}
+
+	xdropBest = new int*[ grid_width ];
+	for( int j = 0; j < grid_width; ++j ){
+		xdropBest[j] = new int[ grid_height ];
+	}
 }
 
 /**
@@ -598,6 +930,13 @@ void AbstractBlockAligner::deallocateStructures() {
 		delete[] grid_scores;
 		grid_scores = NULL;
 	}
+	if(xdropBest != NULL) {
+		for( int j = 0; j < grid_width; ++j ){
+			delete[] xdropBest[j];
+		}
+		delete[] xdropBest;
+		xdropBest = NULL;
+	}
 }
 
 /**
@@ -621,6 +960,10 @@ bool AbstractBlockAligner::isBlockPruned(int bx, int by) const {
 void AbstractBlockAligner::pruningUpdate(int bx, int by, int score) {
 	if (blockPruner != NULL) {
 		blockPruner->pruningUpdate(bx, by, score);
+		if (blockPruner->getGrid() != NULL) {
+			/* prunes with the best score found by any process */
+			blockPruner->updateBestScore(shareBestScore(blockPruner->getBestScore()));
+		}
 	}
 }
 
@@ -639,6 +982,37 @@ void AbstractBlockAligner::setPreferredSizes(int preferredBlockSize,	int preferr
 	}
 }
 
+/*
+ * Thread-safe versions of the AbstractAligner methods. The threads of the
+ * scheduler are serialized before calling MASA-Core.
+ */
+
+void AbstractBlockAligner::receiveFirstRow(cell_t* buffer, int len) {
+	pthread_mutex_lock(&mutex);
+	AbstractAligner::receiveFirstRow(buffer, len);
+	pthread_mutex_unlock(&mutex);
+}
+
+void AbstractBlockAligner::receiveFirstColumn(cell_t* buffer, int len) {
+	pthread_mutex_lock(&mutex);
+	AbstractAligner::receiveFirstColumn(buffer, len);
+	pthread_mutex_unlock(&mutex);
+}
 
+void AbstractBlockAligner::dispatchColumn(int j, const cell_t* buffer, int len) {
+	pthread_mutex_lock(&mutex);
+	AbstractAligner::dispatchColumn(j, buffer, len);
+	pthread_mutex_unlock(&mutex);
+}
 
+void AbstractBlockAligner::dispatchRow(int i, const cell_t* buffer, int len) {
+	pthread_mutex_lock(&mutex);
+	AbstractAligner::dispatchRow(i, buffer, len);
+	pthread_mutex_unlock(&mutex);
+}
 
+void AbstractBlockAligner::dispatchScore(score_t score, int bx, int by) {
+	pthread_mutex_lock(&mutex);
+	AbstractAligner::dispatchScore(score, bx, by);
+	pthread_mutex_unlock(&mutex);
+}
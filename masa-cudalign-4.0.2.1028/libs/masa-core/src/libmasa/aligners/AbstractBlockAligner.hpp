@@ -26,6 +26,11 @@
 #include "../parameters/BlockAlignerParameters.hpp"
 #include "../processors/AbstractBlockProcessor.hpp"
 #include "../pruning/BlockPruningGenericN2.hpp"
+#include "../schedulers/WavefrontScheduler.hpp"
+
+class BlockAutotuner;
+
+#include <pthread.h>
 
 /**
  * @brief Abstract class that processes blocks individually considering
@@ -40,18 +45,26 @@
  * you want to create a CPU block scheduler that processes a single block
  * in the specific hardware/software architecture.
  *
- * In order to extend an AbstractDiagonalAligner, the class must implement
- * two methods.
+ * In order to extend an AbstractBlockAligner, the class must implement
+ * the alignBlock method and may override the scheduleBlocks method.
  *
  * <ul>
  *  <li>scheduleBlocks: schedules the block executions using a customized
- *  	mechanism.
+ *  	mechanism. The default implementation executes the blocks in a pool
+ *  	of threads (see WavefrontScheduler and the --threads parameter).
  *  <li>alignBlock: responsible to receive/dispatch data from/to MASA-Core
  *  	and call the processBlock for each block. These procedures must
  *  	be aware of the schedule mechanism in order to avoid unsafe calls
  *  	to MASA-Core.
  * </ul>
  *
+ * With the default scheduler, alignBlock is called simultaneously for
+ * independent blocks of the same anti-diagonal. The receive/dispatch methods
+ * of this class are serialized with a mutex, and block (bx,by) is only
+ * started after blocks (bx-1,by) and (bx,by-1) have returned, so the chunks
+ * of rows and columns are still dispatched in order. The block processor
+ * must be reentrant, i.e., it must not keep per-block state in its members.
+ *
  */
 class AbstractBlockAligner : public AbstractAligner {
 public:
@@ -59,7 +72,7 @@ public:
 	 * Constructor
 	 *
 	 * @param blockProcessor the block processor to be used. If NULL, the
-	 * default processor will be used.
+	 * default processor (SIMDBlockProcessor) will be used.
 	 * @param params the aligner parameters. If NULL, the default param
 	 * class will be used.
 	 */
@@ -79,6 +92,7 @@ public:
 	virtual aligner_capabilities_t getCapabilities();
 	virtual const score_params_t* getScoreParameters();
 	virtual IAlignerParameters* getParameters();
+	virtual void setScoreParameters(const score_params_t* score_params);
 
 	virtual void setSequences(const char* seq0, const char* seq1, int seq0_len, int seq1_len);
 	virtual void unsetSequences();
@@ -104,12 +118,14 @@ protected:
 	 * Schedules all the blocks for execution. As soon as one block is
 	 * ready to be executed, this method must call the
 	 * AbstractBlockAligner::alignBlock(int,int) function in order to prepare
-	 * this block for real execution.
+	 * this block for real execution. The default implementation uses
+	 * a WavefrontScheduler with the number of threads given in the
+	 * parameters.
 	 *
 	 * @param grid_width width of the grid in blocks.
 	 * @param grid_height height of the grid in blocks.
 	 */
-	virtual void scheduleBlocks(int grid_width, int grid_height) = 0;
+	virtual void scheduleBlocks(int grid_width, int grid_height);
 
 	/**
 	 * This method is called by AbstractBlockAligner::alignBlock(int,int)
@@ -170,6 +186,14 @@ protected:
 	 */
 	void setPreferredSizes(int preferredBlockSize, int preferredGridSize);
 
+	/* thread-safe versions of the AbstractAligner methods */
+
+	void receiveFirstRow(cell_t* buffer, int len);
+	void receiveFirstColumn(cell_t* buffer, int len);
+	void dispatchColumn(int j, const cell_t* buffer, int len);
+	void dispatchRow(int i, const cell_t* buffer, int len);
+	void dispatchScore(score_t score, int bx=-1, int by=-1);
+
 
 	/* memory related methods */
 
@@ -190,6 +214,15 @@ private:
 	/** Block Pruner object */
 	BlockPruningGenericN2* blockPruner;
 
+	/** Scheduler used by the default scheduleBlocks implementation */
+	WavefrontScheduler* scheduler;
+
+	/** Chooses the block dimensions when --autotune is given */
+	BlockAutotuner* autotuner;
+
+	/** Serializes the MASA-Core calls and the pruning/statistics updates */
+	pthread_mutex_t mutex;
+
 	/** Preferred maximum size of a block. */
 	int preferredBlockSize;
 
@@ -218,6 +251,13 @@ private:
 	/** Number of pruned blocks */
 	int statPrunedBlocks;
 
+	/**
+	 * Best score of the blocks above and to the left of each block, used by
+	 * the X-drop. These blocks always finish before the block starts, so
+	 * the dropped blocks do not depend on the number of threads.
+	 */
+	int** xdropBest;
+
 
 	/** Score parameters */
 	score_params_t score_params;
@@ -229,6 +269,13 @@ private:
 	/* Other methods */
 
 	void pruningUpdate(int bx, int by, int score);
+	bool isBlockDropped(int bx, int by, int i0, int j0, int i1, int j1);
+	void clearBlock(int bx, int by, int i0, int j0, int i1, int j1);
+	score_t processPartialBlock(int bx, int by, int i0, int j0, int i1, int j1);
+	score_t processMaskedTile(cell_t* row, cell_t* col, int i0, int j0, int i1, int j1, bool* mask);
+	int getThreadCount() const;
+	WavefrontScheduler* getScheduler();
+	static void staticAlignBlock(void* arg, int bx, int by);
 };
 
 #endif /* ABSTRACTBLOCKALIGNER_HPP_ */
@@ -493,6 +493,8 @@ void AbstractDiagonalAligner::pruneBlocks() {
 	int prevStart;
 	int prevEnd;
 	pruner->getNonPrunableWindow(&prevStart, &prevEnd);
+	/* prunes with the best score found by any process */
+	pruner->updateBestScore(shareBestScore(pruner->getBestScore()));
 	pruner->updatePruningWindow(currentExternalDiagonal-1, block_scores);
 	pruner->getNonPrunableWindow(&windowStart, &windowEnd);
 	if (windowEnd < prevEnd) {
@@ -27,7 +27,11 @@
 #include <string.h>
 #include <errno.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <vector>
+#include <algorithm>
 
 #include "../common/Common.hpp"
 #include "../stage1/sw_stage1.h"
@@ -92,19 +96,47 @@ using namespace std;
  */
 #define DEFAULT_BUFFER_LIMIT	(1024*1024)
 
+/**
+ * Pairs of a batch execution with at least this number of cells are
+ * aligned with all the threads (see --batch-large).
+ */
+#define DEFAULT_BATCH_LARGE (1000*1000*1000LL)
+#define DEFAULT_BATCH_LARGE_STRING "1G" // SHOW USAGE
+
+/**
+ * States of the pairs of a batch execution.
+ */
+#define BATCH_PAIR_PENDING	(0)
+#define BATCH_PAIR_RUNNING	(1)
+#define BATCH_PAIR_DONE		(2)
+
 /**
  * Stage 4 Strategies
  */
 #define STAGE_4_STRATEGY_ORIGINAL_MM_STRING		"ORIGINAL_MM"
 #define STAGE_4_STRATEGY_ORTHOGONAL_STRING		"ORTHOGONAL"
 #define STAGE_4_STRATEGY_OPTIMIZED_STRING		"OPTIMIZED"
+#define STAGE_4_STRATEGY_SIMD_STRING			"SIMD"
 #define STAGE_4_STRATEGIES_STRING	\
 			STAGE_4_STRATEGY_ORIGINAL_MM_STRING", "\
-			STAGE_4_STRATEGY_ORTHOGONAL_STRING" and "\
-			STAGE_4_STRATEGY_OPTIMIZED_STRING
+			STAGE_4_STRATEGY_ORTHOGONAL_STRING", "\
+			STAGE_4_STRATEGY_OPTIMIZED_STRING" and "\
+			STAGE_4_STRATEGY_SIMD_STRING
 #define DEFAULT_STAGE_4_STRATEGY		STAGE_4_STRATEGY_OPTIMIZED
 #define DEFAULT_STAGE_4_STRATEGY_STRING		STAGE_4_STRATEGY_OPTIMIZED_STRING // SHOW USAGE
 
+/**
+ * Pool Transports
+ */
+#define POOL_TRANSPORT_FILE_STRING		"FILE"
+#define POOL_TRANSPORT_SHM_STRING		"SHM"
+#define POOL_TRANSPORT_SOCKET_STRING	"SOCKET"
+#define POOL_TRANSPORTS_STRING	\
+			POOL_TRANSPORT_FILE_STRING", "\
+			POOL_TRANSPORT_SHM_STRING" and "\
+			POOL_TRANSPORT_SOCKET_STRING
+#define DEFAULT_POOL_TRANSPORT_STRING		POOL_TRANSPORT_FILE_STRING // SHOW USAGE
+
 /**
  * Only pairwise sequence alignment is supported
  */
@@ -127,6 +159,8 @@ using namespace std;
 #define ARG_SHARED_DIR			0x8004
 #define ARG_WAIT_PART			0x8005
 #define ARG_FORK			    0x8006
+#define ARG_POOL_TRANSPORT		0x8007
+#define ARG_TRACE				0x8008
 
 // Input Options
 #define ARG_TRIM                't'
@@ -136,11 +170,19 @@ using namespace std;
 #define ARG_REVERSE             0x9007
 #define ARG_COMPLEMENT          0x9008
 #define ARG_REVERSE_COMPLEMENT  0x9009
+#define ARG_SEQUENCE_CACHE      0x900A
+#define ARG_BATCH				0x900B
+#define ARG_BATCH_WORKERS		0x900C
+#define ARG_BATCH_LARGE			0x900D
 
 // Alignment Options
 #define ARG_ALIGNMENT_START		0x9101
 #define ARG_ALIGNMENT_END		0x9102
 #define ARG_ALIGNMENT_EDGES		0x9103
+#define ARG_MATCH				0x9104
+#define ARG_MISMATCH			0x9105
+#define ARG_GAP_OPEN			0x9106
+#define ARG_GAP_EXT				0x9107
 
 
 // Execution Options
@@ -150,11 +192,15 @@ using namespace std;
 #define ARG_DUMP_BLOCKS    		0x1007
 #define ARG_DISK_SIZE           0x1008
 #define ARG_RAM_SIZE            0x1009
+#define ARG_COMPRESS_ROWS       0x100A
 #define ARG_FLUSH_COLUMN        0x1010
 #define ARG_LOAD_COLUMN         0x1011
 #define ARG_ALIGNMENT_ID		0x1012
 #define ARG_MAX_ALIGNMENTS		0x1013
 #define ARG_SKIP_STAGE_1		0x1014
+#define ARG_BAND				0x1017
+#define ARG_XDROP				0x1018
+#define ARG_DIRECT_IO			0x1019
 
 #define ARG_MASANET				0x1015
 #define ARG_MASANET_CONNECT		0x1016
@@ -175,6 +221,7 @@ using namespace std;
 // Tools Options
 #define ARG_DRAW_PRUNING		0x7015
 #define ARG_TEST				0x7016
+#define ARG_EXPORT_CROSSPOINTS	0x7017
 
 
 #define TOOL_DRAW_PRUNING		(1)
@@ -210,6 +257,11 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
                            the gpu stages. The default is to use a subfolder of\n\
                            the work directory (see --work-dir parameter).\n\
 --shared-dir=DIR        Directory used to share data between forked instances.\n\
+--pool-transport=TYPE   Selects how the forked instances exchange messages.   \n\
+                           Possible values are: " POOL_TRANSPORTS_STRING ".\n\
+                           SHM and SOCKET require all the instances in the   \n\
+                           same host; FILE also works with NFS directories.  \n\
+                           Default Value: " DEFAULT_POOL_TRANSPORT_STRING " \n\
 --wait-part=PART        Process will wait until the conclusion of --part=PART.\n\
 -c, --clear             Clears the work directory before any computation. This \n\
                            prevents the continuation of previously interrupted \n\
@@ -222,6 +274,10 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
 --fork                  Fork many processes in order to optimize performance. \n\
 --fork=COUNT            Fork with a limited number of processes.\n\
 --fork=W1,W2,...,Wn     Fork with the given weight proportions.\n\
+--trace=FILE            Records a timeline of the stages, threads, buffers and \n\
+                           disk accesses in FILE, using the trace-event JSON  \n\
+                           format (chrome://tracing or Perfetto). Forked      \n\
+                           instances write to FILE.PID.                       \n\
 \n\
 \n\
 \033[1mInput Options:\033[0m\n\
@@ -250,6 +306,20 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
                         Generate reverse-complement (opposite strand) for      \n\
                            sequence 1, 2 or both. This parameter joins the     \n\
                            --reverse and --complement parameters. \n\
+--sequence-cache=DIR    Keeps the parsed fasta files in DIR, so the next       \n\
+                           executions load them without parsing.               \n\
+--batch=FILE            Aligns all the pairs listed in FILE instead of the two \n\
+                           fasta files. Each line of FILE contains a pair:     \n\
+                           FASTA1 FASTA2 [NAME]. Each pair is aligned in the   \n\
+                           subdirectory NAME (default: pair.NNNNN) of the work \n\
+                           directory, and batch.txt summarizes all the pairs.  \n\
+--batch-workers=N       Number of processes that align the small pairs of the  \n\
+                           batch, each one with a single thread.               \n\
+                           Default: one per CPU.                               \n\
+--batch-large=CELLS     Pairs with at least CELLS matrix cells (estimated from \n\
+                           the file sizes) are aligned one at a time with all  \n\
+                           the threads. Accepts the decimal suffixes 'K', 'M' \n\
+                           and 'G'. Default: " DEFAULT_BATCH_LARGE_STRING "\n\
 \n\
 \033[1mAlignment Type:\033[0m\n\
 \n\
@@ -262,6 +332,12 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
                         -    2: start/end of sequence 2.                       \n\
                         -    3: start/end of sequences 1 or 2.                 \n\
                         -    +: start/end of sequences 1 and 2.                \n\
+--match=SCORE           Match score (positive). Default: aligner dependent.    \n\
+--mismatch=SCORE        Mismatch score (negative).                             \n\
+--gap-open=PENALTY      Gap opening penalty (positive or zero).                \n\
+--gap-ext=PENALTY       Gap extension penalty (positive).                      \n\
+                           These parameters are only accepted by aligners      \n\
+                           supporting variable penalties.                      \n\
 \n\
 \033[1mStage Options:\033[0m\n\
 \n\
@@ -274,12 +350,31 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
                            in stage #1 will prevent the execution of subsequent\n\
                            phases.\n\
 -p, --no-block-pruning  Does not use the block pruning optimization            \n\
+--band=W                Only aligns the cells whose distance from the diagonal \n\
+                           between the corners of the matrix is, at most, W    \n\
+                           cells. The blocks outside the band are skipped.     \n\
+--xdrop=X               Skips the blocks whose first row and column are lower  \n\
+                           than the best score of the blocks above and to the  \n\
+                           left of them minus X, so the result does not depend \n\
+                           on the number of threads. The computed blocks are   \n\
+                           stored in the work directory and the next stages    \n\
+                           only align inside them. Not supported with --fork.  \n\
+                           Both options must be given to every stage.          \n\
 \n\
 --disk-size=SIZE        Limits the disk/ram size available to the special rows.\n\
 --ram-size=SIZE            The SIZE parameter may contain suffix M (e.g., 500M)\n\
                            or G (e.g., 10G). This option is ignored if used\n\
                            together with the --no-flush parameter. \n\
                            Default values: "DEFAULT_FLUSH_RAM_STRING"/"DEFAULT_FLUSH_DISK_STRING".\n\
+--compress-special-rows Compresses the special rows stored in disk. The same   \n\
+                           disk size holds more special rows, reducing the     \n\
+                           work of the stages #2 and #3.                       \n\
+--direct-io             Writes the special rows with O_DIRECT, bypassing the   \n\
+                           page cache. The rows are always written by a        \n\
+                           background thread, which holds up to 1/16 of the    \n\
+                           --ram-size (4M to 64M) in queued buffers. Rows      \n\
+                           written with --compress-special-rows do not use the \n\
+                           background thread nor O_DIRECT.                     \n\
 --flush-column=URL      Store the last column cells in some destination. The   \n\
                            URL is given in some of these formats: \n\
                            file://PATH_TO_FILE \n\
@@ -320,7 +415,8 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
 --maximum-partition=SIZE \n\
                         Defines the maximum partition size allowed as output   \n\
                            of the stage #4. This parameter limits the size of  \n\
-                           partitions processed in stage #5. \n\
+                           partitions processed in stage #5, which accepts     \n\
+                           partitions up to 16384. \n\
                            Default Value: "DEFAULT_STAGE_4_MPS_STRING" \n\
 --stage-4-strategy=TYPE Selects the strategy to be used in Stage #4. Possible  \n\
                            values are: "STAGE_4_STRATEGIES_STRING".             \n\
@@ -341,6 +437,11 @@ FASTA FILES:            Supply two sequences in fasta format files.            \
                            the --list-formats parameter. \n\
 --list-formats          Lists all the possible output formats for stage #6.    \n\
 \n\
+\033[1mTools Options:\033[0m\n\
+--export-crosspoints=FILE Writes a copy of the binary crosspoints FILE (see   \n\
+                           the crosspoints folder of the work directory) in  \n\
+                           the text format, in FILE.txt, and exits.          \n\
+\n\
 \n\
 "
 
@@ -468,6 +569,35 @@ static long long parse_size(char* optarg, char* current_arg) {
 	return size;
 }
 
+/**
+ * Parses a number of items with an optional decimal suffix ('K', 'M' or
+ * 'G'), e.g. "100000000" or "100M".
+ */
+static long long parse_count(char* optarg, char* current_arg) {
+	char* end;
+	double count = strtod(optarg, &end);
+	switch ( *end ) {
+	case 0:
+		break;
+	case 'K':
+		count *= 1000;
+		end++;
+		break;
+	case 'M':
+		count *= 1000*1000;
+		end++;
+		break;
+	case 'G':
+		count *= 1000*1000*1000;
+		end++;
+		break;
+	}
+	if (end == optarg || *end != 0 || count < 0) {
+		throw IllegalArgumentException("Wrong number (use an integer with an optional 'K', 'M' or 'G' suffix).", current_arg);
+	}
+	return (long long)count;
+}
+
 /**
  * Show possible output formats used in stage #6->
  */
@@ -480,6 +610,24 @@ static void print_output_formats ( FILE* file=stdout ) {
     }
 }
 
+/**
+ * Writes a copy of a crosspoints file in the text format (FILE.txt).
+ *
+ * @return the exit code of the process.
+ */
+static int export_crosspoints ( const char* filename ) {
+	if ( access ( filename, R_OK ) != 0 ) {
+		fprintf ( stderr, "Could not read crosspoints file: %s\n", filename );
+		return 1;
+	}
+	CrosspointsFile crosspoints ( filename );
+	crosspoints.loadCrosspoints();
+	string text_file = string ( filename ) + ".txt";
+	crosspoints.exportText ( text_file );
+	printf ( "Crosspoints exported to %s\n", text_file.c_str() );
+	return 0;
+}
+
 /**
  * Load sequence with proper flags.
  */
@@ -756,6 +904,354 @@ void executeTracebackPredicted(Job* _job, Timer* timer, int ev_stage2, int ev_st
 	timer->eventRecord(ev_stage6);
 }
 
+/**
+ * A pair of sequences of a batch execution (see --batch).
+ */
+typedef struct {
+	/** fasta files of the pair */
+	string fasta[SEQUENCES_COUNT];
+	/** name of the pair, also used as its work subdirectory */
+	string name;
+	/** matrix size, estimated from the size of the fasta files */
+	long long cells;
+} batch_pair_t;
+
+/**
+ * Parameters and state of a batch execution (see --batch).
+ */
+typedef struct {
+	vector<batch_pair_t> pairs;
+	/** number of processes that align the small pairs */
+	int workers;
+	/** pairs with at least this number of cells use all the threads */
+	long long large;
+	bool clear_n;
+	bool reverse_seq[SEQUENCES_COUNT];
+	bool complement_seq[SEQUENCES_COUNT];
+	char* aligner_header;
+	int argc;
+	char** argv;
+	/**
+	 * Anonymous mapping shared with the workers. The first position is the
+	 * next entry of the queue to be claimed and the position p+1 keeps the
+	 * state of pair p (BATCH_PAIR_*).
+	 */
+	volatile int* shared;
+} batch_t;
+
+/**
+ * Reads the batch manifest. Each non-empty line that does not start with
+ * '#' contains the two fasta files of a pair and, optionally, its name.
+ */
+static void load_batch_manifest(const char* filename, batch_t* batch) {
+	FILE* file = fopen(filename, "rt");
+	if (file == NULL) {
+		fprintf(stderr, "FATAL: could not open the batch file (%s).\n", filename);
+		exit(1);
+	}
+	char line[3*FILENAME_MAX];
+	char fasta0[FILENAME_MAX];
+	char fasta1[FILENAME_MAX];
+	char name[FILENAME_MAX];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line_number++;
+		int fields = sscanf(line, "%s %s %s", fasta0, fasta1, name);
+		if (fields <= 0 || fasta0[0] == '#') {
+			continue;
+		}
+		if (fields < 2) {
+			fprintf(stderr, "FATAL: %s:%d: expected \"FASTA1 FASTA2 [NAME]\".\n", filename, line_number);
+			exit(1);
+		}
+		batch_pair_t pair;
+		pair.fasta[0] = fasta0;
+		pair.fasta[1] = fasta1;
+		if (fields == 3) {
+			pair.name = name;
+		} else {
+			sprintf(name, "pair.%05d", (int)batch->pairs.size());
+			pair.name = name;
+		}
+		pair.cells = 1;
+		for (int i=0; i<SEQUENCES_COUNT; i++) {
+			struct stat st;
+			if (stat(pair.fasta[i].c_str(), &st)) {
+				fprintf(stderr, "FATAL: %s:%d: could not open %s.\n", filename, line_number, pair.fasta[i].c_str());
+				exit(1);
+			}
+			pair.cells *= st.st_size;
+		}
+		for (size_t i=0; i<batch->pairs.size(); i++) {
+			if (batch->pairs[i].name == pair.name) {
+				fprintf(stderr, "FATAL: %s:%d: duplicated pair name (%s).\n", filename, line_number, pair.name.c_str());
+				exit(1);
+			}
+		}
+		batch->pairs.push_back(pair);
+	}
+	fclose(file);
+}
+
+/**
+ * Aligns one pair of a batch execution in its own work subdirectory. The
+ * aligner must be already initialized by the calling worker.
+ */
+static void align_batch_pair(batch_t* batch, const batch_pair_t* pair, Job* _job) {
+	IAligner* aligner = _job->aligner;
+
+	Timer timer;
+	int ev_start  = timer.createEvent("START");
+	int ev_seqs   = timer.createEvent("SEQUENCES");
+	int ev_init   = timer.createEvent("INIT");
+	int ev_stage1 = timer.createEvent("STAGE1");
+	int ev_stage2 = timer.createEvent("STAGE2");
+	int ev_stage3 = timer.createEvent("STAGE3");
+	int ev_stage4 = timer.createEvent("STAGE4");
+	int ev_stage5 = timer.createEvent("STAGE5");
+	int ev_stage6 = timer.createEvent("STAGE6");
+
+	timer.eventRecord(ev_start);
+
+	Job* job = _job->createBatchJob(pair->name);
+	for (int i=0; i<SEQUENCES_COUNT; i++) {
+		SequenceInfo* sequenceInfo = new SequenceInfo();
+		sequenceInfo->setFilename(pair->fasta[i]);
+
+		SequenceModifiers* modifiers = new SequenceModifiers();
+		modifiers->setClearN(i == 0 ? batch->clear_n : false);
+		modifiers->setReverse(batch->reverse_seq[i]);
+		modifiers->setComplement(batch->complement_seq[i]);
+
+		Sequence* sequence = new Sequence(sequenceInfo, modifiers);
+		job->addSequence(sequence);
+		job->getAlignmentParams()->addSequence(sequence);
+	}
+	timer.eventRecord(ev_seqs);
+
+	job->getAlignmentParams()->printParams(stdout);
+	if ( !job->initialize(false) ) {
+		fprintf(stderr, "Error during Job initialization (%s)\n", pair->name.c_str());
+		exit ( 1 );
+	}
+
+	FILE* aligner_stats = job->fopenStatistics(ALIGNER_STATISTICS, 0);
+	print_header(batch->aligner_header, aligner_stats);
+	fprintf(aligner_stats, "%s", batch->argv[0]);
+	for (int i=1; i<batch->argc; i++) {
+		fprintf(aligner_stats, " %s", batch->argv[i]);
+	}
+	fprintf(aligner_stats, "\nBatch pair: %s %s %s\n\n", pair->name.c_str(),
+			pair->fasta[0].c_str(), pair->fasta[1].c_str());
+	aligner->printInitialStatistics(aligner_stats);
+	fflush(aligner_stats);
+	timer.eventRecord(ev_init);
+
+	int count = stage1 ( job );
+	timer.eventRecord(ev_stage1);
+	executeTraceback(job, &timer, count, ev_stage2, ev_stage3, ev_stage4, ev_stage5, ev_stage6);
+
+	FILE* stats = job->fopenStatistics(STAGE_GLOBAL, 0);
+	double size = ((double)job->getSequence(0)->getLen())*job->getSequence(1)->getLen();
+
+	float diff = timer.printStatistics(stats);
+	fprintf(stats, "        Total: %.4f\n", diff);
+	fprintf(stats, "       Matrix: %.4e\n", size);
+	fprintf(stats, "        MCUPS: %.4f\n", size/1000000.0f/(diff/1000.0f));
+	fclose(stats);
+
+	job->finalizeWorkerAligners();
+	aligner->printFinalStatistics(aligner_stats);
+	fclose(aligner_stats);
+
+	/* One line per pair, appended by a single write */
+	char score[32] = "-";
+	if (count > 0) {
+		Alignment* alignment = AlignmentBinaryFile::read(job->getAlignmentBinaryFile(0));
+		sprintf(score, "%d", alignment->getRawScore());
+		delete alignment;
+	}
+	FILE* summary = fopen((_job->getWorkPath() + "/batch.txt").c_str(), "at");
+	if (summary != NULL) {
+		fprintf(summary, "%s\t%s\t%.4e\t%.4f\t%s\t%s\n", pair->name.c_str(), score,
+				size, diff, pair->fasta[0].c_str(), pair->fasta[1].c_str());
+		fclose(summary);
+	}
+
+	for (int i=0; i<SEQUENCES_COUNT; i++) {
+		delete job->getSequence(i)->getModifiers();
+		delete job->getSequence(i)->getInfo();
+		delete job->getSequence(i);
+	}
+	delete job;
+}
+
+/**
+ * Body of a batch worker process. The aligner is initialized once and then
+ * reused by all the pairs claimed by this worker.
+ */
+static void run_batch_worker(batch_t* batch, Job* _job, const vector<int>& queue, int worker, bool threaded) {
+	if (!threaded) {
+		/* forked instances use a single thread (see Job::getThreadCount) */
+		_job->aligner->getParameters()->setForkId(worker);
+	}
+	_job->aligner->initialize();
+	while (1) {
+		int k = __sync_fetch_and_add(&batch->shared[0], 1);
+		if (k >= (int)queue.size()) {
+			break;
+		}
+		int p = queue[k];
+		batch->shared[p+1] = BATCH_PAIR_RUNNING;
+		align_batch_pair(batch, &batch->pairs[p], _job);
+		__sync_synchronize();
+		batch->shared[p+1] = BATCH_PAIR_DONE;
+	}
+	_job->aligner->finalize();
+	exit(0);
+}
+
+/**
+ * Forks a batch worker process.
+ *
+ * @return the pid of the worker.
+ */
+static int fork_batch_worker(batch_t* batch, Job* _job, const vector<int>& queue, int worker, bool threaded) {
+	fflush(stdout);
+	fflush(stderr);
+	int pid = fork();
+	if (pid == 0) {
+		run_batch_worker(batch, _job, queue, worker, threaded);
+	} else if (pid < 0) {
+		perror("Error during fork()");
+		exit(1);
+	}
+	fprintf(stderr, "+PID: %d\n", pid);
+	return pid;
+}
+
+/**
+ * Forks the workers that process the queue of pairs and waits for them.
+ * A worker that dies (e.g., due to a fatal error in one pair) is replaced
+ * by a new one while the queue is not empty, so only the pair that it was
+ * aligning is lost.
+ */
+static void run_batch_workers(batch_t* batch, Job* _job, const vector<int>& queue, int count, bool threaded) {
+	if (queue.empty()) {
+		return;
+	}
+	if (count > (int)queue.size()) {
+		count = queue.size();
+	}
+	batch->shared[0] = 0;
+
+	vector<int> pids(count);
+	for (int w=0; w<count; w++) {
+		pids[w] = fork_batch_worker(batch, _job, queue, w, threaded);
+	}
+	int running = count;
+	int respawns = queue.size();
+	while (running > 0) {
+		int status;
+		int pid = wait(&status);
+		if (pid == -1) {
+			if (errno == EINTR) continue;
+			if (errno == ECHILD) break;
+			perror("Error during wait()");
+			abort();
+		}
+		running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			continue;
+		}
+		fprintf(stderr, "-PID(%d): batch worker aborted (status: %d)\n", pid, status);
+		for (int w=0; w<count; w++) {
+			if (pids[w] == pid && batch->shared[0] < (int)queue.size() && respawns-- > 0) {
+				pids[w] = fork_batch_worker(batch, _job, queue, w, threaded);
+				running++;
+			}
+		}
+	}
+}
+
+/**
+ * Orders the pairs by decreasing size, so the workers finish the queue
+ * with the smallest pairs.
+ */
+static bool compare_batch_pairs(const batch_pair_t* a, const batch_pair_t* b) {
+	return a->cells > b->cells;
+}
+
+/**
+ * Executes all the stages for each pair of the batch manifest (see --batch).
+ * The small pairs are packed across the single-threaded worker processes,
+ * then the large pairs are aligned one at a time by a process that uses all
+ * the threads. Each pair is aligned in the subdirectory of the work
+ * directory with its name, and a summary of all the pairs is appended to
+ * the "batch.txt" file of the work directory.
+ *
+ * @return the number of pairs that could not be aligned.
+ */
+static int execute_batch(batch_t* batch, Job* _job) {
+	int count = batch->pairs.size();
+	string work_path = _job->getWorkPath();
+	if (mkdir(work_path.c_str(), 0774) && errno != EEXIST) {
+		fprintf(stderr, "Path (%s) could not be created. Try to create it manually. (errno: %d)\n", work_path.c_str(), errno);
+		exit(1);
+	}
+
+	batch->shared = (volatile int*)mmap(NULL, (count+1)*sizeof(int),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (batch->shared == MAP_FAILED) {
+		perror("Error during mmap()");
+		exit(1);
+	}
+	for (int p=0; p<count; p++) {
+		batch->shared[p+1] = BATCH_PAIR_PENDING;
+	}
+
+	vector<const batch_pair_t*> sorted;
+	for (int p=0; p<count; p++) {
+		sorted.push_back(&batch->pairs[p]);
+	}
+	stable_sort(sorted.begin(), sorted.end(), compare_batch_pairs);
+	vector<int> small_queue;
+	vector<int> large_queue;
+	for (int k=0; k<count; k++) {
+		int p = sorted[k] - &batch->pairs[0];
+		if (sorted[k]->cells >= batch->large) {
+			large_queue.push_back(p);
+		} else {
+			small_queue.push_back(p);
+		}
+	}
+	FILE* summary = fopen((work_path + "/batch.txt").c_str(), "at");
+	if (summary != NULL) {
+		if (ftell(summary) == 0) {
+			fprintf(summary, "# name\tscore\tcells\tmsecs\tfasta1\tfasta2\n");
+		}
+		fclose(summary);
+	}
+
+	printf("Batch: %d pairs (%d small pairs in %d workers, %d large pairs).\n",
+			count, (int)small_queue.size(), batch->workers, (int)large_queue.size());
+
+	run_batch_workers(batch, _job, small_queue, batch->workers, false);
+	run_batch_workers(batch, _job, large_queue, 1, true);
+
+	int failed = 0;
+	for (int p=0; p<count; p++) {
+		if (batch->shared[p+1] != BATCH_PAIR_DONE) {
+			fprintf(stderr, "Batch pair %s (%s %s) could not be aligned.\n", batch->pairs[p].name.c_str(),
+					batch->pairs[p].fasta[0].c_str(), batch->pairs[p].fasta[1].c_str());
+			failed++;
+		}
+	}
+	printf("Batch: %d of %d pairs aligned (see %s/batch.txt).\n", count-failed, count, work_path.c_str());
+	munmap((void*)batch->shared, (count+1)*sizeof(int));
+	return failed;
+}
+
 /*
  * Program entry point.
  */
@@ -775,6 +1271,8 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
     const score_params_t* score_params = aligner->getScoreParameters();
     alignment_params->setAffineGapPenalties(-score_params->gap_open, -score_params->gap_ext);
     alignment_params->setMatchMismatchScores(score_params->match, score_params->mismatch);
+    score_params_t custom_score_params = *score_params;
+    bool custom_penalties = false;
 
     /* Default Values */
     int verbosity = 2;
@@ -784,6 +1282,8 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
     _job->disk_limit = DEFAULT_DISK_LIMIT;
     _job->ram_limit = DEFAULT_RAM_LIMIT;
 	_job->block_pruning = true;
+	_job->band = -1;
+	_job->xdrop = 0;
 	_job->dump_blocks = false;
     _job->setWorkPath ( DEFAULT_WORK_DIRECTORY );
     _job->stage4_maximum_partition_size = DEFAULT_STAGE_4_MPS;
@@ -814,6 +1314,9 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
     bool reverse_seq[SEQUENCES_COUNT] = {false, false};
     bool complement_seq[SEQUENCES_COUNT] = {false, false};
     char *fasta_file[SEQUENCES_COUNT];
+    char *batch_file = NULL;
+    int batch_workers = 0;
+    long long batch_large = DEFAULT_BATCH_LARGE;
 
     //_job->alignerParameter = AlignerFactory::createAlignerParameter();
     //_job->alignerParameter = new ExampleParameters();
@@ -828,6 +1331,7 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
         {"work-dir",    required_argument,      0, ARG_WORK_DIR},
         {"special-rows-dir", required_argument,	0, ARG_SPECIAL_ROWS_DIR},
         {"shared-dir",  required_argument,		0, ARG_SHARED_DIR},
+        {"pool-transport", required_argument,	0, ARG_POOL_TRANSPORT},
         {"wait-part", 	required_argument,		0, ARG_WAIT_PART},
         {"clear",       no_argument,            0, ARG_CLEAR},
         {"verbose",     required_argument,      0, ARG_VERBOSE},
@@ -836,6 +1340,7 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
         {"multigpu",    no_argument,            0, ARG_MULTIPLE_GPUS},*/
         //{"blocks",      required_argument,      0, ARG_BLOCKS},
         {"fork",		optional_argument,			0, ARG_FORK},
+        {"trace",		required_argument,		0, ARG_TRACE},
 
         // Input Options
         {"trim",        required_argument,      0, ARG_TRIM},
@@ -845,17 +1350,27 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
         {"reverse",     required_argument,      0, ARG_REVERSE},
         {"complement",  required_argument,      0, ARG_COMPLEMENT},
         {"reverse-complement", required_argument, 0, ARG_REVERSE_COMPLEMENT},
+        {"sequence-cache", required_argument,   0, ARG_SEQUENCE_CACHE},
+        {"batch",       required_argument,      0, ARG_BATCH},
+        {"batch-workers", required_argument,    0, ARG_BATCH_WORKERS},
+        {"batch-large", required_argument,      0, ARG_BATCH_LARGE},
 
         // Input Options
         {"alignment-start", required_argument,  0, ARG_ALIGNMENT_START},
         {"alignment-end", required_argument,  0, ARG_ALIGNMENT_END},
         {"alignment-edges", required_argument,  0, ARG_ALIGNMENT_EDGES},
+        {"match",       required_argument,      0, ARG_MATCH},
+        {"mismatch",    required_argument,      0, ARG_MISMATCH},
+        {"gap-open",    required_argument,      0, ARG_GAP_OPEN},
+        {"gap-ext",     required_argument,      0, ARG_GAP_EXT},
 
         // Execution Options
         {"stage-1",     no_argument,            0, ARG_STAGE_1},
         {"no-flush",    no_argument,            0, ARG_NO_FLUSH},
         {"disk-size",   required_argument,      0, ARG_DISK_SIZE},
         {"ram-size",    required_argument,      0, ARG_RAM_SIZE},
+        {"compress-special-rows", no_argument,  0, ARG_COMPRESS_ROWS},
+        {"direct-io",   no_argument,            0, ARG_DIRECT_IO},
         {"flush-column", required_argument,     0, ARG_FLUSH_COLUMN},
         {"load-column", required_argument,      0, ARG_LOAD_COLUMN},
 		{"no-block-pruning", no_argument,		0, ARG_NO_BLOCK_PRUNING},
@@ -863,6 +1378,8 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 		{"alignment-id", required_argument,		0, ARG_ALIGNMENT_ID},
 		{"max-alignments", required_argument,	0, ARG_MAX_ALIGNMENTS},
 		{"skip-stage-1", no_argument,			0, ARG_SKIP_STAGE_1},
+		{"band",		required_argument,		0, ARG_BAND},
+		{"xdrop",		required_argument,		0, ARG_XDROP},
 		// Masanet
         {"masanet", 		optional_argument,     	0, ARG_MASANET},
         {"masanet-connect", required_argument,      0, ARG_MASANET_CONNECT},
@@ -888,6 +1405,7 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 		// Tools Options
 		//{"draw-pruning", no_argument,			0, ARG_DRAW_PRUNING},
         {"test",		required_argument,		0, ARG_TEST},
+        {"export-crosspoints", required_argument, 0, ARG_EXPORT_CROSSPOINTS},
 
         {0, 0, 0, 0}
     };
@@ -929,6 +1447,10 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					throw IllegalArgumentException(err.getErr().c_str(), current_arg);
 				}
 				break;
+			case ARG_TRACE:
+				Tracer::open(optarg);
+				Tracer::setThreadName("main");
+				break;
 			case ARG_SHARED_DIR:
 				try {
 					_job->setSharedPath( optarg );
@@ -943,6 +1465,18 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					throw IllegalArgumentException(err.getErr().c_str(), current_arg);
 				}
 				break;
+			case ARG_POOL_TRANSPORT:
+				if (strcmp(optarg, POOL_TRANSPORT_FILE_STRING)==0) {
+					_job->pool_transport = POOL_TRANSPORT_FILE;
+				} else if (strcmp(optarg, POOL_TRANSPORT_SHM_STRING)==0) {
+					_job->pool_transport = POOL_TRANSPORT_SHM;
+				} else if (strcmp(optarg, POOL_TRANSPORT_SOCKET_STRING)==0) {
+					_job->pool_transport = POOL_TRANSPORT_SOCKET;
+				} else {
+					throw IllegalArgumentException("Unrecognized pool transport. "\
+							"Possible values are: " POOL_TRANSPORTS_STRING, current_arg);
+				}
+				break;
 			case ARG_CLEAR:
 				clear_work_directory = true;
 				break;
@@ -1041,6 +1575,20 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					throw IllegalArgumentException("Wrong complement argument. Choose 'none', '1', '2' or 'both'.", current_arg);
 				}
 				break;
+			case ARG_SEQUENCE_CACHE:
+				SequenceData::setCacheDirectory(optarg);
+				break;
+			case ARG_BATCH:
+				batch_file = optarg;
+				break;
+			case ARG_BATCH_WORKERS:
+				if (sscanf(optarg, "%d", &batch_workers) != 1 || batch_workers < 1) {
+					throw IllegalArgumentException("The number of batch workers must be positive.", current_arg);
+				}
+				break;
+			case ARG_BATCH_LARGE:
+				batch_large = parse_count(optarg, current_arg);
+				break;
 			case ARG_REVERSE_COMPLEMENT:
 				if ( !parse_sequence_flags ( optarg, complement_seq ) ) {
 					throw IllegalArgumentException("Wrong reverse-complement argument. Choose 'none', '1', '2' or 'both'.", current_arg);
@@ -1068,6 +1616,34 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					throw IllegalArgumentException("Wrong alignment end argument. Choose '*', '1', '2', '3' or '+'.", current_arg);
 				}
 				break;
+			case ARG_MATCH:
+				custom_score_params.match = atoi ( optarg );
+				if ( custom_score_params.match <= 0 ) {
+					throw IllegalArgumentException("Match score must be positive.", current_arg);
+				}
+				custom_penalties = true;
+				break;
+			case ARG_MISMATCH:
+				custom_score_params.mismatch = atoi ( optarg );
+				if ( custom_score_params.mismatch >= 0 ) {
+					throw IllegalArgumentException("Mismatch score must be negative.", current_arg);
+				}
+				custom_penalties = true;
+				break;
+			case ARG_GAP_OPEN:
+				custom_score_params.gap_open = atoi ( optarg );
+				if ( custom_score_params.gap_open < 0 ) {
+					throw IllegalArgumentException("Gap opening penalty must not be negative.", current_arg);
+				}
+				custom_penalties = true;
+				break;
+			case ARG_GAP_EXT:
+				custom_score_params.gap_ext = atoi ( optarg );
+				if ( custom_score_params.gap_ext <= 0 ) {
+					throw IllegalArgumentException("Gap extension penalty must be positive.", current_arg);
+				}
+				custom_penalties = true;
+				break;
 			case ARG_STAGE_1:
 				phase = STAGE_1;
 				break;
@@ -1091,15 +1667,17 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					_job->ram_limit = parse_size(optarg, current_arg);
 				}
 				break;
+			case ARG_COMPRESS_ROWS:
+				_job->compress_special_rows = true;
+				break;
+			case ARG_DIRECT_IO:
+				_job->direct_io = true;
+				break;
 			case ARG_FLUSH_COLUMN:
 				_job->flush_column_url = optarg;
-				_job->block_pruning = false; // TODO
-				fprintf(stderr, "Warning: Block Pruning is not compatible with multigpus yet.\n");
 				break;
 			case ARG_LOAD_COLUMN:
 				_job->load_column_url = optarg;
-				_job->block_pruning = false; // TODO
-				fprintf(stderr, "Warning: Block Pruning is not compatible with multigpus yet.\n");
 				break;
 
 			case ARG_ALIGNMENT_ID:
@@ -1117,6 +1695,16 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 			case ARG_SKIP_STAGE_1:
 				skip_stage_1 = true;
 				break;
+			case ARG_BAND:
+				if (sscanf(optarg, "%d", &_job->band) != 1 || _job->band < 1) {
+					throw IllegalArgumentException("Band must be positive.", current_arg);
+				}
+				break;
+			case ARG_XDROP:
+				if (sscanf(optarg, "%d", &_job->xdrop) != 1 || _job->xdrop < 1) {
+					throw IllegalArgumentException("X-drop must be positive.", current_arg);
+				}
+				break;
 
 			case ARG_MASANET:
 				if ( optarg != NULL )  {
@@ -1156,6 +1744,8 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					_job->stage4_strategy = STAGE_4_STRATEGY_ORTHOGONAL;
 				} else if (strcmp(optarg, STAGE_4_STRATEGY_OPTIMIZED_STRING)==0) {
 					_job->stage4_strategy = STAGE_4_STRATEGY_OPTIMIZED;
+				} else if (strcmp(optarg, STAGE_4_STRATEGY_SIMD_STRING)==0) {
+					_job->stage4_strategy = STAGE_4_STRATEGY_SIMD;
 				} else {
 					throw IllegalArgumentException("Unrecognized stage #4 strategy. "\
 							"Possible values are: "STAGE_4_STRATEGIES_STRING, current_arg);
@@ -1192,6 +1782,9 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 					throw IllegalArgumentException(out.str().c_str(), current_arg);
 				}
 				break;
+			case ARG_EXPORT_CROSSPOINTS:
+				exit ( export_crosspoints ( optarg ) );
+				break;
 			case ARG_TEST: {
 				//AlignerTester* tester = new AlignerTester(aligner);
 				//return tester->test(optarg);
@@ -1219,7 +1812,11 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 		}
 
 	    /* Mandatory file names */
-	    if (_job->peer_listen_port < 0) {
+	    if (batch_file != NULL) {
+	    	if (argc - optind != 0) {
+	    		throw IllegalArgumentException("Fasta files must be supplied in the batch file.");
+	    	}
+	    } else if (_job->peer_listen_port < 0) {
 	    	if (argc - optind == 2 ) {
 	    		fasta_file[0] = argv[optind++];
 	        	fasta_file[1] = argv[optind++];
@@ -1227,6 +1824,17 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 	    		throw IllegalArgumentException("Supply two fasta files.");
 	    	}
     	}
+
+	    /* Custom penalties */
+	    if (custom_penalties) {
+	    	if (aligner->getCapabilities().variable_penalties != SUPPORTED) {
+	    		throw IllegalArgumentException("This aligner does not support variable penalties.");
+	    	}
+	    	aligner->setScoreParameters(&custom_score_params);
+	    	score_params = aligner->getScoreParameters();
+	    	alignment_params->setAffineGapPenalties(-score_params->gap_open, -score_params->gap_ext);
+	    	alignment_params->setMatchMismatchScores(score_params->match, score_params->mismatch);
+	    }
     } catch (IllegalArgumentException& err) {
     	fprintf(stderr, "%s", err.what());
     	fprintf(stderr, "See `%s --help' for more information.\n", argv[0]);
@@ -1246,6 +1854,39 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
     	sleep(600);
     }
 
+    if (batch_file != NULL) {
+    	if (fork_count != NOT_FORKED_INSTANCE || split_count > 0 || phase != ALL_STAGES || skip_stage_1
+    			|| trim_start[0] || trim_start[1] || trim_end[0] || trim_end[1]
+    			|| _job->flush_column_url.length() > 0 || _job->load_column_url.length() > 0) {
+        	fprintf(stderr, "FATAL: --batch executes all the stages of untrimmed pairs in a single process.\n");
+        	exit(1);
+    	}
+    	batch_t batch;
+    	batch.workers = batch_workers;
+    	if (batch.workers <= 0) {
+    		batch.workers = sysconf( _SC_NPROCESSORS_ONLN );
+    		if (batch.workers < 1) {
+    			batch.workers = 1;
+    		}
+    	}
+    	batch.large = batch_large;
+    	batch.clear_n = clear_n;
+    	for (int i=0; i<SEQUENCES_COUNT; i++) {
+    		batch.reverse_seq[i] = reverse_seq[i];
+    		batch.complement_seq[i] = complement_seq[i];
+    	}
+    	batch.aligner_header = aligner_header;
+    	batch.argc = argc;
+    	batch.argv = argv;
+    	load_batch_manifest(batch_file, &batch);
+
+    	int failed = execute_batch(&batch, _job);
+
+    	delete _job->configs;
+    	delete _job;
+    	exit ( failed ? 1 : 0 );
+    }
+
     /* Loads both sequences */
     /*for (int i=0; i<2; i++) {
     	load_sequence (alignment_params->getSeq(i), clear_n, reverse_seq[i], complement_seq[i], fasta_file[i]);
@@ -1302,6 +1943,11 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 	timer.eventRecord(ev_seqs);
 
 
+    if (_job->xdrop > 0 && (fork_count != NOT_FORKED_INSTANCE || split_count > 0)) {
+    	fprintf(stderr, "FATAL: --xdrop is not supported in forked or split executions.\n");
+    	exit(1);
+    }
+
     if ( fork_count != NOT_FORKED_INSTANCE) {
         if (phase == ALL_STAGES) {
         	//fprintf(stderr, "Warning: only Stage 1 will be executed in forked processes.\n");
@@ -1315,13 +1961,6 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
         	_job->disk_limit = NO_FLUSH;
         	_job->ram_limit = NO_FLUSH;
         }*/
-        if (_job->block_pruning) {
-			fprintf(stderr, "Warning: disabling Block Pruning in forked processes.\n");
-			_job->block_pruning = false;
-        	//_job->disk_limit = NO_FLUSH;
-        	//_job->ram_limit = NO_FLUSH;
-        }
-
         fork_multi_process ( fork_count, _job, fork_proportions, split_step );
     }
 
@@ -1394,6 +2033,7 @@ int libmasa_entry_point(int argc, char** argv, IAligner* aligner, char* aligner_
 
 	fclose(stats);
 
+	_job->finalizeWorkerAligners();
 	aligner->finalize();
 	aligner->printFinalStatistics(aligner_stats);
 	fclose(aligner_stats);
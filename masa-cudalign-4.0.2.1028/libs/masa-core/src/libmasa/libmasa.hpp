@@ -37,6 +37,7 @@
 #include "aligners/AbstractAlignerSafe.hpp"
 #include "processors/AbstractBlockProcessor.hpp"
 #include "processors/CPUBlockProcessor.hpp"
+#include "processors/SIMDBlockProcessor.hpp"
 
 /* libmasa util includes */
 #include "utils/AlignerUtils.hpp"
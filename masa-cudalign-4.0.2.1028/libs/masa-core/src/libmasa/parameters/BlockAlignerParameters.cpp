@@ -38,6 +38,9 @@ using namespace std;
 #define DEFAULT_GRID_SIZE		 AUTO_GRID_SIZE
 #define DEFAULT_GRID_SIZE_STR	"Auto"
 
+#define AUTO_THREAD_COUNT		 0
+#define DEFAULT_THREAD_COUNT_STR	"Auto (one per CPU)"
+
 /**
  * Usage Strings
  */
@@ -49,6 +52,12 @@ using namespace std;
 --grid-width=W               Divides the Grid in H rows of blocks. Default: "DEFAULT_GRID_SIZE_STR".\n\
 --grid-height=H              Divides the Grid in W columns of blocks. Default: "DEFAULT_GRID_SIZE_STR".\n\
 --grid-size=H,W              Defines the dimensions of the grid.\n\
+--threads=N                  Number of threads that process blocks of the\n\
+                               same anti-diagonal and the partitions of\n\
+                               stages 3 to 5. Default: " DEFAULT_THREAD_COUNT_STR ".\n\
+--autotune=FILE              Chooses the block dimensions with short calibration\n\
+                               runs. The results are kept in FILE for each host\n\
+                               and class of partition sizes and reused later.\n\
 "
 
 /**
@@ -60,6 +69,8 @@ using namespace std;
 #define ARG_BLOCK_WIDTH  0x1004
 #define ARG_GRID_SIZE    0x1005
 #define ARG_BLOCK_SIZE   0x1006
+#define ARG_THREADS      0x1007
+#define ARG_AUTOTUNE     0x1008
 
 static struct option long_options[] = {
         {"block-height",     required_argument,      0, ARG_BLOCK_HEIGHT},
@@ -68,6 +79,8 @@ static struct option long_options[] = {
         {"grid-width",       required_argument,      0, ARG_GRID_WIDTH},
         {"grid-size",        required_argument,      0, ARG_GRID_SIZE},
         {"block-size",       required_argument,      0, ARG_BLOCK_SIZE},
+        {"threads",          required_argument,      0, ARG_THREADS},
+        {"autotune",         required_argument,      0, ARG_AUTOTUNE},
         {0, 0, 0, 0}
     };
 
@@ -79,6 +92,8 @@ BlockAlignerParameters::BlockAlignerParameters() {
 	gridHeight = DEFAULT_GRID_SIZE;
 	blockWidth = DEFAULT_BLOCK_SIZE;
 	blockHeight = DEFAULT_BLOCK_SIZE;
+	threadCount = AUTO_THREAD_COUNT;
+	autotuneFile = "";
 }
 
 void BlockAlignerParameters::printUsage() const {
@@ -113,6 +128,12 @@ int BlockAlignerParameters::processArgument(int argc, char** argv) {
 		case ARG_BLOCK_HEIGHT:
 			sscanf ( optarg, "%d", &blockHeight);
 			break;
+		case ARG_THREADS:
+			sscanf ( optarg, "%d", &threadCount);
+			break;
+		case ARG_AUTOTUNE:
+			autotuneFile = optarg;
+			break;
 		default:
 			return ret;
 	}
@@ -134,6 +155,11 @@ int BlockAlignerParameters::processArgument(int argc, char** argv) {
 		return ARGUMENT_ERROR;
 	}
 
+	if ( threadCount < 0 ) {
+		setLastError("The number of threads must be a positive integer.");
+		return ARGUMENT_ERROR;
+	}
+
 	return ARGUMENT_OK;
 }
 
@@ -152,3 +178,11 @@ int BlockAlignerParameters::getBlockHeight() const {
 int BlockAlignerParameters::getGridHeight() const {
 	return gridHeight;
 }
+
+int BlockAlignerParameters::getThreadCount() const {
+	return threadCount;
+}
+
+const string& BlockAlignerParameters::getAutotuneFile() const {
+	return autotuneFile;
+}
@@ -25,6 +25,9 @@
 
 #include "AbstractAlignerParameters.hpp"
 
+#include <string>
+using namespace std;
+
 #define MAX_GRID_SIZE 1024
 #define MAX_BLOCK_SIZE 1024*20
 #define MIN_GRID_SIZE 1
@@ -48,6 +51,12 @@ private:
 	/** Width of one block. 0 indicates variable */
 	int blockWidth;
 
+	/** Number of threads of the block scheduler. 0 indicates automatic */
+	int threadCount;
+
+	/** File with the block dimensions chosen by the autotuner. Empty disables it */
+	string autotuneFile;
+
 public:
 	BlockAlignerParameters();
 	virtual ~BlockAlignerParameters();
@@ -66,6 +75,8 @@ public:
 	int getBlockWidth() const;
 	int getGridWidth() const;
 	int getGridHeight() const;
+	int getThreadCount() const;
+	const string& getAutotuneFile() const;
 };
 
 
@@ -30,6 +30,7 @@ public:
 	virtual ~AbstractBlockProcessor();
 	virtual void setSequences(const char* seq0, const char* seq1, int seq0_len, int seq1_len) = 0;
 	virtual void unsetSequences() = 0;
+	virtual void setScoreParameters(const score_params_t* score_params) = 0;
 
 	virtual score_t processBlock(cell_t *row, cell_t *col,
 			const int i0, const int j0, const int i1, const int j1,
@@ -19,6 +19,7 @@
  *
  ******************************************************************************/
 
+
 #include "CPUBlockProcessor.hpp"
 
 #include <stdio.h>
@@ -35,6 +36,12 @@
 CPUBlockProcessor::CPUBlockProcessor() {
 	this->seq0 = NULL;
 	this->seq1 = NULL;
+
+	this->score_params.match = DNA_MATCH;
+	this->score_params.mismatch = DNA_MISMATCH;
+	this->score_params.gap_open = DNA_GAP_OPEN;
+	this->score_params.gap_ext = DNA_GAP_EXT;
+	this->defaultScores = true;
 }
 
 CPUBlockProcessor::~CPUBlockProcessor() {
@@ -50,10 +57,25 @@ void CPUBlockProcessor::unsetSequences() {
 
 }
 
+/**
+ * Defines the match/mismatch scores and the gap penalties. If they are
+ * equal to the default DNA scores, the kernel with constant scores is used.
+ *
+ * @param score_params the new score parameters.
+ */
+void CPUBlockProcessor::setScoreParameters(const score_params_t* score_params) {
+	this->score_params = *score_params;
+	this->defaultScores = (score_params->match == DNA_MATCH
+			&& score_params->mismatch == DNA_MISMATCH
+			&& score_params->gap_open == DNA_GAP_OPEN
+			&& score_params->gap_ext == DNA_GAP_EXT);
+}
+
 
 /**
  * Implements the smith waterman recurrence function.
  *
+ * @param scoring the scoring policy (dna_scoring_t or score_params_t)
  * @param c0 char of sequence s0
  * @param c1 char of sequence s1
  * @param[in,out] 	e00 Input E[i][j-1]; Output E[i][j]
@@ -61,19 +83,22 @@ void CPUBlockProcessor::unsetSequences() {
  * @param[in] 		h01	Input H[i][j-1]
  * @param[in] 		h11 Input H[i-1][j-1]
  * @param[in] 		h10 Input H[i-1][j]
- * @param[out] 		h00 Ouput H[i][j]
+ * @param[out] 		h00 Output H[i][j]
  */
-static void sw(const unsigned char c0, const unsigned char c1,
+template <class SCORING>
+static inline void sw(const SCORING& scoring, const unsigned char c0, const unsigned char c1,
 			int *e00, int *f00, const int h01, const int h11, const int h10, int *h00) {
-    *e00 = MAX2(h01-DNA_GAP_OPEN, *e00)-DNA_GAP_EXT; // Horizontal propagation
-    *f00 = MAX2(h10-DNA_GAP_OPEN, *f00)-DNA_GAP_EXT; // Vertical propagation
-    int v1 = h11+((c1!=c0)?DNA_MISMATCH:DNA_MATCH);
-    *h00 = MAX4(0, v1, *e00, *f00);
+    *e00 = MAX2(h01-scoring.gap_open, *e00)-scoring.gap_ext; // Horizontal propagation
+    *f00 = MAX2(h10-scoring.gap_open, *f00)-scoring.gap_ext; // Vertical propagation
+    int v1 = h11+((c1!=c0)?scoring.mismatch:scoring.match);
+    /* E depends on the previous cell, so it is the last term of the max */
+    *h00 = MAX2(MAX2(MAX2(v1, *f00), 0), *e00);
 }
 
 /**
  * Implements the Needleman Wunsch recurrence function.
  *
+ * @param scoring the scoring policy (dna_scoring_t or score_params_t)
  * @param c0 char of sequence s0
  * @param c1 char of sequence s1
  * @param[in,out] 	e00 Input E[i][j-1]; Output E[i][j]
@@ -81,50 +106,37 @@ static void sw(const unsigned char c0, const unsigned char c1,
  * @param[in] 		h01	Input H[i][j-1]
  * @param[in] 		h11 Input H[i-1][j-1]
  * @param[in] 		h10 Input H[i-1][j]
- * @param[out] 		h00 Ouput H[i][j]
+ * @param[out] 		h00 Output H[i][j]
  */
-static void nw(const unsigned char c0, const unsigned char c1,
+template <class SCORING>
+static inline void nw(const SCORING& scoring, const unsigned char c0, const unsigned char c1,
 			int *e00, int *f00, const int h01, const int h11, const int h10, int *h00) {
 
-    *e00 = MAX2(h01-DNA_GAP_OPEN, *e00)-DNA_GAP_EXT; // Horizontal propagation
-    *f00 = MAX2(h10-DNA_GAP_OPEN, *f00)-DNA_GAP_EXT; // Vertical propagation
-    int v1 = h11+((c1!=c0)?DNA_MISMATCH:DNA_MATCH);
-    *h00 = MAX3(v1, *e00, *f00);
+    *e00 = MAX2(h01-scoring.gap_open, *e00)-scoring.gap_ext; // Horizontal propagation
+    *f00 = MAX2(h10-scoring.gap_open, *f00)-scoring.gap_ext; // Vertical propagation
+    int v1 = h11+((c1!=c0)?scoring.mismatch:scoring.match);
+    *h00 = MAX2(MAX2(v1, *f00), *e00);
 }
 
 /**
- * Executes the SW/NW recurrence function for the given block.
- * @param[in,out] 	row		Input: cells from the first row of the block, where
- * 									 row[k] represents cell (i0-1,j0+k);
- * 							Output: the same range is used for write, but the output represents the
- * 									last row of the block;
- * @param[in,out] 	col		Input: cells from the first column of the partition, where
- * 									col[k] represents cell (i0-1+k,j0-1). Note that
- * 									the col vector contains the diag cell (i0-1,j0-1).
- * 							Output: the same idea, but representing the last column of the partition.
- * 							 		Note that col[0] represents the diag cell (i0-1,j0-1).
+ * Recurrence kernel specialized at compile time.
  *
- * @param[in] 		i0	start row
- * @param[in] 		j0	start column
- * @param[in] 		i1	end row
- * @param[in] 		j1	end column
- * @return
+ * @tparam LOCAL true for Smith-Waterman, false for Needleman-Wunsch.
+ * @tparam SCORING scoring policy. It is received by value, so the penalties
+ * 		are kept in registers and do not alias the row/col vectors.
+ *
+ * @see CPUBlockProcessor::processBlock
  */
-score_t CPUBlockProcessor::processBlock(cell_t *row, cell_t *col,
-		const int i0, const int j0, const int i1, const int j1,
-		const int recurrenceType) {
+template <bool LOCAL, class SCORING>
+static score_t process_block(const SCORING scoring, const char* seq0, const char* seq1,
+		cell_t *row, cell_t *col, const int i0, const int j0, const int i1, const int j1) {
 	/* Initializing the best score of this block */
 	score_t block_best;
 	block_best.i = -1;
 	block_best.j = -1;
 	block_best.score = -INF;
 
-	/* sequence strings starting from the position i0 and j0. */
-	const char* seq0 = this->seq0 + i0;
-	const char* seq1 = this->seq1 + j0;
-
 	int h11 = col[0].h; // diagonal cell H[i-1][j-1]
-	//printf("[%d..%d][%d..%d] %d\n", i0, i1, j0, j1, h11);
 
 	for (int i=0; i<i1-i0; i++) {
 		/* Reads cells from the previous left-block */
@@ -138,10 +150,10 @@ score_t CPUBlockProcessor::processBlock(cell_t *row, cell_t *col,
 
 			/* Calculates H[i][j] */
 			int h00;
-			if (recurrenceType == SMITH_WATERMAN) {
-				sw(c, seq1[j], &e00, &f10, h01, h11, h10, &h00);
+			if (LOCAL) {
+				sw(scoring, c, seq1[j], &e00, &f10, h01, h11, h10, &h00);
 			} else {
-				nw(c, seq1[j], &e00, &f10, h01, h11, h10, &h00);
+				nw(scoring, c, seq1[j], &e00, &f10, h01, h11, h10, &h00);
 			}
 
 			/* Store the cells to be used in the next iteration */
@@ -166,10 +178,52 @@ score_t CPUBlockProcessor::processBlock(cell_t *row, cell_t *col,
 		col[i+1].h = h01;
 		col[i+1].e = e00;
 	}
-	//printf("[%d..%d][%d..%d] %d\n", i0, i1, j0, j1, h11);
+
+	return block_best;
+}
+
+/**
+ * Executes the SW/NW recurrence function for the given block.
+ * @param[in,out] 	row		Input: cells from the first row of the block, where
+ * 									 row[k] represents cell (i0-1,j0+k);
+ * 							Output: the same range is used for write, but the output represents the
+ * 									last row of the block;
+ * @param[in,out] 	col		Input: cells from the first column of the partition, where
+ * 									col[k] represents cell (i0-1+k,j0-1). Note that
+ * 									the col vector contains the diag cell (i0-1,j0-1).
+ * 							Output: the same idea, but representing the last column of the partition.
+ * 							 		Note that col[0] represents the diag cell (i0-1,j0-1).
+ *
+ * @param[in] 		i0	start row
+ * @param[in] 		j0	start column
+ * @param[in] 		i1	end row
+ * @param[in] 		j1	end column
+ * @return
+ */
+score_t CPUBlockProcessor::processBlock(cell_t *row, cell_t *col,
+		const int i0, const int j0, const int i1, const int j1,
+		const int recurrenceType) {
+	/* sequence strings starting from the position i0 and j0. */
+	const char* seq0 = this->seq0 + i0;
+	const char* seq1 = this->seq1 + j0;
+
+	/* Chooses the specialized kernel */
+	score_t block_best;
+	if (recurrenceType == SMITH_WATERMAN) {
+		if (defaultScores) {
+			block_best = process_block<true>(dna_scoring_t(), seq0, seq1, row, col, i0, j0, i1, j1);
+		} else {
+			block_best = process_block<true>(score_params, seq0, seq1, row, col, i0, j0, i1, j1);
+		}
+	} else {
+		if (defaultScores) {
+			block_best = process_block<false>(dna_scoring_t(), seq0, seq1, row, col, i0, j0, i1, j1);
+		} else {
+			block_best = process_block<false>(score_params, seq0, seq1, row, col, i0, j0, i1, j1);
+		}
+	}
 
 	if (DEBUG) printf("ProcessBlock (%d,%d)-(%d,%d) - best:(%d,%d,%d)\n", i0, j0, i1, j1, block_best.score, block_best.i, block_best.j);
 
 	return block_best;
 }
-
@@ -23,7 +23,7 @@
 #define CPUBLOCKPROCESSOR_HPP_
 
 #include "AbstractBlockProcessor.hpp"
-#include "../libmasa.hpp"
+#include "../IManager.hpp"
 
 /*
  * The score constants
@@ -34,8 +34,29 @@
 #define DNA_GAP_OPEN    (3)
 #define DNA_GAP_FIRST   (DNA_GAP_EXT+DNA_GAP_OPEN)
 
+/**
+ * Scoring policy with the default DNA scores as compile-time constants.
+ * It has the same members of score_params_t, so both types may be used
+ * as the SCORING parameter of the templated recurrence kernels.
+ */
+struct dna_scoring_t {
+	enum {
+		match = DNA_MATCH,
+		mismatch = DNA_MISMATCH,
+		gap_open = DNA_GAP_OPEN,
+		gap_ext = DNA_GAP_EXT
+	};
+};
 
-
+/**
+ * @brief Block processor that executes the SW/NW recurrence in the CPU.
+ *
+ * The recurrence is implemented by a kernel templated by the recurrence
+ * type (SW or NW) and by the scoring policy (dna_scoring_t or score_params_t).
+ * The kernel is chosen once per call of processBlock, so the inner loop does
+ * not test the recurrence type and, with the default scores, all the
+ * penalties are immediate values.
+ */
 class CPUBlockProcessor: public AbstractBlockProcessor {
 public:
 
@@ -44,11 +65,17 @@ public:
 
 	virtual void setSequences(const char* seq0, const char* seq1, int seq0_len, int seq1_len);
 	virtual void unsetSequences();
+	virtual void setScoreParameters(const score_params_t* score_params);
 	virtual score_t processBlock(cell_t *row, cell_t *col, const int i0, const int j0, const int i1, const int j1, const int recurrenceType);
 
-private:
+protected:
 	const char *seq0;
 	const char *seq1;
+
+	/** Match/mismatch scores and gap penalties */
+	score_params_t score_params;
+	/** true if score_params is equal to the default DNA scores */
+	bool defaultScores;
 };
 
 #endif /* CPUBLOCKPROCESSOR_HPP_ */
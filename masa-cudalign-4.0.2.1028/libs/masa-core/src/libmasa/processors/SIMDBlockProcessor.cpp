@@ -0,0 +1,489 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ *
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "SIMDBlockProcessor.hpp"
+
+#include <stdio.h>
+#include <limits.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86_ENABLED
+#include <immintrin.h>
+#endif
+
+#define DEBUG (0)
+
+/*
+ * Some macros
+ */
+#define MAX2(A,B) (((A)>(B))?(A):(B))
+
+/**
+ * Scalar recurrence for the rows [ia,ib) of the block. This is the same
+ * loop of CPUBlockProcessor::processBlock, used for the rows that do not
+ * fill a whole SIMD strip.
+ *
+ * @param h11 H value of cell (ia-1,-1), relative to the block.
+ * @param scoring the match/mismatch scores and gap penalties.
+ */
+static void process_rows(const char* seq0, const char* seq1,
+		cell_t* row, cell_t* col, const int width, const int ia, const int ib,
+		int h11, const bool local, const score_params_t scoring,
+		int* best_score, int* best_i, int* best_j) {
+	for (int i=ia; i<ib; i++) {
+		int h01 = col[i+1].h;	// H[i][j-1]
+		int e00 = col[i+1].e;	// E[i][j-1]
+
+		const unsigned char c = seq0[i];
+		for (int j=0; j<width; j++) {
+			int h10 = row[j].h; // H[i-1][j]
+			int f10 = row[j].f; // F[i-1][j]
+
+			e00 = MAX2(h01-scoring.gap_open, e00)-scoring.gap_ext; // Horizontal propagation
+			f10 = MAX2(h10-scoring.gap_open, f10)-scoring.gap_ext; // Vertical propagation
+			int h00 = h11+(((unsigned char)seq1[j]!=c)?scoring.mismatch:scoring.match);
+			h00 = MAX2(h00, MAX2(e00, f10));
+			if (local) {
+				h00 = MAX2(h00, 0);
+			}
+
+			h11 = h10;
+			h01 = h00;
+			row[j].h = h00;
+			row[j].f = f10;
+
+			if (*best_score < h00) {
+				*best_score = h00;
+				*best_i = i;
+				*best_j = j;
+			}
+		}
+
+		h11 = col[i+1].h;
+		col[i+1].h = h01;
+		col[i+1].e = e00;
+	}
+}
+
+#ifdef SIMD_X86_ENABLED
+
+/*
+ * SSE4.1 kernel: 4 lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+namespace simd_sse41 {
+	typedef __m128i vec_t;
+	typedef __m128i mask_t;
+	typedef int elem_t;
+	static const int LANES = 4;
+	static const bool SATURATED = false;
+	static const int ELEM_MIN = -INF;
+	static const int ELEM_MAX = INF;
+
+	static inline vec_t v_set1(int x) { return _mm_set1_epi32(x); }
+	static inline vec_t v_loadu(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void v_storeu(int* p, vec_t v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm_add_epi32(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm_sub_epi32(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm_max_epi32(a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm_min_epi32(a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm_cmpgt_epi32(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm_cmpeq_epi32(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return _mm_and_si128(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) { return _mm_insert_epi32(_mm_slli_si128(v, 4), x, 0); }
+	static inline int v_last(vec_t v) { return _mm_extract_epi32(v, 3); }
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+/*
+ * AVX2 kernel: 8 lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace simd_avx2 {
+	typedef __m256i vec_t;
+	typedef __m256i mask_t;
+	typedef int elem_t;
+	static const int LANES = 8;
+	static const bool SATURATED = false;
+	static const int ELEM_MIN = -INF;
+	static const int ELEM_MAX = INF;
+
+	static inline vec_t v_set1(int x) { return _mm256_set1_epi32(x); }
+	static inline vec_t v_loadu(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static inline void v_storeu(int* p, vec_t v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm256_add_epi32(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm256_sub_epi32(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm256_max_epi32(a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm256_min_epi32(a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm256_cmpgt_epi32(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm256_cmpeq_epi32(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return _mm256_and_si256(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm256_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) {
+		const vec_t idx = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+		return _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v, idx), _mm256_set1_epi32(x), 0x01);
+	}
+	static inline int v_last(vec_t v) { return _mm_extract_epi32(_mm256_extracti128_si256(v, 1), 3); }
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+/*
+ * AVX-512F kernel: 16 lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace simd_avx512 {
+	typedef __m512i vec_t;
+	typedef __mmask16 mask_t;
+	typedef int elem_t;
+	static const int LANES = 16;
+	static const bool SATURATED = false;
+	static const int ELEM_MIN = -INF;
+	static const int ELEM_MAX = INF;
+
+	/*
+	 * The zero-masked forms with all lanes enabled are the same instructions,
+	 * but GCC's unmasked wrappers pass an undefined source vector, which
+	 * triggers -Wmaybe-uninitialized once the kernel is inlined.
+	 */
+	static const mask_t ALL = (mask_t)-1;
+
+	static inline vec_t v_set1(int x) { return _mm512_set1_epi32(x); }
+	static inline vec_t v_loadu(const int* p) { return _mm512_loadu_si512((const void*)p); }
+	static inline void v_storeu(int* p, vec_t v) { _mm512_storeu_si512((void*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm512_add_epi32(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm512_sub_epi32(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm512_maskz_max_epi32(ALL, a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm512_maskz_min_epi32(ALL, a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm512_cmpgt_epi32_mask(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm512_cmpeq_epi32_mask(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return a & b; }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm512_mask_blend_epi32(m, a, b); }
+	static inline vec_t v_shift_in(vec_t v, int x) { return _mm512_maskz_alignr_epi32(ALL, v, _mm512_set1_epi32(x), 15); }
+	static inline int v_last(vec_t v) { return _mm_extract_epi32(_mm512_maskz_extracti32x4_epi32(0xF, v, 3), 3); }
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+/*
+ * SSE4.1 kernel: 8 saturated 16-bit lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+namespace simd_sse41_16 {
+	typedef __m128i vec_t;
+	typedef __m128i mask_t;
+	typedef short elem_t;
+	static const int LANES = 8;
+	static const bool SATURATED = true;
+	static const int ELEM_MIN = SHRT_MIN;
+	static const int ELEM_MAX = SHRT_MAX;
+
+	static inline vec_t v_set1(int x) { return _mm_set1_epi16(x); }
+	static inline vec_t v_loadu(const short* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void v_storeu(short* p, vec_t v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm_adds_epi16(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm_subs_epi16(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm_max_epi16(a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm_min_epi16(a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm_cmpgt_epi16(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm_cmpeq_epi16(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return _mm_and_si128(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) { return _mm_insert_epi16(_mm_slli_si128(v, 2), x, 0); }
+	static inline int v_last(vec_t v) { return (short)_mm_extract_epi16(v, 7); }
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+/*
+ * AVX2 kernel: 16 saturated 16-bit lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace simd_avx2_16 {
+	typedef __m256i vec_t;
+	typedef __m256i mask_t;
+	typedef short elem_t;
+	static const int LANES = 16;
+	static const bool SATURATED = true;
+	static const int ELEM_MIN = SHRT_MIN;
+	static const int ELEM_MAX = SHRT_MAX;
+
+	static inline vec_t v_set1(int x) { return _mm256_set1_epi16(x); }
+	static inline vec_t v_loadu(const short* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static inline void v_storeu(short* p, vec_t v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm256_adds_epi16(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm256_subs_epi16(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm256_max_epi16(a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm256_min_epi16(a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm256_cmpgt_epi16(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm256_cmpeq_epi16(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return _mm256_and_si256(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm256_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) {
+		/* low half: [x..x], high half: low half of v */
+		const vec_t carry = _mm256_permute2x128_si256(v, _mm256_set1_epi16(x), 0x02);
+		return _mm256_alignr_epi8(v, carry, 14);
+	}
+	static inline int v_last(vec_t v) { return (short)_mm_extract_epi16(_mm256_extracti128_si256(v, 1), 7); }
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+/*
+ * AVX-512BW kernel: 32 saturated 16-bit lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+namespace simd_avx512_16 {
+	typedef __m512i vec_t;
+	typedef __mmask32 mask_t;
+	typedef short elem_t;
+	static const int LANES = 32;
+	static const bool SATURATED = true;
+	static const int ELEM_MIN = SHRT_MIN;
+	static const int ELEM_MAX = SHRT_MAX;
+
+	/* element 0 comes from the second operand (index 32) */
+	static const short shift_idx[32] __attribute__ ((aligned (64))) = {
+		32, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+		15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30 };
+
+	static inline vec_t v_set1(int x) { return _mm512_set1_epi16(x); }
+	static inline vec_t v_loadu(const short* p) { return _mm512_loadu_si512((const void*)p); }
+	static inline void v_storeu(short* p, vec_t v) { _mm512_storeu_si512((void*)p, v); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm512_adds_epi16(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm512_subs_epi16(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm512_max_epi16(a, b); }
+	static inline vec_t v_min(vec_t a, vec_t b) { return _mm512_min_epi16(a, b); }
+	static inline mask_t v_cmpgt(vec_t a, vec_t b) { return _mm512_cmpgt_epi16_mask(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm512_cmpeq_epi16_mask(a, b); }
+	static inline mask_t m_and(mask_t a, mask_t b) { return a & b; }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm512_mask_blend_epi16(m, a, b); }
+	static inline vec_t v_shift_in(vec_t v, int x) {
+		return _mm512_permutex2var_epi16(v, _mm512_load_si512((const void*)shift_idx), _mm512_set1_epi16(x));
+	}
+	static inline int v_last(vec_t v) {
+		/* zero-masked, see simd_avx512 */
+		return (short)_mm_extract_epi16(_mm512_maskz_extracti32x4_epi32(0xF, v, 3), 7);
+	}
+
+#include "SIMDBlockProcessorKernel.hpp"
+}
+#pragma GCC pop_options
+
+#endif /* SIMD_X86_ENABLED */
+
+/**
+ * Creates the block processor.
+ *
+ * @param instructionSet one of SIMD_NONE, SIMD_SSE41, SIMD_AVX2, SIMD_AVX512
+ * 		or SIMD_AUTO. An instruction set not supported by the cpu is
+ * 		replaced by the best supported one.
+ * @param saturated if true, the blocks are first processed with saturated
+ * 		16-bit lanes, falling back to 32-bit lanes on overflow.
+ */
+SIMDBlockProcessor::SIMDBlockProcessor(int instructionSet, bool saturated) {
+	int detected = detectInstructionSet();
+	if (instructionSet == SIMD_AUTO || instructionSet > detected) {
+		instructionSet = detected;
+	}
+	this->instructionSet = instructionSet;
+	this->saturated = saturated;
+	this->saturatedBlocks = 0;
+	this->overflowBlocks = 0;
+
+	lanes = getLanes(instructionSet);
+
+	/* the 16-bit operations of AVX-512 are only available in AVX-512BW */
+	instructionSet16 = instructionSet;
+	if (instructionSet16 == SIMD_AVX512 && !hasAVX512BW()) {
+		instructionSet16 = SIMD_AVX2;
+	}
+	lanes16 = 2*getLanes(instructionSet16);
+	if (DEBUG) printf("SIMDBlockProcessor: %s (%d lanes)\n", getInstructionSetName(this->instructionSet), lanes);
+}
+
+SIMDBlockProcessor::~SIMDBlockProcessor() {
+	if (DEBUG) printf("SIMDBlockProcessor: 16-bit blocks: %lld. Overflows: %lld\n", saturatedBlocks, overflowBlocks);
+}
+
+/**
+ * Detects the best instruction set supported by the cpu.
+ *
+ * @return one of SIMD_NONE, SIMD_SSE41, SIMD_AVX2 or SIMD_AVX512.
+ */
+int SIMDBlockProcessor::detectInstructionSet() {
+#ifdef SIMD_X86_ENABLED
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SIMD_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return SIMD_AVX2;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return SIMD_SSE41;
+	}
+#endif
+	return SIMD_NONE;
+}
+
+/**
+ * @return true if the cpu supports the 16-bit operations of AVX-512.
+ */
+bool SIMDBlockProcessor::hasAVX512BW() {
+#ifdef SIMD_X86_ENABLED
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512bw");
+#else
+	return false;
+#endif
+}
+
+/**
+ * @return the number of 32-bit lanes of the instruction set.
+ */
+int SIMDBlockProcessor::getLanes(int instructionSet) {
+	switch (instructionSet) {
+	case SIMD_SSE41:  return 4;
+	case SIMD_AVX2:   return 8;
+	case SIMD_AVX512: return 16;
+	default:          return 1;
+	}
+}
+
+/**
+ * @return a printable name of the instruction set.
+ */
+const char* SIMDBlockProcessor::getInstructionSetName(int instructionSet) {
+	switch (instructionSet) {
+	case SIMD_SSE41:  return "SSE4.1";
+	case SIMD_AVX2:   return "AVX2";
+	case SIMD_AVX512: return "AVX-512F";
+	default:          return "none";
+	}
+}
+
+/**
+ * @return the instruction set used by this processor.
+ */
+int SIMDBlockProcessor::getInstructionSet() const {
+	return instructionSet;
+}
+
+/**
+ * @return the number of rows processed simultaneously.
+ */
+int SIMDBlockProcessor::getLanes() const {
+	return lanes;
+}
+
+/**
+ * @return true if the 16-bit lanes are used.
+ */
+bool SIMDBlockProcessor::isSaturated() const {
+	return saturated && instructionSet != SIMD_NONE;
+}
+
+/**
+ * @return the number of blocks processed with 16-bit lanes.
+ */
+long long SIMDBlockProcessor::getSaturatedBlocks() const {
+	return saturatedBlocks;
+}
+
+/**
+ * @return the number of blocks that overflowed the 16-bit lanes and
+ * were recomputed with 32-bit lanes.
+ */
+long long SIMDBlockProcessor::getOverflowBlocks() const {
+	return overflowBlocks;
+}
+
+/**
+ * Executes the SW/NW recurrence function for the given block.
+ *
+ * @copydoc CPUBlockProcessor::processBlock
+ */
+score_t SIMDBlockProcessor::processBlock(cell_t *row, cell_t *col,
+		const int i0, const int j0, const int i1, const int j1,
+		const int recurrenceType) {
+	const int height = i1-i0;
+	const int width = j1-j0;
+	if (instructionSet == SIMD_NONE || height < lanes || width <= 0) {
+		return CPUBlockProcessor::processBlock(row, col, i0, j0, i1, j1, recurrenceType);
+	}
+
+	const bool local = (recurrenceType == SMITH_WATERMAN);
+	score_t block_best;
+#ifdef SIMD_X86_ENABLED
+	if (saturated && height >= lanes16) {
+		bool processed;
+		switch (instructionSet16) {
+		case SIMD_AVX512:
+			processed = simd_avx512_16::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+			break;
+		case SIMD_AVX2:
+			processed = simd_avx2_16::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+			break;
+		default:
+			processed = simd_sse41_16::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+			break;
+		}
+		if (processed) {
+			__sync_add_and_fetch(&saturatedBlocks, 1);
+			return block_best;
+		}
+		/* the block was left untouched: recompute it with 32-bit lanes */
+		__sync_add_and_fetch(&overflowBlocks, 1);
+	}
+
+	switch (instructionSet) {
+	case SIMD_AVX512:
+		simd_avx512::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+		break;
+	case SIMD_AVX2:
+		simd_avx2::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+		break;
+	default:
+		simd_sse41::process_block(seq0+i0, seq1+j0, row, col, i0, j0, height, width, local, score_params, &block_best);
+		break;
+	}
+#else
+	block_best = CPUBlockProcessor::processBlock(row, col, i0, j0, i1, j1, recurrenceType);
+#endif
+
+	if (DEBUG) printf("ProcessBlock (%d,%d)-(%d,%d) - best:(%d,%d,%d)\n", i0, j0, i1, j1, block_best.score, block_best.i, block_best.j);
+
+	return block_best;
+}
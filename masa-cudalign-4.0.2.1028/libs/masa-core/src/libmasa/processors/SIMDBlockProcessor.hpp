@@ -0,0 +1,97 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ *
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef SIMDBLOCKPROCESSOR_HPP_
+#define SIMDBLOCKPROCESSOR_HPP_
+
+#include "CPUBlockProcessor.hpp"
+
+/** No SIMD instruction set available. The scalar processor is used. */
+#define SIMD_NONE		(0)
+/** 4 lanes of 32-bit integers (SSE4.1). */
+#define SIMD_SSE41		(1)
+/** 8 lanes of 32-bit integers (AVX2). */
+#define SIMD_AVX2		(2)
+/** 16 lanes of 32-bit integers (AVX-512F). */
+#define SIMD_AVX512		(3)
+
+/** Automatically detects the best instruction set through CPUID. */
+#define SIMD_AUTO		(-1)
+
+/**
+ * @brief Block processor that vectorizes the recurrence along anti-diagonals.
+ *
+ * The block is processed in horizontal strips with one row per SIMD lane.
+ * Lane k of the strip lags k columns behind lane 0, so all the lanes of
+ * a vector compute cells of the same anti-diagonal and the dependencies
+ * between adjacent rows are resolved with a single lane shift per step.
+ *
+ * The instruction set (SSE4.1, AVX2 or AVX-512F) is chosen at runtime
+ * through CPUID, and the scalar CPUBlockProcessor is used whenever none is
+ * available or the block is smaller than the vector width. The produced
+ * rows, columns and best scores are bit-identical to the scalar processor,
+ * so it may replace the CPUBlockProcessor in any AbstractBlockAligner.
+ *
+ * By default, each block is first processed with saturated 16-bit lanes,
+ * doubling the number of lanes. The cells are stored relative to a
+ * per-block offset, so only the range of scores inside the block must fit
+ * in 16 bits. Blocks that overflow are transparently recomputed with 32-bit
+ * lanes, and the borders are always produced as regular cell_t values.
+ */
+class SIMDBlockProcessor: public CPUBlockProcessor {
+public:
+
+	SIMDBlockProcessor(int instructionSet = SIMD_AUTO, bool saturated = true);
+	virtual ~SIMDBlockProcessor();
+
+	virtual score_t processBlock(cell_t *row, cell_t *col, const int i0, const int j0, const int i1, const int j1, const int recurrenceType);
+
+	int getInstructionSet() const;
+	int getLanes() const;
+	bool isSaturated() const;
+	long long getSaturatedBlocks() const;
+	long long getOverflowBlocks() const;
+	static const char* getInstructionSetName(int instructionSet);
+	static int detectInstructionSet();
+
+private:
+	/** Instruction set used by this processor (SIMD_NONE, SIMD_SSE41, ...) */
+	int instructionSet;
+	/** Number of 32-bit lanes of the chosen instruction set */
+	int lanes;
+
+	/** Tries the 16-bit lanes before the 32-bit lanes */
+	bool saturated;
+	/** Instruction set used with 16-bit lanes */
+	int instructionSet16;
+	/** Number of 16-bit lanes of instructionSet16 */
+	int lanes16;
+
+	/** Statistics: blocks processed with 16-bit lanes */
+	long long saturatedBlocks;
+	/** Statistics: blocks recomputed with 32-bit lanes */
+	long long overflowBlocks;
+
+	static bool hasAVX512BW();
+	static int getLanes(int instructionSet);
+};
+
+#endif /* SIMDBLOCKPROCESSOR_HPP_ */
@@ -0,0 +1,353 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ *
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/*
+ * Anti-diagonal kernel of the SIMDBlockProcessor.
+ *
+ * This file has no include guards on purpose. It is included once for each
+ * instruction set and lane width inside a namespace that defines the vector
+ * primitives (vec_t, mask_t, elem_t, LANES, SATURATED, v_add, v_max,
+ * v_shift_in, ...) and inside a "#pragma GCC target" region, so the same
+ * code is compiled for SSE4.1, AVX2 and AVX-512 in a single translation unit.
+ *
+ * With 16-bit lanes (SATURATED), the cells are stored relative to a
+ * per-block offset and the arithmetic saturates. If any H value gets close
+ * to the saturation limits the block is rejected and must be recomputed
+ * with 32-bit lanes.
+ */
+
+/**
+ * Cell with the lane width, used for the borders of the block.
+ */
+struct lane_cell_t {
+	elem_t h;
+	union {
+		elem_t f;
+		elem_t e;
+	};
+};
+
+/**
+ * Score parameters broadcast to all the lanes.
+ */
+struct vscore_t {
+	vec_t match;
+	vec_t mismatch;
+	vec_t gap_open;
+	vec_t gap_ext;
+	/** the zero score of the Smith-Waterman recurrence (relative to the offset) */
+	vec_t zero;
+};
+
+/**
+ * Computes one anti-diagonal step of the strip.
+ *
+ * @tparam LOCAL true for Smith-Waterman, false for Needleman-Wunsch.
+ * @tparam MASKED true if some lanes lie outside the block (first and last
+ * 		LANES-1 steps of the strip).
+ */
+template <bool LOCAL, bool MASKED>
+static inline void strip_step(const int t, const int width,
+		const elem_t* rev_seq1, const vscore_t& vs, const vec_t& vC0, const vec_t& vLane,
+		vec_t& vH, vec_t& vHprev, vec_t& vE, vec_t& vF,
+		vec_t& vBest, vec_t& vBestJ, vec_t& vMin, int& diag0, lane_cell_t* row) {
+
+	/* lane 0 reads from the input row; lane k reads from lane k-1 */
+	int h_up0 = 0;
+	int f_up0 = 0;
+	if (!MASKED || t < width) {
+		h_up0 = row[t].h;
+		f_up0 = row[t].f;
+	}
+	const vec_t vUp = v_shift_in(vH, h_up0);
+	const vec_t vFup = v_shift_in(vF, f_up0);
+	const vec_t vDiag = v_shift_in(vHprev, diag0);
+	diag0 = h_up0;
+
+	/* lane k compares seq0[k] with seq1[t-k] */
+	const vec_t vC1 = v_loadu(rev_seq1 + (width+LANES-2-t));
+	const vec_t vSub = v_blend(v_cmpeq(vC0, vC1), vs.mismatch, vs.match);
+
+	const vec_t vEn = v_sub(v_max(v_sub(vH, vs.gap_open), vE), vs.gap_ext); // Horizontal propagation
+	const vec_t vFn = v_sub(v_max(v_sub(vUp, vs.gap_open), vFup), vs.gap_ext); // Vertical propagation
+	vec_t vHn = v_max(v_add(vDiag, vSub), v_max(vEn, vFn));
+	if (LOCAL) {
+		vHn = v_max(vHn, vs.zero);
+	}
+
+	const vec_t vJ = v_sub(v_set1(t), vLane);
+	vHprev = vH;
+	if (MASKED) {
+		const mask_t active = m_and(v_cmpgt(vJ, v_set1(-1)), v_cmpgt(v_set1(width), vJ));
+		const mask_t better = m_and(active, v_cmpgt(vHn, vBest));
+		vH = v_blend(active, vH, vHn);
+		vE = v_blend(active, vE, vEn);
+		vF = v_blend(active, vF, vFn);
+		vBest = v_blend(better, vBest, vHn);
+		vBestJ = v_blend(better, vBestJ, vJ);
+		if (SATURATED) {
+			vMin = v_min(vMin, v_blend(active, vMin, vHn));
+		}
+	} else {
+		const mask_t better = v_cmpgt(vHn, vBest);
+		vH = vHn;
+		vE = vEn;
+		vF = vFn;
+		vBest = v_blend(better, vBest, vHn);
+		vBestJ = v_blend(better, vBestJ, vJ);
+		if (SATURATED) {
+			vMin = v_min(vMin, vHn);
+		}
+	}
+
+	/* the last lane produces the last row of the strip */
+	if (!MASKED || t >= LANES-1) {
+		const int j = t-(LANES-1);
+		row[j].h = v_last(vH);
+		row[j].f = v_last(vF);
+	}
+}
+
+/**
+ * Processes the rows [ia,ia+LANES) of the block.
+ *
+ * @param seq0 sequence 0 starting at the first row of the block.
+ * @param row first row of the block (in) and last row of the strip (out).
+ * @param col first column of the block (in) and last column of the block (out).
+ * @param width block width.
+ * @param ia first row of the strip, relative to the block.
+ * @param rev_seq1 sequence 1 of the block, reversed and padded with LANES-1
+ * 		elements on both sides.
+ * @param[in,out] diag H value of cell (ia-1,-1), relative to the block.
+ * @param vs the score parameters broadcast to all the lanes.
+ * @param[in,out] best_score best score of the block.
+ * @param[out] best_i row of the best score, relative to the block.
+ * @param[out] best_j column of the best score, relative to the block.
+ * @param[in,out] min_score lowest H value of the block (only if SATURATED).
+ */
+template <bool LOCAL>
+static void process_strip(const char* seq0, lane_cell_t* row, lane_cell_t* col,
+		const int width, const int ia, const elem_t* rev_seq1, int* diag,
+		const vscore_t& vs, int* best_score, int* best_i, int* best_j,
+		int* min_score) {
+	elem_t tmp_h[LANES] __attribute__ ((aligned (64)));
+	elem_t tmp_e[LANES] __attribute__ ((aligned (64)));
+	elem_t tmp_c[LANES] __attribute__ ((aligned (64)));
+	elem_t tmp_l[LANES] __attribute__ ((aligned (64)));
+
+	for (int k=0; k<LANES; k++) {
+		tmp_h[k] = col[ia+k+1].h;
+		tmp_e[k] = col[ia+k+1].e;
+		tmp_c[k] = (unsigned char)seq0[ia+k];
+		tmp_l[k] = k;
+	}
+	const vec_t vC0 = v_loadu(tmp_c);
+	const vec_t vLane = v_loadu(tmp_l);
+
+	/*
+	 * While lane k is outside the block, vH holds H[ia+k][-1], which is
+	 * exactly the left and diagonal input of lanes k and k+1.
+	 */
+	vec_t vH = v_loadu(tmp_h);
+	vec_t vHprev = vH;
+	vec_t vE = v_loadu(tmp_e);
+	vec_t vF = v_set1(ELEM_MIN);
+	vec_t vBest = v_set1(ELEM_MIN);
+	vec_t vBestJ = v_set1(-1);
+	vec_t vMin = v_set1(ELEM_MAX);
+	int diag0 = *diag;
+
+	/* old H[ia+LANES-1][-1] is the diagonal input of the next strip */
+	*diag = tmp_h[LANES-1];
+
+	const int steps = width+LANES-1;
+	const int p1 = (LANES-1 < width) ? LANES-1 : width;
+	int t = 0;
+	for (; t<p1; t++) {
+		strip_step<LOCAL, true>(t, width, rev_seq1, vs, vC0, vLane, vH, vHprev, vE, vF, vBest, vBestJ, vMin, diag0, row);
+	}
+	for (; t<width; t++) {
+		strip_step<LOCAL, false>(t, width, rev_seq1, vs, vC0, vLane, vH, vHprev, vE, vF, vBest, vBestJ, vMin, diag0, row);
+	}
+	for (; t<steps; t++) {
+		strip_step<LOCAL, true>(t, width, rev_seq1, vs, vC0, vLane, vH, vHprev, vE, vF, vBest, vBestJ, vMin, diag0, row);
+	}
+
+	/* Store cells to the next right block */
+	v_storeu(tmp_h, vH);
+	v_storeu(tmp_e, vE);
+	for (int k=0; k<LANES; k++) {
+		col[ia+k+1].h = tmp_h[k];
+		col[ia+k+1].e = tmp_e[k];
+	}
+
+	if (SATURATED) {
+		v_storeu(tmp_h, vMin);
+		for (int k=0; k<LANES; k++) {
+			if (*min_score > tmp_h[k]) {
+				*min_score = tmp_h[k];
+			}
+		}
+	}
+
+	/* Lanes are visited in row order, keeping the scalar tie-breaking */
+	v_storeu(tmp_h, vBest);
+	v_storeu(tmp_e, vBestJ);
+	for (int k=0; k<LANES; k++) {
+		if (*best_score < tmp_h[k]) {
+			*best_score = tmp_h[k];
+			*best_i = ia+k;
+			*best_j = tmp_e[k];
+		}
+	}
+}
+
+/**
+ * Processes the block with the current instruction set. The rows that do
+ * not fill a whole strip are processed by the scalar code.
+ *
+ * With SATURATED lanes, the block is rejected (returning false) if any
+ * value does not fit in the lane width, and the row and column are left
+ * untouched in this case.
+ *
+ * @param[out] block_best the best score of the block.
+ * @return true if the block was processed.
+ * @see CPUBlockProcessor::processBlock
+ */
+static bool process_block(const char* seq0, const char* seq1,
+		cell_t *row, cell_t *col, const int i0, const int j0,
+		const int height, const int width, const bool local,
+		const score_params_t scoring, score_t* block_best) {
+	/*
+	 * The H values of the lanes are relative to the offset, and they must
+	 * stay in [lo,hi] so that no operation saturates.
+	 */
+	int offset = 0;
+	int lo = ELEM_MIN;
+	int hi = ELEM_MAX;
+	if (SATURATED) {
+		if (width+2*LANES > ELEM_MAX) {
+			return false;
+		}
+		int margin = MAX2(scoring.gap_open+scoring.gap_ext, MAX2(scoring.match, -scoring.mismatch));
+		lo = ELEM_MIN+margin;
+		hi = ELEM_MAX-margin;
+
+		int min_h = col[0].h;
+		int max_h = col[0].h;
+		for (int j=0; j<width; j++) {
+			if (min_h > row[j].h) min_h = row[j].h;
+			if (max_h < row[j].h) max_h = row[j].h;
+		}
+		for (int i=1; i<=height; i++) {
+			if (min_h > col[i].h) min_h = col[i].h;
+			if (max_h < col[i].h) max_h = col[i].h;
+		}
+		if ((long long)max_h - min_h > (long long)hi - lo) {
+			return false;
+		}
+		offset = min_h + (max_h - min_h)/2;
+	}
+
+	/* Converts the borders to the lane width */
+	lane_cell_t* lane_row = new lane_cell_t[width+height+1];
+	lane_cell_t* lane_col = lane_row + width;
+	bool fits = true;
+	for (int j=0; j<width; j++) {
+		const int f = row[j].f - offset;
+		fits &= (f <= hi);
+		lane_row[j].h = row[j].h - offset;
+		lane_row[j].f = MAX2(f, ELEM_MIN);
+	}
+	for (int i=0; i<=height; i++) {
+		const int e = col[i].e - offset;
+		fits &= (e <= hi);
+		lane_col[i].h = col[i].h - offset;
+		lane_col[i].e = MAX2(e, ELEM_MIN);
+	}
+	if (!fits) {
+		delete[] lane_row;
+		return false;
+	}
+
+	/* rev_seq1[p] = seq1[width+LANES-2-p], padded with LANES-1 sentinels */
+	const int rev_len = width+2*(LANES-1);
+	elem_t* rev_seq1 = new elem_t[rev_len];
+	for (int p=0; p<rev_len; p++) {
+		const int j = width+LANES-2-p;
+		rev_seq1[p] = (j >= 0 && j < width) ? (unsigned char)seq1[j] : -1;
+	}
+
+	vscore_t vs;
+	vs.match = v_set1(scoring.match);
+	vs.mismatch = v_set1(scoring.mismatch);
+	vs.gap_open = v_set1(scoring.gap_open);
+	vs.gap_ext = v_set1(scoring.gap_ext);
+	vs.zero = v_set1(MAX2(-offset, ELEM_MIN));
+
+	/* the scalar code stores the old H[-1][width-1] in col[0] */
+	const int corner = row[width-1].h;
+	int diag = lane_col[0].h;
+
+	int best_score = ELEM_MIN;
+	int best_i = -1;
+	int best_j = -1;
+	int min_score = ELEM_MAX;
+	int ia = 0;
+	for (; ia+LANES<=height; ia+=LANES) {
+		if (local) {
+			process_strip<true>(seq0, lane_row, lane_col, width, ia, rev_seq1, &diag, vs, &best_score, &best_i, &best_j, &min_score);
+		} else {
+			process_strip<false>(seq0, lane_row, lane_col, width, ia, rev_seq1, &diag, vs, &best_score, &best_i, &best_j, &min_score);
+		}
+	}
+	delete[] rev_seq1;
+
+	if (SATURATED && (best_score > hi || min_score < lo)) {
+		delete[] lane_row;
+		return false;
+	}
+
+	/* Converts the borders back to cell_t */
+	for (int j=0; j<width; j++) {
+		row[j].h = lane_row[j].h + offset;
+		row[j].f = lane_row[j].f + offset;
+	}
+	for (int i=1; i<=ia; i++) {
+		col[i].h = lane_col[i].h + offset;
+		col[i].e = lane_col[i].e + offset;
+	}
+	delete[] lane_row;
+
+	block_best->score = (best_i >= 0) ? best_score + offset : -INF;
+	if (ia < height) {
+		process_rows(seq0, seq1, row, col, width, ia, height, diag + offset, local, scoring, &block_best->score, &best_i, &best_j);
+	}
+	col[0].h = corner;
+
+	block_best->i = -1;
+	block_best->j = -1;
+	if (best_i >= 0) {
+		block_best->i = i0+best_i;
+		block_best->j = j0+best_j;
+	}
+	return true;
+}
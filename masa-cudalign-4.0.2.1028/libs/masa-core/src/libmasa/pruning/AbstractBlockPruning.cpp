@@ -43,6 +43,10 @@ void AbstractBlockPruning::updateBestScore(int score) {
 	}
 }
 
+int AbstractBlockPruning::getBestScore() const {
+	return bestScore;
+}
+
 const Grid* AbstractBlockPruning::getGrid() const {
 	return grid;
 }
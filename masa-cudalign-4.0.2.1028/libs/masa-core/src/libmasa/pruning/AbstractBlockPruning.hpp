@@ -32,6 +32,7 @@ public:
 	virtual ~AbstractBlockPruning();
 
 	void updateBestScore(int score);
+	int getBestScore() const;
 	const Grid* getGrid() const;
 	void setGrid(const Grid* grid);
 	void setSuperPartition(Partition superPartition);
@@ -0,0 +1,329 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ *
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "WavefrontScheduler.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../common/Tracer.hpp"
+
+#define DEBUG (0)
+
+/**
+ * Creates the pool of threads.
+ *
+ * @param threadCount number of threads, including the thread that will
+ * 		call the execute() method. Values lower than 1 are set to 1.
+ */
+WavefrontScheduler::WavefrontScheduler(int threadCount) {
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+	this->threadCount = threadCount;
+	this->gridWidth = 0;
+	this->gridHeight = 0;
+	this->function = NULL;
+	this->arg = NULL;
+	this->dependencies = NULL;
+	this->remainingBlocks = 0;
+	this->readyBlocks = 0;
+	this->idleWorkers = 0;
+	this->activeWorkers = 0;
+	this->generation = 0;
+	this->terminate = false;
+	this->stolenBlocks = 0;
+
+	pthread_mutex_init(&jobMutex, NULL);
+	pthread_cond_init(&jobCondition, NULL);
+	pthread_cond_init(&doneCondition, NULL);
+	pthread_mutex_init(&idleMutex, NULL);
+	pthread_cond_init(&idleCondition, NULL);
+
+	workers = new worker_t[threadCount];
+	for (int i=0; i<threadCount; i++) {
+		workers[i].scheduler = this;
+		workers[i].id = i;
+		pthread_mutex_init(&workers[i].mutex, NULL);
+	}
+	for (int i=1; i<threadCount; i++) {
+		int rc = pthread_create(&workers[i].thread, NULL, staticFunctionThread, (void*)&workers[i]);
+		if (rc) {
+			fprintf(stderr, "WavefrontScheduler ERROR; return code from pthread_create() is %d\n", rc);
+			exit(-1);
+		}
+	}
+}
+
+/**
+ * Stops and joins all the threads of the pool.
+ */
+WavefrontScheduler::~WavefrontScheduler() {
+	pthread_mutex_lock(&jobMutex);
+	terminate = true;
+	pthread_cond_broadcast(&jobCondition);
+	pthread_mutex_unlock(&jobMutex);
+
+	for (int i=1; i<threadCount; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (int i=0; i<threadCount; i++) {
+		pthread_mutex_destroy(&workers[i].mutex);
+	}
+	delete[] workers;
+
+	pthread_cond_destroy(&idleCondition);
+	pthread_mutex_destroy(&idleMutex);
+	pthread_cond_destroy(&doneCondition);
+	pthread_cond_destroy(&jobCondition);
+	pthread_mutex_destroy(&jobMutex);
+}
+
+/**
+ * @return the number of threads of the pool, including the calling thread.
+ */
+int WavefrontScheduler::getThreadCount() const {
+	return threadCount;
+}
+
+/**
+ * @return the number of blocks stolen from the queue of other threads.
+ */
+long long WavefrontScheduler::getStolenBlocks() const {
+	return stolenBlocks;
+}
+
+/**
+ * Executes all the blocks of the grid, returning only after the last one.
+ * The function is called exactly once for each block, and block (bx,by)
+ * is only called after blocks (bx-1,by) and (bx,by-1) have returned.
+ *
+ * @param gridWidth width of the grid in blocks.
+ * @param gridHeight height of the grid in blocks.
+ * @param function function called for each block.
+ * @param arg argument passed to the function.
+ */
+void WavefrontScheduler::execute(int gridWidth, int gridHeight,
+		block_function_t function, void* arg) {
+	if (gridWidth <= 0 || gridHeight <= 0) {
+		return;
+	}
+
+	if (threadCount == 1) {
+		/* No threads: serial execution in anti-diagonal order */
+		for (int d = 0; d < gridWidth+gridHeight-1; d++) {
+			for (int bx = 0; bx < gridWidth && bx <= d; bx++) {
+				int by = d - bx;
+				if (by < gridHeight) {
+					function(arg, bx, by);
+				}
+			}
+		}
+		return;
+	}
+
+	this->gridWidth = gridWidth;
+	this->gridHeight = gridHeight;
+	this->function = function;
+	this->arg = arg;
+	this->remainingBlocks = gridWidth*gridHeight;
+	this->dependencies = new int[gridWidth*gridHeight];
+	for (int by = 0; by < gridHeight; by++) {
+		for (int bx = 0; bx < gridWidth; bx++) {
+			dependencies[by*gridWidth + bx] = (bx > 0) + (by > 0);
+		}
+	}
+
+	/* The top-left block is the only one without dependencies */
+	pushBlock(&workers[0], 0);
+
+	pthread_mutex_lock(&jobMutex);
+	activeWorkers = threadCount-1;
+	generation++;
+	pthread_cond_broadcast(&jobCondition);
+	pthread_mutex_unlock(&jobMutex);
+
+	executeJob(&workers[0]);
+
+	/* Waits until every pool thread leaves the job */
+	pthread_mutex_lock(&jobMutex);
+	while (activeWorkers > 0) {
+		pthread_cond_wait(&doneCondition, &jobMutex);
+	}
+	pthread_mutex_unlock(&jobMutex);
+
+	delete[] dependencies;
+	dependencies = NULL;
+	if (DEBUG) printf("WavefrontScheduler: %dx%d blocks. Stolen: %lld\n", gridWidth, gridHeight, stolenBlocks);
+}
+
+void* WavefrontScheduler::staticFunctionThread(void* arg) {
+	worker_t* worker = (worker_t*)arg;
+	Tracer::setThreadName("wavefront worker");
+	worker->scheduler->executeLoop(worker);
+	return NULL;
+}
+
+/**
+ * Main loop of the pool threads. Waits for a new job, executes it
+ * and notifies its conclusion.
+ */
+void WavefrontScheduler::executeLoop(worker_t* worker) {
+	int seenGeneration = 0;
+	while (true) {
+		pthread_mutex_lock(&jobMutex);
+		while (!terminate && generation == seenGeneration) {
+			pthread_cond_wait(&jobCondition, &jobMutex);
+		}
+		if (terminate) {
+			pthread_mutex_unlock(&jobMutex);
+			break;
+		}
+		seenGeneration = generation;
+		pthread_mutex_unlock(&jobMutex);
+
+		executeJob(worker);
+
+		pthread_mutex_lock(&jobMutex);
+		activeWorkers--;
+		if (activeWorkers == 0) {
+			pthread_cond_signal(&doneCondition);
+		}
+		pthread_mutex_unlock(&jobMutex);
+	}
+}
+
+/**
+ * Executes ready blocks until all the blocks of the grid are done.
+ */
+void WavefrontScheduler::executeJob(worker_t* worker) {
+	int block;
+	while (true) {
+		if (popBlock(worker, &block)) {
+			int bx = block % gridWidth;
+			int by = block / gridWidth;
+			function(arg, bx, by);
+			releaseBlock(worker, bx, by);
+			if (__sync_sub_and_fetch(&remainingBlocks, 1) == 0) {
+				/* Wakes up the threads still waiting for blocks */
+				pthread_mutex_lock(&idleMutex);
+				pthread_cond_broadcast(&idleCondition);
+				pthread_mutex_unlock(&idleMutex);
+			}
+		} else if (__sync_add_and_fetch(&remainingBlocks, 0) == 0) {
+			break;
+		} else {
+			waitBlock();
+		}
+	}
+}
+
+/**
+ * Sleeps until some block is ready or all the blocks are done.
+ *
+ * The idleWorkers increment and the readyBlocks test are ordered by full
+ * barriers, as are the readyBlocks increment and the idleWorkers test in
+ * pushBlock(). So either this thread sees the new block or the pusher sees
+ * this thread and signals it under idleMutex.
+ */
+void WavefrontScheduler::waitBlock() {
+	pthread_mutex_lock(&idleMutex);
+	__sync_add_and_fetch(&idleWorkers, 1);
+	while (__sync_add_and_fetch(&readyBlocks, 0) <= 0
+			&& __sync_add_and_fetch(&remainingBlocks, 0) > 0) {
+		pthread_cond_wait(&idleCondition, &idleMutex);
+	}
+	__sync_sub_and_fetch(&idleWorkers, 1);
+	pthread_mutex_unlock(&idleMutex);
+}
+
+/**
+ * Obtains a ready block, first from the worker's own queue (newest block)
+ * and then from the other queues (oldest block).
+ *
+ * @return true if a block was obtained.
+ */
+bool WavefrontScheduler::popBlock(worker_t* worker, int* block) {
+	bool found = false;
+	pthread_mutex_lock(&worker->mutex);
+	if (!worker->queue.empty()) {
+		*block = worker->queue.back();
+		worker->queue.pop_back();
+		found = true;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+	if (found) {
+		__sync_sub_and_fetch(&readyBlocks, 1);
+		return true;
+	}
+
+	for (int k = 1; k < threadCount && !found; k++) {
+		worker_t* victim = &workers[(worker->id + k) % threadCount];
+		pthread_mutex_lock(&victim->mutex);
+		if (!victim->queue.empty()) {
+			*block = victim->queue.front();
+			victim->queue.pop_front();
+			found = true;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+	}
+	if (found) {
+		__sync_sub_and_fetch(&readyBlocks, 1);
+		__sync_add_and_fetch(&stolenBlocks, 1);
+	}
+	return found;
+}
+
+/**
+ * Enqueues a ready block in the worker's queue, waking up one idle thread.
+ */
+void WavefrontScheduler::pushBlock(worker_t* worker, int block) {
+	pthread_mutex_lock(&worker->mutex);
+	worker->queue.push_back(block);
+	pthread_mutex_unlock(&worker->mutex);
+
+	__sync_add_and_fetch(&readyBlocks, 1);
+	if (__sync_add_and_fetch(&idleWorkers, 0) > 0) {
+		pthread_mutex_lock(&idleMutex);
+		pthread_cond_signal(&idleCondition);
+		pthread_mutex_unlock(&idleMutex);
+	}
+}
+
+/**
+ * Decrements the dependency counters of the right and bottom neighbors of
+ * block (bx,by), enqueueing them when they become ready. The bottom block
+ * is pushed last, so it is the next one executed by this worker.
+ */
+void WavefrontScheduler::releaseBlock(worker_t* worker, int bx, int by) {
+	if (bx+1 < gridWidth) {
+		int next = by*gridWidth + bx+1;
+		if (__sync_sub_and_fetch(&dependencies[next], 1) == 0) {
+			pushBlock(worker, next);
+		}
+	}
+	if (by+1 < gridHeight) {
+		int next = (by+1)*gridWidth + bx;
+		if (__sync_sub_and_fetch(&dependencies[next], 1) == 0) {
+			pushBlock(worker, next);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ *
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef WAVEFRONTSCHEDULER_HPP_
+#define WAVEFRONTSCHEDULER_HPP_
+
+#include <pthread.h>
+#include <deque>
+using namespace std;
+
+/**
+ * @brief Executes the blocks of a grid in a pool of threads, respecting the
+ * wavefront dependencies of the DP matrix.
+ *
+ * Block (bx,by) depends on blocks (bx-1,by) and (bx,by-1). Each block has a
+ * dependency counter, and as soon as it reaches zero the block is pushed
+ * to the queue of the thread that released it. Each thread pops its own
+ * queue in LIFO order, keeping the row/column chunks in cache, and steals
+ * the oldest blocks of the other threads when its queue is empty. So all
+ * the independent blocks of the same anti-diagonal may be executed
+ * simultaneously. Threads without ready blocks sleep until a new block is
+ * released or the grid is finished.
+ *
+ * The threads are created once and reused by every call to execute(). The
+ * calling thread also works as one of the threads of the pool.
+ */
+class WavefrontScheduler {
+public:
+	/**
+	 * Function called for each block of the grid.
+	 *
+	 * @param arg the argument given in the execute() method.
+	 * @param bx horizontal block coordinate.
+	 * @param by vertical block coordinate.
+	 */
+	typedef void (*block_function_t)(void* arg, int bx, int by);
+
+	WavefrontScheduler(int threadCount);
+	virtual ~WavefrontScheduler();
+
+	void execute(int gridWidth, int gridHeight, block_function_t function, void* arg);
+
+	int getThreadCount() const;
+	long long getStolenBlocks() const;
+
+private:
+	/** Private state of each thread of the pool */
+	struct worker_t {
+		/** the scheduler that owns this worker */
+		WavefrontScheduler* scheduler;
+		/** worker id. Worker 0 is the thread that calls execute() */
+		int id;
+		/** thread handler (not used in worker 0) */
+		pthread_t thread;
+		/** protects the ready queue */
+		pthread_mutex_t mutex;
+		/** ids of the blocks ready for execution */
+		deque<int> queue;
+	};
+
+	/** Number of threads, including the calling thread */
+	int threadCount;
+	/** Workers of the pool */
+	worker_t* workers;
+
+	/* Current job */
+	int gridWidth;
+	int gridHeight;
+	block_function_t function;
+	void* arg;
+	/** Number of unfinished dependencies of each block */
+	int* dependencies;
+	/** Number of blocks not executed yet */
+	int remainingBlocks;
+	/** Number of blocks waiting in the queues */
+	int readyBlocks;
+	/** Number of threads parked in idleCondition */
+	int idleWorkers;
+	/** Number of pool threads still executing the current job */
+	int activeWorkers;
+	/** Incremented for each new job */
+	int generation;
+	/** Tells the pool threads to exit */
+	bool terminate;
+
+	/** Statistics: number of blocks executed by a thread that did not release it */
+	long long stolenBlocks;
+
+	pthread_mutex_t jobMutex;
+	pthread_cond_t jobCondition;
+	pthread_cond_t doneCondition;
+	pthread_mutex_t idleMutex;
+	pthread_cond_t idleCondition;
+
+	static void* staticFunctionThread(void* arg);
+	void executeLoop(worker_t* worker);
+	void executeJob(worker_t* worker);
+	void waitBlock();
+	bool popBlock(worker_t* worker, int* block);
+	void pushBlock(worker_t* worker, int block);
+	void releaseBlock(worker_t* worker, int bx, int by);
+};
+
+#endif /* WAVEFRONTSCHEDULER_HPP_ */
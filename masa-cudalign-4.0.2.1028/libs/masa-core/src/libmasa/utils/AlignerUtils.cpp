@@ -20,9 +20,16 @@
  ******************************************************************************/
 
 #include "AlignerUtils.hpp"
+#include "../processors/SIMDBlockProcessor.hpp"
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86_ENABLED
+#include <immintrin.h>
+#endif
 
 #define MAX2(A,B) (((A)>(B))?(A):(B))
 
@@ -47,6 +54,148 @@ void AlignerUtils::splitBlocksEvenly(int* pos, int j0, int j1, int blocks) {
 
 
 
+/*
+ * The cells are loaded as (h,e) pairs, so the odd lanes of each vector hold
+ * the E components. The scan stops in the first vector where any sum
+ * reaches the goal score and the exact cell is found by the scalar tail.
+ */
+
+#ifdef SIMD_X86_ENABLED
+
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+static int find_candidate_sse41(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty) {
+	const __m128i vOpen = _mm_setr_epi32(0, gap_open_penalty, 0, gap_open_penalty);
+	const __m128i vLimit = _mm_set1_epi32(goalScore-1);
+	int k = 0;
+	for (; k+4 <= len; k+=4) {
+		__m128i s0 = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(buffer+k)), _mm_loadu_si128((const __m128i*)(base+k)));
+		__m128i s1 = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(buffer+k+2)), _mm_loadu_si128((const __m128i*)(base+k+2)));
+		__m128i m = _mm_or_si128(_mm_cmpgt_epi32(_mm_add_epi32(s0, vOpen), vLimit),
+				_mm_cmpgt_epi32(_mm_add_epi32(s1, vOpen), vLimit));
+		if (!_mm_testz_si128(m, m)) {
+			break;
+		}
+	}
+	return k;
+}
+
+static int find_best_sse41(const cell_t* buffer, int len, int* best) {
+	const __m128i vMin = _mm_set1_epi32(INT_MIN);
+	__m128i vMax = vMin;
+	int k = 0;
+	for (; k+2 <= len; k+=2) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(buffer+k));
+		vMax = _mm_max_epi32(vMax, _mm_blend_epi16(v, vMin, 0xCC));
+	}
+	vMax = _mm_max_epi32(vMax, _mm_shuffle_epi32(vMax, _MM_SHUFFLE(1,0,3,2)));
+	*best = _mm_cvtsi128_si32(vMax);
+	return k;
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+static int find_candidate_avx2(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty) {
+	const __m256i vOpen = _mm256_setr_epi32(0, gap_open_penalty, 0, gap_open_penalty, 0, gap_open_penalty, 0, gap_open_penalty);
+	const __m256i vLimit = _mm256_set1_epi32(goalScore-1);
+	int k = 0;
+	for (; k+8 <= len; k+=8) {
+		__m256i s0 = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(buffer+k)), _mm256_loadu_si256((const __m256i*)(base+k)));
+		__m256i s1 = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(buffer+k+4)), _mm256_loadu_si256((const __m256i*)(base+k+4)));
+		__m256i m = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_add_epi32(s0, vOpen), vLimit),
+				_mm256_cmpgt_epi32(_mm256_add_epi32(s1, vOpen), vLimit));
+		if (!_mm256_testz_si256(m, m)) {
+			break;
+		}
+	}
+	return k;
+}
+
+static int find_best_avx2(const cell_t* buffer, int len, int* best) {
+	const __m256i vMin = _mm256_set1_epi32(INT_MIN);
+	__m256i vMax = vMin;
+	int k = 0;
+	for (; k+4 <= len; k+=4) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buffer+k));
+		vMax = _mm256_max_epi32(vMax, _mm256_blend_epi32(v, vMin, 0xAA));
+	}
+	__m128i vMax4 = _mm_max_epi32(_mm256_castsi256_si128(vMax), _mm256_extracti128_si256(vMax, 1));
+	vMax4 = _mm_max_epi32(vMax4, _mm_shuffle_epi32(vMax4, _MM_SHUFFLE(1,0,3,2)));
+	*best = _mm_cvtsi128_si32(vMax4);
+	return k;
+}
+#pragma GCC pop_options
+
+#endif
+
+/**
+ * @return the instruction set used by the matching functions.
+ */
+static int get_instruction_set() {
+	static int instructionSet = -1;
+	if (instructionSet == -1) {
+		instructionSet = SIMDBlockProcessor::detectInstructionSet();
+	}
+	return instructionSet;
+}
+
+/**
+ * Finds the first cell where the matching procedure must stop, i.e.,
+ * the first k where \f$base[k].h+buffer[k].h \ge goal\f$ or
+ * \f$base[k].e+buffer[k].e+gap\_open \ge goal\f$.
+ *
+ * @return the index of the cell or len if the goal score is not reached.
+ */
+int AlignerUtils::findMatchCandidate(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty) {
+	int k = 0;
+#ifdef SIMD_X86_ENABLED
+	int instructionSet = get_instruction_set();
+	if (instructionSet >= SIMD_AVX2) {
+		k = find_candidate_avx2(buffer, base, len, goalScore, gap_open_penalty);
+	} else if (instructionSet == SIMD_SSE41) {
+		k = find_candidate_sse41(buffer, base, len, goalScore, gap_open_penalty);
+	}
+#endif
+	for (; k < len; k++) {
+		int sum_match = base[k].h + buffer[k].h;
+		int sum_gap = base[k].e + buffer[k].e + gap_open_penalty;
+		if (sum_match >= goalScore || sum_gap >= goalScore) {
+			break;
+		}
+	}
+	return k;
+}
+
+/**
+ * Finds the cell with the highest H score. In case of ties, the first
+ * cell is returned.
+ *
+ * @return the index of the best cell, or 0 if no cell is greater than -INF.
+ */
+int AlignerUtils::findBestCell(const cell_t* buffer, int len) {
+	int best_score = -INF;
+	int k = 0;
+#ifdef SIMD_X86_ENABLED
+	int instructionSet = get_instruction_set();
+	if (instructionSet >= SIMD_AVX2) {
+		k = find_best_avx2(buffer, len, &best_score);
+	} else if (instructionSet == SIMD_SSE41) {
+		k = find_best_sse41(buffer, len, &best_score);
+	}
+#endif
+	for (; k < len; k++) {
+		if (best_score < buffer[k].h) {
+			best_score = buffer[k].h;
+		}
+	}
+	if (best_score <= -INF) {
+		return 0;
+	}
+	for (k = 0; buffer[k].h != best_score; k++);
+	return k;
+}
+
 match_result_t AlignerUtils::matchColumn(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty) {
 	//printf ( "BUSOUT[%d..%d](%d) goal: %d\n", i, i+len, len, goal );
 	//cell_t* h_busOut = &col[i];
@@ -56,7 +205,9 @@ match_result_t AlignerUtils::matchColumn(const cell_t* buffer, const cell_t* bas
 	match_result_t match_result;
 	match_result.found = false;
 
-	for ( int k = 0; k < len && !end; k++ ) {
+	/* skips the cells that cannot stop the matching procedure */
+	int k0 = DEBUG ? 0 : findMatchCandidate(buffer, base, len, goalScore, gap_open_penalty);
+	for ( int k = k0; k < len && !end; k++ ) {
 		int sum_match = base[k].h + buffer[k].h;
 		int sum_gap = base[k].e + buffer[k].e + gap_open_penalty;
 
@@ -28,6 +28,8 @@ class AlignerUtils {
 public:
 	static void splitBlocksEvenly(int* pos, int j0, int j1, int count);
 	static match_result_t matchColumn(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty);
+	static int findMatchCandidate(const cell_t* buffer, const cell_t* base, int len, int goalScore, int gap_open_penalty);
+	static int findBestCell(const cell_t* buffer, int len);
 };
 
 #endif /* ALIGNERUTILS_HPP_ */
@@ -0,0 +1,310 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "BlockAutotuner.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../parameters/BlockAlignerParameters.hpp"
+
+#define DEBUG (0)
+
+/** Maximum number of rows of the calibration slice */
+#define SLICE_ROWS			(4096)
+
+/** Maximum number of columns of the calibration slice per thread */
+#define SLICE_COLUMNS		(4096)
+
+/**
+ * Partitions smaller than this are not calibrated, since the calibration
+ * would take a significant fraction of their time. They still use the
+ * dimensions tuned previously for their class.
+ */
+#define MIN_CALIBRATION_CELLS	(1LL<<32)
+
+/** Square block sizes tried in the first calibration step */
+static const int square_sizes[] = {256, 512, 1024, 2048, 0};
+
+/**
+ * Data shared by the blocks of one calibration run.
+ */
+struct calibration_t {
+	AbstractBlockProcessor* processor;
+	int recurrenceType;
+	Partition slice;
+	int height;
+	int width;
+	cell_t** row;
+	cell_t** col;
+};
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static int ilog2(int x) {
+	int log = 0;
+	while (x > 1) {
+		x >>= 1;
+		log++;
+	}
+	return log;
+}
+
+/**
+ * Function called by the WavefrontScheduler for each calibration block.
+ */
+static void calibration_block(void* arg, int bx, int by) {
+	calibration_t* c = (calibration_t*)arg;
+	int i0 = c->slice.getI0() + by*c->height;
+	int j0 = c->slice.getJ0() + bx*c->width;
+	int i1 = std::min(i0 + c->height, c->slice.getI1());
+	int j1 = std::min(j0 + c->width, c->slice.getJ1());
+	c->processor->processBlock(c->row[bx], c->col[by], i0, j0, i1, j1, c->recurrenceType);
+}
+
+/**
+ * Constructor. Loads the dimensions tuned in the previous executions.
+ *
+ * @param filename file that keeps the tuned dimensions.
+ */
+BlockAutotuner::BlockAutotuner(string filename) {
+	this->filename = filename;
+	char name[256];
+	if (gethostname(name, sizeof(name)) != 0) {
+		sprintf(name, "unknown");
+	}
+	name[sizeof(name)-1] = '\0';
+	this->host = name;
+	load();
+}
+
+BlockAutotuner::~BlockAutotuner() {
+}
+
+/**
+ * Returns the block dimensions for the given partition. If the class of
+ * the partition was not tuned yet and the partition is large enough,
+ * the calibration is executed and the result is saved.
+ *
+ * @param partition the partition that will be aligned.
+ * @param processor the block processor, with the sequences already defined.
+ * @param scheduler the scheduler that will process the blocks.
+ * @param recurrenceType SMITH_WATERMAN or NEEDLEMAN_WUNSCH.
+ * @param[out] height the block height.
+ * @param[out] width the block width.
+ * @return false if there is no tuned dimension for this partition.
+ */
+bool BlockAutotuner::getBlockSize(const Partition& partition, AbstractBlockProcessor* processor,
+		WavefrontScheduler* scheduler, int recurrenceType, int* height, int* width) {
+	string key = getKey(partition, scheduler->getThreadCount());
+	map<string, tuned_block_t>::iterator it = entries.find(key);
+	if (it == entries.end()) {
+		if (((long long)partition.getHeight())*partition.getWidth() < MIN_CALIBRATION_CELLS) {
+			return false;
+		}
+
+		tuned_block_t best;
+		best.height = 0;
+		best.width = 0;
+		best.mcups = 0;
+
+		/* at least 2x2 blocks, so the wavefront is also measured */
+		Partition slice = getSlice(partition, scheduler->getThreadCount());
+		int maxHeight = std::min(slice.getHeight()/2, MAX_BLOCK_SIZE);
+		int maxWidth = std::min(slice.getWidth()/2, MAX_BLOCK_SIZE);
+
+		/* warm up, so the first candidate is not penalized */
+		calibrate(partition, processor, scheduler, recurrenceType, 1024, 1024);
+
+		/* the best square block, then its best width, then its best height */
+		vector< pair<int,int> > candidates;
+		for (int step = 0; step < 3; step++) {
+			candidates.clear();
+			if (step == 0) {
+				for (int k = 0; square_sizes[k] != 0; k++) {
+					candidates.push_back(make_pair(square_sizes[k], square_sizes[k]));
+				}
+			} else if (step == 1) {
+				candidates.push_back(make_pair(best.height, best.width/2));
+				candidates.push_back(make_pair(best.height, best.width*2));
+				candidates.push_back(make_pair(best.height, best.width*4));
+			} else {
+				candidates.push_back(make_pair(best.height/2, best.width));
+				candidates.push_back(make_pair(best.height*2, best.width));
+			}
+			for (size_t k = 0; k < candidates.size(); k++) {
+				int h = candidates[k].first;
+				int w = candidates[k].second;
+				if (h < MIN_BLOCK_SIZE || w < MIN_BLOCK_SIZE || h > maxHeight || w > maxWidth) {
+					continue;
+				}
+				double mcups = calibrate(partition, processor, scheduler, recurrenceType, h, w);
+				if (DEBUG) printf("Autotune %s: %dx%d %.1f MCUPS\n", key.c_str(), h, w, mcups);
+				if (mcups > best.mcups) {
+					best.height = h;
+					best.width = w;
+					best.mcups = mcups;
+				}
+			}
+		}
+		printf("Autotune [%s]: block %dx%d (%.1f MCUPS)\n", key.c_str(), best.height, best.width, best.mcups);
+
+		entries[key] = best;
+		save();
+		it = entries.find(key);
+	}
+	*height = it->second.height;
+	*width = it->second.width;
+	return true;
+}
+
+/**
+ * Returns the class of the partition: the host, the number of threads and
+ * the logarithm of the partition dimensions.
+ */
+string BlockAutotuner::getKey(const Partition& partition, int threads) const {
+	char str[512];
+	sprintf(str, "%s %d %d %d", host.c_str(), threads,
+			ilog2(partition.getHeight()), ilog2(partition.getWidth()));
+	return string(str);
+}
+
+/**
+ * Returns the slice of the top rows of the partition used in the calibration.
+ */
+Partition BlockAutotuner::getSlice(const Partition& partition, int threads) const {
+	int sliceHeight = std::min(partition.getHeight(), SLICE_ROWS);
+	int sliceWidth = std::min(partition.getWidth(), SLICE_COLUMNS*std::max(threads, 2));
+	return Partition(partition.getI0(), partition.getJ0(),
+			partition.getI0() + sliceHeight, partition.getJ0() + sliceWidth);
+}
+
+/**
+ * Processes a slice of the top rows of the partition with the given
+ * block dimensions.
+ *
+ * @return the performance in MCUPS.
+ */
+double BlockAutotuner::calibrate(const Partition& partition, AbstractBlockProcessor* processor,
+		WavefrontScheduler* scheduler, int recurrenceType, int height, int width) {
+	calibration_t c;
+	c.processor = processor;
+	c.recurrenceType = recurrenceType;
+	c.slice = getSlice(partition, scheduler->getThreadCount());
+	int sliceHeight = c.slice.getHeight();
+	int sliceWidth = c.slice.getWidth();
+	c.height = height;
+	c.width = width;
+
+	int gridWidth = (sliceWidth + width - 1)/width;
+	int gridHeight = (sliceHeight + height - 1)/height;
+	c.row = new cell_t*[gridWidth];
+	for (int bx = 0; bx < gridWidth; bx++) {
+		c.row[bx] = new cell_t[width];
+		for (int k = 0; k < width; k++) {
+			c.row[bx][k].h = 0;
+			c.row[bx][k].e = -INF;
+		}
+	}
+	c.col = new cell_t*[gridHeight];
+	for (int by = 0; by < gridHeight; by++) {
+		c.col[by] = new cell_t[height+1];
+		for (int k = 0; k <= height; k++) {
+			c.col[by][k].h = 0;
+			c.col[by][k].e = -INF;
+		}
+	}
+
+	double t0 = now();
+	scheduler->execute(gridWidth, gridHeight, calibration_block, &c);
+	double t1 = now();
+
+	for (int bx = 0; bx < gridWidth; bx++) {
+		delete[] c.row[bx];
+	}
+	delete[] c.row;
+	for (int by = 0; by < gridHeight; by++) {
+		delete[] c.col[by];
+	}
+	delete[] c.col;
+
+	return ((double)sliceHeight)*sliceWidth/1000000.0/(t1-t0);
+}
+
+/**
+ * Loads the file with the tuned dimensions. Each line contains the host,
+ * the number of threads, the classes of the height and width, the block
+ * height and width and the measured MCUPS.
+ */
+void BlockAutotuner::load() {
+	FILE* file = fopen(filename.c_str(), "r");
+	if (file == NULL) {
+		return;
+	}
+	char line[1024];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char host[256];
+		int threads;
+		int heightClass;
+		int widthClass;
+		tuned_block_t entry;
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%255s %d %d %d %d %d %lf", host, &threads, &heightClass, &widthClass,
+				&entry.height, &entry.width, &entry.mcups) == 7) {
+			char key[512];
+			sprintf(key, "%s %d %d %d", host, threads, heightClass, widthClass);
+			entries[key] = entry;
+		}
+	}
+	fclose(file);
+}
+
+/**
+ * Saves all the tuned dimensions. The file is replaced atomically, so
+ * concurrent instances never read a partial file.
+ */
+void BlockAutotuner::save() {
+	char tmp[32];
+	sprintf(tmp, ".%d.tmp", getpid());
+	string tmpFilename = filename + tmp;
+	FILE* file = fopen(tmpFilename.c_str(), "w");
+	if (file == NULL) {
+		fprintf(stderr, "Warning: could not save the block dimensions in %s.\n", filename.c_str());
+		return;
+	}
+	fprintf(file, "# host threads height_class width_class block_height block_width mcups\n");
+	for (map<string, tuned_block_t>::const_iterator it = entries.begin(); it != entries.end(); it++) {
+		fprintf(file, "%s %d %d %.1f\n", it->first.c_str(), it->second.height, it->second.width, it->second.mcups);
+	}
+	fclose(file);
+	rename(tmpFilename.c_str(), filename.c_str());
+}
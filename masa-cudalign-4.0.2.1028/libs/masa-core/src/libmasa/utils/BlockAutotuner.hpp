@@ -0,0 +1,81 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#ifndef BLOCKAUTOTUNER_HPP_
+#define BLOCKAUTOTUNER_HPP_
+
+#include <map>
+#include <string>
+using namespace std;
+
+#include "../libmasaTypes.hpp"
+#include "../Partition.hpp"
+#include "../processors/AbstractBlockProcessor.hpp"
+#include "../schedulers/WavefrontScheduler.hpp"
+
+/**
+ * Block dimensions chosen for one class of partitions.
+ */
+struct tuned_block_t {
+	/** Height of the blocks */
+	int height;
+	/** Width of the blocks */
+	int width;
+	/** Performance measured in the calibration */
+	double mcups;
+};
+
+/**
+ * @brief Chooses the block dimensions of the block aligners with short
+ * calibration runs.
+ *
+ * The partitions are classified by host, number of threads and the
+ * logarithm of their dimensions. The first large partition of each class
+ * is calibrated: a slice of its top rows is processed with a few block
+ * dimensions, using the real block processor and scheduler, and the
+ * fastest dimensions are kept. The results are saved in a text file, so
+ * the next executions reuse them without calibration.
+ */
+class BlockAutotuner {
+public:
+	BlockAutotuner(string filename);
+	virtual ~BlockAutotuner();
+
+	bool getBlockSize(const Partition& partition, AbstractBlockProcessor* processor,
+			WavefrontScheduler* scheduler, int recurrenceType, int* height, int* width);
+
+private:
+	/** File that keeps the tuned dimensions */
+	string filename;
+	/** Tuned dimensions of each class */
+	map<string, tuned_block_t> entries;
+	/** Name of this host */
+	string host;
+
+	string getKey(const Partition& partition, int threads) const;
+	Partition getSlice(const Partition& partition, int threads) const;
+	double calibrate(const Partition& partition, AbstractBlockProcessor* processor,
+			WavefrontScheduler* scheduler, int recurrenceType, int height, int width);
+	void load();
+	void save();
+};
+
+#endif /* BLOCKAUTOTUNER_HPP_ */
@@ -223,6 +223,8 @@ void alignPartition(SpecialRowsPartition* sraPartition, int ev_prepare, int ev_i
 		block_pruning = false;
 	}
 	sw->setBlockPruning(block_pruning);
+	/* the processes of a multi-process execution prune with the global best score */
+	sw->setAlignerPool(job->getAlignerPool());
 	timer.eventRecord(ev_init);
 	Partition partition(i0, j0, i1, j1);
 	sw->alignPartition(partition, START_TYPE_MATCH);
@@ -242,6 +244,7 @@ void alignPartition(SpecialRowsPartition* sraPartition, int ev_prepare, int ev_i
  * @return the number of best scores stored in the work directory.
  */
 int stage1(Job* job) {
+	TRACE_SPAN(TRACE_STAGE, "stage1");
 	FILE* stats = job->fopenStatistics(STAGE_1, 0);
 	job->getAlignmentParams()->printParams(stats);
 	fflush(stats);
@@ -333,7 +336,15 @@ int stage1(Job* job) {
 	} else {
 		status->setCurrentStage(STAGE_1);
 		status->save();
+		/* a new execution must not reuse the blocks of a previous X-drop */
+		if (job->xdrop > 0) {
+			remove(job->getRegionFile().c_str());
+		}
 	}
+
+	AlignmentRegion* region = job->createAlignmentRegion(STAGE_1);
+	sw->setRegion(region);
+	sw->setXDrop(job->xdrop, job->getRegionFile());
 	//bestScoreList->add(bestScore.i, bestScore.j, bestScore.score);
 	//printf("Best Init: %d,%d,%d\n", bestScore.j, bestScore.i, bestScore.score);
 
@@ -450,6 +461,9 @@ int stage1(Job* job) {
 
 	aligner->printStatistics(stats);
 	delete sw;
+	if (region != NULL) {
+		delete region;
+	}
 	delete seq_vertical;
 	delete seq_horizontal;
 	//delete specialRowWriter;
@@ -235,6 +235,7 @@ void stage2_pool_send(Job* job, crosspoint_t crosspoint_r, int final) {
 }
 
 crosspoint_t stage2(Job* job, int id) {
+	TRACE_SPAN(TRACE_STAGE, "stage2");
 	alignment_id = id;
 	//job = _job;
 	FILE* stats = job->fopenStatistics(STAGE_2, id);
@@ -322,6 +323,8 @@ crosspoint_t stage2(Job* job, int id) {
 
 	sw->setRecurrenceType(NEEDLEMAN_WUNSCH);
 	sw->setBlockPruning(false);
+	AlignmentRegion* region = job->createAlignmentRegion(STAGE_2);
+	sw->setRegion(region);
 	aligner->clearStatistics();
 
 	if (sraPartitionStage1 != NULL && job->getSRALimit() > 0) {
@@ -509,6 +512,9 @@ crosspoint_t stage2(Job* job, int id) {
 	aligner->printStatistics(stats);
     delete crosspoints;
 	delete sw;
+	if (region != NULL) {
+		delete region;
+	}
 	delete seq_horizontal;
 	delete seq_vertical;
 	//delete specialRowReader;
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -33,16 +34,40 @@
 
 #define DEBUG (0)
 
+/** Resources owned by each stage 3 thread */
+typedef struct {
+	pthread_t thread;
+	IAligner* aligner;
+	AlignerManager* sw;
+	struct stage3_step_t* step;
+} stage3_worker_t;
+
+/** A partition between two crosspoints of the previous iteration */
+typedef struct {
+	crosspoint_t crosspoint0;
+	crosspoint_t crosspoint1;
+	/* Crosspoints found inside the partition, in order */
+	vector<crosspoint_t> crosspoints;
+} stage3_partition_t;
+
+/** The partitions of one iteration, shared by all the workers */
+struct stage3_step_t {
+	stage3_partition_t* partitions;
+	int count;
+	/* Next partition to be processed */
+	volatile int next;
+	SpecialRowsArea* sraPrev;
+	int seq0_len;
+	int seq1_len;
+	int reverse;
+};
+
 /* The object where the SRA partitions of stage 3 are saved */
 static SpecialRowsArea* sraStage3;
 
-/* The partition from where the special rows will be read. Initially, this
- * partition is from stage 2, but then it is updated in the next iteratios.  */
-static SpecialRowsPartition* sraPrevPartition;
-
+/* Serializes the changes in the partition maps of the SpecialRowsArea objects */
+static pthread_mutex_t sraMutex = PTHREAD_MUTEX_INITIALIZER;
 
-static AlignerManager* sw;
-static IAligner* aligner;
 static const score_params_t* score_params;
 
 
@@ -65,7 +90,9 @@ static crosspoint_t find_next_crosspoint (AlignerManager* sw, const crosspoint_t
 
 	SpecialRowsPartition* sraPartitionStage3 = NULL;
 	if (sraStage3 != NULL) {
+		pthread_mutex_lock(&sraMutex);
 		sraPartitionStage3 = sraStage3->createPartition(i0r, j0r, i1r, j1r);
+		pthread_mutex_unlock(&sraMutex);
 	}
 	sraPartitionStage3->setFirstColumnReader(firstColumn);
 	sraPartitionStage3->setFirstRowReader(firstRow);
@@ -108,7 +135,9 @@ static crosspoint_t find_next_crosspoint (AlignerManager* sw, const crosspoint_t
 		}
 		next_crosspoint = sw->getNextCrosspoint();
 		if (sraPartitionStage3 != NULL) {
+			pthread_mutex_lock(&sraMutex);
 			sraStage3->truncatePartition(sraPartitionStage3, next_crosspoint.i, next_crosspoint.j);
+			pthread_mutex_unlock(&sraMutex);
 		}
 	} else {
 		next_crosspoint = crosspoint1;
@@ -118,9 +147,10 @@ static crosspoint_t find_next_crosspoint (AlignerManager* sw, const crosspoint_t
 }
 
 
-void processPartition(crosspoint_t crosspoint0, crosspoint_t crosspoint1,
+static void processPartition(AlignerManager* sw, SpecialRowsPartition* sraPrevPartition,
+		crosspoint_t crosspoint0, crosspoint_t crosspoint1,
 		int seq0_len, int seq1_len, int reverse,
-		CrosspointsFile*& crosspoints) {
+		vector<crosspoint_t>& crosspoints) {
 
 	// If we don't need to save more rows, so we do not need to process the last partition (last row)
 	bool processLastRow = (sraStage3 != NULL);
@@ -202,73 +232,149 @@ void processPartition(crosspoint_t crosspoint0, crosspoint_t crosspoint1,
 	    crosspoint_t tmp = crosspoint;
 	    tmp.score = goal_adj;
 
-	    //crosspoints->push_back(tmp);
-		crosspoints->write(tmp.i, tmp.j, tmp.score, tmp.type);
+	    crosspoints.push_back(tmp);
+	}
+}
+
+static void reducePartition(stage3_worker_t* worker, stage3_partition_t* partition) {
+	stage3_step_t* step = worker->step;
+	crosspoint_t crosspoint0 = partition->crosspoint0;
+	crosspoint_t crosspoint1 = partition->crosspoint1;
+
+	crosspoint_t crosspoint0r = crosspoint1.reverse(step->seq0_len, step->seq1_len);
+	crosspoint_t crosspoint1r = crosspoint0.reverse(step->seq0_len, step->seq1_len);
+
+	printf("(%d,%d)-(%d,%d)\n", crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
+	if (crosspoint0r.i != crosspoint1r.i && crosspoint0r.j != crosspoint1r.j) {
+		/* The partition from where the special rows will be read. Initially, this
+		 * partition is from stage 2, but then it is updated in the next iterations.  */
+		pthread_mutex_lock(&sraMutex);
+		SpecialRowsPartition* sraPrevPartition = step->sraPrev->openPartition(crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
+		pthread_mutex_unlock(&sraMutex);
+		if (sraPrevPartition->getRowsCount() > 1) { // 1 = fixed constant first row (rowId = 0).
+			// We have special rows in this partition
+			processPartition(worker->sw, sraPrevPartition, crosspoint0, crosspoint1,
+					step->seq0_len, step->seq1_len, step->reverse, partition->crosspoints);
+		} else {
+			// We do not have special rows in this partition
+			if (sraStage3 != NULL) {
+				// So we create an empty partition and avoid the processPartition call
+				pthread_mutex_lock(&sraMutex);
+				sraStage3->createPartition(crosspoint0.i, crosspoint0.j, crosspoint1.i, crosspoint1.j);
+				pthread_mutex_unlock(&sraMutex);
+			}
+		}
+	} else {
+		if (DEBUG) printf("ignoring full-gap partition (%d,%d)-(%d,%d)\n", crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
+	}
+}
+
+/**
+ * Processes the partitions of the current step, in any order, until there
+ * are no more partitions left.
+ */
+static void* reduceThread(void* arg) {
+	stage3_worker_t* worker = (stage3_worker_t*)arg;
+	stage3_step_t* step = worker->step;
+	Tracer::setThreadName("stage3 worker");
+	int k;
+	while ((k = __sync_fetch_and_add(&step->next, 1)) < step->count) {
+		reducePartition(worker, &step->partitions[k]);
 	}
+	return NULL;
 }
 
 int reduce_partitions(CrosspointsFile*& crosspointsPrev, CrosspointsFile*& crosspoints,
-		Sequence* seq_vertical, Sequence* seq_horizontal, SpecialRowsArea*& sraPrev, int reverse, FILE* stats) {
-	int seq0_len = seq_vertical->getInfo()->getSize();
-	int seq1_len = seq_horizontal->getInfo()->getSize();
+		Sequence* seq_vertical, Sequence* seq_horizontal, SpecialRowsArea*& sraPrev, int reverse, FILE* stats,
+		stage3_worker_t* workers, int workerCount) {
+	stage3_step_t step;
+	step.seq0_len = seq_vertical->getInfo()->getSize();
+	step.seq1_len = seq_horizontal->getInfo()->getSize();
+	step.reverse = reverse;
+	step.sraPrev = sraPrev;
+	step.count = crosspointsPrev->size() - 1;
+	step.next = 0;
+	step.partitions = new stage3_partition_t[step.count > 0 ? step.count : 1];
+	for (int k=0; k<step.count; k++) {
+		step.partitions[k].crosspoint0 = crosspointsPrev->at(k);
+		step.partitions[k].crosspoint1 = crosspointsPrev->at(k+1);
+	}
+
+	int threads = workerCount;
+	if (threads > step.count) {
+		threads = step.count;
+	}
+	if (threads < 1) {
+		threads = 1;
+	}
 
 	crosspoint_t m1 = crosspointsPrev->back();
 	crosspoint_t m0 = crosspointsPrev->front();
 	// FIXME we need to respect the maximum partition size capability of the aligner!
-	sw->setSequences(seq_vertical, seq_horizontal, m0.i, m0.j, m1.i, m1.j, stats);
-	//printf("*********************** %p, %p, %d,%d, %d, %d", seq_vertical->getData(), seq_horizontal->getData(), m0.i, m0.j, m1.i, m1.j);
+	for (int i=0; i<threads; i++) {
+		workers[i].step = &step;
+		workers[i].sw->setSequences(seq_vertical, seq_horizontal, m0.i, m0.j, m1.i, m1.j, i == 0 ? stats : NULL);
+	}
 
-	crosspoint_t crosspoint0;
-	crosspoint_t crosspoint1;
-	int partition_id = 0;
-	crosspoint1 = crosspointsPrev->front();
-	while (partition_id < crosspointsPrev->size() - 1) {
-		partition_id++;
-		crosspoint0 = crosspoint1;
-		crosspoint1 = crosspointsPrev->at(partition_id);
-
-		//crosspoints->push_back(crosspoint0);
-		crosspoints->write(crosspoint0.i, crosspoint0.j, crosspoint0.score,	crosspoint0.type);
-
-		crosspoint_t crosspoint0r = crosspoint1.reverse(seq0_len, seq1_len);
-		crosspoint_t crosspoint1r = crosspoint0.reverse(seq0_len, seq1_len);
-
-		printf("(%d,%d)-(%d,%d)\n", crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
-		if (crosspoint0r.i != crosspoint1r.i && crosspoint0r.j != crosspoint1r.j) {
-			sraPrevPartition = sraPrev->openPartition(crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
-			//sraPrevPartition->setFirstRow(score_params, true);
-			//sw->setLastColumnReader(sraPrevPartition);
-			if (sraPrevPartition->getRowsCount() > 1) { // 1 = fixed constant first row (rowId = 0).
-				// We have special rows in this partition
-				processPartition(crosspoint0, crosspoint1, seq0_len, seq1_len, reverse, crosspoints);
-			} else {
-				// We do not have special rows in this partition
-				if (sraStage3 != NULL) {
-					// So we create an empty partition and avoid the processPartition call
-					sraStage3->createPartition(crosspoint0.i, crosspoint0.j, crosspoint1.i, crosspoint1.j);
-				}
-			}
-		} else {
-			if (DEBUG) printf("ignoring full-gap partition (%d,%d)-(%d,%d)\n", crosspoint0r.i, crosspoint0r.j, crosspoint1r.i, crosspoint1r.j);
+	// The current thread is the worker 0.
+	for (int i=1; i<threads; i++) {
+		int rc = pthread_create(&workers[i].thread, NULL, reduceThread, (void*)&workers[i]);
+		if (rc) {
+			fprintf(stderr, "ERROR; return code from pthread_create() is %d\n", rc);
+			exit(-1);
 		}
 	}
-	crosspoints->write(crosspoint1.i, crosspoint1.j, crosspoint1.score, crosspoint1.type);
+	reduceThread(&workers[0]);
+	for (int i=1; i<threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	/* The crosspoints are written in the partitions order */
+	for (int k=0; k<step.count; k++) {
+		stage3_partition_t* partition = &step.partitions[k];
+		crosspoints->write(partition->crosspoint0.i, partition->crosspoint0.j,
+				partition->crosspoint0.score, partition->crosspoint0.type);
+		for (int c=0; c<partition->crosspoints.size(); c++) {
+			const crosspoint_t& tmp = partition->crosspoints[c];
+			crosspoints->write(tmp.i, tmp.j, tmp.score, tmp.type);
+		}
+	}
+	crosspoints->write(m1.i, m1.j, m1.score, m1.type);
 	crosspoints->close();
 	if (DEBUG) printf("********** %d %d ********\n", crosspointsPrev->size(), crosspoints->size());
 
-	sw->unsetSequences();
+	for (int i=0; i<threads; i++) {
+		workers[i].sw->unsetSequences();
+	}
+	delete[] step.partitions;
 
 	return crosspoints->size();
 }
 
 void stage3(Job* job, int id) {
+	TRACE_SPAN(TRACE_STAGE, "stage3");
 	FILE* stats = job->fopenStatistics(STAGE_3, id);
 	job->getAlignmentParams()->printParams(stats);
 	fprintf(stats, "Initial VmSize: %d KB\n", getMasaProcessVmSize()/1024);
 	fflush(stats);
-	aligner = job->aligner;
-	score_params = aligner->getScoreParameters();
-	sw = new AlignerManager(aligner);
+	score_params = job->aligner->getScoreParameters();
+
+	/* Each worker aligns its partitions with its own aligner. If the
+	 * aligner cannot be cloned, the partitions are processed serially. */
+	int workerCount = job->getThreadCount();
+	if (workerCount < 1) {
+		workerCount = 1;
+	}
+	stage3_worker_t* workers = new stage3_worker_t[workerCount];
+	for (int i=0; i<workerCount; i++) {
+		workers[i].aligner = job->getWorkerAligner(i);
+		if (workers[i].aligner == NULL) {
+			workerCount = i;
+			break;
+		}
+		workers[i].sw = new AlignerManager(workers[i].aligner);
+	}
+	fprintf(stats, "Threads: %d\n", workerCount);
 
 
 
@@ -305,10 +411,14 @@ void stage3(Job* job, int id) {
 //	sw->setFirstColumnSource(true);
 //	sw->setFirstRowSource(true);
 	//sw->setLastColumnDestination(TO_VECTOR);
-	sw->setRecurrenceType(NEEDLEMAN_WUNSCH);
-	//sw->setCheckLocation(CHECK_NOWHERE);
-	sw->setBlockPruning(false);
-	aligner->clearStatistics();
+	AlignmentRegion* region = job->createAlignmentRegion(STAGE_3);
+	for (int i=0; i<workerCount; i++) {
+		workers[i].sw->setRecurrenceType(NEEDLEMAN_WUNSCH);
+		//sw->setCheckLocation(CHECK_NOWHERE);
+		workers[i].sw->setBlockPruning(false);
+		workers[i].sw->setRegion(region);
+		workers[i].aligner->clearStatistics();
+	}
 
 
 
@@ -355,18 +465,20 @@ void stage3(Job* job, int id) {
 
 			//sraStage3 = new SpecialRowsArea(job->getSpecialRowsPath(STAGE_3, id, deep), 12345678);
 			sraStage3 = job->getSpecialRowsArea(STAGE_3, id, deep);
+	    	int specialRowInterval = flushInterval;
 	    	if (flushInterval < min_interval) {
-	    		sw->setSpecialRowInterval(min_interval);
+	    		specialRowInterval = min_interval;
 	    		saveSRA = false;
-	    	} else {
-	    		sw->setSpecialRowInterval(flushInterval);
+	    	}
+	    	for (int i=0; i<workerCount; i++) {
+	    		workers[i].sw->setSpecialRowInterval(specialRowInterval);
 	    	}
 			if (!saveSRA) {
 				sraStage3->setPersistentPartitions(false);
 				//sraStage3 = NULL;
 			}
 
-	    	reduce_partitions(crosspointsPrev, crosspoints, seq_vertical, seq_horizontal, sraPrev, reverse, stats);
+	    	reduce_partitions(crosspointsPrev, crosspoints, seq_vertical, seq_horizontal, sraPrev, reverse, stats, workers, workerCount);
 
 			fprintf(stderr, "Stage3: Crosspoints: %d/%d  Rows: %d/%d %s\n",
 					crosspointsPrev->size(), crosspoints->size(),
@@ -434,15 +546,27 @@ void stage3(Job* job, int id) {
 	float diff = timer.printStatistics(stats);
 	
 	fprintf(stats, "        Total: %.4f\n", diff);
-	fprintf(stats, "        Cells: %.4e\n", (double)aligner->getProcessedCells());
-	fprintf(stats, "        MCUPS: %.4f\n", aligner->getProcessedCells()/1000000.0f/(diff/1000.0f));
-	fprintf(stats, "Millions Cells Updates: %.3f\n", aligner->getProcessedCells() / 1000000.0f);
+	long long cells = 0;
+	for (int i=0; i<workerCount; i++) {
+		cells += workers[i].aligner->getProcessedCells();
+	}
+	fprintf(stats, "        Cells: %.4e\n", (double)cells);
+	fprintf(stats, "        MCUPS: %.4f\n", cells/1000000.0f/(diff/1000.0f));
+	fprintf(stats, "Millions Cells Updates: %.3f\n", cells / 1000000.0f);
 	fprintf(stats, " Final VmSize: %d KB\n", getMasaProcessVmSize()/1024);
 	
 	//aligner->finalize();
-	aligner->printStatistics(stats);
+	job->aligner->printStatistics(stats);
 	delete crosspoints;
 
+	for (int i=0; i<workerCount; i++) {
+		delete workers[i].sw;
+	}
+	delete[] workers;
+	if (region != NULL) {
+		delete region;
+	}
+
 	delete seq_horizontal;
 	delete seq_vertical;
 
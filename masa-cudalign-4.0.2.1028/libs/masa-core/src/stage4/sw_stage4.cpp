@@ -25,19 +25,28 @@
 #include <string.h>
 
 #include <pthread.h>
+#include <sched.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <deque>
+using namespace std;
+
 #include "../common/Common.hpp"
+#include "../common/biology/SequenceWindow.hpp"
 
 #include "../libmasa/processors/CPUBlockProcessor.hpp"
+#include "../libmasa/processors/SIMDBlockProcessor.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86_ENABLED
+#include <immintrin.h>
+#endif
 
 //#include <cutil_inline.h>
 
 #define H_MAX (2*64*1024)
 
-#define NUM_THREADS 4
-
 #define DEBUG (0)
 
 /*#define dna_match       (1)
@@ -52,10 +61,8 @@ static int dna_gap_ext;
 static int dna_match;
 static int dna_mismatch;
 
+/** Scratch memory of each stage 4 worker, reused by all its splits */
 typedef struct {
-    int partition0;
-    int partition1;
-
     int h0[H_MAX];
     int e0[H_MAX];
 
@@ -67,164 +74,200 @@ typedef struct {
     cell_t c0[H_MAX];
     cell_t c1[H_MAX];
 
-    Job* job;
-    const CrosspointsFile* crosspoints;
-    /* OUT */
-    crosspoint_t *out_pos;
+    /** Decoded ranges of the sequences: forward 0 and 1, reverse 0 and 1 */
+    SequenceWindow windows[4];
 } split_args_t;
 
+/**
+ * Partition between two crosspoints. When the partition is split, the
+ * halves become its children, so the final list of crosspoints is obtained
+ * by an in-order traversal of the tree.
+ */
+struct split_node_t {
+	crosspoint_t c0;
+	crosspoint_t c1;
+	split_node_t* left;
+	split_node_t* right;
+};
+
+/** Private state of each thread of the split pool */
+struct split_worker_t {
+	/** worker id. Worker 0 is the thread that calls reduce_partitions() */
+	int id;
+	pthread_t thread;
+	/** protects the queue */
+	pthread_mutex_t mutex;
+	/** partitions waiting to be split */
+	deque<split_node_t*> queue;
+	split_args_t* args;
+	struct split_pool_t* pool;
+};
+
+/** Work-stealing pool that splits the partitions */
+struct split_pool_t {
+	Job* job;
+	int threadCount;
+	split_worker_t* workers;
+	/** Number of partitions queued or being split */
+	volatile int pending;
+	/* Statistics */
+	volatile int splits;
+	volatile int stolen;
+};
+
+/** Region given by --band and --xdrop, or NULL for the whole matrix */
+static AlignmentRegion* region = NULL;
+
+/**
+ * @return true if the vertex (i,j) is inside the region. If transposed,
+ * 		i is a column and j is a row of the forward matrix.
+ */
+static inline bool inside_region(const AlignmentRegion* region, bool transposed, int i, int j) {
+	return transposed ? region->isInside(j, i) : region->isInside(i, j);
+}
+
 static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, 
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1);
+						int *h0, int *h1, int *e0, int *e1, SequenceWindow* windows,
+						const AlignmentRegion* region = NULL, bool transposed = false);
 static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, 
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1);
+						int *h0, int *h1, int *e0, int *e1, SequenceWindow* windows);
 												
 static crosspoint_t ort_split_2(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1,
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1, cell_t *c0, cell_t *c1);
+						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1, cell_t *c0, cell_t *c1,
+						SequenceWindow* windows);
 
-static void *split_thread(void *thread_arg) {
-    static int inv_type[] = {0,2,1};
+static crosspoint_t ort_split_simd(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1,
+						int type_s, int type_e, int score_s, int score_e,
+						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1,
+						SequenceWindow* windows);
 
-    split_args_t* args = (split_args_t*)thread_arg;
+/**
+ * Finds the crosspoint that splits the partition (c0,c1) in half, along its
+ * largest dimension.
+ *
+ * @return false if the partition does not need to be split.
+ */
+static bool split_partition(Job* job, split_args_t* args, crosspoint_t c0, crosspoint_t c1, crosspoint_t* out) {
+    static int inv_type[] = {0,2,1};
+    TraceSpan span(TRACE_STAGE4, "split");
+    span.setArg(((long long)(c1.i-c0.i))*(c1.j-c0.j));
 
-    Job* job = args->job;
-    const CrosspointsFile* crosspoints = args->crosspoints;
 	Sequence* seq0 = job->getAlignmentParams()->getSequence(0);
 	Sequence* seq1 = job->getAlignmentParams()->getSequence(1);
 
-    int i0, j0, i1, j1, type0, type1, score0, score1;
-
-    int partition_id = args->partition0;
-    i0 = crosspoints->at(partition_id).i;
-    j0 = crosspoints->at(partition_id).j;
-    type0 = crosspoints->at(partition_id).type;
-	score0 = crosspoints->at(partition_id).score;
+    int i0 = c0.i;
+    int j0 = c0.j;
+    int type0 = c0.type;
+    int score0 = c0.score;
+    int i1 = c1.i;
+    int j1 = c1.j;
+    int type1 = c1.type;
+    int score1 = c1.score;
+
+    int delta_i = i1-i0;
+    int delta_j = j1-j0;
+
+    /* the partitions crossing the border of the region are split cell by cell */
+    const AlignmentRegion* partitionRegion = NULL;
+    if (region != NULL && region->getOverlap(i0, j0, i1, j1, false) != REGION_INSIDE) {
+    	partitionRegion = region;
+    }
 
-    float last_percent = 0;
-    for (int k=args->partition0+1; k<=args->partition1; k++) {
-        float percent = 100.0f*(k-args->partition0)/(args->partition1-args->partition0);
-        if (percent > last_percent+25) {
-            printf("Split: %5.1f (%6d/%6d)\n", percent , k, crosspoints->size());
-            last_percent = percent;
-        }
-        partition_id++;
-        i1 = crosspoints->at(k).i;
-        j1 = crosspoints->at(k).j;
-        type1 = crosspoints->at(k).type;
-        score1 = crosspoints->at(k).score;
-
-        int delta_i = i1-i0;
-        int delta_j = j1-j0;
-
-        int inverse = (delta_i < delta_j);
-//        if (delta_i == 0) {
-//        	if (j0 < j1-job->stage4_maximum_partition_size) {
-//        		int len = delta_j/2;
-//        		args->out_pos[k].i = i1;
-//        		args->out_pos[k].j = j0+len;
-//        		args->out_pos[k].type = TYPE_GAP_1;
-//        		args->out_pos[k].score = score0 -len*dna_gap_ext - dna_gap_open*(score0!=TYPE_GAP_1);
-//        	} else {
-//                args->out_pos[k].type = -1;
-//        	}
-//        } else
-        if (delta_i == 0 || delta_j == 0) {
-            args->out_pos[k].type = -1;
-        } else if (inverse) {
-			if (j0 < j1-job->stage4_maximum_partition_size) {
-				crosspoint_t out_tmp;
-				int strategy = job->stage4_strategy;
-				if (strategy != STAGE_4_STRATEGY_ORIGINAL_MM) {
-					if (delta_j/2+1 >= H_MAX) {
-						fprintf(stderr, "Info: half-partition is too large (%d/2>%d). Disabling optimized execution for this partition\n", delta_j, H_MAX);
-						strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
-					}
+    int inverse = (delta_i < delta_j);
+    if (delta_i == 0 || delta_j == 0) {
+        return false;
+    } else if (inverse) {
+		if (j0 < j1-job->stage4_maximum_partition_size) {
+			crosspoint_t out_tmp;
+			int strategy = job->stage4_strategy;
+			if (partitionRegion != NULL) {
+				strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
+			} else if (strategy != STAGE_4_STRATEGY_ORIGINAL_MM) {
+				if (delta_j/2+1 >= H_MAX) {
+					fprintf(stderr, "Info: half-partition is too large (%d/2>%d). Disabling optimized execution for this partition\n", delta_j, H_MAX);
+					strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
 				}
+			}
 
-				switch (strategy) {
-					case STAGE_4_STRATEGY_ORIGINAL_MM:
-						out_tmp = split(seq1, seq0, j0, i0, j1, i1, inv_type[type0],
-								inv_type[type1], score0, score1, args->h0, args->h1,
-								args->e0, args->e1);
-	                    break;
-					case STAGE_4_STRATEGY_ORTHOGONAL:
-						out_tmp = ort_split(seq1, seq0, j0, i0, j1, i1,
-								inv_type[type0], inv_type[type1], score0, score1,
-								args->h0, args->h1, args->e0, args->e1);
-						break;
-					case STAGE_4_STRATEGY_OPTIMIZED:
-						out_tmp = ort_split_2(seq1, seq0, j0, i0, j1, i1,
-								inv_type[type0], inv_type[type1], score0, score1,
-								args->h0, args->h1, args->e0, args->e1, args->r0,
-								args->r1, args->c0, args->c1);
-						break;
-				}
+			switch (strategy) {
+				case STAGE_4_STRATEGY_ORIGINAL_MM:
+					out_tmp = split(seq1, seq0, j0, i0, j1, i1, inv_type[type0],
+							inv_type[type1], score0, score1, args->h0, args->h1,
+							args->e0, args->e1, args->windows, partitionRegion, true);
+                    break;
+				case STAGE_4_STRATEGY_ORTHOGONAL:
+					out_tmp = ort_split(seq1, seq0, j0, i0, j1, i1,
+							inv_type[type0], inv_type[type1], score0, score1,
+							args->h0, args->h1, args->e0, args->e1, args->windows);
+					break;
+				case STAGE_4_STRATEGY_OPTIMIZED:
+					out_tmp = ort_split_2(seq1, seq0, j0, i0, j1, i1,
+							inv_type[type0], inv_type[type1], score0, score1,
+							args->h0, args->h1, args->e0, args->e1, args->r0,
+							args->r1, args->c0, args->c1, args->windows);
+					break;
+				case STAGE_4_STRATEGY_SIMD:
+					out_tmp = ort_split_simd(seq1, seq0, j0, i0, j1, i1,
+							inv_type[type0], inv_type[type1], score0, score1,
+							args->h0, args->h1, args->e0, args->e1, args->r0,
+							args->r1, args->windows);
+					break;
+			}
 
-				args->out_pos[k].i = out_tmp.j;
-                args->out_pos[k].j = out_tmp.i;
-                args->out_pos[k].type = inv_type[out_tmp.type];
-                args->out_pos[k].score = out_tmp.score;
-            } else {
-                args->out_pos[k].type = -1;
-            }
+			out->i = out_tmp.j;
+            out->j = out_tmp.i;
+            out->type = inv_type[out_tmp.type];
+            out->score = out_tmp.score;
         } else {
-			if (i0 < i1-job->stage4_maximum_partition_size) {
-				crosspoint_t out_tmp;
-				int strategy = job->stage4_strategy;
-				if (strategy != STAGE_4_STRATEGY_ORIGINAL_MM) {
-					if (delta_i/2+1 >= H_MAX) {
-						fprintf(stderr, "Info: half-partition is too large (%d/2>%d). Disabling optimized execution for this partition\n", delta_i, H_MAX);
-						strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
-					}
-				}
-
-				switch (strategy) {
-					case STAGE_4_STRATEGY_ORIGINAL_MM:
-	                    out_tmp = split ( seq0, seq1, i0, j0, i1, j1,
-	                                          type0, type1, score0, score1,
-	                                          args->h0, args->h1, args->e0, args->e1 );
-						break;
-					case STAGE_4_STRATEGY_ORTHOGONAL:
-						out_tmp = ort_split(seq0, seq1, i0, j0, i1, j1, type0,
-								type1, score0, score1, args->h0, args->h1, args->e0,
-								args->e1);
-						break;
-					case STAGE_4_STRATEGY_OPTIMIZED:
-						out_tmp = ort_split_2(seq0, seq1, i0, j0, i1, j1, type0,
-								type1, score0, score1, args->h0, args->h1, args->e0,
-								args->e1, args->r0, args->r1, args->c0, args->c1);
-						break;
-				}
-										 
-				args->out_pos[k] = out_tmp;
-            } else {
-                args->out_pos[k].type = -1;
-            }
+            return false;
         }
+    } else {
+		if (i0 < i1-job->stage4_maximum_partition_size) {
+			crosspoint_t out_tmp;
+			int strategy = job->stage4_strategy;
+			if (partitionRegion != NULL) {
+				strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
+			} else if (strategy != STAGE_4_STRATEGY_ORIGINAL_MM) {
+				if (delta_i/2+1 >= H_MAX) {
+					fprintf(stderr, "Info: half-partition is too large (%d/2>%d). Disabling optimized execution for this partition\n", delta_i, H_MAX);
+					strategy = STAGE_4_STRATEGY_ORIGINAL_MM;
+				}
+			}
 
-		//printf("%d,%d,%d,%d\n", args->out_pos[k].type, args->out_pos[k].i, args->out_pos[k].j, args->out_pos[k].score);
-
-        type0 = type1;
-		score0 = score1;
-        i0 = i1;
-        j0 = j1;
-    }
-
-    pthread_exit(NULL);
-    return NULL;
-}
+			switch (strategy) {
+				case STAGE_4_STRATEGY_ORIGINAL_MM:
+                    out_tmp = split ( seq0, seq1, i0, j0, i1, j1,
+                                          type0, type1, score0, score1,
+                                          args->h0, args->h1, args->e0, args->e1, args->windows,
+                                          partitionRegion, false );
+					break;
+				case STAGE_4_STRATEGY_ORTHOGONAL:
+					out_tmp = ort_split(seq0, seq1, i0, j0, i1, j1, type0,
+							type1, score0, score1, args->h0, args->h1, args->e0,
+							args->e1, args->windows);
+					break;
+				case STAGE_4_STRATEGY_OPTIMIZED:
+					out_tmp = ort_split_2(seq0, seq1, i0, j0, i1, j1, type0,
+							type1, score0, score1, args->h0, args->h1, args->e0,
+							args->e1, args->r0, args->r1, args->c0, args->c1, args->windows);
+					break;
+				case STAGE_4_STRATEGY_SIMD:
+					out_tmp = ort_split_simd(seq0, seq1, i0, j0, i1, j1, type0,
+							type1, score0, score1, args->h0, args->h1, args->e0,
+							args->e1, args->r0, args->r1, args->windows);
+					break;
+			}
 
-static void create_split_thread(split_args_t* args, pthread_t* pthread) {
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    int rc = pthread_create(pthread, &attr, split_thread, (void *)args);
-    if (rc) {
-        printf("ERROR; return code from pthread_create() is %d\n", rc);
-        exit(-1);
+			*out = out_tmp;
+        } else {
+            return false;
+        }
     }
+    // A split in the start crosspoint would not reduce the partition.
+    return (out->i != i0 || out->j != j0);
 }
 
 void processBlock(const char* s0, const char* s1, cell_t *row, cell_t *col,
@@ -272,6 +315,132 @@ cell_t processCol(const char* s0, const char c, int h11, int h10, cell_t *col, c
 	//printf("FW: %d/%d\n", i, mid0);
 }
 
+/** Column kernel of the SIMD strategy (see sw_stage4_kernel.h) */
+typedef cell_t (*column_kernel_f)(const char* s0, const char c, int h11, int h10, int* h, int* e, const int len);
+
+/**
+ * Scalar column kernel, used when the cpu has no supported instruction set.
+ * It is processCol with the column stored as separate H and E arrays.
+ */
+static cell_t process_column_scalar(const char* s0, const char c, int h11, int h10, int* h, int* e, const int len) {
+	int f0 = -INF;
+	for (int j=0; j<len; j++) {
+		e[j] = MAX(h[j]-dna_gap_first, e[j]-dna_gap_ext);
+		f0 = MAX(h10-dna_gap_first, f0-dna_gap_ext);
+		h10 = MAX3(h11+((c==s0[j])?dna_match:dna_mismatch), e[j], f0);
+		h11 = h[j];
+		h[j] = h10;
+	}
+	cell_t cell;
+	cell.f = f0;
+	cell.h = h10;
+	return cell;
+}
+
+#ifdef SIMD_X86_ENABLED
+
+/*
+ * SSE4.1 column kernel: 4 lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+namespace stage4_sse41 {
+	typedef __m128i vec_t;
+	typedef __m128i mask_t;
+	static const int LANES = 4;
+
+	static inline vec_t v_set1(int x) { return _mm_set1_epi32(x); }
+	static inline vec_t v_loadu(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void v_storeu(int* p, vec_t v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline vec_t v_load_chars(const char* p) {
+		int x;
+		memcpy(&x, p, sizeof(x));
+		return _mm_cvtepi8_epi32(_mm_cvtsi32_si128(x));
+	}
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm_add_epi32(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm_sub_epi32(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm_max_epi32(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm_cmpeq_epi32(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) { return _mm_insert_epi32(_mm_slli_si128(v, 4), x, 0); }
+	static inline int v_last(vec_t v) { return _mm_extract_epi32(v, 3); }
+	static inline vec_t v_broadcast_last(vec_t v) { return _mm_shuffle_epi32(v, 0xFF); }
+	/** Inclusive prefix maximum of the lanes */
+	static inline vec_t v_scan_max(vec_t v) {
+		v = _mm_max_epi32(v, _mm_or_si128(_mm_slli_si128(v, 4), _mm_setr_epi32(-INF, 0, 0, 0)));
+		v = _mm_max_epi32(v, _mm_or_si128(_mm_slli_si128(v, 8), _mm_setr_epi32(-INF, -INF, 0, 0)));
+		return v;
+	}
+
+#include "sw_stage4_kernel.h"
+}
+#pragma GCC pop_options
+
+/*
+ * AVX2 column kernel: 8 lanes.
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace stage4_avx2 {
+	typedef __m256i vec_t;
+	typedef __m256i mask_t;
+	static const int LANES = 8;
+
+	static inline vec_t v_set1(int x) { return _mm256_set1_epi32(x); }
+	static inline vec_t v_loadu(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static inline void v_storeu(int* p, vec_t v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static inline vec_t v_load_chars(const char* p) { return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)p)); }
+	static inline vec_t v_add(vec_t a, vec_t b) { return _mm256_add_epi32(a, b); }
+	static inline vec_t v_sub(vec_t a, vec_t b) { return _mm256_sub_epi32(a, b); }
+	static inline vec_t v_max(vec_t a, vec_t b) { return _mm256_max_epi32(a, b); }
+	static inline mask_t v_cmpeq(vec_t a, vec_t b) { return _mm256_cmpeq_epi32(a, b); }
+	static inline vec_t v_blend(mask_t m, vec_t a, vec_t b) { return _mm256_blendv_epi8(a, b, m); }
+	static inline vec_t v_shift_in(vec_t v, int x) {
+		const vec_t idx = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+		return _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v, idx), _mm256_set1_epi32(x), 0x01);
+	}
+	static inline int v_last(vec_t v) { return _mm_extract_epi32(_mm256_extracti128_si256(v, 1), 3); }
+	static inline vec_t v_broadcast_last(vec_t v) { return _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7)); }
+	/** Inclusive prefix maximum of the lanes: inside each half, then across the halves */
+	static inline vec_t v_scan_max(vec_t v) {
+		const vec_t inf = _mm256_set1_epi32(-INF);
+		v = _mm256_max_epi32(v, _mm256_blend_epi32(_mm256_slli_si256(v, 4), inf, 0x11));
+		v = _mm256_max_epi32(v, _mm256_blend_epi32(_mm256_slli_si256(v, 8), inf, 0x33));
+		vec_t low = _mm256_shuffle_epi32(_mm256_permute2x128_si256(v, v, 0x08), 0xFF);
+		return _mm256_max_epi32(v, _mm256_blend_epi32(low, inf, 0x0F));
+	}
+
+#include "sw_stage4_kernel.h"
+}
+#pragma GCC pop_options
+
+#endif
+
+/**
+ * Chooses the column kernel of the best instruction set supported by the cpu.
+ *
+ * @param instructionSet receives the chosen instruction set (SIMD_NONE,
+ * 		SIMD_SSE41 or SIMD_AVX2).
+ */
+static column_kernel_f select_column_kernel(int* instructionSet) {
+#ifdef SIMD_X86_ENABLED
+	int detected = SIMDBlockProcessor::detectInstructionSet();
+	if (detected >= SIMD_AVX2) {
+		*instructionSet = SIMD_AVX2;
+		return stage4_avx2::process_column;
+	}
+	if (detected == SIMD_SSE41) {
+		*instructionSet = SIMD_SSE41;
+		return stage4_sse41::process_column;
+	}
+#endif
+	*instructionSet = SIMD_NONE;
+	return process_column_scalar;
+}
+
+/** Column kernel used by ort_split_simd, chosen in stage4() */
+static column_kernel_f column_kernel = process_column_scalar;
+
 static bool match(cell_t a, cell_t b, int diff, crosspoint_t* pt) {
 	int sum_match = a.h + b.h;
 	int sum_gap = a.f + b.f + dna_gap_open;
@@ -296,7 +465,8 @@ static bool match(cell_t a, cell_t b, int diff, crosspoint_t* pt) {
 
 static crosspoint_t ort_split_2(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1,
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1, cell_t *c0, cell_t *c1) {
+						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1, cell_t *c0, cell_t *c1,
+						SequenceWindow* windows) {
 	if (DEBUG) printf("%d %d %d %d %d %d   %d %d\n", i0, j0, i1, j1, type_s, type_e, score_s, score_e);
 
 	int seq0_len = i1-i0;
@@ -319,10 +489,13 @@ static crosspoint_t ort_split_2(Sequence *seq0, Sequence *seq1, int i0, int j0,
 
 	/* Forward */
 
-	const char* s0 = seq0->getData(false)+(i0);
-	const char* s1 = seq1->getData(false)+(j0);
-	const char* s0r = seq0->getData(true)+(seq0->getInfo()->getSize()-i1);
-	const char* s1r = seq1->getData(true)+(seq1->getInfo()->getSize()-j1);
+	/* only the characters of the partition are decoded */
+	int size0 = seq0->getInfo()->getSize();
+	int size1 = seq1->getInfo()->getSize();
+	const char* s0 = windows[0].load(seq0, i0, i1)+(i0);
+	const char* s1 = windows[1].load(seq1, j0, j1)+(j0);
+	const char* s0r = windows[2].load(seq0, size0-i1, size0-i0, true)+(size0-i1);
+	const char* s1r = windows[3].load(seq1, size1-j1, size1-j0, true)+(size1-j1);
 
 //	for (int i=0; i<seq0_len; i++) {
 //		printf("%d: %c%c\n", i, s0[i], s0r[i]);
@@ -379,9 +552,97 @@ static crosspoint_t ort_split_2(Sequence *seq0, Sequence *seq1, int i0, int j0,
 	exit(1);
 }
 
+/**
+ * Same as ort_split_2, but the columns are stored as separate H and E
+ * arrays (h0/e0 for the forward half and h1/e1 for the reverse half) and
+ * are computed by the vectorized column_kernel.
+ */
+static crosspoint_t ort_split_simd(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1,
+						int type_s, int type_e, int score_s, int score_e,
+						int *h0, int *h1, int *e0, int *e1, cell_t *r0, cell_t *r1,
+						SequenceWindow* windows) {
+	if (DEBUG) printf("%d %d %d %d %d %d   %d %d\n", i0, j0, i1, j1, type_s, type_e, score_s, score_e);
+
+	int seq0_len = i1-i0;
+	int seq1_len = j1-j0;
+
+	if (seq1_len >= H_MAX) {
+		fprintf(stderr, "Partition size is too large (%d > %d). You need to store more special rows in stages 1-3.\n", seq1_len, H_MAX);
+		exit(1);
+	}
+
+	int diff = score_e - score_s;
+
+	int imid = seq0_len/2;
+	int imid0 = imid;
+	int imid1 = seq0_len - imid; // (imid1 >= imid0) is always true
+
+	int jmid = seq1_len/2;
+	int jmid0 = jmid;
+	int jmid1 = seq1_len - jmid; //  (jmid1 >= jmid0) is always true
+
+	/* only the characters of the partition are decoded */
+	int size0 = seq0->getInfo()->getSize();
+	int size1 = seq1->getInfo()->getSize();
+	const char* s0 = windows[0].load(seq0, i0, i1)+(i0);
+	const char* s1 = windows[1].load(seq1, j0, j1)+(j0);
+	const char* s0r = windows[2].load(seq0, size0-i1, size0-i0, true)+(size0-i1);
+	const char* s1r = windows[3].load(seq1, size1-j1, size1-j0, true)+(size1-j1);
+
+	for (int i=0; i<imid0; i++) {
+		h0[i] = -(i+1)*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_2);
+		e0[i] = -INF;
+	}
+	for (int i=0; i<imid1; i++) {
+		h1[i] = -(i+1)*dna_gap_ext - dna_gap_open;
+		e1[i] = -INF;
+	}
+	r0[0].h = r0[0].f = h0[imid0-1];
+	r1[0].h = r1[0].f = h1[imid1-1];
+
+	crosspoint_t cross;
+
+	int d0 = (type_s!=TYPE_MATCH)?-INF:0;
+	int d1 = (type_e!=TYPE_MATCH)?-INF:0;
+	for (int j=0; j<seq1_len; j++) {
+		/* H of the first row in the forward and reverse columns */
+		int b0 = -(j+1)*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_1);
+		cell_t rr0 = column_kernel(s0, s1[j], d0, b0, h0, e0, imid0);
+		d0 = b0;
+
+		int b1 = -(j+1)*dna_gap_ext - dna_gap_open;
+		cell_t rr1 = column_kernel(s0r, s1r[j], d1, b1, h1, e1, imid1);
+		d1 = b1;
+
+		if (j+1<=jmid1) {
+			r0[j+1] = rr0;
+			r1[j+1] = rr1;
+		}
+		if (DEBUG) printf("%d: %d %d  (%d %d) (%d %d)\n", j, rr0.h, rr1.h, imid0, imid1, jmid0, jmid1);
+
+		if (j+1>=jmid1) {
+			if (match(rr0, r1[seq1_len-(j+1)], diff, &cross)) {
+				cross.j = j0+(j+1);
+				cross.i = imid0+i0;
+				cross.score += score_s;
+				return cross;
+			}
+			if (match(r0[seq1_len-(j+1)], rr1, diff, &cross)) {
+				cross.j = j0+(seq1_len-(j+1));
+				cross.i = imid0+i0;
+				cross.score += score_s;
+				return cross;
+			}
+		}
+	}
+	if (DEBUG) printf("NOT FOUND %d\n", diff);
+	fprintf(stderr, "NOT FOUND %d (%d %d %d %d - %d %d %d %d)\n", diff, type_s, i0, j0, score_s, type_e, i1, j1, score_e);
+	exit(1);
+}
+
 static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, 
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1) {
+						int *h0, int *h1, int *e0, int *e1, SequenceWindow* windows) {
 	
 	if (DEBUG) printf("%d %d %d %d %d %d\n", i0, j0, i1, j1, type_s, type_e, score_s, score_e);
 	
@@ -397,10 +658,14 @@ static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, in
 	int mid0 = mid;
 	int mid1 = seq0_len - mid;
 	
+	/* the characters of the partition, indexed like getData() */
+	const char* d0 = windows[0].load(seq0, i0-1, i1+1);
+	const char* d1 = windows[1].load(seq1, j0-1, j1+1);
+
 	/* Forward */
 	
-	const char* s0 = seq0->getData()+(i0-1);
-	const char* s1 = seq1->getData()+(j0-1);
+	const char* s0 = d0+(i0-1);
+	const char* s1 = d1+(j0-1);
 	
 	for (int j=1; j<=seq1_len; j++) {
 		h0[j] = -j*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_1);
@@ -438,8 +703,8 @@ static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, in
 	int diff = 	(score_e + (type_e == TYPE_MATCH ? 0 : dna_gap_open)) - score_s;
 	
 	
-	const char* s0r = seq0->getData()+(i1-1);
-	const char* s1r = seq1->getData()+(j1-1);
+	const char* s0r = d0+(i1-1);
+	const char* s1r = d1+(j1-1);
 	
 	for (int i=1; i<=mid1; i++) {
 		h1[i] = -i*dna_gap_ext - dna_gap_open*(type_e!=TYPE_GAP_2);
@@ -550,8 +815,8 @@ static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, in
 		const char s=s0[-(i-1)];
 		if (PRINT) printf("%2d/%2d ", h1[0], e1[0]);
 		for (int j=1; j<=seq1_len; j++) {
-			e1[j] = MAX(h1[j]-DNA_GAP_FIRST, e1[j]-dna_gap_ext);
-			f1 = MAX(h_next-DNA_GAP_FIRST, f1-dna_gap_ext);
+			e1[j] = MAX(h1[j]-dna_gap_first, e1[j]-dna_gap_ext);
+			f1 = MAX(h_next-dna_gap_first, f1-dna_gap_ext);
 			h_next = MAX3(h_tmp+((s==s1[-(j-1)])?dna_match:dna_mismatch), e1[j], f1);
 			h_tmp = h1[j];
 			h1[j] = h_next;
@@ -639,9 +904,14 @@ static crosspoint_t ort_split(Sequence *seq0, Sequence *seq1, int i0, int j0, in
 /*
 */
 
+/*
+ * If a region is given, the cells outside the region are -INF, so the
+ * crosspoint is found among the paths inside the region.
+ */
 static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, 
 						int type_s, int type_e, int score_s, int score_e,
-						int *h0, int *h1, int *e0, int *e1) {
+						int *h0, int *h1, int *e0, int *e1, SequenceWindow* windows,
+						const AlignmentRegion* region, bool transposed) {
 
 	if (DEBUG) printf("%d %d %d %d %d %d\n", i0, j0, i1, j1, type_s, type_e, score_s, score_e);
 
@@ -658,10 +928,14 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
     int mid1 = seq0_len - mid;
 
 
+    /* the characters of the partition, indexed like getData() */
+    const char* d0 = windows[0].load(seq0, i0-1, i1+1);
+    const char* d1 = windows[1].load(seq1, j0-1, j1+1);
+
     /* Forward */
 
-    const char* s0 = seq0->getData()+(i0-1);
-    const char* s1 = seq1->getData()+(j0-1);
+    const char* s0 = d0+(i0-1);
+    const char* s1 = d1+(j0-1);
 
     for (int j=1; j<=seq1_len; j++) {
         h0[j] = -j*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_1);
@@ -669,11 +943,21 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
     }
     h0[0] = (type_s!=TYPE_MATCH)?-INF:0;
     e0[0] = (type_s!=TYPE_GAP_2)?-INF:0;
+    if (region != NULL) {
+        for (int j=1; j<=seq1_len; j++) {
+            if (!inside_region(region, transposed, i0, j0+j)) {
+                h0[j] = e0[j] = -INF;
+            }
+        }
+    }
 
     for (int i=1; i<=mid0; i++) {
         int h_tmp = h0[0];
         int h_next;
         h_next = h0[0] = e0[0] = -i*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_2);
+        if (region != NULL && !inside_region(region, transposed, i0+i, j0)) {
+            h_next = h0[0] = e0[0] = -INF;
+        }
         int f0 = -INF;
         const char s=s0[i];
         //if (DEBUG) printf("%2d/%2d ", h0[0], e0[0]);
@@ -681,6 +965,9 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
             e0[j] = MAX(h0[j]-dna_gap_first, e0[j]-dna_gap_ext);
             f0 = MAX(h_next-dna_gap_first, f0-dna_gap_ext);
             h_next = MAX3(h_tmp+((s==s1[j])?dna_match:dna_mismatch), e0[j], f0);
+            if (region != NULL && !inside_region(region, transposed, i0+i, j0+j)) {
+                h_next = e0[j] = f0 = -INF;
+            }
             h_tmp = h0[j];
             h0[j] = h_next;
             //if (DEBUG) printf("%2d/%2d ", h_next, e0[j]);
@@ -694,8 +981,8 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
     /* Reverse */
 
 
-    s0 = seq0->getData()+(i1-1);
-    s1 = seq1->getData()+(j1-1);
+    s0 = d0+(i1-1);
+    s1 = d1+(j1-1);
 
     for (int j=1; j<=seq1_len; j++) {
         h1[j] = -j*dna_gap_ext - dna_gap_open*(type_e!=TYPE_GAP_1);
@@ -703,11 +990,21 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
     }
     h1[0] = (type_e!=TYPE_MATCH)?-INF:0;
     e1[0] = (type_e!=TYPE_GAP_2)?-INF:0;
+    if (region != NULL) {
+        for (int j=1; j<=seq1_len; j++) {
+            if (!inside_region(region, transposed, i1, j1-j)) {
+                h1[j] = e1[j] = -INF;
+            }
+        }
+    }
 
     for (int i=1; i<=mid1; i++) {
         int h_tmp = h1[0];
         int h_next;
         h_next = h1[0] = e1[0] = -i*dna_gap_ext - dna_gap_open*(type_e!=TYPE_GAP_2);
+        if (region != NULL && !inside_region(region, transposed, i1-i, j1)) {
+            h_next = h1[0] = e1[0] = -INF;
+        }
         int f1 = -INF;
         const char s=s0[-(i-1)];
         //if (DEBUG) printf("%2d/%2d ", h1[0], e1[0]);
@@ -715,6 +1012,9 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
             e1[j] = MAX(h1[j]-dna_gap_first, e1[j]-dna_gap_ext);
             f1 = MAX(h_next-dna_gap_first, f1-dna_gap_ext);
             h_next = MAX3(h_tmp+((s==s1[-(j-1)])?dna_match:dna_mismatch), e1[j], f1);
+            if (region != NULL && !inside_region(region, transposed, i1-i, j1-j)) {
+                h_next = e1[j] = f1 = -INF;
+            }
             h_tmp = h1[j];
             h1[j] = h_next;
 
@@ -729,8 +1029,8 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
 
 
 
-    s0 = seq0->getData()+(i0-1);
-    s1 = seq1->getData()+(j0-1);
+    s0 = d0+(i0-1);
+    s1 = d1+(j0-1);
 
     int ii, jj, tt, best, ss;
     best = -INF;
@@ -782,73 +1082,182 @@ static crosspoint_t split(Sequence *seq0, Sequence *seq1, int i0, int j0, int i1
     return pt;
 }
 
-int merge_partitions(CrosspointsFile* crosspoints, crosspoint_t *new_positions) {
-    vector<crosspoint_t> merged_partitions;
-    merged_partitions.clear();
-    merged_partitions.push_back(crosspoints->at(0));
-    int has_new_pos = 0;
-    for (int i=1; i<crosspoints->size(); i++) {
-        bool diff_pos = (new_positions[i].i!=crosspoints->at(i-1).i || new_positions[i].j!=crosspoints->at(i-1).j);
-        if (new_positions[i].type != -1 && diff_pos) {
-            has_new_pos = 1;
-            merged_partitions.push_back(new_positions[i]);
-        }
-        merged_partitions.push_back(crosspoints->at(i));
-    }
-    if (has_new_pos) {
-    	crosspoints->clear();
-    	crosspoints->assign(merged_partitions.begin(), merged_partitions.end());
-    	//crosspoints->save();
-    }
-    return has_new_pos;
+static void push_partition(split_worker_t* worker, split_node_t* node) {
+	pthread_mutex_lock(&worker->mutex);
+	worker->queue.push_back(node);
+	pthread_mutex_unlock(&worker->mutex);
 }
 
-static int reduce_partitions(Job* job, CrosspointsFile* crosspoints) {
-    /*int i0, j0, i1, j1, start_type, prev_type, prev_score;
-
-    int partition_id = 0;
-    i1 = job->crosspoints[partition_id].i;
-    j1 = job->crosspoints[partition_id].j;
-    prev_type = job->crosspoints[partition_id].type;
-    prev_score = job->crosspoints[partition_id].score;*/
+/**
+ * Obtains a partition, first from the worker's own queue (newest partition)
+ * and then from the other queues (oldest partition, i.e., the largest one).
+ */
+static split_node_t* pop_partition(split_worker_t* worker) {
+	split_pool_t* pool = worker->pool;
+	split_node_t* node = NULL;
+	pthread_mutex_lock(&worker->mutex);
+	if (!worker->queue.empty()) {
+		node = worker->queue.back();
+		worker->queue.pop_back();
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	for (int k = 1; k < pool->threadCount && node == NULL; k++) {
+		split_worker_t* victim = &pool->workers[(worker->id + k) % pool->threadCount];
+		pthread_mutex_lock(&victim->mutex);
+		if (!victim->queue.empty()) {
+			node = victim->queue.front();
+			victim->queue.pop_front();
+		}
+		pthread_mutex_unlock(&victim->mutex);
+		if (node != NULL) {
+			__sync_add_and_fetch(&pool->stolen, 1);
+		}
+	}
+	return node;
+}
 
-    static pthread_t thread[NUM_THREADS];
-    static split_args_t args[NUM_THREADS];
-    crosspoint_t *new_partitions = (crosspoint_t *)malloc(crosspoints->size()*sizeof(crosspoint_t));
+/**
+ * Splits partitions until every queue is empty. Each split partition
+ * enqueues its two halves in the worker's own queue.
+ */
+static void *split_thread(void *thread_arg) {
+	split_worker_t* worker = (split_worker_t*)thread_arg;
+	split_pool_t* pool = worker->pool;
+	Tracer::setThreadName("stage4 worker");
+	while (true) {
+		split_node_t* node = pop_partition(worker);
+		if (node == NULL) {
+			if (__sync_add_and_fetch(&pool->pending, 0) == 0) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		crosspoint_t mid;
+		if (split_partition(pool->job, worker->args, node->c0, node->c1, &mid)) {
+			node->left = new split_node_t;
+			node->left->c0 = node->c0;
+			node->left->c1 = mid;
+			node->left->left = node->left->right = NULL;
+			node->right = new split_node_t;
+			node->right->c0 = mid;
+			node->right->c1 = node->c1;
+			node->right->left = node->right->right = NULL;
+
+			__sync_add_and_fetch(&pool->pending, 2);
+			__sync_add_and_fetch(&pool->splits, 1);
+			push_partition(worker, node->right);
+			push_partition(worker, node->left);
+		}
+		__sync_sub_and_fetch(&pool->pending, 1);
+	}
+	return NULL;
+}
 
-    int num_threads = NUM_THREADS;
-    if (num_threads >= crosspoints->size()-1) {
-    	num_threads = crosspoints->size()-1;
+static void create_split_thread(split_worker_t* worker) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    int rc = pthread_create(&worker->thread, &attr, split_thread, (void *)worker);
+    if (rc) {
+        printf("ERROR; return code from pthread_create() is %d\n", rc);
+        exit(-1);
     }
+}
 
-    for (int i=0; i<num_threads; i++) {
-        args[i].job = job;
-        args[i].crosspoints = crosspoints;
-        args[i].out_pos = new_partitions;
-        args[i].partition1 = (crosspoints->size()-1)*(i+1)/num_threads;
-        if (i==0) {
-            args[0].partition0 = 0;
-        } else {
-            args[i].partition0 = args[i-1].partition1;
-        }
-        printf("Thread %d [%d..%d] (%d)\n", i, args[i].partition0, args[i].partition1, crosspoints->size());
+/**
+ * Appends the end crosspoints of the leaves of the tree, in order, and
+ * releases the nodes.
+ */
+static void collect_partitions(split_node_t* node, vector<crosspoint_t>& out) {
+	if (node->left == NULL) {
+		out.push_back(node->c1);
+	} else {
+		collect_partitions(node->left, out);
+		collect_partitions(node->right, out);
+		delete node->left;
+		delete node->right;
+	}
+}
+
+/**
+ * Splits all the partitions until they are smaller than the maximum
+ * partition size, using a work-stealing pool of threads.
+ *
+ * @return the number of splits.
+ */
+static int reduce_partitions(Job* job, CrosspointsFile* crosspoints, int* stolen) {
+	int count = crosspoints->size()-1;
+	if (count <= 0) {
+		return 0;
+	}
+
+    int num_threads = job->getThreadCount();
+    if (num_threads > count) {
+    	num_threads = count;
+    }
+    if (num_threads < 1) {
+    	num_threads = 1;
     }
-    //args[num_threads-1].partition1 = crosspoints->size()-1;
 
-    for (int i=0; i<num_threads; i++) {
-        //printf("%d: %d-%d  (%d)\n", i, args[i].partition0, args[i].partition1, job->partitions_count);
-        create_split_thread(&args[i], &thread[i]);
+	split_pool_t pool;
+	pool.job = job;
+	pool.threadCount = num_threads;
+	pool.workers = new split_worker_t[num_threads];
+	pool.pending = count;
+	pool.splits = 0;
+	pool.stolen = 0;
+
+	/* Initial partitions are distributed in contiguous ranges */
+	split_node_t* roots = new split_node_t[count];
+	for (int i=0; i<num_threads; i++) {
+		split_worker_t* worker = &pool.workers[i];
+		worker->id = i;
+		worker->pool = &pool;
+		worker->args = new split_args_t;
+		pthread_mutex_init(&worker->mutex, NULL);
+		int k0 = count*i/num_threads;
+		int k1 = count*(i+1)/num_threads;
+		printf("Thread %d [%d..%d] (%d)\n", i, k0, k1, crosspoints->size());
+		for (int k=k1-1; k>=k0; k--) {
+			roots[k].c0 = crosspoints->at(k);
+			roots[k].c1 = crosspoints->at(k+1);
+			roots[k].left = roots[k].right = NULL;
+			worker->queue.push_back(&roots[k]);
+		}
+	}
+
+	// The current thread is the worker 0.
+    for (int i=1; i<num_threads; i++) {
+        create_split_thread(&pool.workers[i]);
     }
-    for (int i=0; i<num_threads; i++) {
-        int rc = pthread_join(thread[i], NULL);
+    split_thread(&pool.workers[0]);
+    for (int i=1; i<num_threads; i++) {
+        int rc = pthread_join(pool.workers[i].thread, NULL);
         if (rc) {
             printf("ERROR; return code from pthread_join() is %d\n", rc);
             exit(-1);
         }
     }
-    int has_new_partitions = merge_partitions(crosspoints, new_partitions);
-    free(new_partitions);
-    return has_new_partitions;
+
+    vector<crosspoint_t> reduced;
+    reduced.push_back(crosspoints->at(0));
+    for (int k=0; k<count; k++) {
+    	collect_partitions(&roots[k], reduced);
+    }
+    crosspoints->clear();
+    crosspoints->assign(reduced.begin(), reduced.end());
+
+	for (int i=0; i<num_threads; i++) {
+		delete pool.workers[i].args;
+		pthread_mutex_destroy(&pool.workers[i].mutex);
+	}
+	delete[] pool.workers;
+	delete[] roots;
+
+	*stolen = pool.stolen;
+	return pool.splits;
 }
 
 int stage4_pool_wait(Job* job, int id) {
@@ -881,6 +1290,7 @@ int stage4_pool_wait(Job* job, int id) {
 }
 
 void stage4(Job* job, int id) {
+	TRACE_SPAN(TRACE_STAGE, "stage4");
 	FILE* stats = job->fopenStatistics(STAGE_4, id);
 	Sequence* seq0 = job->getAlignmentParams()->getSequence(0);
 	Sequence* seq1 = job->getAlignmentParams()->getSequence(1);
@@ -898,6 +1308,11 @@ void stage4(Job* job, int id) {
 	
 	fprintf(stats, "MAXIMUM PARTITION SIZE: %d\n", job->stage4_maximum_partition_size);
 	fprintf(stats, "STAGE4 STRATEGY: #%d\n", job->stage4_strategy);
+	if (job->stage4_strategy == STAGE_4_STRATEGY_SIMD) {
+		int instructionSet;
+		column_kernel = select_column_kernel(&instructionSet);
+		fprintf(stats, "STAGE4 INSTRUCTION SET: %s\n", SIMDBlockProcessor::getInstructionSetName(instructionSet));
+	}
 	
 	Timer timer2;
 	
@@ -909,6 +1324,8 @@ void stage4(Job* job, int id) {
 	
 	timer2.eventRecord(ev_start);
 	
+	region = job->createAlignmentRegion(STAGE_4);
+
 	CrosspointsFile* stage3Crosspoints = new CrosspointsFile(job->getCrosspointFile(STAGE_3, id));
 	stage3Crosspoints->loadCrosspoints();
 	//stage3Crosspoints->reverse(seq0_len, seq1_len);
@@ -919,39 +1336,31 @@ void stage4(Job* job, int id) {
 	
 	timer2.eventRecord(ev_crosspoints);
 	
-	int must_write_partitions = 0;
-	int step = 1;
 	int max_i, max_j;
-	float step_sum = 0;
-	while (crosspoints->getLargestPartitionSize(&max_i, &max_j) > job->stage4_maximum_partition_size) {
-		int crosspoints_count = crosspoints->size();
-		if (step == 1) {
-			fprintf(stats, "-step %2d  max size: %5dx%5d crosspoints: %8d   time: %.4f   sum:%.4f\n", 
-					0, max_i, max_j, crosspoints_count, 0.0f, 0.0f);
-			fflush(stats);
-		}
-		if (!reduce_partitions(job, crosspoints)) {
-			fprintf(stderr, "Didn't reduce partition.\n");
-            // TODO tratar erro? não houve redução!
-            break;
-        }
-		float step_diff = timer2.eventRecord(ev_step);
-		step_sum += step_diff;
-		fprintf(stats, " step %2d  max size: %5dx%5d crosspoints: %8d   time: %.4f   sum:%.4f\n", 
-				step, max_i, max_j, crosspoints_count, step_diff, step_sum);
-		fflush(stats);
-		//timer2.eventRecord(ev_write);
-		step++;
+	crosspoints->getLargestPartitionSize(&max_i, &max_j);
+	fprintf(stats, "-step %2d  max size: %5dx%5d crosspoints: %8d   time: %.4f   sum:%.4f\n",
+			0, max_i, max_j, crosspoints->size(), 0.0f, 0.0f);
+	fflush(stats);
+
+	int stolen = 0;
+	int splits = reduce_partitions(job, crosspoints, &stolen);
+	if (crosspoints->getLargestPartitionSize(&max_i, &max_j) > job->stage4_maximum_partition_size) {
+		fprintf(stderr, "Didn't reduce partition.\n");
 	}
+
 	float step_diff = timer2.eventRecord(ev_step);
-	step_sum += step_diff;
-	fprintf(stats, "-step %2d  max size: %5dx%5d crosspoints: %8d   time: %.4f   sum:%.4f\n", 
-			step, max_i, max_j, crosspoints->size(), step_diff, step_sum);
+	fprintf(stats, "-step %2d  max size: %5dx%5d crosspoints: %8d   time: %.4f   sum:%.4f\n",
+			1, max_i, max_j, (int)crosspoints->size(), step_diff, step_diff);
+	fprintf(stats, "Splits: %d  Stolen: %d\n", splits, stolen);
 	fflush(stats);
 	timer2.eventRecord(ev_start);
 	
     crosspoints->save();
 	delete crosspoints;
+	if (region != NULL) {
+		delete region;
+		region = NULL;
+	}
 
 	timer2.eventRecord(ev_write);
 	
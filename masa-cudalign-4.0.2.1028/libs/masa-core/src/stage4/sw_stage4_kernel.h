@@ -0,0 +1,113 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2010-2015   Edans Sandes
+ *
+ * This file is part of MASA-Core.
+ * 
+ * MASA-Core is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * MASA-Core is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with MASA-Core.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/*
+ * Column kernel of the SIMD strategy of stage 4.
+ *
+ * This file has no include guards on purpose. It is included once for each
+ * instruction set inside a namespace that defines the vector primitives
+ * (vec_t, LANES, v_add, v_max, v_shift_in, v_scan_max, ...) and inside a
+ * "#pragma GCC target" region, like SIMDBlockProcessorKernel.hpp.
+ */
+
+/**
+ * Vectorized version of processCol, with the column stored as separate
+ * H and E arrays.
+ *
+ * E and the diagonal candidate D of each cell only depend on the previous
+ * column, so they are computed LANES cells at a time. F depends on the cell
+ * above, but when opening a gap costs at least as much as extending it,
+ * F of cell j is the best of D[k] - first - (j-1-k)*ext for k < j (where
+ * D[-1] is the H of the first row). So F is a prefix maximum of
+ * D[k] + k*ext, computed inside each vector and carried to the next one.
+ * The results are identical to processCol.
+ *
+ * @param s0 the characters of the column.
+ * @param c the character of the other sequence in this column.
+ * @param h11 H of the first row in the previous column.
+ * @param h10 H of the first row in this column.
+ * @param h the H values, updated from the previous to this column.
+ * @param e the E values, updated from the previous to this column.
+ * @param len the number of cells of the column.
+ * @return the H and F values of the last cell.
+ */
+static cell_t process_column(const char* s0, const char c, int h11, int h10, int* h, int* e, const int len) {
+	int f0 = -INF;
+	int j = 0;
+	if (dna_gap_first >= dna_gap_ext && len >= LANES) {
+		const vec_t v_c = v_set1(c);
+		const vec_t v_match = v_set1(dna_match);
+		const vec_t v_mismatch = v_set1(dna_mismatch);
+		const vec_t v_first = v_set1(dna_gap_first);
+		const vec_t v_ext = v_set1(dna_gap_ext);
+		const vec_t v_ext_lanes = v_set1(LANES*dna_gap_ext);
+
+		/* (k-1)*ext for the cells k of the vector */
+		int k[LANES];
+		for (int l=0; l<LANES; l++) {
+			k[l] = (l-1)*dna_gap_ext;
+		}
+		vec_t v_k = v_loadu(k);
+
+		vec_t carry = v_set1(-INF);
+		vec_t fv = carry;
+		/* the cell above the vector: new D (or H of the first row), new H and old H */
+		int last_d = h10;
+		int last_h = h10;
+		int last_old = h11;
+		for (; j+LANES <= len; j+=LANES) {
+			vec_t old_h = v_loadu(h+j);
+			vec_t open = v_sub(old_h, v_first);
+			vec_t ev = v_max(open, v_sub(v_loadu(e+j), v_ext));
+			mask_t eq = v_cmpeq(v_load_chars(s0+j), v_c);
+			vec_t diag = v_add(v_shift_in(old_h, last_old), v_blend(eq, v_mismatch, v_match));
+			vec_t dv = v_max(diag, ev);
+
+			vec_t g = v_max(v_scan_max(v_add(v_shift_in(dv, last_d), v_k)), carry);
+			carry = v_broadcast_last(g);
+			fv = v_sub(v_sub(g, v_first), v_k);
+			vec_t hv = v_max(dv, fv);
+
+			v_storeu(e+j, ev);
+			v_storeu(h+j, hv);
+			last_old = v_last(old_h);
+			last_d = v_last(dv);
+			last_h = v_last(hv);
+			v_k = v_add(v_k, v_ext_lanes);
+		}
+		if (j > 0) {
+			f0 = v_last(fv);
+			h10 = last_h;
+			h11 = last_old;
+		}
+	}
+	for (; j<len; j++) {
+		e[j] = MAX(h[j]-dna_gap_first, e[j]-dna_gap_ext);
+		f0 = MAX(h10-dna_gap_first, f0-dna_gap_ext);
+		h10 = MAX3(h11+((c==s0[j])?dna_match:dna_mismatch), e[j], f0);
+		h11 = h[j];
+		h[j] = h10;
+	}
+	cell_t cell;
+	cell.f = f0;
+	cell.h = h10;
+	return cell;
+}
@@ -26,16 +26,99 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <pthread.h>
 
-#include "../common/Common.hpp"
+#include <vector>
+using namespace std;
 
-#define H_MAX (1*1024)
-#define W_MAX (1*1024)
+#include "../common/Common.hpp"
+#include "../common/biology/SequenceWindow.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/** Largest partition (in each dimension) accepted by stage 5 */
+#define MAX_PARTITION_SIZE (16*1024)
+
+/*
+ * Traceback code of a cell, stored in 4 bits. The two lowest bits tell
+ * which candidate produced H (the first one in the order tested by the
+ * traceback) and the other bits tell whether E and F were opened from H.
+ */
+#define TB_H_DIAG	(0)
+#define TB_H_E		(1)
+#define TB_H_F		(2)
+#define TB_H_MASK	(3)
+#define TB_E_OPEN	(4)
+#define TB_F_OPEN	(8)
+
+/**
+ * Buffers used by each stage 5 worker. Only two rows of scores are kept,
+ * and the traceback follows the 4-bit codes of the cells, so each cell
+ * costs half a byte instead of the three int matrices (24 times less).
+ */
+struct stage5_matrix_t {
+	/** H of the previous and of the current rows */
+	int* h0;
+	int* h1;
+	/** E of the last computed row */
+	int* e;
+	/** Characters of the sequence 1, as int for the vector comparisons */
+	int* s1;
+	/** Traceback codes of the current row, one per byte */
+	unsigned char* codes;
+	/** Number of cells allocated for each row */
+	int rowCapacity;
+	/** Traceback codes of the partition, two per byte */
+	unsigned char* tb;
+	long long tbCapacity;
+	/** Decoded characters of the partition being aligned */
+	SequenceWindow window0;
+	SequenceWindow window1;
+
+	stage5_matrix_t() {
+		h0 = h1 = e = s1 = NULL;
+		codes = NULL;
+		rowCapacity = 0;
+		tb = NULL;
+		tbCapacity = 0;
+	}
 
-static int h[W_MAX][H_MAX];
-static int e[W_MAX][H_MAX];
-static int f[W_MAX][H_MAX];
+	~stage5_matrix_t() {
+		free(h0);
+		free(h1);
+		free(e);
+		free(s1);
+		free(codes);
+		free(tb);
+	}
 
+	/** Grows the buffers for a partition with the given number of cells */
+	void reserve(int rows, int cols) {
+		if (cols + 1 > rowCapacity) {
+			/* padding for the vector loads past the end of the row */
+			rowCapacity = cols + 1;
+			int bytes = (rowCapacity + 16) * sizeof(int);
+			h0 = (int*)realloc(h0, bytes);
+			h1 = (int*)realloc(h1, bytes);
+			e = (int*)realloc(e, bytes);
+			s1 = (int*)realloc(s1, bytes);
+			codes = (unsigned char*)realloc(codes, rowCapacity + 16);
+		}
+		long long tbSize = (long long)rows * ((cols+1)/2) + 16;
+		if (tbSize > tbCapacity) {
+			tbCapacity = tbSize;
+			free(tb);
+			tb = (unsigned char*)malloc(tbCapacity);
+		}
+		if (h0 == NULL || h1 == NULL || e == NULL || s1 == NULL
+				|| codes == NULL || tb == NULL) {
+			fprintf(stderr, "stage5: could not allocate the traceback buffers.\n");
+			exit(1);
+		}
+	}
+};
 
 
 #define DEBUG (0)
@@ -46,6 +129,9 @@ static int dna_gap_ext;
 static int dna_match;
 static int dna_mismatch;
 
+/** Region given by --band and --xdrop, or NULL for the whole matrix */
+static AlignmentRegion* region = NULL;
+
 struct total_score_t {
 	int score;
 	int matches;
@@ -60,30 +146,259 @@ struct total_score_t {
 		gapOpen = 0;
 		gapExtensions = 0;
 	}
+
+	void add(const total_score_t& other) {
+		score += other.score;
+		matches += other.matches;
+		mismatches += other.mismatches;
+		gapOpen += other.gapOpen;
+		gapExtensions += other.gapExtensions;
+	}
 };
 
+/** Gap found during the traceback of a partition */
+struct stage5_gap_t {
+	int seq;
+	int pos;
+};
+
+/**
+ * Result of a partition. The gaps are kept in the traceback order, so they
+ * can be merged into the Alignment exactly as if the partitions were
+ * processed serially.
+ */
+struct stage5_partition_t {
+	crosspoint_t m0;
+	crosspoint_t m1;
+	int sum;
+	total_score_t score;
+	vector<stage5_gap_t> gaps;
+};
+
+/** Data shared by the stage 5 workers */
+struct stage5_workers_t {
+	Sequence* seq0;
+	Sequence* seq1;
+	vector<stage5_partition_t>* partitions;
+	volatile int next;
+};
+
+
+static void addGap(stage5_partition_t* partition, int seq, int pos) {
+	stage5_gap_t gap;
+	gap.seq = seq;
+	gap.pos = pos;
+	partition->gaps.push_back(gap);
+}
 
 // i,j 1-based
-static void dot(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i, int j, int type) {
+static void dot(stage5_partition_t* partition, Sequence *seq0, Sequence *seq1, int i, int j, int type) {
     //int pt;
-    const char* s0 = seq0->getData()-1;
-    const char* s1 = seq1->getData()-1;
+    /* the characters are only printed in debug mode, since getData() decodes the whole strand */
+    const char* s0 = DEBUG ? seq0->getData()-1 : NULL;
+    const char* s1 = DEBUG ? seq1->getData()-1 : NULL;
     if (DEBUG) printf("(%5d,%5d) ", seq0->getAbsolutePos(i), seq1->getAbsolutePos(j));
     if (type == 0) {
         if (DEBUG) printf("%c%s%c [                 ]\n", s0[i], s0[i]==s1[j]?"-":" ", s1[j]);
     } else if (type == 1) {
     	int adjust = seq1->isReversed()?0:1;
         if (DEBUG) printf("%c - [ add(1, %7d) ]\n", s0[i], j+adjust);
-        alignment->addGapInSeq1(seq1->getAbsolutePos(j+adjust));
+        addGap(partition, 1, seq1->getAbsolutePos(j+adjust));
     } else if (type == 2) {
     	int adjust = seq0->isReversed()?0:1;
         if (DEBUG) printf("- %c [ add(0, %7d) ]\n", s1[j], i+adjust);
-        alignment->addGapInSeq0(seq0->getAbsolutePos(i+adjust));
+        addGap(partition, 0, seq0->getAbsolutePos(i+adjust));
     }
 }
 
+#ifdef __SSE2__
+static inline __m128i max_epi32(__m128i a, __m128i b) {
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+#endif
+
+/**
+ * Packs the traceback codes of the cells 1..len of a row, two per byte:
+ * cell 2k+1 in the low nibble and 2k+2 in the high nibble.
+ */
+static void packCodes(const unsigned char* codes, const int len, unsigned char* tb) {
+	int k = 0;
+#ifdef __SSE2__
+	const __m128i v_low = _mm_set1_epi16(0x000F);
+	for (; 2*k+16 <= len; k+=8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(codes+1+2*k));
+		v = _mm_or_si128(_mm_and_si128(v, v_low), _mm_slli_epi16(_mm_srli_epi16(v, 8), 4));
+		_mm_storel_epi64((__m128i*)(tb+k), _mm_packus_epi16(v, v));
+	}
+#endif
+	for (; 2*k < len; k++) {
+		int hi = (2*k+2 <= len) ? codes[2*k+2] : 0;
+		tb[k] = codes[2*k+1] | (hi << 4);
+	}
+}
+
+/**
+ * Computes the row below m->h0 into m->h1 (whose first column must be
+ * already set), and stores the traceback codes of the row in tb.
+ *
+ * E and the diagonal candidate D only depend on the previous row, so they
+ * are computed 4 cells at a time. F depends on the cell at the left, but
+ * when H is max(D,F) and opening a gap costs at least as much as extending
+ * it, F of cell j is the best of D[k] - first - (j-1-k)*ext for k < j. So
+ * F is obtained with a prefix maximum of D[k] + k*ext, that is computed
+ * inside each vector and carried to the next one.
+ *
+ * @param s the character of the sequence 0 in this row.
+ * @param len the number of cells of the row (excluding the first column).
+ * @param tb receives (len+1)/2 bytes with the codes of the cells 1..len.
+ */
+static void computeRow(stage5_matrix_t* m, const char s, const int len, unsigned char* tb) {
+	const int* h0 = m->h0;
+	int* h1 = m->h1;
+	int* e = m->e;
+	const int* s1 = m->s1;
+	unsigned char* codes = m->codes;
+
+	int j = 1;
+	/* F and H of the cell at the left */
+	int f = -INF;
+	int left = h1[0];
+#ifdef __SSE2__
+	if (dna_gap_first >= dna_gap_ext) {
+		const __m128i v_s = _mm_set1_epi32(s);
+		const __m128i v_match = _mm_set1_epi32(dna_match);
+		const __m128i v_mismatch = _mm_set1_epi32(dna_mismatch);
+		const __m128i v_first = _mm_set1_epi32(dna_gap_first);
+		const __m128i v_ext = _mm_set1_epi32(dna_gap_ext);
+		const __m128i v_ext4 = _mm_set1_epi32(4*dna_gap_ext);
+		const __m128i v_inf1 = _mm_set_epi32(0, 0, 0, -INF);
+		const __m128i v_inf2 = _mm_set_epi32(0, 0, -INF, -INF);
+		const __m128i v_code_e = _mm_set1_epi32(TB_H_E);
+		const __m128i v_code_f = _mm_set1_epi32(TB_H_F);
+		const __m128i v_e_open = _mm_set1_epi32(TB_E_OPEN);
+		const __m128i v_f_open = _mm_set1_epi32(TB_F_OPEN);
+		/* (k-1)*ext for the cells k of the vector */
+		__m128i v_k = _mm_set_epi32(2*dna_gap_ext, dna_gap_ext, 0, -dna_gap_ext);
+		/* the last lanes hold the cell at the left of the vector */
+		__m128i last_d = _mm_set_epi32(left, 0, 0, 0);
+		__m128i last_h = last_d;
+		__m128i carry = _mm_set1_epi32(-INF);
+		__m128i fv = carry;
+		for (; j+4 <= len+1; j+=4) {
+			__m128i up = _mm_loadu_si128((const __m128i*)(h0+j));
+			__m128i diag = _mm_loadu_si128((const __m128i*)(h0+j-1));
+			__m128i open = _mm_sub_epi32(up, v_first);
+			__m128i ev = max_epi32(open, _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(e+j)), v_ext));
+			__m128i eq = _mm_cmpeq_epi32(v_s, _mm_loadu_si128((const __m128i*)(s1+j-1)));
+			diag = _mm_add_epi32(diag, _mm_or_si128(_mm_and_si128(eq, v_match), _mm_andnot_si128(eq, v_mismatch)));
+			__m128i dv = max_epi32(diag, ev);
+			/* the diagonal has priority over E in the ties */
+			__m128i code = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(ev, diag), v_code_e),
+					_mm_and_si128(_mm_cmpeq_epi32(ev, open), v_e_open));
+
+			/* prefix maximum of D[k-1] + (k-1)*ext */
+			__m128i g = _mm_add_epi32(_mm_or_si128(_mm_slli_si128(dv, 4), _mm_srli_si128(last_d, 12)), v_k);
+			g = max_epi32(g, _mm_or_si128(_mm_slli_si128(g, 4), v_inf1));
+			g = max_epi32(g, _mm_or_si128(_mm_slli_si128(g, 8), v_inf2));
+			g = max_epi32(g, carry);
+			carry = _mm_shuffle_epi32(g, 0xFF);
+			fv = _mm_sub_epi32(_mm_sub_epi32(g, v_first), v_k);
+
+			__m128i hv = max_epi32(dv, fv);
+			__m128i h_left = _mm_or_si128(_mm_slli_si128(hv, 4), _mm_srli_si128(last_h, 12));
+			__m128i from_f = _mm_cmpgt_epi32(fv, dv);
+			code = _mm_or_si128(_mm_andnot_si128(from_f, code),
+					_mm_and_si128(from_f, _mm_or_si128(_mm_and_si128(code, v_e_open), v_code_f)));
+			code = _mm_or_si128(code, _mm_and_si128(_mm_cmpeq_epi32(fv, _mm_sub_epi32(h_left, v_first)), v_f_open));
+
+			_mm_storeu_si128((__m128i*)(e+j), ev);
+			_mm_storeu_si128((__m128i*)(h1+j), hv);
+			code = _mm_packs_epi32(code, code);
+			code = _mm_packus_epi16(code, code);
+			int packed = _mm_cvtsi128_si32(code);
+			memcpy(codes+j, &packed, 4);
+
+			last_d = dv;
+			last_h = hv;
+			v_k = _mm_add_epi32(v_k, v_ext4);
+		}
+		if (j > 1) {
+			f = _mm_cvtsi128_si32(_mm_srli_si128(fv, 12));
+			left = h1[j-1];
+		}
+	}
+#endif
+	for (; j<=len; j++) {
+		int open = h0[j]-dna_gap_first;
+		int ev = MAX(open, e[j]-dna_gap_ext);
+		int diag = h0[j-1]+((s==s1[j-1])?dna_match:dna_mismatch);
+		int code = (ev > diag ? TB_H_E : TB_H_DIAG) | (ev == open ? TB_E_OPEN : 0);
+		e[j] = ev;
+
+		int f_open = left-dna_gap_first;
+		f = MAX(f_open, f-dna_gap_ext);
+		if (f == f_open) {
+			code |= TB_F_OPEN;
+		}
+		left = MAX(diag, ev);
+		if (f > left) {
+			left = f;
+			code = (code & ~TB_H_MASK) | TB_H_F;
+		}
+		h1[j] = left;
+		codes[j] = code;
+	}
+
+	packCodes(codes, len, tb);
+}
+
+/**
+ * Computes the row I of a partition that crosses the border of the region,
+ * like computeRow. The cells outside the region are set to -INF.
+ *
+ * @param I the row of the forward matrix.
+ * @param J0 the column of the forward matrix at the first column (h1[0]).
+ */
+static void computeMaskedRow(stage5_matrix_t* m, const char s, const int len, unsigned char* tb,
+		const int I, const int J0) {
+	const int* h0 = m->h0;
+	int* h1 = m->h1;
+	int* e = m->e;
+	const int* s1 = m->s1;
+	unsigned char* codes = m->codes;
+
+	int f = -INF;
+	int left = h1[0];
+	for (int j=1; j<=len; j++) {
+		int open = h0[j]-dna_gap_first;
+		int ev = MAX(open, e[j]-dna_gap_ext);
+		int diag = h0[j-1]+((s==s1[j-1])?dna_match:dna_mismatch);
+		int code = (ev > diag ? TB_H_E : TB_H_DIAG) | (ev == open ? TB_E_OPEN : 0);
+
+		int f_open = left-dna_gap_first;
+		f = MAX(f_open, f-dna_gap_ext);
+		if (f == f_open) {
+			code |= TB_F_OPEN;
+		}
+		left = MAX(diag, ev);
+		if (f > left) {
+			left = f;
+			code = (code & ~TB_H_MASK) | TB_H_F;
+		}
+		if (!region->isInside(I, J0+j)) {
+			ev = f = left = -INF;
+		}
+		e[j] = ev;
+		h1[j] = left;
+		codes[j] = code;
+	}
+	packCodes(codes, len, tb);
+}
+
 // i0, j0, i1, j1: input as 0 based. Alignment includes (i0,j0) and excludes (i1,j1).
-static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, int type_s, int type_e, total_score_t* sum_score) {
+static int sw(stage5_matrix_t* m, stage5_partition_t* partition, Sequence *seq0, Sequence *seq1, int i0, int j0, int i1, int j1, int type_s, int type_e) {
+	total_score_t* sum_score = &partition->score;
     if (i0 == i1) {
     	int sum = (j1-j0)*-dna_gap_ext;
     	if (type_s != TYPE_GAP_1) {
@@ -91,7 +406,7 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
     		sum += -dna_gap_open;
     	}
     	for (int j=j1; j>j0; j--) {
-    		dot(alignment, seq0, seq1, i0, j, 2);
+    		dot(partition, seq0, seq1, i0, j, 2);
     		sum_score->gapExtensions++;
     	}
     	sum_score->score += sum;
@@ -103,7 +418,7 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
     		sum += -dna_gap_open;
     	}
     	for (int i=i1; i>i0; i--) {
-    		dot(alignment, seq0, seq1, i, j0, 1);
+    		dot(partition, seq0, seq1, i, j0, 1);
     		sum_score->gapExtensions++;
     	}
     	sum_score->score += sum;
@@ -130,84 +445,59 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
     int seq1_len = j1-j0+1;
 
 
-    const char* s0 = seq0->getData()+(i0-1);
-    const char* s1 = seq1->getData()+(j0-1);
+    const char* s0 = m->window0.load(seq0, i0-1, i1)+(i0-1);
+    const char* s1 = m->window1.load(seq1, j0-1, j1)+(j0-1);
 
-    for (int j=1; j<=seq1_len; j++) {
-        h[0][j] = -j*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_1);
-        e[0][j] = -INF;
+    m->reserve(seq0_len, seq1_len);
+    for (int j=0; j<seq1_len; j++) {
+        m->s1[j] = s1[j];
     }
-    h[0][0] = (type_s!=0?-INF:0);
-    e[0][0] = (type_s!=1?-INF:0);
 
-    for (int i=1; i<=seq0_len; i++) {
-        h[i][0] = -i*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_2);
-        f[i][0] = -INF;
-        const char s=s0[i-1];
-
-        int* h0 = h[i];
-        int* h1 = h[i-1];
-        int* e0 = e[i];
-        int* e1 = e[i-1];
-        int* f0 = f[i];
-        for (int j=1; j<=seq1_len; j++) {
-            e0[j] = MAX(h1[j]-dna_gap_first, e1[j]-dna_gap_ext);
-            f0[j] = MAX(h0[j-1]-dna_gap_first, f0[j-1]-dna_gap_ext);
-            h0[j] = MAX3(h1[j-1]+((s==s1[j-1])?dna_match:dna_mismatch), e0[j], f0[j]);
+    /* the partitions crossing the border of the region are computed cell by cell */
+    bool masked = (region != NULL && region->getOverlap(i0-1, j0-1,
+    		i0-1+seq0_len, j0-1+seq1_len, false) != REGION_INSIDE);
+
+    for (int j=1; j<=seq1_len; j++) {
+        m->h0[j] = -j*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_1);
+        m->e[j] = -INF;
+        if (masked && !region->isInside(i0-1, j0-1+j)) {
+            m->h0[j] = -INF;
         }
-        //printf("\nj:%4d %c SW: %4d\n", j1-j, s1[j-1], h[j][seq0_len]);
     }
+    m->h0[0] = (type_s!=0?-INF:0);
 
-    if (false && DEBUG) {
-        printf("%8s:\t.\t", "HEADER");
-        for (int j=0; j<=seq1_len; j++) {
-            printf("%c(%2d)\t", j==0?'*':s1[j-1], (j+j0-1)%100);
-        }
-        printf("\n");
-        for (int i=0; i<=seq0_len; i++) {
-            printf("%8d:\t%c\t", i+i0-1, i==0?'*':s0[i-1]);
-            for (int j=0; j<=seq1_len; j++) {
-                int v=h[i][j];
-                if (v <= -INF) {
-                    printf("%5s\t", "INF");
-                } else {
-                    printf("%5d\t", v);
-                }
+    int rowBytes = (seq1_len+1)/2;
+    for (int i=1; i<=seq0_len; i++) {
+        m->h1[0] = -i*dna_gap_ext - dna_gap_open*(type_s!=TYPE_GAP_2);
+        if (masked) {
+            if (!region->isInside(i0-1+i, j0-1)) {
+                m->h1[0] = -INF;
             }
-            printf("\n");
+            computeMaskedRow(m, s0[i-1], seq1_len, m->tb + (long long)(i-1)*rowBytes, i0-1+i, j0-1);
+        } else {
+            computeRow(m, s0[i-1], seq1_len, m->tb + (long long)(i-1)*rowBytes);
         }
+        int* tmp = m->h0;
+        m->h0 = m->h1;
+        m->h1 = tmp;
     }
 
-
     int sum = 0;
     int i=seq0_len;
     int j=seq1_len;
     int score;
     int c;
     
-    score = h[seq0_len][seq1_len];
+    /* E and F of the last cell only differ from H in debug messages */
+    score = m->h0[seq1_len];
     if (type_e==0) {
         i--;
         j--;
         c=TYPE_MATCH;
     } else if (type_e==TYPE_GAP_2) {
-        score -= dna_gap_open;
-        int ss = e[seq0_len][seq1_len];
-        if (true || ss >= score) { // TODO validar esse if
-            score = ss;
-            c=TYPE_GAP_2;
-        } else {
-            c=TYPE_MATCH;
-        }
+        c=TYPE_GAP_2;
     } else if (type_e==TYPE_GAP_1) {
-        score -= dna_gap_open;
-        int ss = f[seq0_len][seq1_len];
-        if (true || ss > score) { // TODO validar esse if
-            score = ss;
-            c=TYPE_GAP_1;
-        } else {
-            c=TYPE_MATCH;
-        }
+        c=TYPE_GAP_1;
     }
 
     if (DEBUG) printf ("Score: %5d %d%d\n", score, type_s, type_e);
@@ -216,42 +506,38 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
 
         int dir;
 
-        int _eh = h[i-1][j]-dna_gap_first;
-        int _fh = h[i][j-1]-dna_gap_first;
-        int _h11 = h[i-1][j-1]+((s0[i-1]==s1[j-1])?dna_match:dna_mismatch);
-        int _h10 = e[i][j];
-        int _h01 = f[i][j];
-        int _h00 = h[i][j];
+        int k = j-1;
+        int code = (m->tb[(long long)(i-1)*rowBytes + k/2] >> ((k&1)*4)) & 0xF;
 
         if (c==0) {
-            if (_h00 == _h11) {
+            if ((code & TB_H_MASK) == TB_H_DIAG) {
                 dir = 0;
                 c=TYPE_MATCH;
-            } else if (_h00 == _h10) {
+            } else if ((code & TB_H_MASK) == TB_H_E) {
                 dir = 1;
-                if (_h10==_eh) {
+                if (code & TB_E_OPEN) {
                     c=TYPE_MATCH;
                 } else {
                     c=TYPE_GAP_2;
                 }
-            } else if (_h00 == _h01) {
+            } else {
                 dir = 2;
-                if (_h01==_fh) {
+                if (code & TB_F_OPEN) {
                     c=TYPE_MATCH;
                 } else {
                     c=TYPE_GAP_1;
                 }
-            }             
+            }
         } else if (c==TYPE_GAP_2) {
             dir = 1;
-            if (_h10==_eh) {
+            if (code & TB_E_OPEN) {
                 c=TYPE_MATCH;
             } else {
                 c=TYPE_GAP_2;
             }
         } else if (c==TYPE_GAP_1) {
             dir = 2;
-            if (_h01==_fh) {
+            if (code & TB_F_OPEN) {
                 c=TYPE_MATCH;
             } else {
                 c=TYPE_GAP_1;
@@ -260,7 +546,7 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
 
         int pt=0;
 
-        dot(alignment, seq0, seq1, i0+(i-1), j0+(j-1), dir);
+        dot(partition, seq0, seq1, i0+(i-1), j0+(j-1), dir);
         if (dir == 0) {
             pt = ((s0[i-1]==s1[j-1])?dna_match:dna_mismatch);
             if (s0[i-1]==s1[j-1]) {
@@ -294,7 +580,7 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
 
     }
     while (i>0) {
-        dot(alignment, seq0, seq1, i0+(i-1), j0+(j-1), 1);
+        dot(partition, seq0, seq1, i0+(i-1), j0+(j-1), 1);
 		int pt = -dna_gap_ext;
 		i--;
     	sum_score->gapExtensions++;
@@ -303,7 +589,7 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
         //if (DEBUG) printf("   %2d %5d {c:%d, dir:%d} (%d,%d)*\n", pt, sum, c, 2, i, j);
     }
     while (j>0) {
-        dot(alignment, seq0, seq1, i0+(i-1), j0+(j-1), 2);
+        dot(partition, seq0, seq1, i0+(i-1), j0+(j-1), 2);
 		int pt = -dna_gap_ext;
 		j--;
     	sum_score->gapExtensions++;
@@ -319,7 +605,58 @@ static int sw(Alignment* alignment, Sequence *seq0, Sequence *seq1, int i0, int
 }
 
 
+static void* stage5Worker(void* arg) {
+	stage5_workers_t* workers = (stage5_workers_t*)arg;
+	Tracer::setThreadName("stage5 worker");
+	stage5_matrix_t* m = new stage5_matrix_t;
+	vector<stage5_partition_t>& partitions = *workers->partitions;
+	int k;
+	while ((k = __sync_fetch_and_add(&workers->next, 1)) < (int)partitions.size()) {
+		stage5_partition_t* p = &partitions[k];
+		p->sum = sw(m, p, workers->seq0, workers->seq1,
+				p->m0.i, p->m0.j, p->m1.i, p->m1.j, p->m0.type, p->m1.type);
+	}
+	delete m;
+	return NULL;
+}
+
+/**
+ * Aligns all the partitions, distributing them among a pool of threads
+ * (see Job::getThreadCount()).
+ */
+static void alignPartitions(Job* job, Sequence* seq0, Sequence* seq1, vector<stage5_partition_t>& partitions, FILE* stats) {
+	stage5_workers_t workers;
+	workers.seq0 = seq0;
+	workers.seq1 = seq1;
+	workers.partitions = &partitions;
+	workers.next = 0;
+
+	int threadCount = job->getThreadCount();
+	if (threadCount > (int)partitions.size()) {
+		threadCount = partitions.size();
+	}
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+	fprintf(stats, "Threads: %d\n", threadCount);
+
+	// The current thread is also a worker.
+	vector<pthread_t> threads(threadCount-1);
+	for (int i = 0; i < threadCount-1; i++) {
+		int rc = pthread_create(&threads[i], NULL, stage5Worker, (void*)&workers);
+		if (rc) {
+			fprintf(stderr, "stage5: pthread_create() error %d\n", rc);
+			exit(1);
+		}
+	}
+	stage5Worker(&workers);
+	for (int i = 0; i < threadCount-1; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
 int stage5(Job* job, int id) {
+	TRACE_SPAN(TRACE_STAGE, "stage5");
 	FILE* stats = job->fopenStatistics(STAGE_5, id);
 	Sequence* seq0 = job->getAlignmentParams()->getSequence(0);
 	Sequence* seq1 = job->getAlignmentParams()->getSequence(1);
@@ -342,6 +679,8 @@ int stage5(Job* job, int id) {
 
 	timer2.init();
 
+	region = job->createAlignmentRegion(STAGE_5);
+
 	CrosspointsFile* stage4Crosspoints = new CrosspointsFile(job->getCrosspointFile(STAGE_4, id));
 	stage4Crosspoints->loadCrosspoints();
 
@@ -384,7 +723,7 @@ int stage5(Job* job, int id) {
 
 
     int max_size = stage4Crosspoints->getLargestPartitionSize();
-    if (max_size > W_MAX || max_size > H_MAX) {
+    if (max_size > MAX_PARTITION_SIZE) {
         fprintf(stderr, "ERROR: MAX SIZE: %d\n", max_size);
         exit(1);
     }
@@ -394,15 +733,33 @@ int stage5(Job* job, int id) {
 	timer2.eventRecord(ev_start);
 
 	
-	total_score_t sum_score;
+	vector<stage5_partition_t> partitions(stage4Crosspoints->size() > 0 ? stage4Crosspoints->size()-1 : 0);
     for (; partition_id<stage4Crosspoints->size(); partition_id++) {
         crosspoint_t m1 = stage4Crosspoints->at(partition_id);
+        partitions[partition_id-1].m0 = m0;
+        partitions[partition_id-1].m1 = m1;
+        m0 = m1;
+    }
 
-        //if (curr.i == 0 && curr.j == 0) break;
+    alignPartitions(job, seq0, seq1, partitions, stats);
+
+	// The gaps are merged serially, in the order of the partitions.
+	total_score_t sum_score;
+    for (size_t k = 0; k < partitions.size(); k++) {
+        stage5_partition_t* p = &partitions[k];
+        crosspoint_t m0 = p->m0;
+        crosspoint_t m1 = p->m1;
+        int sum = p->sum;
+        for (size_t g = 0; g < p->gaps.size(); g++) {
+        	if (p->gaps[g].seq == 0) {
+        		alignment->addGapInSeq0(p->gaps[g].pos);
+        	} else {
+        		alignment->addGapInSeq1(p->gaps[g].pos);
+        	}
+        }
+        sum_score.add(p->score);
+        vector<stage5_gap_t>().swap(p->gaps);
 
-        int sum = sw(alignment, seq0, seq1, m0.i, m0.j, m1.i, m1.j, m0.type, m1.type, &sum_score);
-		
-        //score += sum;
         if (DEBUG) printf("> SW   %5d/%d\n", sum, sum_score.score);
         if (DEBUG) {
 			int goal_diff = (m1.score) - (m0.score);
@@ -414,8 +771,6 @@ int stage5(Job* job, int id) {
         }
 
         if (DEBUG) printf("\n");
-
-        m0 = m1;
     }
     // TODO efetuar um sanity check no score/sum. Esse valor deve ser identico ao stage1.
 
@@ -481,5 +836,9 @@ int stage5(Job* job, int id) {
 	fclose(stats);
 	
 	delete stage4Crosspoints;
+	if (region != NULL) {
+		delete region;
+		region = NULL;
+	}
 	return 0;
 }
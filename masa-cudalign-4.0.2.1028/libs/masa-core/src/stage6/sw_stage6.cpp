@@ -990,6 +990,7 @@ cairo_stroke(cr);*/
 
 
 void stage6(Job* job, int id) {
+	TRACE_SPAN(TRACE_STAGE, "stage6");
 	FILE* stats = job->fopenStatistics(STAGE_6, id);
 	Sequence* seq0 = job->getAlignmentParams()->getSequence(0);
 	Sequence* seq1 = job->getAlignmentParams()->getSequence(1);